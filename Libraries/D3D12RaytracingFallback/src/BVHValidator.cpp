@@ -179,6 +179,290 @@ namespace FallbackLayer
         return true;
     }
 
+    static AABB IntersectAABBs(const AABB &a, const AABB &b)
+    {
+        AABB intersection;
+        intersection.min = max(a.min, b.min);
+        intersection.max = min(a.max, b.max);
+        return intersection;
+    }
+
+    struct BvhValidator::LinearValidationState
+    {
+        const AABBNode *pNodes;
+        UINT numNodes;
+
+        // Set instead of pNodes for QuantizedBvh4 bottom levels, numNodes counts these
+        const QuantizedBvh4Node *pQuantizedNodes;
+
+        // Bottom level only
+        const Primitive *pPrimitives;
+        const PrimitiveMetaData *pPrimitiveMetaData;
+        const std::vector<UINT> *pGeometryOffsets;
+
+        // Top level only
+        const BVHMetadata *pInstanceMetadata;
+
+        bool bTopLevel;
+        std::vector<LeafNodePtr> *pExpectedLeafNodes;
+
+        // Catches nodes reachable from more than one parent and leaves found twice
+        std::unique_ptr<std::atomic<bool>[]> nodeVisited;
+        std::unique_ptr<std::atomic<bool>[]> leafFound;
+
+        // Set by the first thread to hit an error, which also owns errorMessage
+        std::atomic<bool> bFailed;
+        std::wstring errorMessage;
+
+        void ReportError(const std::wstring &message)
+        {
+            bool bExpected = false;
+            if (bFailed.compare_exchange_strong(bExpected, true))
+            {
+                errorMessage = message;
+            }
+        }
+    };
+
+    void BvhValidator::VerifyNodeLinear(
+        LinearValidationState &state,
+        const PendingNode &pendingNode,
+        std::vector<PendingNode> &pendingNodes,
+        std::wstring &errorMessage)
+    {
+        ThrowErrorIfFalse(pendingNode.nodeIndex < state.numNodes, L"Child node index is past the end of the BVH");
+        ThrowErrorIfFalse(!state.nodeVisited[pendingNode.nodeIndex].exchange(true), L"BVH node is referenced by more than one parent");
+
+        if (state.pQuantizedNodes)
+        {
+            VerifyQuantizedNodeLinear(state, pendingNode, pendingNodes, errorMessage);
+            return;
+        }
+
+        const AABBNode &node = state.pNodes[pendingNode.nodeIndex];
+        AABB nodeAABB;
+        FallbackLayer::DecompressAABB(nodeAABB, node);
+
+        // Being contained by every box on the parent chain is the same as being
+        // contained by their intersection, so that's all that's passed down
+        const AABB ancestorsBox = IntersectAABBs(pendingNode.ancestorsBox, nodeAABB);
+
+        if (!node.leaf)
+        {
+            const UINT childIndices[] = { node.internalNode.leftNodeIndex, node.rightNodeIndex };
+            for (UINT childIndex : childIndices)
+            {
+                ThrowErrorIfFalse(IsChildNodeIndexValid(childIndex), L"Circular referance to root node");
+                ThrowErrorIfFalse(childIndex < state.numNodes, L"Child node index is past the end of the BVH");
+
+                AABB childAABB;
+                FallbackLayer::DecompressAABB(childAABB, state.pNodes[childIndex]);
+                ThrowErrorIfFalse(IsChildContainedByParent(nodeAABB, childAABB), L"AABB not contained by parent");
+
+                pendingNodes.push_back({ childIndex, ancestorsBox });
+            }
+            return;
+        }
+
+        // Top level leaves always hold one instance
+        VerifyLeafLinear(state, node.leafNode.firstTriangleId, state.bTopLevel ? 1 : node.numTriangles, nodeAABB, ancestorsBox, errorMessage);
+    }
+
+    // Quantized child boxes are rounded outwards by up to a 255th of their parent,
+    // more than TEST_EPSILON, so they aren't checked against the parent's box. Every
+    // primitive is still checked against the intersection of the boxes above it.
+    void BvhValidator::VerifyQuantizedNodeLinear(
+        LinearValidationState &state,
+        const PendingNode &pendingNode,
+        std::vector<PendingNode> &pendingNodes,
+        std::wstring &errorMessage)
+    {
+        const QuantizedBvh4Node &node = state.pQuantizedNodes[pendingNode.nodeIndex];
+        ThrowErrorIfFalse(node.numChildren > 0 && node.numChildren <= QuantizedBvh4Width, L"Invalid number of children in a quantized node");
+
+        for (UINT child = 0; child < node.numChildren; child++)
+        {
+            AABB childAABB;
+            DecodeQuantizedBvh4ChildBox(node, child, childAABB);
+            const AABB ancestorsBox = IntersectAABBs(pendingNode.ancestorsBox, childAABB);
+
+            const UINT childFlags = node.childFlags[child];
+            if (childFlags & QuantizedBvh4LeafFlag)
+            {
+                AABBNode leaf;
+                leaf.nodeAllBits = childFlags;
+                VerifyLeafLinear(state, leaf.leafNode.firstTriangleId, leaf.leafNode.numTriangleIds, childAABB, ancestorsBox, errorMessage);
+            }
+            else
+            {
+                ThrowErrorIfFalse(IsChildNodeIndexValid(childFlags), L"Circular referance to root node");
+                pendingNodes.push_back({ childFlags, ancestorsBox });
+            }
+        }
+    }
+
+    void BvhValidator::VerifyLeafLinear(
+        LinearValidationState &state,
+        UINT firstPrimitive,
+        UINT numPrimitives,
+        const AABB &leafAABB,
+        const AABB &ancestorsBox,
+        std::wstring &errorMessage)
+    {
+        std::vector<LeafNodePtr> &expectedLeafNodes = *state.pExpectedLeafNodes;
+
+        ThrowErrorIfFalse(numPrimitives > 0, L"Invalid value for numTriangles");
+        ThrowErrorIfFalse((UINT64)firstPrimitive + numPrimitives <= expectedLeafNodes.size(), L"Leaf references a primitive past the end of the BVH");
+
+        for (UINT primitiveIndex = firstPrimitive; primitiveIndex < firstPrimitive + numPrimitives; primitiveIndex++)
+        {
+            UINT expectedLeafIndex;
+            void *pLeafData = nullptr;
+            if (state.bTopLevel)
+            {
+                expectedLeafIndex = state.pInstanceMetadata[primitiveIndex].InstanceIndex;
+            }
+            else
+            {
+                const PrimitiveMetaData &metadata = state.pPrimitiveMetaData[primitiveIndex];
+                const std::vector<UINT> &geometryOffsets = *state.pGeometryOffsets;
+                ThrowErrorIfFalse(metadata.GeometryContributionToHitGroupIndex + 1 < geometryOffsets.size(), L"Leaf references a geometry that wasn't part of the build");
+
+                const UINT geometryIndex = metadata.GeometryContributionToHitGroupIndex;
+                ThrowErrorIfFalse(metadata.PrimitiveIndex < geometryOffsets[geometryIndex + 1] - geometryOffsets[geometryIndex], L"Leaf references a primitive that isn't in its geometry");
+
+                expectedLeafIndex = geometryOffsets[geometryIndex] + metadata.PrimitiveIndex;
+                pLeafData = (void *)&state.pPrimitives[primitiveIndex];
+            }
+            ThrowErrorIfFalse(expectedLeafIndex < expectedLeafNodes.size(), L"Leaf references an instance that wasn't part of the build");
+
+            LeafNode &expectedLeaf = *expectedLeafNodes[expectedLeafIndex];
+            ThrowErrorIfFalse(expectedLeaf.IsLeafEqual(pLeafData, leafAABB), L"Leaf doesn't match the primitive it was built from");
+            ThrowErrorIfFalse(expectedLeaf.IsContainedByBox(ancestorsBox), L"One of the BVH levels has AABBs that can't contain one of the leaf nodes");
+            ThrowErrorIfFalse(!state.leafFound[expectedLeafIndex].exchange(true), L"Leaf node found more than once in the BVH");
+        }
+    }
+
+    bool BvhValidator::VerifyBVHOutputLinear(
+        std::vector<LeafNodePtr> &pExpectedLeafNodes,
+        const std::vector<UINT> &geometryOffsets,
+        bool bTopLevel,
+        const BYTE *pOutputCpuData,
+        std::wstring &errorMessage)
+    {
+        const BVHOffsets &offsets = *(const BVHOffsets*)pOutputCpuData;
+
+        LinearValidationState state;
+        state.pNodes = (const AABBNode*)(pOutputCpuData + offsets.offsetToBoxes);
+        state.numNodes = (offsets.offsetToVertices - offsets.offsetToBoxes) / sizeof(AABBNode);
+        state.pQuantizedNodes = nullptr;
+        if (!bTopLevel && state.numNodes > 0 && IsQuantizedBvh4(pOutputCpuData))
+        {
+            state.pQuantizedNodes = (const QuantizedBvh4Node*)(state.pNodes + 1);
+            state.numNodes = state.pNodes[0].rightNodeIndex;
+            if (sizeof(AABBNode) + (UINT64)state.numNodes * sizeof(QuantizedBvh4Node) != offsets.offsetToVertices - offsets.offsetToBoxes)
+            {
+                errorMessage = L"Number of quantized nodes doesn't match the size of the BVH";
+                return false;
+            }
+        }
+        state.pPrimitives = (const Primitive*)(pOutputCpuData + offsets.offsetToVertices);
+        state.pPrimitiveMetaData = (const PrimitiveMetaData*)(pOutputCpuData + offsets.offsetToPrimitiveMetaData);
+        state.pGeometryOffsets = &geometryOffsets;
+        state.pInstanceMetadata = (const BVHMetadata*)(pOutputCpuData + offsets.offsetToVertices);
+        state.bTopLevel = bTopLevel;
+        state.pExpectedLeafNodes = &pExpectedLeafNodes;
+        state.nodeVisited.reset(new std::atomic<bool>[state.numNodes]);
+        state.leafFound.reset(new std::atomic<bool>[pExpectedLeafNodes.size()]);
+        state.bFailed = false;
+        for (UINT i = 0; i < state.numNodes; i++) state.nodeVisited[i] = false;
+        for (size_t i = 0; i < pExpectedLeafNodes.size(); i++) state.leafFound[i] = false;
+
+        const UINT numThreads = m_numThreads ? m_numThreads : std::max(1u, std::thread::hardware_concurrency());
+
+        // Validate the top of the tree breadth-first until there are enough subtrees
+        // to keep every thread busy, then hand the subtrees out to the threads
+        AABB unboundedBox;
+        unboundedBox.min = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+        unboundedBox.max = { FLT_MAX, FLT_MAX, FLT_MAX };
+        // The quantized root's children are bounded by the fp32 box in front of it
+        AABB rootBox = unboundedBox;
+        if (state.pQuantizedNodes)
+        {
+            FallbackLayer::DecompressAABB(rootBox, state.pNodes[0]);
+        }
+        std::vector<PendingNode> subtrees(1, { 0, rootBox });
+        const size_t subtreesPerThread = 8;
+        try
+        {
+            ThrowErrorIfFalse(state.numNodes > 0, L"BVH doesn't have any nodes");
+            while (numThreads > 1 && !subtrees.empty() && subtrees.size() < numThreads * subtreesPerThread)
+            {
+                std::vector<PendingNode> nextLevel;
+                for (const PendingNode &node : subtrees)
+                {
+                    VerifyNodeLinear(state, node, nextLevel, errorMessage);
+                }
+                subtrees.swap(nextLevel);
+            }
+        }
+        catch (bool)
+        {
+            return false;
+        }
+
+        std::atomic<size_t> nextSubtree(0);
+        auto validateSubtrees = [&]()
+        {
+            std::vector<PendingNode> stack;
+            std::wstring threadErrorMessage;
+            try
+            {
+                for (size_t subtree = nextSubtree++; subtree < subtrees.size() && !state.bFailed; subtree = nextSubtree++)
+                {
+                    stack.push_back(subtrees[subtree]);
+                    while (!stack.empty() && !state.bFailed)
+                    {
+                        const PendingNode node = stack.back();
+                        stack.pop_back();
+                        VerifyNodeLinear(state, node, stack, threadErrorMessage);
+                    }
+                }
+            }
+            catch (bool)
+            {
+                state.ReportError(threadErrorMessage);
+            }
+        };
+
+        std::vector<std::future<void>> workers;
+        for (UINT i = 1; i < numThreads && i < subtrees.size(); i++)
+        {
+            workers.push_back(std::async(std::launch::async, validateSubtrees));
+        }
+        validateSubtrees();
+        for (auto &worker : workers)
+        {
+            worker.wait();
+        }
+
+        if (state.bFailed)
+        {
+            errorMessage = state.errorMessage;
+            return false;
+        }
+
+        for (size_t i = 0; i < pExpectedLeafNodes.size(); i++)
+        {
+            if (!state.leafFound[i])
+            {
+                errorMessage = L"Didn't find a leaf node for one or more of the expected leaves";
+                return false;
+            }
+        }
+        return true;
+    }
+
     bool BvhValidator::AABBLeafNode::IsContainedByBox(const AABB &parentBox)
     {
         return IsChildContainedByParent(parentBox, box);
@@ -217,7 +501,7 @@ namespace FallbackLayer
         transformedBox.max = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
         for (UINT i = 0; i < ARRAYSIZE(vertices); i++)
         {
-            float3 v = Transform(vertices[0], transform);
+            float3 v = Transform(vertices[i], transform);
             transformedBox.min = min(v, transformedBox.min);
             transformedBox.max = max(v, transformedBox.max);
         }
@@ -243,6 +527,10 @@ namespace FallbackLayer
             pLeafNodes.push_back(std::unique_ptr<LeafNode>(new AABBLeafNode(aabb)));
         }
 
+        if (m_mode == BvhValidationMode::Linear)
+        {
+            return VerifyBVHOutputLinear(pLeafNodes, std::vector<UINT>(), true, pOutputCpuData, errorMessage);
+        }
         return VerifyBVHOutput(pLeafNodes, pOutputCpuData, errorMessage);
     }
 
@@ -294,9 +582,12 @@ namespace FallbackLayer
         const BYTE *pBVHData, std::wstring &errorMessage)
     {
         std::vector<std::unique_ptr<LeafNode>> pLeafNodes;
+        std::vector<UINT> geometryOffsets;
 
         for (UINT geometryIndex = 0; geometryIndex < geometryCount; geometryIndex++)
         {
+            geometryOffsets.push_back((UINT)pLeafNodes.size());
+
             CpuGeometryDescriptor &geometryDescriptor = pCpuGeometryDescriptors[geometryIndex];
             const UINT vertexStrideInBytes = sizeof(float) * 3;
             const float *pVerticies = geometryDescriptor.m_pVertexData;
@@ -323,7 +614,13 @@ namespace FallbackLayer
                 pLeafNodes.push_back(std::unique_ptr<LeafNode>(new TriangleLeafNode(v[0], v[1], v[2])));
             }
         }
+        geometryOffsets.push_back((UINT)pLeafNodes.size());
 
+        // The exhaustive walk only understands binary nodes
+        if (m_mode == BvhValidationMode::Linear || IsQuantizedBvh4(pBVHData))
+        {
+            return VerifyBVHOutputLinear(pLeafNodes, geometryOffsets, false, pBVHData, errorMessage);
+        }
         return VerifyBVHOutput(pLeafNodes, pBVHData, errorMessage);
     }
 
@@ -11,9 +11,24 @@
 #pragma once
 namespace FallbackLayer
 {
+    enum class BvhValidationMode
+    {
+        // Checks every expected leaf against every node of each level, O(nodes x leaves)
+        Exhaustive,
+
+        // Single top-down pass that only checks each leaf against the nodes on its
+        // parent chain, O(nodes + leaves). Subtrees are validated in parallel.
+        // CpuBvhNodeFormat::QuantizedBvh4 bottom levels are always validated this way.
+        Linear,
+    };
+
     class BvhValidator : public IAccelerationStructureValidator
     {
     public:
+        // numThreads is only used by BvhValidationMode::Linear, 0 uses all hardware threads
+        BvhValidator(BvhValidationMode mode = BvhValidationMode::Exhaustive, UINT numThreads = 0) :
+            m_mode(mode), m_numThreads(numThreads) {}
+
         virtual bool VerifyBottomLevelOutput(
             CpuGeometryDescriptor *pCpuGeometryDescriptors,
             UINT geometryCount,
@@ -69,6 +84,50 @@ namespace FallbackLayer
             const BYTE *pOutputCpuData,
             std::wstring &errorMessage);
 
+        struct LinearValidationState;
+
+        // Bottom level leaves are mapped back to pExpectedLeafNodes through the
+        // PrimitiveMetaData of the output, geometryOffsets holds the index of the first
+        // expected leaf of each geometry. Top level leaves are mapped through the
+        // InstanceIndex of their BVHMetadata.
+        bool VerifyBVHOutputLinear(
+            std::vector<LeafNodePtr> &pExpectedLeafNodes,
+            const std::vector<UINT> &geometryOffsets,
+            bool bTopLevel,
+            const BYTE *pOutputCpuData,
+            std::wstring &errorMessage);
+
+        struct PendingNode
+        {
+            UINT nodeIndex;
+
+            // Intersection of the boxes of every ancestor of the node
+            AABB ancestorsBox;
+        };
+
+        void VerifyNodeLinear(
+            LinearValidationState &state,
+            const PendingNode &node,
+            std::vector<PendingNode> &pendingNodes,
+            std::wstring &errorMessage);
+
+        void VerifyQuantizedNodeLinear(
+            LinearValidationState &state,
+            const PendingNode &node,
+            std::vector<PendingNode> &pendingNodes,
+            std::wstring &errorMessage);
+
+        void VerifyLeafLinear(
+            LinearValidationState &state,
+            UINT firstPrimitive,
+            UINT numPrimitives,
+            const AABB &leafAABB,
+            const AABB &ancestorsBox,
+            std::wstring &errorMessage);
+
+        BvhValidationMode m_mode;
+        UINT m_numThreads;
+
         static bool IsVertexContainedByAABB(const AABB &aabb, const BvhValidator::Vertex &v);
         static bool IsVertexEqual(const Vertex &vertex1, const Vertex &vertex2);
 
@@ -9,14 +9,91 @@
 //
 //*********************************************************
 #include "pch.h"
+#include "TreeletReorderBindings.h"
 
 namespace FallbackLayer
 {
+    //
+    // Counts heap allocations and live bytes of everything allocated through
+    // TrackingAllocator during a build
+    //
+
+    class BuildMemoryTracker
+    {
+    public:
+        BuildMemoryTracker() : m_numAllocations(0), m_currentBytes(0), m_peakBytes(0) {}
+
+        void OnAllocate(size_t size)
+        {
+            m_numAllocations++;
+            const UINT64 currentBytes = m_currentBytes += size;
+            UINT64 peakBytes = m_peakBytes.load();
+            while (currentBytes > peakBytes && !m_peakBytes.compare_exchange_weak(peakBytes, currentBytes)) {}
+        }
+
+        void OnFree(size_t size)
+        {
+            m_currentBytes -= size;
+        }
+
+        UINT64 GetNumAllocations() const { return m_numAllocations; }
+        UINT64 GetPeakBytes() const { return m_peakBytes; }
+
+    private:
+        std::atomic<UINT64> m_numAllocations;
+        std::atomic<UINT64> m_currentBytes;
+        std::atomic<UINT64> m_peakBytes;
+    };
+
+    template <typename T>
+    class TrackingAllocator
+    {
+    public:
+        typedef T value_type;
+
+        TrackingAllocator(BuildMemoryTracker* pTracker = nullptr) : m_pTracker(pTracker) {}
+
+        template <typename U>
+        TrackingAllocator(const TrackingAllocator<U>& other) : m_pTracker(other.m_pTracker) {}
+
+        T* allocate(size_t count)
+        {
+            if (m_pTracker)
+            {
+                m_pTracker->OnAllocate(count * sizeof(T));
+            }
+            return std::allocator<T>().allocate(count);
+        }
+
+        void deallocate(T* pMemory, size_t count)
+        {
+            if (m_pTracker)
+            {
+                m_pTracker->OnFree(count * sizeof(T));
+            }
+            std::allocator<T>().deallocate(pMemory, count);
+        }
+
+        template <typename U>
+        bool operator==(const TrackingAllocator<U>& other) const { return m_pTracker == other.m_pTracker; }
+
+        template <typename U>
+        bool operator!=(const TrackingAllocator<U>& other) const { return m_pTracker != other.m_pTracker; }
+
+        BuildMemoryTracker* m_pTracker;
+    };
+
+    template <typename T>
+    using TrackedVector = std::vector<T, TrackingAllocator<T>>;
+
     struct BVH
     {
-        std::vector<AABBNode>   m_nodes;
-        std::vector<float> m_triangles;
-        std::vector<PrimitiveMetaData> m_metadata;
+        BVH(BuildMemoryTracker* pTracker = nullptr) :
+            m_nodes(TrackingAllocator<AABBNode>(pTracker)),
+            m_metadata(TrackingAllocator<PrimitiveMetaData>(pTracker)) {}
+
+        TrackedVector<AABBNode>   m_nodes;
+        TrackedVector<PrimitiveMetaData> m_metadata;
     };
 
     static
@@ -43,8 +120,8 @@ namespace FallbackLayer
     static
         void ComputeBox(
             AABB& overallBox,
-            const std::vector<AABB>& boxes,
-            const std::vector<PrimitiveMetaData>& metadata)
+            const TrackedVector<AABB>& boxes,
+            const TrackedVector<PrimitiveMetaData>& metadata)
     {
         if (metadata.empty())
         {
@@ -116,16 +193,15 @@ namespace FallbackLayer
         return v;
     }
 
+    //
+    // Writes the box of a node, leaves the flags untouched
+    //
+
     static
-        UINT32 BuildBVHAddNode(
-            BVH& bvh,
-            const AABB& box,
-            UINT32 maxDimension)
+        void CompressAABB(
+            AABBNode& packedBox,
+            const AABB& box)
     {
-        UNREFERENCED_PARAMETER(maxDimension);
-        assert(maxDimension < 3);
-        const UINT32 nodeIndex = (UINT32)bvh.m_nodes.size();
-
         float cX = (box.max.x + box.min.x) * 0.5f;
         float cY = (box.max.y + box.min.y) * 0.5f;
         float cZ = (box.max.z + box.min.z) * 0.5f;
@@ -137,14 +213,28 @@ namespace FallbackLayer
         float dY = max(box.max.y - cY, cY - box.min.y);
         float dZ = max(box.max.z - cZ, cZ - box.min.z);
 
-        AABBNode packedBox;
         packedBox.center[0] = cX;
         packedBox.center[1] = cY;
         packedBox.center[2] = cZ;
         packedBox.halfDim[0] = dX;
         packedBox.halfDim[1] = dY;
         packedBox.halfDim[2] = dZ;
+    }
+
+    static
+        UINT32 BuildBVHAddNode(
+            BVH& bvh,
+            const AABB& box,
+            UINT32 maxDimension)
+    {
+        UNREFERENCED_PARAMETER(maxDimension);
+        assert(maxDimension < 3);
+        const UINT32 nodeIndex = (UINT32)bvh.m_nodes.size();
+
+        AABBNode packedBox;
+        CompressAABB(packedBox, box);
         packedBox.nodeAllBits = 0;
+        packedBox.rightNodeIndex = 0;
 
         bvh.m_nodes.push_back(packedBox);
 
@@ -159,7 +249,7 @@ namespace FallbackLayer
         UINT32 BuildBVHAddLeaf(
             BVH& bvh,
             const AABB& box,
-            const std::vector<PrimitiveMetaData>& metadata)
+            const TrackedVector<PrimitiveMetaData>& metadata)
     {
         const UINT32 nodeIndex = BuildBVHAddNode(bvh, box, 0);
 
@@ -176,6 +266,9 @@ namespace FallbackLayer
         bvh.m_nodes[nodeIndex].leafNode.firstTriangleId = idIndex;
         bvh.m_nodes[nodeIndex].leafNode.numTriangleIds = (UINT32)metadata.size();
 
+        // Also where TraverseFunction.hlsli reads the count from
+        bvh.m_nodes[nodeIndex].numTriangles = (UINT32)metadata.size();
+
         return nodeIndex;
     }
 
@@ -185,8 +278,8 @@ namespace FallbackLayer
 
     static
         void SortByCentroid(
-            std::vector<PrimitiveMetaData>& metadata,
-            const std::vector<AABB>& boxes,
+            TrackedVector<PrimitiveMetaData>& metadata,
+            const TrackedVector<AABB>& boxes,
             UINT32 maxDimension)
     {
         struct TriPosition
@@ -195,7 +288,7 @@ namespace FallbackLayer
             UINT32  id;
         };
 
-        std::vector<TriPosition> sortTris(metadata.size());
+        TrackedVector<TriPosition> sortTris(metadata.size(), TriPosition(), metadata.get_allocator());
 
         for (UINT32 i = 0; i < metadata.size(); ++i)
         {
@@ -247,11 +340,11 @@ namespace FallbackLayer
 
     static
         void SahSplit(
-            std::vector<PrimitiveMetaData>& metadata,
+            TrackedVector<PrimitiveMetaData>& metadata,
             UINT32& maxDimension,
             UINT32& numTrisInLeftNode,
             const AABB& nodeBox,
-            const std::vector<AABB>& boxes)
+            const TrackedVector<AABB>& boxes)
     {
         static const UINT NUM_SAH_BINS = 64;
 
@@ -383,25 +476,40 @@ namespace FallbackLayer
     static
         void BuildBVH(
             BVH& bvh,
-            const std::vector<AABB>& boxes,
-            const std::vector<PrimitiveMetaData>& primitiveMetaData,
-            UINT32 maxTrisInLeaf)
+            const TrackedVector<AABB>& boxes,
+            const TrackedVector<PrimitiveMetaData>& primitiveMetaData,
+            UINT32 maxTrisInLeaf,
+            BuildMemoryTracker* pTracker)
     {
         //
         // These are huge so use pointers
         //
         struct StackItem
         {
-            std::vector<PrimitiveMetaData> primitiveMetaData;
+            StackItem(BuildMemoryTracker* pTracker) : primitiveMetaData(TrackingAllocator<PrimitiveMetaData>(pTracker)) {}
+
+            TrackedVector<PrimitiveMetaData> primitiveMetaData;
             UINT32              parentIndex;
             UINT                right : 1;
             UINT                axis : 2;
         };
 
-        std::deque<StackItem*>   fifoLefts;
-        std::deque<StackItem*>   fifoRights;
+        // Items go through the tracker as well so both builders report comparable numbers
+        TrackingAllocator<StackItem> itemAllocator(pTracker);
+        auto newStackItem = [&]() -> StackItem*
+        {
+            return new (itemAllocator.allocate(1)) StackItem(pTracker);
+        };
+        auto deleteStackItem = [&](StackItem* pItem)
+        {
+            pItem->~StackItem();
+            itemAllocator.deallocate(pItem, 1);
+        };
+
+        std::deque<StackItem*, TrackingAllocator<StackItem*>>   fifoLefts(itemAllocator);
+        std::deque<StackItem*, TrackingAllocator<StackItem*>>   fifoRights(itemAllocator);
 
-        StackItem* temp = new StackItem;
+        StackItem* temp = newStackItem();
         temp->parentIndex = (UINT)-1;
         temp->primitiveMetaData = primitiveMetaData;
         temp->right = false;
@@ -476,7 +584,7 @@ namespace FallbackLayer
 
                 thisNodeIndex = BuildBVHAddNode(bvh, nodeBox, splitDimension);
 
-                StackItem* leftItem = new StackItem;
+                StackItem* leftItem = newStackItem();
                 leftItem->parentIndex = thisNodeIndex;
                 leftItem->primitiveMetaData.resize(leftChildNumNodes);
                 leftItem->right = false;
@@ -486,7 +594,7 @@ namespace FallbackLayer
                     leftItem->primitiveMetaData[i] = item->primitiveMetaData[i];
                 }
 
-                StackItem* rightItem = new StackItem;
+                StackItem* rightItem = newStackItem();
                 rightItem->parentIndex = thisNodeIndex;
                 rightItem->primitiveMetaData.resize(rightChildNumNodes);
                 rightItem->right = true;
@@ -511,189 +619,2591 @@ namespace FallbackLayer
             }
 
             // Free the item after use
-            delete item;
+            deleteStackItem(item);
         }
     }
 
-    void BuildUniformBVH(
-        _In_  UINT NumElements,
-        _In_reads_opt_(NumElements)  const D3D12_RAYTRACING_GEOMETRY_DESC *pGeometries,
-        BVH &bvh)
-    {
-        using namespace DirectX;
-        //
-        // Compute number of triangles
-        //
+    //
+    // Parallel binned SAH builder
+    //
+    // Primitive bounds are kept as structure-of-arrays that are partitioned in place,
+    // every work item owns a contiguous [begin, end) range of them. Nodes are
+    // emitted in the same order as BuildBVH: the right child directly follows its
+    // parent and the left child is emitted once the right subtree is complete. Large
+    // left subtrees are built on another thread as a separate BVH and spliced back in
+    // at the position they would have been emitted at, so the output doesn't depend on
+    // the number of threads.
+    //
+    // Build records and per-node scratch (chunk bounds, SAH bins) come from per-task
+    // arenas, so after warm-up a node makes no tracked heap allocations. Work handed to
+    // another thread still goes through std::async, which allocates the thread's shared
+    // state and, for a subtree, the std::future holding it. That only happens when a free
+    // thread was acquired, so it is bounded by the splits that went parallel rather than
+    // by the node count, and it isn't counted in CpuBvh2BuildStats.
+    //
+
+    static const UINT NUM_BINNED_SAH_BINS = 64;
+    static const UINT32 MIN_PRIMITIVES_PER_SUBTREE_TASK = 4 * 1024;
+    static const UINT32 MIN_PRIMITIVES_PER_BINNING_TASK = 64 * 1024;
+    static const size_t BUILD_ARENA_BLOCK_SIZE = 64 * 1024;
 
-        UINT    totalNumberOfTriangles = 0;
+    //
+    // Bump allocator handing out memory from blocks of BUILD_ARENA_BLOCK_SIZE. Reset()
+    // rewinds to the first block but keeps all blocks around for reuse.
+    //
 
-        for (UINT i = 0; i < NumElements; ++i)
+    class BuildArena
+    {
+    public:
+        BuildArena(BuildMemoryTracker* pTracker) :
+            m_blocks(TrackingAllocator<BYTE*>(pTracker)),
+            m_pTracker(pTracker),
+            m_currentBlock(0),
+            m_offsetInBlock(0) {}
+
+        ~BuildArena()
         {
-            auto &geometry = pGeometries[i];
-            if (geometry.Type == D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES)
+            TrackingAllocator<BYTE> allocator(m_pTracker);
+            for (BYTE* pBlock : m_blocks)
             {
-                totalNumberOfTriangles += GetPrimitiveCountFromGeometryDesc(geometry);
+                allocator.deallocate(pBlock, BUILD_ARENA_BLOCK_SIZE);
             }
-            else
+        }
+
+        template <typename T>
+        T* Allocate(size_t count = 1)
+        {
+            static_assert(std::is_trivially_destructible<T>::value, L"Arena memory is never destructed");
+            const size_t alignment = alignof(T);
+            const size_t size = sizeof(T) * count;
+            assert(size + alignment <= BUILD_ARENA_BLOCK_SIZE);
+
+            m_offsetInBlock = (m_offsetInBlock + alignment - 1) & ~(alignment - 1);
+            if (m_blocks.empty() || m_offsetInBlock + size > BUILD_ARENA_BLOCK_SIZE)
             {
-                throw - 1; // Intersection shaders not supported yet
+                if (!m_blocks.empty())
+                {
+                    m_currentBlock++;
+                }
+                if (m_currentBlock == m_blocks.size())
+                {
+                    m_blocks.push_back(TrackingAllocator<BYTE>(m_pTracker).allocate(BUILD_ARENA_BLOCK_SIZE));
+                }
+                m_offsetInBlock = 0;
             }
 
+            T* pAllocation = (T*)(m_blocks[m_currentBlock] + m_offsetInBlock);
+            m_offsetInBlock += size;
+            return pAllocation;
         }
 
-        //
-        // Create AABBs
-        //
+        void Reset()
+        {
+            m_currentBlock = 0;
+            m_offsetInBlock = 0;
+        }
 
-        std::vector<AABB> boxes;
-        boxes.resize(totalNumberOfTriangles);
+    private:
+        TrackedVector<BYTE*> m_blocks;
+        BuildMemoryTracker* m_pTracker;
+        size_t m_currentBlock;
+        size_t m_offsetInBlock;
+    };
 
-        std::vector<PrimitiveMetaData> primitiveMetaData;
-        primitiveMetaData.resize(totalNumberOfTriangles);
+    //
+    // Primitive bounds and centroids stored as structure-of-arrays so the binning and
+    // bounds kernels can stream them. All arrays are partitioned in place together,
+    // m_pIndices maps a slot back to its PrimitiveMetaData.
+    //
 
-        std::vector<float>  triangleVertices;
-        triangleVertices.resize(totalNumberOfTriangles * 9);
+    struct BuildPrimitives
+    {
+        float* m_pMin[3];
+        float* m_pMax[3];
+        float* m_pCentroid[3];
+        UINT32* m_pIndices;
 
-        UINT triangleIndex = 0;
-        for (UINT i = 0; i < NumElements; ++i)
+        void Swap(UINT32 a, UINT32 b)
         {
-            auto &geometry = pGeometries[i];
-            if (geometry.Type != D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES)
+            for (UINT axis = 0; axis < 3; axis++)
             {
-                throw - 1; // Intersection shaders not supported yet
+                std::swap(m_pMin[axis][a], m_pMin[axis][b]);
+                std::swap(m_pMax[axis][a], m_pMax[axis][b]);
+                std::swap(m_pCentroid[axis][a], m_pCentroid[axis][b]);
             }
+            std::swap(m_pIndices[a], m_pIndices[b]);
+        }
+    };
 
-            auto &triangles = geometry.Triangles;
-            if (GetPrimitiveCountFromGeometryDesc(geometry) == 0)
+    struct RangeBounds
+    {
+        AABB nodeBox;
+        AABB centroidBox;
+    };
 
-            {
-                continue;
-            }
+    struct SahBins
+    {
+        AABB box[3][NUM_BINNED_SAH_BINS];
+        UINT numPrimitives[3][NUM_BINNED_SAH_BINS];
+    };
+
+    //
+    // Binning and partitioning must agree exactly on which bin a primitive falls in.
+    // The SIMD kernels compute the same clamp-then-truncate sequence without FMA, so
+    // every path produces bit-identical bins.
+    //
+
+    static
+        UINT GetBinIndex(
+            float centroid,
+            float rangeMin,
+            float binsPerUnit)
+    {
+        const float bin = std::min((float)(NUM_BINNED_SAH_BINS - 1), std::max(0.0f, (centroid - rangeMin) * binsPerUnit));
+        return (UINT)bin;
+    }
 
-            // 
-            const UINT64 vertexStrideDwords = triangles.VertexBuffer.StrideInBytes / 4;
-            const UINT numTris = GetPrimitiveCountFromGeometryDesc(geometry);
+    typedef void(*ComputeRangeBoundsKernel)(
+        const BuildPrimitives& primitives,
+        UINT32 begin,
+        UINT32 end,
+        RangeBounds& bounds);
 
-            float *pVertexData = (float *)geometry.Triangles.VertexBuffer.StartAddress;
-            float *pIndexData = (float *)geometry.Triangles.IndexBuffer;
+    typedef void(*BinPrimitivesKernel)(
+        const BuildPrimitives& primitives,
+        UINT32 begin,
+        UINT32 end,
+        const AABB& centroidBox,
+        const float binsPerUnit[3],
+        SahBins& bins);
 
-            const float* pVertices = (float*)(pVertexData);
-            const UINT16* pIndices = (UINT16*)(pIndexData);
+    //
+    // Scalar reference kernels
+    //
+
+    static
+        void ComputeRangeBoundsScalar(
+            const BuildPrimitives& primitives,
+            UINT32 begin,
+            UINT32 end,
+            RangeBounds& bounds)
+    {
+        InitBoxToInverseMax(bounds.nodeBox);
+        InitBoxToInverseMax(bounds.centroidBox);
+        for (UINT32 i = begin; i < end; i++)
+        {
+            for (UINT axis = 0; axis < 3; axis++)
+            {
+                bounds.nodeBox.minArr[axis] = std::min(bounds.nodeBox.minArr[axis], primitives.m_pMin[axis][i]);
+                bounds.nodeBox.maxArr[axis] = std::max(bounds.nodeBox.maxArr[axis], primitives.m_pMax[axis][i]);
+                bounds.centroidBox.minArr[axis] = std::min(bounds.centroidBox.minArr[axis], primitives.m_pCentroid[axis][i]);
+                bounds.centroidBox.maxArr[axis] = std::max(bounds.centroidBox.maxArr[axis], primitives.m_pCentroid[axis][i]);
+            }
+        }
+    }
 
-            for (UINT j = 0; j < numTris; ++j)
+    static
+        void InitSahBins(
+            SahBins& bins)
+    {
+        for (UINT axis = 0; axis < 3; axis++)
+        {
+            for (UINT bin = 0; bin < NUM_BINNED_SAH_BINS; bin++)
             {
-                const UINT16 i0 = pIndices[j * 3 + 0];
-                const UINT16 i1 = pIndices[j * 3 + 1];
-                const UINT16 i2 = pIndices[j * 3 + 2];
+                InitBoxToInverseMax(bins.box[axis][bin]);
+                bins.numPrimitives[axis][bin] = 0;
+            }
+        }
+    }
 
-                const float* v0 = &pVertices[i0 * vertexStrideDwords];
-                const float* v1 = &pVertices[i1 * vertexStrideDwords];
-                const float* v2 = &pVertices[i2 * vertexStrideDwords];
+    static
+        void BinPrimitivesScalar(
+            const BuildPrimitives& primitives,
+            UINT32 begin,
+            UINT32 end,
+            const AABB& centroidBox,
+            const float binsPerUnit[3],
+            SahBins& bins)
+    {
+        InitSahBins(bins);
+        for (UINT32 i = begin; i < end; i++)
+        {
+            AABB box;
+            for (UINT axis = 0; axis < 3; axis++)
+            {
+                box.minArr[axis] = primitives.m_pMin[axis][i];
+                box.maxArr[axis] = primitives.m_pMax[axis][i];
+            }
 
-                float* pTriVerts = &triangleVertices[triangleIndex * 9];
+            for (UINT axis = 0; axis < 3; axis++)
+            {
+                const UINT bin = GetBinIndex(primitives.m_pCentroid[axis][i], centroidBox.minArr[axis], binsPerUnit[axis]);
+                AddExtentToBox(bins.box[axis][bin], box);
+                bins.numPrimitives[axis][bin]++;
+            }
+        }
+    }
 
-                pTriVerts[0] = v0[0];
-                pTriVerts[1] = v0[1];
-                pTriVerts[2] = v0[2];
+    //
+    // SSE4.1 kernels. A primitive's box is loaded as one min and one max vector and
+    // the bin indices of all three axes are computed with a single vector op chain, so
+    // each primitive costs three vector min/max pairs instead of eighteen scalar ones.
+    //
 
-                pTriVerts[3] = v1[0];
-                pTriVerts[4] = v1[1];
-                pTriVerts[5] = v1[2];
+    struct SimdBinBox
+    {
+        __m128 min;
+        __m128 max;
+    };
 
-                pTriVerts[6] = v2[0];
-                pTriVerts[7] = v2[1];
-                pTriVerts[8] = v2[2];
+    static
+        void InitSimdBins(
+            SimdBinBox bins[3][NUM_BINNED_SAH_BINS],
+            UINT numPrimitives[3][NUM_BINNED_SAH_BINS])
+    {
+        const __m128 inverseMin = _mm_set1_ps(10e10f);
+        const __m128 inverseMax = _mm_set1_ps(-10e10f);
+        for (UINT axis = 0; axis < 3; axis++)
+        {
+            for (UINT bin = 0; bin < NUM_BINNED_SAH_BINS; bin++)
+            {
+                bins[axis][bin].min = inverseMin;
+                bins[axis][bin].max = inverseMax;
+                numPrimitives[axis][bin] = 0;
+            }
+        }
+    }
 
-                AABB& box = boxes[triangleIndex];
-                for (UINT k = 0; k < 3; ++k)
-                {
-#define AABB_Min_Padding 0.001f
-                    box.minArr[k] = std::min(v2[k], std::min(v0[k], v1[k]));
-                    box.maxArr[k] = std::max(v2[k], std::max(v0[k], v1[k])) + AABB_Min_Padding;
+    static
+        void StoreSimdBins(
+            const SimdBinBox simdBins[3][NUM_BINNED_SAH_BINS],
+            const UINT numPrimitives[3][NUM_BINNED_SAH_BINS],
+            SahBins& bins)
+    {
+        for (UINT axis = 0; axis < 3; axis++)
+        {
+            for (UINT bin = 0; bin < NUM_BINNED_SAH_BINS; bin++)
+            {
+                float min[4], max[4];
+                _mm_storeu_ps(min, simdBins[axis][bin].min);
+                _mm_storeu_ps(max, simdBins[axis][bin].max);
+
+                AABB& box = bins.box[axis][bin];
+                box.min = { min[0], min[1], min[2] };
+                box.max = { max[0], max[1], max[2] };
+                bins.numPrimitives[axis][bin] = numPrimitives[axis][bin];
+            }
+        }
+    }
 
-                    if (_isnan(box.minArr[k]) ||
-                        _isnan(box.maxArr[k]))
-                    {
-                        box.minArr[k] = 0;
-                        box.maxArr[k] = 0;
-                    }
-                }
+    static
+        void ComputeRangeBoundsSse41(
+            const BuildPrimitives& primitives,
+            UINT32 begin,
+            UINT32 end,
+            RangeBounds& bounds)
+    {
+        // Align the vector loop to the array start so the loads stay within [begin, end)
+        const UINT32 vectorEnd = begin + ((end - begin) & ~3u);
+        for (UINT axis = 0; axis < 3; axis++)
+        {
+            __m128 minValues = _mm_set1_ps(10e10f);
+            __m128 maxValues = _mm_set1_ps(-10e10f);
+            __m128 minCentroids = minValues;
+            __m128 maxCentroids = maxValues;
+            for (UINT32 i = begin; i < vectorEnd; i += 4)
+            {
+                minValues = _mm_min_ps(minValues, _mm_loadu_ps(&primitives.m_pMin[axis][i]));
+                maxValues = _mm_max_ps(maxValues, _mm_loadu_ps(&primitives.m_pMax[axis][i]));
+                const __m128 centroids = _mm_loadu_ps(&primitives.m_pCentroid[axis][i]);
+                minCentroids = _mm_min_ps(minCentroids, centroids);
+                maxCentroids = _mm_max_ps(maxCentroids, centroids);
+            }
 
-                // Create out internal triangle indices.
-                PrimitiveMetaData metadata;
-                metadata.GeometryContributionToHitGroupIndex = i;
-                metadata.PrimitiveIndex = triangleIndex;
-                metadata.GeometryFlags = geometry.Flags;
-                primitiveMetaData[triangleIndex] = metadata;
+            float lanes[4][4];
+            _mm_storeu_ps(lanes[0], minValues);
+            _mm_storeu_ps(lanes[1], maxValues);
+            _mm_storeu_ps(lanes[2], minCentroids);
+            _mm_storeu_ps(lanes[3], maxCentroids);
 
-                // Next triangle
-                triangleIndex++;
+            float minValue = lanes[0][0], maxValue = lanes[1][0];
+            float minCentroid = lanes[2][0], maxCentroid = lanes[3][0];
+            for (UINT lane = 1; lane < 4; lane++)
+            {
+                minValue = std::min(minValue, lanes[0][lane]);
+                maxValue = std::max(maxValue, lanes[1][lane]);
+                minCentroid = std::min(minCentroid, lanes[2][lane]);
+                maxCentroid = std::max(maxCentroid, lanes[3][lane]);
+            }
+            for (UINT32 i = vectorEnd; i < end; i++)
+            {
+                minValue = std::min(minValue, primitives.m_pMin[axis][i]);
+                maxValue = std::max(maxValue, primitives.m_pMax[axis][i]);
+                minCentroid = std::min(minCentroid, primitives.m_pCentroid[axis][i]);
+                maxCentroid = std::max(maxCentroid, primitives.m_pCentroid[axis][i]);
             }
+
+            bounds.nodeBox.minArr[axis] = minValue;
+            bounds.nodeBox.maxArr[axis] = maxValue;
+            bounds.centroidBox.minArr[axis] = minCentroid;
+            bounds.centroidBox.maxArr[axis] = maxCentroid;
         }
+    }
 
-        //
-        // Create a BVH
-        //
+    static
+        void BinPrimitivesSse41(
+            const BuildPrimitives& primitives,
+            UINT32 begin,
+            UINT32 end,
+            const AABB& centroidBox,
+            const float binsPerUnit[3],
+            SahBins& bins)
+    {
+        SimdBinBox simdBins[3][NUM_BINNED_SAH_BINS];
+        UINT numPrimitives[3][NUM_BINNED_SAH_BINS];
+        InitSimdBins(simdBins, numPrimitives);
 
-        BuildBVH(bvh, boxes, primitiveMetaData, MAX_TRIS_IN_LEAF);
+        const __m128 rangeMin = _mm_setr_ps(centroidBox.min.x, centroidBox.min.y, centroidBox.min.z, 0.0f);
+        const __m128 scale = _mm_setr_ps(binsPerUnit[0], binsPerUnit[1], binsPerUnit[2], 0.0f);
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 lastBin = _mm_set1_ps((float)(NUM_BINNED_SAH_BINS - 1));
 
-        //
-        // Now copy and compress geometry
-        //
+        for (UINT32 i = begin; i < end; i++)
+        {
+            const __m128 centroid = _mm_setr_ps(primitives.m_pCentroid[0][i], primitives.m_pCentroid[1][i], primitives.m_pCentroid[2][i], 0.0f);
+            const __m128 min = _mm_setr_ps(primitives.m_pMin[0][i], primitives.m_pMin[1][i], primitives.m_pMin[2][i], 0.0f);
+            const __m128 max = _mm_setr_ps(primitives.m_pMax[0][i], primitives.m_pMax[1][i], primitives.m_pMax[2][i], 0.0f);
+
+            const __m128 binFloat = _mm_min_ps(lastBin, _mm_max_ps(zero, _mm_mul_ps(_mm_sub_ps(centroid, rangeMin), scale)));
+            const __m128i binIndex = _mm_cvttps_epi32(binFloat);
+
+            const UINT binX = (UINT)_mm_extract_epi32(binIndex, 0);
+            const UINT binY = (UINT)_mm_extract_epi32(binIndex, 1);
+            const UINT binZ = (UINT)_mm_extract_epi32(binIndex, 2);
+
+            simdBins[0][binX].min = _mm_min_ps(simdBins[0][binX].min, min);
+            simdBins[0][binX].max = _mm_max_ps(simdBins[0][binX].max, max);
+            simdBins[1][binY].min = _mm_min_ps(simdBins[1][binY].min, min);
+            simdBins[1][binY].max = _mm_max_ps(simdBins[1][binY].max, max);
+            simdBins[2][binZ].min = _mm_min_ps(simdBins[2][binZ].min, min);
+            simdBins[2][binZ].max = _mm_max_ps(simdBins[2][binZ].max, max);
+            numPrimitives[0][binX]++;
+            numPrimitives[1][binY]++;
+            numPrimitives[2][binZ]++;
+        }
+
+        StoreSimdBins(simdBins, numPrimitives, bins);
+    }
+
+    //
+    // AVX2 kernels. Bounds reduce eight primitives per iteration and binning computes
+    // the bin indices of eight primitives on all three axes before scattering them.
+    //
 
-        // Copy verts
-        const UINT numTris = triangleIndex;
-        bvh.m_triangles.resize(numTris * 3 * 3);
-        assert(bvh.m_triangles.size() == triangleVertices.size());
-        assert(sizeof(bvh.m_triangles[0]) == sizeof(triangleVertices[0]));
+    static
+        float HorizontalMin(__m256 values)
+    {
+        __m128 lanes = _mm_min_ps(_mm256_castps256_ps128(values), _mm256_extractf128_ps(values, 1));
+        lanes = _mm_min_ps(lanes, _mm_movehl_ps(lanes, lanes));
+        lanes = _mm_min_ss(lanes, _mm_shuffle_ps(lanes, lanes, 1));
+        return _mm_cvtss_f32(lanes);
+    }
+
+    static
+        float HorizontalMax(__m256 values)
+    {
+        __m128 lanes = _mm_max_ps(_mm256_castps256_ps128(values), _mm256_extractf128_ps(values, 1));
+        lanes = _mm_max_ps(lanes, _mm_movehl_ps(lanes, lanes));
+        lanes = _mm_max_ss(lanes, _mm_shuffle_ps(lanes, lanes, 1));
+        return _mm_cvtss_f32(lanes);
+    }
 
-        for (UINT i = 0; i < numTris; ++i)
+    static
+        void ComputeRangeBoundsAvx2(
+            const BuildPrimitives& primitives,
+            UINT32 begin,
+            UINT32 end,
+            RangeBounds& bounds)
+    {
+        const UINT32 vectorEnd = begin + ((end - begin) & ~7u);
+        for (UINT axis = 0; axis < 3; axis++)
         {
-            UINT inputIndex = bvh.m_metadata[i].PrimitiveIndex;
-            float *pInputTriangle = &triangleVertices.data()[inputIndex * 9];
-            float* pOutputTriangle = &bvh.m_triangles[i * 9];
+            __m256 minValues = _mm256_set1_ps(10e10f);
+            __m256 maxValues = _mm256_set1_ps(-10e10f);
+            __m256 minCentroids = minValues;
+            __m256 maxCentroids = maxValues;
+            for (UINT32 i = begin; i < vectorEnd; i += 8)
+            {
+                minValues = _mm256_min_ps(minValues, _mm256_loadu_ps(&primitives.m_pMin[axis][i]));
+                maxValues = _mm256_max_ps(maxValues, _mm256_loadu_ps(&primitives.m_pMax[axis][i]));
+                const __m256 centroids = _mm256_loadu_ps(&primitives.m_pCentroid[axis][i]);
+                minCentroids = _mm256_min_ps(minCentroids, centroids);
+                maxCentroids = _mm256_max_ps(maxCentroids, centroids);
+            }
 
-            // Construct three planes and write to pPlanes
-            XMVECTOR V0 = XMVectorSet(pInputTriangle[0], pInputTriangle[1], pInputTriangle[2], 0.0f);
-            XMVECTOR V1 = XMVectorSet(pInputTriangle[3], pInputTriangle[4], pInputTriangle[5], 0.0f);
-            XMVECTOR V2 = XMVectorSet(pInputTriangle[6], pInputTriangle[7], pInputTriangle[8], 0.0f);
+            float minValue = HorizontalMin(minValues);
+            float maxValue = HorizontalMax(maxValues);
+            float minCentroid = HorizontalMin(minCentroids);
+            float maxCentroid = HorizontalMax(maxCentroids);
+            for (UINT32 i = vectorEnd; i < end; i++)
+            {
+                minValue = std::min(minValue, primitives.m_pMin[axis][i]);
+                maxValue = std::max(maxValue, primitives.m_pMax[axis][i]);
+                minCentroid = std::min(minCentroid, primitives.m_pCentroid[axis][i]);
+                maxCentroid = std::max(maxCentroid, primitives.m_pCentroid[axis][i]);
+            }
 
-            XMStoreFloat3((XMFLOAT3*)pOutputTriangle + 0, V0);
-            XMStoreFloat3((XMFLOAT3*)pOutputTriangle + 1, V1);
-            XMStoreFloat3((XMFLOAT3*)pOutputTriangle + 2, V2);
+            bounds.nodeBox.minArr[axis] = minValue;
+            bounds.nodeBox.maxArr[axis] = maxValue;
+            bounds.centroidBox.minArr[axis] = minCentroid;
+            bounds.centroidBox.maxArr[axis] = maxCentroid;
         }
     }
-}
 
-void BuildRaytracingAccelerationStructureOnCpu(
-    _In_  const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC *pDesc,
-    _Out_ void *pData)
-{
-    FallbackLayer::BVH bvh;
-    FallbackLayer::BuildUniformBVH(pDesc->Inputs.NumDescs, pDesc->Inputs.pGeometryDescs, bvh);
+    static
+        void BinPrimitivesAvx2(
+            const BuildPrimitives& primitives,
+            UINT32 begin,
+            UINT32 end,
+            const AABB& centroidBox,
+            const float binsPerUnit[3],
+            SahBins& bins)
+    {
+        SimdBinBox simdBins[3][NUM_BINNED_SAH_BINS];
+        UINT numPrimitives[3][NUM_BINNED_SAH_BINS];
+        InitSimdBins(simdBins, numPrimitives);
+
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 lastBin = _mm256_set1_ps((float)(NUM_BINNED_SAH_BINS - 1));
+        __m256 rangeMin[3];
+        __m256 scale[3];
+        for (UINT axis = 0; axis < 3; axis++)
+        {
+            rangeMin[axis] = _mm256_set1_ps(centroidBox.minArr[axis]);
+            scale[axis] = _mm256_set1_ps(binsPerUnit[axis]);
+        }
 
-    BYTE* outputData = (BYTE*)pData;
-    BVHOffsets offsets;
-    offsets.offsetToBoxes = sizeof(BVHOffsets);
-    const UINT sizeofBoxes = (UINT)(bvh.m_nodes.size() * sizeof(*bvh.m_nodes.data()));
-    offsets.offsetToVertices = offsets.offsetToBoxes + sizeofBoxes;
-    
-    UINT numTriangles = (UINT)bvh.m_triangles.size() / 9;
-    const UINT sizeofVertices = numTriangles * sizeof(Primitive);
-    offsets.offsetToPrimitiveMetaData = offsets.offsetToVertices + sizeofVertices;
+        __declspec(align(32)) INT32 binIndices[3][8];
+        for (UINT32 i = begin; i < end; i += 8)
+        {
+            const UINT32 count = std::min(8u, end - i);
+            if (count == 8)
+            {
+                for (UINT axis = 0; axis < 3; axis++)
+                {
+                    const __m256 centroids = _mm256_loadu_ps(&primitives.m_pCentroid[axis][i]);
+                    const __m256 binFloat = _mm256_min_ps(lastBin, _mm256_max_ps(zero, _mm256_mul_ps(_mm256_sub_ps(centroids, rangeMin[axis]), scale[axis])));
+                    _mm256_store_si256((__m256i*)binIndices[axis], _mm256_cvttps_epi32(binFloat));
+                }
+            }
+            else
+            {
+                for (UINT axis = 0; axis < 3; axis++)
+                {
+                    for (UINT32 lane = 0; lane < count; lane++)
+                    {
+                        binIndices[axis][lane] = (INT32)GetBinIndex(primitives.m_pCentroid[axis][i + lane], centroidBox.minArr[axis], binsPerUnit[axis]);
+                    }
+                }
+            }
 
-    const UINT sizeofMetadata = (UINT)(bvh.m_metadata.size() * sizeof(*bvh.m_metadata.data()));
-    offsets.totalSize = offsets.offsetToPrimitiveMetaData + sizeofMetadata;
+            for (UINT32 lane = 0; lane < count; lane++)
+            {
+                const UINT32 primitive = i + lane;
+                const __m128 min = _mm_setr_ps(primitives.m_pMin[0][primitive], primitives.m_pMin[1][primitive], primitives.m_pMin[2][primitive], 0.0f);
+                const __m128 max = _mm_setr_ps(primitives.m_pMax[0][primitive], primitives.m_pMax[1][primitive], primitives.m_pMax[2][primitive], 0.0f);
+                for (UINT axis = 0; axis < 3; axis++)
+                {
+                    SimdBinBox& bin = simdBins[axis][binIndices[axis][lane]];
+                    bin.min = _mm_min_ps(bin.min, min);
+                    bin.max = _mm_max_ps(bin.max, max);
+                    numPrimitives[axis][binIndices[axis][lane]]++;
+                }
+            }
+        }
 
-    memcpy(outputData,  &offsets, sizeof(offsets));
-    memcpy(outputData + offsets.offsetToBoxes, bvh.m_nodes.data(), sizeofBoxes);
+        StoreSimdBins(simdBins, numPrimitives, bins);
+    }
 
-    Primitive *pPrimitives = (Primitive *)(outputData + offsets.offsetToVertices);
-    for (UINT i = 0; i < numTriangles; i++)
+    CpuBvh2SimdLevel GetSupportedCpuBvh2SimdLevel()
     {
-        Triangle *pTriangle = (Triangle *)((BYTE *)bvh.m_triangles.data() + sizeof(Triangle) * i);
-        pPrimitives[i].PrimitiveType = TRIANGLE_TYPE;
-        pPrimitives[i].triangle = *pTriangle;
+        int cpuInfo[4];
+        __cpuid(cpuInfo, 0);
+        const int maxFunctionId = cpuInfo[0];
+
+        __cpuid(cpuInfo, 1);
+        const bool bSse41 = (cpuInfo[2] & (1 << 19)) != 0;
+        const bool bOsXSave = (cpuInfo[2] & (1 << 27)) != 0;
+        const bool bAvx = (cpuInfo[2] & (1 << 28)) != 0;
+
+        // AVX state must also be enabled by the OS
+        bool bAvx2 = false;
+        if (maxFunctionId >= 7 && bOsXSave && bAvx && (_xgetbv(0) & 0x6) == 0x6)
+        {
+            __cpuidex(cpuInfo, 7, 0);
+            bAvx2 = (cpuInfo[1] & (1 << 5)) != 0;
+        }
+
+        if (bAvx2)
+        {
+            return CpuBvh2SimdLevel::Avx2;
+        }
+        return bSse41 ? CpuBvh2SimdLevel::Sse41 : CpuBvh2SimdLevel::Scalar;
     }
+
+    class ParallelBuildContext
+    {
+    public:
+        ParallelBuildContext(
+            const BuildPrimitives& primitives,
+            const TrackedVector<PrimitiveMetaData>& metadata,
+            UINT32 maxPrimitivesInLeaf,
+            UINT numThreads,
+            CpuBvh2SimdLevel simdLevel,
+            BuildMemoryTracker* pTracker) :
+            m_primitives(primitives),
+            m_metadata(metadata),
+            m_maxPrimitivesInLeaf(maxPrimitivesInLeaf),
+            m_pTracker(pTracker),
+            m_availableThreads((INT)numThreads - 1)
+        {
+            switch (simdLevel)
+            {
+            case CpuBvh2SimdLevel::Avx2:
+                m_pComputeRangeBounds = ComputeRangeBoundsAvx2;
+                m_pBinPrimitives = BinPrimitivesAvx2;
+                break;
+            case CpuBvh2SimdLevel::Sse41:
+                m_pComputeRangeBounds = ComputeRangeBoundsSse41;
+                m_pBinPrimitives = BinPrimitivesSse41;
+                break;
+            case CpuBvh2SimdLevel::Scalar:
+                m_pComputeRangeBounds = ComputeRangeBoundsScalar;
+                m_pBinPrimitives = BinPrimitivesScalar;
+                break;
+            default:
+                ThrowFailure(E_INVALIDARG, L"Unrecognized CpuBvh2SimdLevel");
+            }
+        }
+
+        // Reserves one of the worker threads, returns false if they're all busy
+        bool TryAcquireThread()
+        {
+            INT availableThreads = m_availableThreads.load();
+            while (availableThreads > 0)
+            {
+                if (m_availableThreads.compare_exchange_weak(availableThreads, availableThreads - 1))
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void ReleaseThread()
+        {
+            m_availableThreads++;
+        }
+
+        const BuildPrimitives& m_primitives;
+        const TrackedVector<PrimitiveMetaData>& m_metadata;
+        const UINT32 m_maxPrimitivesInLeaf;
+        BuildMemoryTracker* const m_pTracker;
+        ComputeRangeBoundsKernel m_pComputeRangeBounds;
+        BinPrimitivesKernel m_pBinPrimitives;
+
+    private:
+        std::atomic<INT> m_availableThreads;
+    };
+
+    //
+    // Splits [begin, end) into chunks and runs them on whichever worker threads are free,
+    // the first chunk always runs on the calling thread. Results are returned per chunk
+    // and the callers merge them with min/max and sums only, so the merged result is
+    // identical no matter how many chunks ran.
+    //
+
+    template<typename ResultType, typename ChunkFunction>
+    static
+        UINT32 ParallelForChunks(
+            ParallelBuildContext& context,
+            BuildArena& scratchArena,
+            UINT32 begin,
+            UINT32 end,
+            ResultType*& pResults,
+            ChunkFunction chunkFunction)
+    {
+        const UINT32 count = end - begin;
+        UINT32 numChunks = 1;
+        if (count >= 2 * MIN_PRIMITIVES_PER_BINNING_TASK)
+        {
+            const UINT32 maxChunks = count / MIN_PRIMITIVES_PER_BINNING_TASK;
+            while (numChunks < maxChunks && context.TryAcquireThread())
+            {
+                numChunks++;
+            }
+        }
+
+        pResults = scratchArena.Allocate<ResultType>(numChunks);
+        const UINT32 chunkSize = DivideAndRoundUp(count, numChunks);
+
+        std::vector<std::future<void>> chunkTasks;
+        for (UINT32 chunk = 1; chunk < numChunks; chunk++)
+        {
+            const UINT32 chunkBegin = std::min(end, begin + chunk * chunkSize);
+            const UINT32 chunkEnd = std::min(end, chunkBegin + chunkSize);
+            ResultType* pResult = &pResults[chunk];
+            chunkTasks.push_back(std::async(std::launch::async, [&context, &chunkFunction, chunkBegin, chunkEnd, pResult]()
+            {
+                chunkFunction(chunkBegin, chunkEnd, *pResult);
+                context.ReleaseThread();
+            }));
+        }
+
+        chunkFunction(begin, std::min(end, begin + chunkSize), pResults[0]);
+
+        for (auto& chunkTask : chunkTasks)
+        {
+            chunkTask.get();
+        }
+        return numChunks;
+    }
+
+    static
+        void ComputeRangeBounds(
+            ParallelBuildContext& context,
+            BuildArena& scratchArena,
+            UINT32 begin,
+            UINT32 end,
+            RangeBounds& bounds)
+    {
+        if (begin == end)
+        {
+            bounds.nodeBox.min = bounds.nodeBox.max = { 0, 0, 0 };
+            bounds.centroidBox = bounds.nodeBox;
+            return;
+        }
+
+        RangeBounds* pChunkBounds;
+        const UINT32 numChunks = ParallelForChunks(context, scratchArena, begin, end, pChunkBounds,
+            [&](UINT32 chunkBegin, UINT32 chunkEnd, RangeBounds& result)
+        {
+            context.m_pComputeRangeBounds(context.m_primitives, chunkBegin, chunkEnd, result);
+        });
+
+        bounds = pChunkBounds[0];
+        for (UINT32 i = 1; i < numChunks; i++)
+        {
+            AddExtentToBox(bounds.nodeBox, pChunkBounds[i].nodeBox);
+            AddExtentToBox(bounds.centroidBox, pChunkBounds[i].centroidBox);
+        }
+    }
+
+    static
+        void BinPrimitives(
+            ParallelBuildContext& context,
+            BuildArena& scratchArena,
+            UINT32 begin,
+            UINT32 end,
+            const AABB& centroidBox,
+            const float binsPerUnit[3],
+            SahBins& bins)
+    {
+        SahBins* pChunkBins;
+        const UINT32 numChunks = ParallelForChunks(context, scratchArena, begin, end, pChunkBins,
+            [&](UINT32 chunkBegin, UINT32 chunkEnd, SahBins& result)
+        {
+            context.m_pBinPrimitives(context.m_primitives, chunkBegin, chunkEnd, centroidBox, binsPerUnit, result);
+        });
+
+        bins = pChunkBins[0];
+        for (UINT32 i = 1; i < numChunks; i++)
+        {
+            for (UINT axis = 0; axis < 3; axis++)
+            {
+                for (UINT bin = 0; bin < NUM_BINNED_SAH_BINS; bin++)
+                {
+                    AddExtentToBox(bins.box[axis][bin], pChunkBins[i].box[axis][bin]);
+                    bins.numPrimitives[axis][bin] += pChunkBins[i].numPrimitives[axis][bin];
+                }
+            }
+        }
+    }
+
+    //
+    // Sweeps the bins of every axis and returns false if no plane separates the
+    // primitives, i.e. all centroids landed in the same bin.
+    //
+
+    static
+        bool FindBestSahSplit(
+            const SahBins& bins,
+            const float binsPerUnit[3],
+            UINT32 numPrimitives,
+            UINT& splitAxis,
+            UINT& splitBin)
+    {
+        float bestSah = FLT_MAX;
+        for (UINT axis = 0; axis < 3; axis++)
+        {
+            if (binsPerUnit[axis] == 0.0f)
+            {
+                continue;
+            }
+
+            float rightAreas[NUM_BINNED_SAH_BINS];
+            AABB rightBox;
+            InitBoxToInverseMax(rightBox);
+            for (UINT bin = NUM_BINNED_SAH_BINS - 1; bin > 0; bin--)
+            {
+                AddExtentToBox(rightBox, bins.box[axis][bin]);
+                rightAreas[bin] = ComputeBoxSurfaceArea(rightBox);
+            }
+
+            AABB leftBox;
+            InitBoxToInverseMax(leftBox);
+            UINT32 numPrimitivesOnLeft = 0;
+            for (UINT bin = 0; bin < NUM_BINNED_SAH_BINS - 1; bin++)
+            {
+                AddExtentToBox(leftBox, bins.box[axis][bin]);
+                numPrimitivesOnLeft += bins.numPrimitives[axis][bin];
+
+                const UINT32 numPrimitivesOnRight = numPrimitives - numPrimitivesOnLeft;
+                if (numPrimitivesOnLeft == 0 || numPrimitivesOnRight == 0)
+                {
+                    continue;
+                }
+
+                const float sah = numPrimitivesOnLeft * ComputeBoxSurfaceArea(leftBox) +
+                    numPrimitivesOnRight * rightAreas[bin + 1];
+                assert(!_isnan(sah));
+
+                if (sah < bestSah)
+                {
+                    bestSah = sah;
+                    splitAxis = axis;
+                    splitBin = bin;
+                }
+            }
+        }
+        return bestSah != FLT_MAX;
+    }
+
+    //
+    // Partitions [begin, end) in place and returns the first primitive of the right child
+    //
+
+    static
+        UINT32 PartitionRange(
+            ParallelBuildContext& context,
+            BuildArena& scratchArena,
+            UINT32 begin,
+            UINT32 end,
+            const RangeBounds& bounds,
+            UINT& splitAxis)
+    {
+        float binsPerUnit[3];
+        for (UINT axis = 0; axis < 3; axis++)
+        {
+            const float extents = bounds.centroidBox.maxArr[axis] - bounds.centroidBox.minArr[axis];
+            binsPerUnit[axis] = extents > 0.0f ? NUM_BINNED_SAH_BINS / extents : 0.0f;
+        }
+
+        SahBins& bins = *scratchArena.Allocate<SahBins>();
+        BinPrimitives(context, scratchArena, begin, end, bounds.centroidBox, binsPerUnit, bins);
+
+        UINT splitBin;
+        if (!FindBestSahSplit(bins, binsPerUnit, end - begin, splitAxis, splitBin))
+        {
+            // All centroids coincide so every split is equally good, split in the middle
+            splitAxis = 0;
+            return begin + (end - begin) / 2;
+        }
+
+        const BuildPrimitives& primitives = context.m_primitives;
+        const float* pCentroids = primitives.m_pCentroid[splitAxis];
+        const float rangeMin = bounds.centroidBox.minArr[splitAxis];
+        const float axisBinsPerUnit = binsPerUnit[splitAxis];
+        auto isOnLeft = [&](UINT32 i) -> bool
+        {
+            return GetBinIndex(pCentroids[i], rangeMin, axisBinsPerUnit) <= splitBin;
+        };
+
+        UINT32 left = begin;
+        UINT32 right = end;
+        for (;;)
+        {
+            while (left < right && isOnLeft(left))
+            {
+                left++;
+            }
+            while (left < right && !isOnLeft(right - 1))
+            {
+                right--;
+            }
+            if (left >= right)
+            {
+                break;
+            }
+            const_cast<BuildPrimitives&>(primitives).Swap(left, right - 1);
+            left++;
+            right--;
+        }
+        return left;
+    }
+
+    static
+        UINT32 BuildBVHAddLeaf(
+            BVH& bvh,
+            const AABB& box,
+            const TrackedVector<PrimitiveMetaData>& metadata,
+            const UINT32* pIndices,
+            UINT32 numPrimitives)
+    {
+        const UINT32 nodeIndex = BuildBVHAddNode(bvh, box, 0);
+
+        bvh.m_nodes[nodeIndex].nodeAllBits = 0;
+        bvh.m_nodes[nodeIndex].leaf = true;
+
+        const UINT32 idIndex = (UINT32)bvh.m_metadata.size();
+
+        for (UINT32 i = 0; i < numPrimitives; i++)
+        {
+            bvh.m_metadata.push_back(metadata[pIndices[i]]);
+        }
+
+        assert(numPrimitives < 128);
+        assert(idIndex < (1 << 24));
+
+        bvh.m_nodes[nodeIndex].leafNode.firstTriangleId = idIndex;
+        bvh.m_nodes[nodeIndex].leafNode.numTriangleIds = numPrimitives;
+        bvh.m_nodes[nodeIndex].numTriangles = numPrimitives;
+
+        return nodeIndex;
+    }
+
+    //
+    // Appends a separately built subtree, rebasing its node and metadata indices,
+    // and returns the index of its root
+    //
+
+    static
+        UINT32 AppendSubtree(
+            BVH& bvh,
+            const BVH& subtree)
+    {
+        const UINT32 nodeOffset = (UINT32)bvh.m_nodes.size();
+        const UINT32 metadataOffset = (UINT32)bvh.m_metadata.size();
+
+        for (AABBNode node : subtree.m_nodes)
+        {
+            if (node.leaf)
+            {
+                node.leafNode.firstTriangleId += metadataOffset;
+            }
+            else
+            {
+                node.internalNode.leftNodeIndex += nodeOffset;
+                node.rightNodeIndex += nodeOffset;
+            }
+            bvh.m_nodes.push_back(node);
+        }
+
+        bvh.m_metadata.insert(bvh.m_metadata.end(), subtree.m_metadata.begin(), subtree.m_metadata.end());
+
+        return nodeOffset;
+    }
+
+    static
+        void BuildBVHSubtree(
+            ParallelBuildContext& context,
+            UINT32 begin,
+            UINT32 end,
+            BVH& bvh)
+    {
+        struct BuildRecord
+        {
+            UINT32              begin;
+            UINT32              end;
+            UINT32              parentIndex;
+            bool                right;
+            BuildRecord*        pNext;
+
+            // Set if the subtree was handed to another thread and only needs appending
+            std::future<BVH>*   pSubtree;
+        };
+
+        // Records are recycled through a free list, scratch is rewound after every node
+        BuildArena recordArena(context.m_pTracker);
+        BuildArena scratchArena(context.m_pTracker);
+        BuildRecord* pFreeRecords = nullptr;
+        auto allocateRecord = [&](UINT32 recordBegin, UINT32 recordEnd, UINT32 parentIndex, bool right) -> BuildRecord*
+        {
+            BuildRecord* pRecord = pFreeRecords;
+            if (pRecord)
+            {
+                pFreeRecords = pRecord->pNext;
+            }
+            else
+            {
+                pRecord = recordArena.Allocate<BuildRecord>();
+            }
+            *pRecord = { recordBegin, recordEnd, parentIndex, right, nullptr, nullptr };
+            return pRecord;
+        };
+
+        BuildRecord* pStack = allocateRecord(begin, end, (UINT32)-1, false);
+        while (pStack)
+        {
+            BuildRecord* pRecord = pStack;
+            pStack = pRecord->pNext;
+
+            UINT32 thisNodeIndex;
+            if (pRecord->pSubtree)
+            {
+                thisNodeIndex = AppendSubtree(bvh, pRecord->pSubtree->get());
+                delete pRecord->pSubtree;
+            }
+            else
+            {
+                scratchArena.Reset();
+
+                RangeBounds bounds;
+                ComputeRangeBounds(context, scratchArena, pRecord->begin, pRecord->end, bounds);
+
+                const UINT32 numPrimitivesInNode = pRecord->end - pRecord->begin;
+                if (numPrimitivesInNode <= context.m_maxPrimitivesInLeaf)
+                {
+                    thisNodeIndex = BuildBVHAddLeaf(bvh, bounds.nodeBox, context.m_metadata, context.m_primitives.m_pIndices + pRecord->begin, numPrimitivesInNode);
+                }
+                else
+                {
+                    UINT splitAxis;
+                    const UINT32 middle = PartitionRange(context, scratchArena, pRecord->begin, pRecord->end, bounds, splitAxis);
+                    assert(middle > pRecord->begin && middle < pRecord->end);
+
+                    thisNodeIndex = BuildBVHAddNode(bvh, bounds.nodeBox, splitAxis);
+
+                    BuildRecord* pLeftRecord = allocateRecord(pRecord->begin, middle, thisNodeIndex, false);
+                    if (middle - pRecord->begin >= MIN_PRIMITIVES_PER_SUBTREE_TASK && context.TryAcquireThread())
+                    {
+                        const UINT32 leftBegin = pRecord->begin;
+                        pLeftRecord->pSubtree = new std::future<BVH>(std::async(std::launch::async, [&context, leftBegin, middle]() -> BVH
+                        {
+                            BVH subtree(context.m_pTracker);
+                            subtree.m_nodes.reserve(2 * (middle - leftBegin));
+                            subtree.m_metadata.reserve(middle - leftBegin);
+                            BuildBVHSubtree(context, leftBegin, middle, subtree);
+                            context.ReleaseThread();
+                            return subtree;
+                        }));
+                    }
+
+                    // The right record is popped first so it ends up at thisNodeIndex + 1
+                    BuildRecord* pRightRecord = allocateRecord(middle, pRecord->end, thisNodeIndex, true);
+                    pLeftRecord->pNext = pStack;
+                    pRightRecord->pNext = pLeftRecord;
+                    pStack = pRightRecord;
+                }
+            }
+
+            // Update child link of the parent
+            if (pRecord->parentIndex != (UINT32)-1 && !pRecord->right)
+            {
+                bvh.m_nodes[pRecord->parentIndex].internalNode.leftNodeIndex = thisNodeIndex;
+                bvh.m_nodes[pRecord->parentIndex].rightNodeIndex = pRecord->parentIndex + 1;
+            }
+
+            pRecord->pNext = pFreeRecords;
+            pFreeRecords = pRecord;
+        }
+    }
+
+    static
+        UINT GetNumBuildThreads(
+            const CpuBvh2BuildSettings &settings)
+    {
+        return settings.NumThreads ? settings.NumThreads : std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    static
+        void BuildBVHParallel(
+            BVH& bvh,
+            const TrackedVector<AABB>& boxes,
+            const TrackedVector<PrimitiveMetaData>& primitiveMetaData,
+            const CpuBvh2BuildSettings& settings,
+            BuildMemoryTracker* pTracker,
+            CpuBvh2SimdLevel& simdLevelUsed)
+    {
+        if (settings.MaxPrimitivesInLeaf == 0 || settings.MaxPrimitivesInLeaf >= 128)
+        {
+            ThrowFailure(E_INVALIDARG, L"MaxPrimitivesInLeaf must be between 1 and 127");
+        }
+
+        // Requests for an unsupported instruction set fall back to the best supported one
+        const CpuBvh2SimdLevel supportedSimdLevel = GetSupportedCpuBvh2SimdLevel();
+        simdLevelUsed = (settings.SimdLevel == CpuBvh2SimdLevel::Auto) ?
+            supportedSimdLevel : std::min(settings.SimdLevel, supportedSimdLevel);
+
+        const UINT32 numPrimitives = (UINT32)primitiveMetaData.size();
+        TrackedVector<float> soaStorage(9 * (size_t)numPrimitives, 0.0f, TrackingAllocator<float>(pTracker));
+        TrackedVector<UINT32> primitiveIndices(numPrimitives, 0, TrackingAllocator<UINT32>(pTracker));
+
+        BuildPrimitives primitives;
+        for (UINT axis = 0; axis < 3; axis++)
+        {
+            primitives.m_pMin[axis] = soaStorage.data() + (0 + axis) * (size_t)numPrimitives;
+            primitives.m_pMax[axis] = soaStorage.data() + (3 + axis) * (size_t)numPrimitives;
+            primitives.m_pCentroid[axis] = soaStorage.data() + (6 + axis) * (size_t)numPrimitives;
+        }
+        primitives.m_pIndices = primitiveIndices.data();
+
+        for (UINT32 i = 0; i < numPrimitives; i++)
+        {
+            const AABB& box = boxes[primitiveMetaData[i].PrimitiveIndex];
+            for (UINT axis = 0; axis < 3; axis++)
+            {
+                primitives.m_pMin[axis][i] = box.minArr[axis];
+                primitives.m_pMax[axis][i] = box.maxArr[axis];
+                primitives.m_pCentroid[axis][i] = (box.maxArr[axis] + box.minArr[axis]) * 0.5f;
+            }
+            primitives.m_pIndices[i] = i;
+        }
+
+        const UINT numThreads = GetNumBuildThreads(settings);
+        ParallelBuildContext context(primitives, primitiveMetaData, settings.MaxPrimitivesInLeaf, numThreads, simdLevelUsed, pTracker);
+
+        bvh.m_nodes.reserve(2 * numPrimitives);
+        bvh.m_metadata.reserve(numPrimitives);
+
+        BuildBVHSubtree(context, 0, numPrimitives, bvh);
+    }
+
+    //
+    // Primitive fetch, mirrors the LoadTriangles*/LoadProceduralGeometry shaders. Primitives
+    // are read straight from the caller's buffers when computing boxes and again when
+    // writing the output, nothing is staged in between.
+    //
+
+    static
+        void ValidateGeometryDesc(
+            const D3D12_RAYTRACING_GEOMETRY_DESC &geometryDesc)
+    {
+        if (geometryDesc.Type == D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES)
+        {
+            const D3D12_RAYTRACING_GEOMETRY_TRIANGLES_DESC &triangles = geometryDesc.Triangles;
+            if (triangles.IndexBuffer == 0 && triangles.IndexFormat != DXGI_FORMAT_UNKNOWN)
+            {
+                ThrowFailure(E_INVALIDARG, L"If the index buffer is null, the Index format must be DXGI_FORMAT_UNKNOWN");
+            }
+            if (!IsVertexBufferFormatSupported(triangles.VertexFormat))
+            {
+                ThrowFailure(E_INVALIDARG, L"Invalid vertex format provided. Supported is limited to DXGI_FORMAT_R32G32B32_FLOAT/DXGI_FORMAT_R32G32B32A32_FLOAT");
+            }
+        }
+        else if (geometryDesc.Type == D3D12_RAYTRACING_GEOMETRY_TYPE_PROCEDURAL_PRIMITIVE_AABBS)
+        {
+            const D3D12_RAYTRACING_GEOMETRY_AABBS_DESC &aabbs = geometryDesc.AABBs;
+            if (aabbs.AABBs.StartAddress == 0 && aabbs.AABBCount > 0)
+            {
+                ThrowFailure(E_INVALIDARG, L"Non-zero AABBCount provided with a null AABB buffer");
+            }
+        }
+        else
+        {
+            ThrowFailure(E_INVALIDARG, L"Unrecognized D3D12_RAYTRACING_GEOMETRY_TYPE");
+        }
+    }
+
+    static
+        void GetTriangleIndices(
+            const D3D12_RAYTRACING_GEOMETRY_TRIANGLES_DESC &triangles,
+            UINT triangleIndex,
+            UINT indices[3])
+    {
+        const UINT firstIndex = triangleIndex * 3;
+        switch (triangles.IndexFormat)
+        {
+        case DXGI_FORMAT_R32_UINT:
+        {
+            const UINT32 *pIndices = (const UINT32 *)triangles.IndexBuffer + firstIndex;
+            indices[0] = pIndices[0];
+            indices[1] = pIndices[1];
+            indices[2] = pIndices[2];
+            break;
+        }
+        case DXGI_FORMAT_R16_UINT:
+        {
+            const UINT16 *pIndices = (const UINT16 *)triangles.IndexBuffer + firstIndex;
+            indices[0] = pIndices[0];
+            indices[1] = pIndices[1];
+            indices[2] = pIndices[2];
+            break;
+        }
+        default:
+            indices[0] = firstIndex;
+            indices[1] = firstIndex + 1;
+            indices[2] = firstIndex + 2;
+            break;
+        }
+    }
+
+    static
+        void LoadTriangle(
+            const D3D12_RAYTRACING_GEOMETRY_TRIANGLES_DESC &triangles,
+            UINT triangleIndex,
+            Triangle &tri)
+    {
+        UINT indices[3];
+        GetTriangleIndices(triangles, triangleIndex, indices);
+
+        // Both supported vertex formats start with a float3 position
+        const BYTE *pVertexData = (const BYTE *)triangles.VertexBuffer.StartAddress;
+        for (UINT i = 0; i < 3; i++)
+        {
+            const float *pVertex = (const float *)(pVertexData + indices[i] * triangles.VertexBuffer.StrideInBytes);
+            tri.v[i] = { pVertex[0], pVertex[1], pVertex[2] };
+        }
+
+        if (triangles.Transform3x4)
+        {
+            // Row-major 3x4, same as the transform in the instance desc
+            const float *pTransform = (const float *)triangles.Transform3x4;
+            for (UINT i = 0; i < 3; i++)
+            {
+                const float3 v = tri.v[i];
+                tri.v[i].x = pTransform[0] * v.x + pTransform[1] * v.y + pTransform[2] * v.z + pTransform[3];
+                tri.v[i].y = pTransform[4] * v.x + pTransform[5] * v.y + pTransform[6] * v.z + pTransform[7];
+                tri.v[i].z = pTransform[8] * v.x + pTransform[9] * v.y + pTransform[10] * v.z + pTransform[11];
+            }
+        }
+    }
+
+    static
+        void LoadProceduralPrimitive(
+            const D3D12_RAYTRACING_GEOMETRY_AABBS_DESC &aabbs,
+            UINT aabbIndex,
+            AABB &aabb)
+    {
+        const BYTE *pAABBData = (const BYTE *)aabbs.AABBs.StartAddress;
+        aabb = *(const AABB *)(pAABBData + aabbIndex * aabbs.AABBs.StrideInBytes);
+    }
+
+    static
+        void ComputePrimitiveBox(
+            const D3D12_RAYTRACING_GEOMETRY_DESC &geometryDesc,
+            UINT primitiveIndex,
+            AABB &box)
+    {
+        if (geometryDesc.Type == D3D12_RAYTRACING_GEOMETRY_TYPE_PROCEDURAL_PRIMITIVE_AABBS)
+        {
+            LoadProceduralPrimitive(geometryDesc.AABBs, primitiveIndex, box);
+        }
+        else
+        {
+            Triangle tri;
+            LoadTriangle(geometryDesc.Triangles, primitiveIndex, tri);
+
+            const float* v0 = &tri.v0.x;
+            const float* v1 = &tri.v1.x;
+            const float* v2 = &tri.v2.x;
+            for (UINT k = 0; k < 3; ++k)
+            {
+#define AABB_Min_Padding 0.001f
+                box.minArr[k] = std::min(v2[k], std::min(v0[k], v1[k]));
+                box.maxArr[k] = std::max(v2[k], std::max(v0[k], v1[k])) + AABB_Min_Padding;
+            }
+        }
+
+        for (UINT k = 0; k < 3; ++k)
+        {
+            if (_isnan(box.minArr[k]) ||
+                _isnan(box.maxArr[k]))
+            {
+                box.minArr[k] = 0;
+                box.maxArr[k] = 0;
+            }
+        }
+    }
+
+    //
+    // Runs fn over [0, count) split across up to numThreads threads. Only used for the
+    // embarrassingly parallel load and write-out loops, which touch disjoint slots.
+    //
+
+    template<typename RangeFunction>
+    static
+        void ParallelForRange(
+            UINT count,
+            UINT numThreads,
+            RangeFunction fn)
+    {
+        const UINT numChunks = std::max(1u, std::min(numThreads, count / MIN_PRIMITIVES_PER_BINNING_TASK));
+        const UINT chunkSize = DivideAndRoundUp(count, numChunks);
+
+        std::vector<std::future<void>> chunkTasks;
+        for (UINT chunk = 1; chunk < numChunks; chunk++)
+        {
+            const UINT chunkBegin = std::min(count, chunk * chunkSize);
+            const UINT chunkEnd = std::min(count, chunkBegin + chunkSize);
+            chunkTasks.push_back(std::async(std::launch::async, [&fn, chunkBegin, chunkEnd]() { fn(chunkBegin, chunkEnd); }));
+        }
+
+        fn(0, std::min(count, chunkSize));
+
+        for (auto& chunkTask : chunkTasks)
+        {
+            chunkTask.get();
+        }
+    }
+
+    static
+        void BuildBVHFromBoxes(
+            BVH &bvh,
+            const TrackedVector<AABB> &boxes,
+            const TrackedVector<PrimitiveMetaData> &primitiveMetaData,
+            const CpuBvh2BuildSettings &settings,
+            BuildMemoryTracker *pTracker,
+            CpuBvh2SimdLevel &simdLevelUsed)
+    {
+        simdLevelUsed = CpuBvh2SimdLevel::Scalar;
+        switch (settings.BuilderType)
+        {
+        case CpuBvh2BuilderType::Serial:
+            BuildBVH(bvh, boxes, primitiveMetaData, settings.MaxPrimitivesInLeaf, pTracker);
+            break;
+        case CpuBvh2BuilderType::ParallelBinnedSah:
+            BuildBVHParallel(bvh, boxes, primitiveMetaData, settings, pTracker, simdLevelUsed);
+            break;
+        default:
+            ThrowFailure(E_INVALIDARG, L"Unrecognized CpuBvh2BuilderType");
+        }
+    }
+
+    //
+    // Treelet reordering, the CPU counterpart of FindTreelets.hlsl and TreeletReorder.hlsl
+    // (Karras & Aila, "Fast Parallel Construction of High-Quality Bounding Volume
+    // Hierarchies"). Every pass visits the nodes bottom-up, and each node with at least
+    // minLeavesPerTreelet leaf nodes below it has the topology of its treelet of
+    // FullTreeletSize nodes replaced by the one with the lowest SAH cost. The cost of a
+    // treelet leaf is the SAH cost of its whole subtree, so a pass never makes the
+    // tree worse.
+    //
+    // A treelet only touches nodes below its root, so separate subtrees are reordered
+    // on separate threads and the nodes above them afterwards. Every node is still
+    // visited after all of its descendants, so the result doesn't depend on the number
+    // of threads.
+    //
+
+    // Pulled from the same paper as the constants in TreeletReorder.hlsl
+    static const float CostOfRayBoxIntersection = 1.2f;
+    static const float CostOfRayTriangleIntersection = 1.0f;
+
+    struct TreeletNode
+    {
+        AABB    box;
+
+        // Unnormalized SAH cost of the subtree below this node
+        float   cost;
+
+        UINT32  numLeaves;
+        UINT32  leftNodeIndex;
+        UINT32  rightNodeIndex;
+        bool    leaf;
+
+        // Set once the node has been reused somewhere else in a treelet, its packed
+        // box has to be recomputed when the nodes are written out again
+        bool    modified;
+    };
+
+    static
+        UINT GetNumTreeletReorderPasses(
+            D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS buildFlags)
+    {
+        // Same policy as TreeletReorder::Optimize
+        if (buildFlags & D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_BUILD)
+        {
+            return 0;
+        }
+        else if (buildFlags & D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE)
+        {
+            return 3;
+        }
+        return 1;
+    }
+
+    static
+        UINT GetBitPermutation(
+            UINT numBitsSet,
+            UINT n)
+    {
+        // Always called with numBitsSet == [2, FullTreeletSize]
+        if (numBitsSet == FullTreeletSize)
+        {
+            return n == 0 ? FullPartitionMask : 0;
+        }
+        return BitPermutations[numBitsSet - 2][n];
+    }
+
+    static
+        bool ReorderTreelet(
+            TrackedVector<TreeletNode>& nodes,
+            UINT32 rootIndex)
+    {
+        //
+        // Form the treelet by repeatedly splitting the treelet leaf with the largest
+        // surface area. The root has at least FullTreeletSize leaves below it, so there
+        // is always an internal node left to split.
+        //
+
+        UINT32 internalNodes[NumInternalTreeletNodes];
+        UINT32 treeletToReorder[FullTreeletSize];
+        internalNodes[0] = rootIndex;
+        treeletToReorder[0] = nodes[rootIndex].leftNodeIndex;
+        treeletToReorder[1] = nodes[rootIndex].rightNodeIndex;
+
+        for (UINT treeletSize = 2; treeletSize < FullTreeletSize; treeletSize++)
+        {
+            float largestSurfaceArea = -1.0f;
+            UINT indexOfNodeToSplit = 0;
+            for (UINT i = 0; i < treeletSize; i++)
+            {
+                const TreeletNode& node = nodes[treeletToReorder[i]];
+                if (!node.leaf)
+                {
+                    const float surfaceArea = ComputeBoxSurfaceArea(node.box);
+                    if (surfaceArea > largestSurfaceArea)
+                    {
+                        largestSurfaceArea = surfaceArea;
+                        indexOfNodeToSplit = i;
+                    }
+                }
+            }
+            assert(largestSurfaceArea >= 0.0f);
+
+            const UINT32 nodeToSplit = treeletToReorder[indexOfNodeToSplit];
+            internalNodes[treeletSize - 1] = nodeToSplit;
+            treeletToReorder[indexOfNodeToSplit] = nodes[nodeToSplit].leftNodeIndex;
+            treeletToReorder[treeletSize] = nodes[nodeToSplit].rightNodeIndex;
+        }
+
+        //
+        // Dynamic programming over every subset of the treelet leaves, from subsets of
+        // size 2 up to the full treelet
+        //
+
+        AABB subsetBoxes[NumTreeletSplitPermutations];
+        float optimalCost[NumTreeletSplitPermutations];
+        BYTE optimalPartition[NumTreeletSplitPermutations];
+
+        for (UINT i = 0; i < FullTreeletSize; i++)
+        {
+            const TreeletNode& node = nodes[treeletToReorder[i]];
+            subsetBoxes[BIT(i)] = node.box;
+            optimalCost[BIT(i)] = node.cost;
+        }
+
+        for (UINT treeletBitmask = 1; treeletBitmask < NumTreeletSplitPermutations; treeletBitmask++)
+        {
+            const UINT lowestBit = treeletBitmask & (0u - treeletBitmask);
+            if (lowestBit != treeletBitmask)
+            {
+                subsetBoxes[treeletBitmask] = subsetBoxes[lowestBit];
+                AddExtentToBox(subsetBoxes[treeletBitmask], subsetBoxes[treeletBitmask ^ lowestBit]);
+            }
+        }
+
+        for (UINT subsetSize = 2; subsetSize <= FullTreeletSize; subsetSize++)
+        {
+            for (UINT i = 0; i < FullTreeletSizeChoose[subsetSize]; i++)
+            {
+                const UINT treeletBitmask = GetBitPermutation(subsetSize, i);
+
+                float lowestCost = FLT_MAX;
+                UINT bestPartition = 0;
+
+                const UINT delta = (treeletBitmask - 1) & treeletBitmask;
+                UINT partitionBitmask = (0u - delta) & treeletBitmask;
+                do
+                {
+                    const float cost = optimalCost[partitionBitmask] + optimalCost[treeletBitmask ^ partitionBitmask];
+                    if (cost < lowestCost)
+                    {
+                        lowestCost = cost;
+                        bestPartition = partitionBitmask;
+                    }
+                    partitionBitmask = (partitionBitmask - delta) & treeletBitmask;
+                } while (partitionBitmask != 0);
+
+                optimalCost[treeletBitmask] = CostOfRayBoxIntersection * ComputeBoxSurfaceArea(subsetBoxes[treeletBitmask]) + lowestCost;
+                optimalPartition[treeletBitmask] = (BYTE)bestPartition;
+            }
+        }
+
+        // The current topology is one of the candidates, only reform if it's beaten
+        if (!(optimalCost[FullPartitionMask] < nodes[rootIndex].cost))
+        {
+            return false;
+        }
+
+        //
+        // Reform the treelet, reusing its internal nodes
+        //
+
+        struct PartitionEntry
+        {
+            UINT Mask;
+            UINT32 NodeIndex;
+        };
+        UINT nodesAllocated = 1;
+        UINT partitionStackSize = 1;
+        PartitionEntry partitionStack[FullTreeletSize];
+        partitionStack[0] = { FullPartitionMask, rootIndex };
+
+        while (partitionStackSize > 0)
+        {
+            const PartitionEntry partition = partitionStack[--partitionStackSize];
+
+            PartitionEntry children[2];
+            children[0].Mask = optimalPartition[partition.Mask];
+            children[1].Mask = partition.Mask ^ children[0].Mask;
+
+            UINT32 numLeaves = 0;
+            for (PartitionEntry& child : children)
+            {
+                if (child.Mask & (child.Mask - 1))
+                {
+                    child.NodeIndex = internalNodes[nodesAllocated++];
+                    partitionStack[partitionStackSize++] = child;
+                }
+                else
+                {
+                    UINT leafIndex = 0;
+                    while (!(child.Mask & BIT(leafIndex)))
+                    {
+                        leafIndex++;
+                    }
+                    child.NodeIndex = treeletToReorder[leafIndex];
+                }
+            }
+
+            TreeletNode& node = nodes[partition.NodeIndex];
+            node.box = subsetBoxes[partition.Mask];
+            node.cost = optimalCost[partition.Mask];
+            node.leftNodeIndex = children[0].NodeIndex;
+            node.rightNodeIndex = children[1].NodeIndex;
+            node.modified = true;
+
+            for (UINT i = 0; i < FullTreeletSize; i++)
+            {
+                if (partition.Mask & BIT(i))
+                {
+                    numLeaves += nodes[treeletToReorder[i]].numLeaves;
+                }
+            }
+            node.numLeaves = numLeaves;
+        }
+
+        return true;
+    }
+
+    struct TreeletStackEntry
+    {
+        UINT32 nodeIndex;
+        bool   childrenVisited;
+    };
+
+    //
+    // Reorders every treelet rooted in the subtree below rootIndex, children first.
+    // Children with at most maxLeavesToSkip leaves are left alone, they're the roots
+    // of subtrees that were already reordered.
+    //
+
+    static
+        UINT ReorderSubtree(
+            TrackedVector<TreeletNode>& nodes,
+            UINT32 rootIndex,
+            UINT32 minLeavesPerTreelet,
+            UINT32 maxLeavesToSkip,
+            TrackedVector<TreeletStackEntry>& stack)
+    {
+        UINT numReordered = 0;
+        stack.clear();
+        stack.push_back({ rootIndex, false });
+        while (!stack.empty())
+        {
+            const TreeletStackEntry entry = stack.back();
+            stack.pop_back();
+
+            TreeletNode& node = nodes[entry.nodeIndex];
+            if (!entry.childrenVisited)
+            {
+                stack.push_back({ entry.nodeIndex, true });
+                for (UINT32 childIndex : { node.leftNodeIndex, node.rightNodeIndex })
+                {
+                    const TreeletNode& child = nodes[childIndex];
+                    // Subtrees with too few leaves can't contain a treelet
+                    if (!child.leaf && child.numLeaves >= minLeavesPerTreelet && child.numLeaves > maxLeavesToSkip)
+                    {
+                        stack.push_back({ childIndex, false });
+                    }
+                }
+                continue;
+            }
+
+            // Children may have been reordered since this node's cost was computed
+            node.cost = CostOfRayBoxIntersection * ComputeBoxSurfaceArea(node.box) +
+                nodes[node.leftNodeIndex].cost + nodes[node.rightNodeIndex].cost;
+
+            if (ReorderTreelet(nodes, entry.nodeIndex))
+            {
+                numReordered++;
+            }
+        }
+        return numReordered;
+    }
+
+    static
+        void OptimizeBVHWithTreeletReorder(
+            BVH& bvh,
+            const TrackedVector<AABB>& boxes,
+            UINT numPasses,
+            const CpuBvh2BuildSettings& settings,
+            BuildMemoryTracker* pTracker)
+    {
+        const UINT32 numNodes = (UINT32)bvh.m_nodes.size();
+        if (numPasses == 0 || numNodes < 2 * FullTreeletSize - 1)
+        {
+            return;
+        }
+
+        //
+        // Unpack the nodes. Children are always stored after their parent, so a reverse
+        // sweep visits them first.
+        //
+
+        TrackedVector<TreeletNode> nodes(numNodes, TreeletNode(), TrackingAllocator<TreeletNode>(pTracker));
+        for (UINT32 i = numNodes; i-- > 0;)
+        {
+            const AABBNode& packedNode = bvh.m_nodes[i];
+            TreeletNode& node = nodes[i];
+            node.modified = false;
+            node.leaf = packedNode.leaf != 0;
+            if (node.leaf)
+            {
+                const UINT32 firstPrimitive = packedNode.leafNode.firstTriangleId;
+                const UINT32 numPrimitives = packedNode.leafNode.numTriangleIds;
+                node.box = boxes[bvh.m_metadata[firstPrimitive].PrimitiveIndex];
+                for (UINT32 j = 1; j < numPrimitives; j++)
+                {
+                    AddExtentToBox(node.box, boxes[bvh.m_metadata[firstPrimitive + j].PrimitiveIndex]);
+                }
+                node.cost = CostOfRayTriangleIntersection * ComputeBoxSurfaceArea(node.box) * numPrimitives;
+                node.numLeaves = 1;
+                node.leftNodeIndex = node.rightNodeIndex = 0;
+            }
+            else
+            {
+                node.leftNodeIndex = packedNode.internalNode.leftNodeIndex;
+                node.rightNodeIndex = packedNode.rightNodeIndex;
+                const TreeletNode& left = nodes[node.leftNodeIndex];
+                const TreeletNode& right = nodes[node.rightNodeIndex];
+                node.box = left.box;
+                AddExtentToBox(node.box, right.box);
+                node.cost = CostOfRayBoxIntersection * ComputeBoxSurfaceArea(node.box) + left.cost + right.cost;
+                node.numLeaves = left.numLeaves + right.numLeaves;
+            }
+        }
+
+        //
+        // Like the GPU path, each pass only forms treelets around nodes with twice as
+        // many leaves as the previous one
+        //
+
+        const UINT numThreads = GetNumBuildThreads(settings);
+        TrackedVector<UINT32> subtreeRoots(pTracker);
+        TrackedVector<TreeletStackEntry> topStack(pTracker);
+        UINT numReordered = 0;
+        UINT32 minLeavesPerTreelet = FullTreeletSize;
+        for (UINT pass = 0; pass < numPasses && minLeavesPerTreelet <= nodes[0].numLeaves; pass++, minLeavesPerTreelet *= 2)
+        {
+            // Hand out subtrees small enough to balance well, the nodes above them are
+            // reordered on this thread once all subtrees are done
+            const UINT32 maxLeavesPerSubtree = nodes[0].numLeaves / (numThreads * 4);
+            const bool bSplitIntoSubtrees = numThreads > 1;
+            subtreeRoots.clear();
+            if (bSplitIntoSubtrees)
+            {
+                topStack.clear();
+                topStack.push_back({ 0, false });
+                while (!topStack.empty())
+                {
+                    const TreeletNode& node = nodes[topStack.back().nodeIndex];
+                    topStack.pop_back();
+                    for (UINT32 childIndex : { node.leftNodeIndex, node.rightNodeIndex })
+                    {
+                        const TreeletNode& child = nodes[childIndex];
+                        if (child.leaf || child.numLeaves < minLeavesPerTreelet)
+                        {
+                            continue;
+                        }
+                        if (child.numLeaves > maxLeavesPerSubtree)
+                        {
+                            topStack.push_back({ childIndex, false });
+                        }
+                        else
+                        {
+                            subtreeRoots.push_back(childIndex);
+                        }
+                    }
+                }
+            }
+
+            std::atomic<UINT> nextSubtree(0);
+            std::atomic<UINT> numReorderedInSubtrees(0);
+            auto reorderSubtrees = [&]()
+            {
+                TrackedVector<TreeletStackEntry> stack(pTracker);
+                UINT numReorderedOnThread = 0;
+                for (UINT subtree = nextSubtree++; subtree < subtreeRoots.size(); subtree = nextSubtree++)
+                {
+                    numReorderedOnThread += ReorderSubtree(nodes, subtreeRoots[subtree], minLeavesPerTreelet, 0, stack);
+                }
+                numReorderedInSubtrees += numReorderedOnThread;
+            };
+
+            std::vector<std::future<void>> workers;
+            for (UINT thread = 1; thread < std::min<UINT>(numThreads, (UINT)subtreeRoots.size()); thread++)
+            {
+                workers.push_back(std::async(std::launch::async, reorderSubtrees));
+            }
+            reorderSubtrees();
+            for (auto& worker : workers)
+            {
+                worker.get();
+            }
+
+            numReordered += numReorderedInSubtrees;
+            numReordered += ReorderSubtree(nodes, 0, minLeavesPerTreelet, bSplitIntoSubtrees ? maxLeavesPerSubtree : 0, topStack);
+        }
+
+        if (numReordered == 0)
+        {
+            return;
+        }
+
+        //
+        // Write the nodes back in the order the builders emit them: the right child
+        // directly follows its parent and the left child comes after the right subtree.
+        // Leaves and untouched internal nodes keep their packed boxes.
+        //
+
+        struct EmitEntry
+        {
+            UINT32 nodeIndex;
+            UINT32 parentIndex;
+            bool   right;
+        };
+
+        TrackedVector<AABBNode> reorderedNodes(numNodes, AABBNode(), TrackingAllocator<AABBNode>(pTracker));
+        TrackedVector<EmitEntry> stack(pTracker);
+        stack.push_back({ 0, (UINT32)-1, false });
+        UINT32 numNodesEmitted = 0;
+        while (!stack.empty())
+        {
+            const EmitEntry entry = stack.back();
+            stack.pop_back();
+
+            const UINT32 nodeIndex = numNodesEmitted++;
+            const TreeletNode& node = nodes[entry.nodeIndex];
+            AABBNode& packedNode = reorderedNodes[nodeIndex];
+            if (node.modified)
+            {
+                CompressAABB(packedNode, node.box);
+                packedNode.nodeAllBits = 0;
+                packedNode.rightNodeIndex = 0;
+            }
+            else
+            {
+                packedNode = bvh.m_nodes[entry.nodeIndex];
+            }
+
+            if (entry.parentIndex != (UINT32)-1)
+            {
+                AABBNode& parent = reorderedNodes[entry.parentIndex];
+                if (entry.right)
+                {
+                    parent.rightNodeIndex = nodeIndex;
+                }
+                else
+                {
+                    parent.internalNode.leftNodeIndex = nodeIndex;
+                }
+            }
+
+            if (!node.leaf)
+            {
+                stack.push_back({ node.leftNodeIndex, nodeIndex, false });
+                stack.push_back({ node.rightNodeIndex, nodeIndex, true });
+            }
+        }
+        assert(numNodesEmitted == numNodes);
+
+        bvh.m_nodes.swap(reorderedNodes);
+    }
+
+    void BuildUniformBVH(
+        _In_  const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS &inputs,
+        const CpuBvh2BuildSettings &settings,
+        BuildMemoryTracker *pTracker,
+        BVH &bvh,
+        TrackedVector<UINT> &geometryPrimitiveOffsets,
+        CpuBvh2SimdLevel &simdLevelUsed)
+    {
+        //
+        // Compute number of primitives
+        //
+
+        geometryPrimitiveOffsets.resize(inputs.NumDescs + 1);
+
+        UINT    totalNumberOfPrimitives = 0;
+
+        for (UINT i = 0; i < inputs.NumDescs; ++i)
+        {
+            const D3D12_RAYTRACING_GEOMETRY_DESC &geometry = GetGeometryDesc(inputs, i);
+            ValidateGeometryDesc(geometry);
+
+            geometryPrimitiveOffsets[i] = totalNumberOfPrimitives;
+            totalNumberOfPrimitives += GetPrimitiveCountFromGeometryDesc(geometry);
+        }
+        geometryPrimitiveOffsets[inputs.NumDescs] = totalNumberOfPrimitives;
+
+        //
+        // Create AABBs. Until the primitives are written out, PrimitiveIndex holds the
+        // index across all geometries so the builders can use it to look up boxes.
+        //
+
+        TrackedVector<AABB> boxes(pTracker);
+        boxes.resize(totalNumberOfPrimitives);
+
+        TrackedVector<PrimitiveMetaData> primitiveMetaData(pTracker);
+        primitiveMetaData.resize(totalNumberOfPrimitives);
+
+        const UINT numThreads = GetNumBuildThreads(settings);
+        for (UINT i = 0; i < inputs.NumDescs; ++i)
+        {
+            const D3D12_RAYTRACING_GEOMETRY_DESC &geometry = GetGeometryDesc(inputs, i);
+            const UINT primitiveOffset = geometryPrimitiveOffsets[i];
+            const UINT numPrimitives = geometryPrimitiveOffsets[i + 1] - primitiveOffset;
+
+            ParallelForRange(numPrimitives, numThreads, [&](UINT begin, UINT end)
+            {
+                for (UINT j = begin; j < end; ++j)
+                {
+                    ComputePrimitiveBox(geometry, j, boxes[primitiveOffset + j]);
+
+                    PrimitiveMetaData &metadata = primitiveMetaData[primitiveOffset + j];
+                    metadata.GeometryContributionToHitGroupIndex = i;
+                    metadata.PrimitiveIndex = primitiveOffset + j;
+                    metadata.GeometryFlags = geometry.Flags;
+                }
+            });
+        }
+
+        //
+        // Create a BVH
+        //
+
+        BuildBVHFromBoxes(bvh, boxes, primitiveMetaData, settings, pTracker, simdLevelUsed);
+
+        // Only bottom levels are reordered, matching GpuBvh2Builder::SupportsTreeletReordering.
+        // The serial builder's output is left exactly as it was.
+        if (settings.BuilderType == CpuBvh2BuilderType::ParallelBinnedSah)
+        {
+            OptimizeBVHWithTreeletReorder(bvh, boxes, GetNumTreeletReorderPasses(inputs.Flags), settings, pTracker);
+        }
+    }
+
+    //
+    // Fetches every primitive again in BVH order straight into the output, and turns
+    // PrimitiveIndex back into the index within its geometry like the GPU builder does
+    //
+
+    void WritePrimitives(
+        _In_  const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS &inputs,
+        const CpuBvh2BuildSettings &settings,
+        const TrackedVector<UINT> &geometryPrimitiveOffsets,
+        TrackedVector<PrimitiveMetaData> &metadata,
+        _Out_writes_(metadata.size()) Primitive *pPrimitives)
+    {
+        ParallelForRange((UINT)metadata.size(), GetNumBuildThreads(settings), [&](UINT begin, UINT end)
+        {
+            for (UINT i = begin; i < end; i++)
+            {
+                const UINT globalIndex = metadata[i].PrimitiveIndex;
+                const UINT geometryIndex = (UINT)(std::upper_bound(geometryPrimitiveOffsets.begin(), geometryPrimitiveOffsets.end(), globalIndex) - geometryPrimitiveOffsets.begin()) - 1;
+                const UINT localIndex = globalIndex - geometryPrimitiveOffsets[geometryIndex];
+                const D3D12_RAYTRACING_GEOMETRY_DESC &geometry = GetGeometryDesc(inputs, geometryIndex);
+
+                Primitive &primitive = pPrimitives[i];
+                if (geometry.Type == D3D12_RAYTRACING_GEOMETRY_TYPE_PROCEDURAL_PRIMITIVE_AABBS)
+                {
+                    primitive.PrimitiveType = PROCEDURAL_PRIMITIVE_TYPE;
+                    memset(&primitive.triangle, 0, sizeof(primitive.triangle));
+                    LoadProceduralPrimitive(geometry.AABBs, localIndex, primitive.aabb);
+                }
+                else
+                {
+                    primitive.PrimitiveType = TRIANGLE_TYPE;
+                    LoadTriangle(geometry.Triangles, localIndex, primitive.triangle);
+                }
+
+                metadata[i].GeometryContributionToHitGroupIndex = geometryIndex;
+                metadata[i].PrimitiveIndex = localIndex;
+                metadata[i].GeometryFlags = geometry.Flags;
+            }
+        });
+    }
+
+    //
+    // Top-level builder. Leaves reference instances and the output follows the GPU
+    // top-level layout: leaf flags hold an index into the BVHMetadata array after the
+    // nodes, and each instance desc is stored with its WorldToObject transform while
+    // ObjectToWorld is kept alongside, like TopLevelLoadAABBs.hlsl does.
+    //
+
+    static
+        void InverseAffineTransform(
+            const float objectToWorld[3][4],
+            float worldToObject[3][4])
+    {
+        const float (*m)[4] = objectToWorld;
+        const float cofactors[3][3] =
+        {
+            { m[1][1] * m[2][2] - m[1][2] * m[2][1], m[0][2] * m[2][1] - m[0][1] * m[2][2], m[0][1] * m[1][2] - m[0][2] * m[1][1] },
+            { m[1][2] * m[2][0] - m[1][0] * m[2][2], m[0][0] * m[2][2] - m[0][2] * m[2][0], m[0][2] * m[1][0] - m[0][0] * m[1][2] },
+            { m[1][0] * m[2][1] - m[1][1] * m[2][0], m[0][1] * m[2][0] - m[0][0] * m[2][1], m[0][0] * m[1][1] - m[0][1] * m[1][0] },
+        };
+        const float determinant = m[0][0] * cofactors[0][0] + m[0][1] * cofactors[1][0] + m[0][2] * cofactors[2][0];
+        const float inverseDeterminant = determinant != 0.0f ? 1.0f / determinant : 0.0f;
+
+        for (UINT row = 0; row < 3; row++)
+        {
+            for (UINT column = 0; column < 3; column++)
+            {
+                worldToObject[row][column] = cofactors[row][column] * inverseDeterminant;
+            }
+            worldToObject[row][3] = -(worldToObject[row][0] * m[0][3] + worldToObject[row][1] * m[1][3] + worldToObject[row][2] * m[2][3]);
+        }
+    }
+
+    static
+        void TransformAABB(
+            const AABB &box,
+            const float transform[3][4],
+            AABB &transformedBox)
+    {
+        // Transform the center and take the absolute value of the rotation/scale
+        // for the extents, which bounds all 8 transformed corners exactly
+        for (UINT row = 0; row < 3; row++)
+        {
+            float center = transform[row][3];
+            float extent = 0.0f;
+            for (UINT column = 0; column < 3; column++)
+            {
+                center += transform[row][column] * (box.maxArr[column] + box.minArr[column]) * 0.5f;
+                extent += fabsf(transform[row][column]) * (box.maxArr[column] - box.minArr[column]) * 0.5f;
+            }
+            transformedBox.minArr[row] = center - extent;
+            transformedBox.maxArr[row] = center + extent;
+        }
+    }
+
+    static
+        const D3D12_RAYTRACING_INSTANCE_DESC &GetInstanceDesc(
+            const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS &inputs,
+            UINT instanceIndex)
+    {
+        switch (inputs.DescsLayout)
+        {
+        case D3D12_ELEMENTS_LAYOUT_ARRAY:
+            return ((const D3D12_RAYTRACING_INSTANCE_DESC *)inputs.InstanceDescs)[instanceIndex];
+        case D3D12_ELEMENTS_LAYOUT_ARRAY_OF_POINTERS:
+            return *((const D3D12_RAYTRACING_INSTANCE_DESC *const *)inputs.InstanceDescs)[instanceIndex];
+        default:
+            ThrowFailure(E_INVALIDARG, L"Unexpected value for D3D12_ELEMENTS_LAYOUT");
+            return *(D3D12_RAYTRACING_INSTANCE_DESC *)nullptr;
+        }
+    }
+
+    static
+        void ComputeInstanceBox(
+            const D3D12_RAYTRACING_INSTANCE_DESC &instanceDesc,
+            AABB &box)
+    {
+        if (instanceDesc.AccelerationStructure == 0)
+        {
+            ThrowFailure(E_INVALIDARG, L"Instance descs must reference a bottom-level acceleration structure");
+        }
+
+        // The root box of the bottom level is always the first node
+        const BYTE *pBottomLevel = (const BYTE *)instanceDesc.AccelerationStructure;
+        const BVHOffsets &offsets = *(const BVHOffsets *)pBottomLevel;
+        AABB objectBox;
+        DecompressAABB(objectBox, *(const AABBNode *)(pBottomLevel + offsets.offsetToBoxes));
+
+        TransformAABB(objectBox, instanceDesc.Transform, box);
+    }
+
+    static
+        void StoreInstanceMetadata(
+            const D3D12_RAYTRACING_INSTANCE_DESC &instanceDesc,
+            UINT instanceIndex,
+            BVHMetadata &metadata)
+    {
+        static_assert(sizeof(instanceDesc) == sizeof(metadata.instanceDesc), "Instance desc layouts must match");
+        memcpy(&metadata.instanceDesc, &instanceDesc, sizeof(instanceDesc));
+        memcpy(metadata.ObjectToWorld, instanceDesc.Transform, sizeof(instanceDesc.Transform));
+        InverseAffineTransform(instanceDesc.Transform, metadata.instanceDesc.Transform);
+        metadata.InstanceIndex = instanceIndex;
+    }
+
+    static
+        bool IsTopLevelLeaf(
+            const AABBNode &node)
+    {
+        return node.leaf != 0;
+    }
+
+    static
+        UINT GetTopLevelLeafIndex(
+            const AABBNode &node)
+    {
+        // Matches GetLeafIndexFromFlag, the index uses every bit below the leaf flags
+        return node.nodeAllBits & 0x3fffffff;
+    }
+
+    void BuildTopLevelBVH(
+        _In_  const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS &inputs,
+        const CpuBvh2BuildSettings &settings,
+        BuildMemoryTracker *pTracker,
+        BVH &bvh,
+        CpuBvh2SimdLevel &simdLevelUsed)
+    {
+        const UINT numInstances = inputs.NumDescs;
+        if (numInstances && inputs.InstanceDescs == 0)
+        {
+            ThrowFailure(E_INVALIDARG, L"Non-zero NumDescs provided with null InstanceDescs");
+        }
+
+        TrackedVector<AABB> boxes(numInstances, AABB(), TrackingAllocator<AABB>(pTracker));
+        TrackedVector<PrimitiveMetaData> instanceMetaData(numInstances, PrimitiveMetaData(), TrackingAllocator<PrimitiveMetaData>(pTracker));
+
+        ParallelForRange(numInstances, GetNumBuildThreads(settings), [&](UINT begin, UINT end)
+        {
+            for (UINT i = begin; i < end; i++)
+            {
+                ComputeInstanceBox(GetInstanceDesc(inputs, i), boxes[i]);
+                instanceMetaData[i].PrimitiveIndex = i;
+            }
+        });
+
+        // The traversal expects exactly one instance per top-level leaf
+        CpuBvh2BuildSettings topLevelSettings = settings;
+        topLevelSettings.MaxPrimitivesInLeaf = 1;
+        BuildBVHFromBoxes(bvh, boxes, instanceMetaData, topLevelSettings, pTracker, simdLevelUsed);
+    }
+
+    //
+    // Writes the top level in the GPU layout. Returns the number of nodes written.
+    //
+
+    UINT WriteTopLevelBVH(
+        _In_  const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS &inputs,
+        const CpuBvh2BuildSettings &settings,
+        const BVH &bvh,
+        _Out_ BYTE *pOutputData)
+    {
+        const UINT numInstances = inputs.NumDescs;
+        const UINT numNodes = numInstances ? (UINT)bvh.m_nodes.size() : 1;
+
+        BVHOffsets offsets;
+        offsets.offsetToBoxes = sizeof(BVHOffsets);
+
+        // offsetToVertices doubles as the offset to the leaf node metadata on the top level
+        offsets.offsetToVertices = offsets.offsetToBoxes + numNodes * sizeof(AABBNode);
+        offsets.offsetToPrimitiveMetaData = offsets.offsetToVertices;
+        offsets.totalSize = offsets.offsetToVertices + numInstances * sizeof(BVHMetadata);
+        memcpy(pOutputData, &offsets, sizeof(offsets));
+
+        AABBNode *pNodes = (AABBNode *)(pOutputData + offsets.offsetToBoxes);
+        if (numInstances == 0)
+        {
+            // Same as the GPU builder, an empty acceleration structure is a single zeroed box
+            memset(pNodes, 0, sizeof(AABBNode));
+            return numNodes;
+        }
+
+        memcpy(pNodes, bvh.m_nodes.data(), numNodes * sizeof(AABBNode));
+        for (UINT i = 0; i < numNodes; i++)
+        {
+            if (IsTopLevelLeaf(pNodes[i]))
+            {
+                const UINT leafIndex = pNodes[i].leafNode.firstTriangleId;
+                pNodes[i].nodeAllBits = leafIndex;
+                pNodes[i].leaf = true;
+                pNodes[i].numTriangles = 1;
+            }
+        }
+
+        BVHMetadata *pMetadata = (BVHMetadata *)(pOutputData + offsets.offsetToVertices);
+        ParallelForRange(numInstances, GetNumBuildThreads(settings), [&](UINT begin, UINT end)
+        {
+            for (UINT leafIndex = begin; leafIndex < end; leafIndex++)
+            {
+                const UINT instanceIndex = bvh.m_metadata[leafIndex].PrimitiveIndex;
+                StoreInstanceMetadata(GetInstanceDesc(inputs, instanceIndex), instanceIndex, pMetadata[leafIndex]);
+            }
+        });
+        return numNodes;
+    }
+
+    //
+    // PERFORM_UPDATE on the top level keeps the hierarchy and only refits it: the leaf
+    // boxes are recomputed from the (possibly changed) instance transforms and bottom
+    // levels, then internal boxes are rebuilt bottom-up. Children are always stored
+    // after their parent, so a single reverse sweep over the nodes suffices.
+    //
+
+    UINT RefitTopLevelBVH(
+        _In_  const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS &inputs,
+        const CpuBvh2BuildSettings &settings,
+        _In_  const BYTE *pSourceData,
+        BuildMemoryTracker *pTracker,
+        _Inout_ BYTE *pOutputData)
+    {
+        if ((inputs.Flags & D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_UPDATE) == 0)
+        {
+            ThrowFailure(E_INVALIDARG, L"D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PERFORM_UPDATE requires D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_UPDATE");
+        }
+        if (pSourceData == nullptr)
+        {
+            ThrowFailure(E_INVALIDARG, L"SourceAccelerationStructureData must be non-zero when performing an update");
+        }
+
+        const BVHOffsets offsets = *(const BVHOffsets *)pSourceData;
+        const UINT numInstances = (offsets.totalSize - offsets.offsetToVertices) / sizeof(BVHMetadata);
+        if (numInstances != inputs.NumDescs)
+        {
+            ThrowFailure(E_INVALIDARG, L"Updates must use the same number of instances as the source acceleration structure");
+        }
+
+        if (pSourceData != pOutputData)
+        {
+            memcpy(pOutputData, pSourceData, offsets.totalSize);
+        }
+
+        const UINT numNodes = (offsets.offsetToVertices - offsets.offsetToBoxes) / sizeof(AABBNode);
+        if (numInstances == 0)
+        {
+            return numNodes;
+        }
+
+        AABBNode *pNodes = (AABBNode *)(pOutputData + offsets.offsetToBoxes);
+        BVHMetadata *pMetadata = (BVHMetadata *)(pOutputData + offsets.offsetToVertices);
+
+        TrackedVector<AABB> leafBoxes(numInstances, AABB(), TrackingAllocator<AABB>(pTracker));
+        ParallelForRange(numInstances, GetNumBuildThreads(settings), [&](UINT begin, UINT end)
+        {
+            for (UINT leafIndex = begin; leafIndex < end; leafIndex++)
+            {
+                const UINT instanceIndex = pMetadata[leafIndex].InstanceIndex;
+                const D3D12_RAYTRACING_INSTANCE_DESC &instanceDesc = GetInstanceDesc(inputs, instanceIndex);
+                ComputeInstanceBox(instanceDesc, leafBoxes[leafIndex]);
+                StoreInstanceMetadata(instanceDesc, instanceIndex, pMetadata[leafIndex]);
+            }
+        });
+
+        for (UINT i = numNodes; i-- > 0;)
+        {
+            AABBNode &node = pNodes[i];
+            if (IsTopLevelLeaf(node))
+            {
+                CompressAABB(node, leafBoxes[GetTopLevelLeafIndex(node)]);
+            }
+            else
+            {
+                AABB box, rightBox;
+                DecompressAABB(box, pNodes[node.internalNode.leftNodeIndex]);
+                DecompressAABB(rightBox, pNodes[node.rightNodeIndex]);
+                AddExtentToBox(box, rightBox);
+                CompressAABB(node, box);
+            }
+        }
+        return numNodes;
+    }
+
+    //
+    // SAH cost of the written nodes normalized to the root, using the same intersection
+    // costs as the treelet reorder
+    //
+
+    static
+        float ComputeSahCost(
+            const AABBNode *pNodes,
+            UINT numNodes,
+            bool bTopLevel)
+    {
+        if (numNodes == 0)
+        {
+            return 0.0f;
+        }
+
+        AABB rootBox;
+        DecompressAABB(rootBox, pNodes[0]);
+        const float rootSurfaceArea = ComputeBoxSurfaceArea(rootBox);
+        if (!(rootSurfaceArea > 0.0f))
+        {
+            return 0.0f;
+        }
+
+        double cost = 0.0;
+        for (UINT i = 0; i < numNodes; i++)
+        {
+            AABB box;
+            DecompressAABB(box, pNodes[i]);
+            const float surfaceArea = ComputeBoxSurfaceArea(box);
+            if (pNodes[i].leaf)
+            {
+                // Top-level leaf flags hold an instance index rather than a primitive count
+                const UINT numPrimitives = bTopLevel ? 1 : pNodes[i].leafNode.numTriangleIds;
+                cost += CostOfRayTriangleIntersection * surfaceArea * numPrimitives;
+            }
+            else
+            {
+                cost += CostOfRayBoxIntersection * surfaceArea;
+            }
+        }
+        return (float)(cost / rootSurfaceArea);
+    }
+
+    static
+        void GetBuildStats(
+            const BuildMemoryTracker &tracker,
+            const AABBNode *pNodes,
+            UINT numNodes,
+            bool bTopLevel,
+            CpuBvh2SimdLevel simdLevelUsed,
+            CpuBvh2BuildStats &stats)
+    {
+        stats.NumHeapAllocations = tracker.GetNumAllocations();
+        stats.PeakMemoryInBytes = tracker.GetPeakBytes();
+        stats.NumNodes = numNodes;
+        stats.NumLeaves = (UINT)std::count_if(pNodes, pNodes + numNodes, [](const AABBNode& node) { return node.leaf != 0; });
+        stats.SimdLevel = simdLevelUsed;
+        stats.SahCost = ComputeSahCost(pNodes, numNodes, bTopLevel);
+        stats.NumQuantizedNodes = 0;
+        stats.Bvh4SahCost = 0.0f;
+        stats.QuantizedSahCost = 0.0f;
+    }
+
+    //
+    // QuantizedBvh4 output, see CpuBvh2Builder.h for the layout
+    //
+
+    static const UINT MaxQuantizedBvh4Value = 255;
+
+    // Largest and smallest exponents whose power of two is a normal float
+    static const int MinQuantizedBvh4Exponent = -126;
+    static const int MaxQuantizedBvh4Exponent = 127;
+
+    void DecodeQuantizedBvh4ChildBox(const QuantizedBvh4Node &node, UINT child, AABB &box)
+    {
+        for (UINT axis = 0; axis < 3; axis++)
+        {
+            const float scale = ldexpf(1.0f, node.exponent[axis]);
+            box.minArr[axis] = node.origin[axis] + node.childMin[axis][child] * scale;
+            box.maxArr[axis] = node.origin[axis] + node.childMax[axis][child] * scale;
+        }
+    }
+
+    bool IsQuantizedBvh4(const BYTE *pBottomLevel)
+    {
+        const BVHOffsets &offsets = *(const BVHOffsets *)pBottomLevel;
+        const AABBNode &root = *(const AABBNode *)(pBottomLevel + offsets.offsetToBoxes);
+        return root.nodeAllBits == QuantizedBvh4RootFlags;
+    }
+
+    static
+        UINT GetQuantizedBvh4LeafPrimitiveCount(
+            UINT childFlags)
+    {
+        return (childFlags >> 24) & 0x7f;
+    }
+
+    //
+    // Picks the smallest power of two scale that covers the node's extent in 255 steps
+    // and rounds every child bound outwards. Bounds are decoded with the same float
+    // math traversal uses and nudged until they contain the fp32 box.
+    //
+
+    static
+        void EncodeQuantizedBvh4Node(
+            const AABB *pChildBoxes,
+            const UINT *pChildFlags,
+            UINT numChildren,
+            QuantizedBvh4Node &node)
+    {
+        node = {};
+        node.numChildren = (UINT8)numChildren;
+
+        AABB nodeBox = pChildBoxes[0];
+        for (UINT child = 0; child < numChildren; child++)
+        {
+            node.childFlags[child] = pChildFlags[child];
+            AddExtentToBox(nodeBox, pChildBoxes[child]);
+        }
+
+        for (UINT axis = 0; axis < 3; axis++)
+        {
+            const float origin = nodeBox.minArr[axis];
+            const float extent = nodeBox.maxArr[axis] - origin;
+
+            int exponent = MinQuantizedBvh4Exponent;
+            if (extent > 0.0f)
+            {
+                frexpf(extent / MaxQuantizedBvh4Value, &exponent);
+                exponent = std::max(exponent, MinQuantizedBvh4Exponent);
+            }
+            while (exponent < MaxQuantizedBvh4Exponent && origin + MaxQuantizedBvh4Value * ldexpf(1.0f, exponent) < nodeBox.maxArr[axis])
+            {
+                exponent++;
+            }
+            const float scale = ldexpf(1.0f, exponent);
+
+            node.origin[axis] = origin;
+            node.exponent[axis] = (INT8)exponent;
+            for (UINT child = 0; child < numChildren; child++)
+            {
+                const float childMin = pChildBoxes[child].minArr[axis];
+                const float childMax = pChildBoxes[child].maxArr[axis];
+
+                UINT quantizedMin = (UINT)std::min(std::max(floorf((childMin - origin) / scale), 0.0f), (float)MaxQuantizedBvh4Value);
+                while (quantizedMin > 0 && origin + quantizedMin * scale > childMin)
+                {
+                    quantizedMin--;
+                }
+
+                UINT quantizedMax = (UINT)std::min(std::max(ceilf((childMax - origin) / scale), 0.0f), (float)MaxQuantizedBvh4Value);
+                while (quantizedMax < MaxQuantizedBvh4Value && origin + quantizedMax * scale < childMax)
+                {
+                    quantizedMax++;
+                }
+
+                node.childMin[axis][child] = (UINT8)quantizedMin;
+                node.childMax[axis][child] = (UINT8)quantizedMax;
+            }
+        }
+    }
+
+    //
+    // Picks which binary nodes become 4-wide nodes with the SAH. Opening a binary
+    // node into its parent saves a node visit but adds a child, so bottom up, every
+    // node gets the cheapest cost of its subtree when it's split into at most
+    // 1..QuantizedBvh4Width children. A greedy top-down collapse leaves many nodes
+    // with only two leaves in them, this keeps nearly every node full.
+    //
+
+    struct Bvh4CollapseCost
+    {
+        // cost[k] is the cheapest way to turn the subtree into at most k + 1
+        // children, numLeftChildren[k] how many of them come from the left child,
+        // 0 if the node is kept as a single child
+        float cost[QuantizedBvh4Width];
+        UINT8 numLeftChildren[QuantizedBvh4Width];
+
+        // Split used when the node itself becomes a 4-wide node
+        UINT8 numLeftChildrenWhenOpened;
+    };
+
+    static
+        void ComputeBvh4CollapseCosts(
+            const AABBNode *pNodes,
+            UINT numNodes,
+            TrackedVector<Bvh4CollapseCost> &costs)
+    {
+        costs.resize(numNodes);
+
+        // Children are always stored after their parent
+        for (UINT i = numNodes; i-- > 0;)
+        {
+            const AABBNode &node = pNodes[i];
+            AABB box;
+            DecompressAABB(box, node);
+            const float surfaceArea = ComputeBoxSurfaceArea(box);
+
+            Bvh4CollapseCost &cost = costs[i];
+            if (node.leaf)
+            {
+                for (UINT k = 0; k < QuantizedBvh4Width; k++)
+                {
+                    cost.cost[k] = CostOfRayTriangleIntersection * surfaceArea * node.leafNode.numTriangleIds;
+                    cost.numLeftChildren[k] = 0;
+                }
+                cost.numLeftChildrenWhenOpened = 0;
+                continue;
+            }
+
+            const Bvh4CollapseCost &left = costs[node.internalNode.leftNodeIndex];
+            const Bvh4CollapseCost &right = costs[node.rightNodeIndex];
+            auto GetCostOfSplit = [&](UINT numChildren, UINT numLeftChildren)
+            {
+                return left.cost[numLeftChildren - 1] + right.cost[numChildren - numLeftChildren - 1];
+            };
+
+            float openedCost = FLT_MAX;
+            for (UINT numLeftChildren = 1; numLeftChildren < QuantizedBvh4Width; numLeftChildren++)
+            {
+                const float splitCost = GetCostOfSplit(QuantizedBvh4Width, numLeftChildren);
+                if (splitCost < openedCost)
+                {
+                    openedCost = splitCost;
+                    cost.numLeftChildrenWhenOpened = (UINT8)numLeftChildren;
+                }
+            }
+
+            const float keptCost = CostOfRayBoxIntersection * surfaceArea + openedCost;
+            for (UINT k = 0; k < QuantizedBvh4Width; k++)
+            {
+                cost.cost[k] = keptCost;
+                cost.numLeftChildren[k] = 0;
+                for (UINT numLeftChildren = 1; numLeftChildren <= k; numLeftChildren++)
+                {
+                    const float splitCost = GetCostOfSplit(k + 1, numLeftChildren);
+                    if (splitCost < cost.cost[k])
+                    {
+                        cost.cost[k] = splitCost;
+                        cost.numLeftChildren[k] = (UINT8)numLeftChildren;
+                    }
+                }
+            }
+        }
+    }
+
+    static
+        void GatherBvh4Children(
+            const AABBNode *pNodes,
+            const TrackedVector<Bvh4CollapseCost> &costs,
+            UINT nodeIndex,
+            UINT maxChildren,
+            UINT childIndices[QuantizedBvh4Width],
+            UINT &numChildren)
+    {
+        const UINT numLeftChildren = costs[nodeIndex].numLeftChildren[maxChildren - 1];
+        if (numLeftChildren == 0)
+        {
+            childIndices[numChildren++] = nodeIndex;
+            return;
+        }
+
+        GatherBvh4Children(pNodes, costs, pNodes[nodeIndex].internalNode.leftNodeIndex, numLeftChildren, childIndices, numChildren);
+        GatherBvh4Children(pNodes, costs, pNodes[nodeIndex].rightNodeIndex, maxChildren - numLeftChildren, childIndices, numChildren);
+    }
+
+    // Children of a node are written next to each other, so a node's children
+    // share cache lines. Returns the SAH cost of the 4-wide tree with the exact
+    // boxes, normalized to the root.
+    static
+        float ConvertToQuantizedBvh4(
+            const AABBNode *pNodes,
+            UINT numNodes,
+            BuildMemoryTracker *pTracker,
+            TrackedVector<QuantizedBvh4Node> &quantizedNodes)
+    {
+        TrackedVector<Bvh4CollapseCost> costs(pTracker);
+        ComputeBvh4CollapseCosts(pNodes, numNodes, costs);
+
+        struct PendingNode
+        {
+            UINT binaryNodeIndex;
+            UINT quantizedNodeIndex;
+        };
+        TrackedVector<PendingNode> pendingNodes(pTracker);
+        pendingNodes.push_back({ 0, 0 });
+        quantizedNodes.resize(1);
+
+        while (!pendingNodes.empty())
+        {
+            const PendingNode pendingNode = pendingNodes.back();
+            pendingNodes.pop_back();
+
+            const AABBNode &node = pNodes[pendingNode.binaryNodeIndex];
+            const UINT numLeftChildren = costs[pendingNode.binaryNodeIndex].numLeftChildrenWhenOpened;
+            UINT childIndices[QuantizedBvh4Width];
+            UINT numChildren = 0;
+            GatherBvh4Children(pNodes, costs, node.internalNode.leftNodeIndex, numLeftChildren, childIndices, numChildren);
+            GatherBvh4Children(pNodes, costs, node.rightNodeIndex, QuantizedBvh4Width - numLeftChildren, childIndices, numChildren);
+
+            AABB childBoxes[QuantizedBvh4Width];
+            UINT childFlags[QuantizedBvh4Width];
+            for (UINT child = 0; child < numChildren; child++)
+            {
+                const AABBNode &childNode = pNodes[childIndices[child]];
+                DecompressAABB(childBoxes[child], childNode);
+                if (childNode.leaf)
+                {
+                    childFlags[child] = childNode.nodeAllBits;
+                }
+                else
+                {
+                    childFlags[child] = (UINT)quantizedNodes.size();
+                    pendingNodes.push_back({ childIndices[child], childFlags[child] });
+                    quantizedNodes.emplace_back();
+                }
+            }
+            EncodeQuantizedBvh4Node(childBoxes, childFlags, numChildren, quantizedNodes[pendingNode.quantizedNodeIndex]);
+        }
+
+        AABB rootBox;
+        DecompressAABB(rootBox, pNodes[0]);
+        const float rootSurfaceArea = ComputeBoxSurfaceArea(rootBox);
+        return rootSurfaceArea > 0.0f ? costs[0].cost[0] / rootSurfaceArea : 0.0f;
+    }
+
+    // Same as ComputeSahCost() with the boxes traversal tests after quantization
+    static
+        float ComputeQuantizedBvh4SahCost(
+            const AABB &rootBox,
+            const QuantizedBvh4Node *pNodes,
+            UINT numNodes)
+    {
+        const float rootSurfaceArea = ComputeBoxSurfaceArea(rootBox);
+        if (numNodes == 0 || !(rootSurfaceArea > 0.0f))
+        {
+            return 0.0f;
+        }
+
+        double cost = CostOfRayBoxIntersection * rootSurfaceArea;
+        for (UINT i = 0; i < numNodes; i++)
+        {
+            for (UINT child = 0; child < pNodes[i].numChildren; child++)
+            {
+                AABB childBox;
+                DecodeQuantizedBvh4ChildBox(pNodes[i], child, childBox);
+                const float surfaceArea = ComputeBoxSurfaceArea(childBox);
+                const UINT childFlags = pNodes[i].childFlags[child];
+                if (childFlags & QuantizedBvh4LeafFlag)
+                {
+                    cost += CostOfRayTriangleIntersection * surfaceArea * GetQuantizedBvh4LeafPrimitiveCount(childFlags);
+                }
+                else
+                {
+                    cost += CostOfRayBoxIntersection * surfaceArea;
+                }
+            }
+        }
+        return (float)(cost / rootSurfaceArea);
+    }
+}
+
+void BuildRaytracingAccelerationStructureOnCpu(
+    _In_  const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC *pDesc,
+    _Out_ void *pData)
+{
+    BuildRaytracingAccelerationStructureOnCpu(pDesc, FallbackLayer::CpuBvh2BuildSettings(), pData);
+}
+
+void BuildRaytracingAccelerationStructureOnCpu(
+    _In_  const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC *pDesc,
+    _In_  const FallbackLayer::CpuBvh2BuildSettings &settings,
+    _Out_ void *pData,
+    _Out_opt_ FallbackLayer::CpuBvh2BuildStats *pStats)
+{
+    const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS &inputs = pDesc->Inputs;
+    FallbackLayer::BuildMemoryTracker tracker;
+    FallbackLayer::BVH bvh(&tracker);
+    FallbackLayer::CpuBvh2SimdLevel simdLevelUsed = FallbackLayer::CpuBvh2SimdLevel::Scalar;
+    BYTE* outputData = (BYTE*)pData;
+
+    if (inputs.Type == D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL)
+    {
+        UINT numNodes;
+        if (inputs.Flags & D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PERFORM_UPDATE)
+        {
+            numNodes = FallbackLayer::RefitTopLevelBVH(inputs, settings, (const BYTE*)pDesc->SourceAccelerationStructureData, &tracker, outputData);
+        }
+        else
+        {
+            FallbackLayer::BuildTopLevelBVH(inputs, settings, &tracker, bvh, simdLevelUsed);
+            numNodes = FallbackLayer::WriteTopLevelBVH(inputs, settings, bvh, outputData);
+        }
+
+        if (pStats)
+        {
+            const AABBNode *pNodes = (const AABBNode *)(outputData + ((BVHOffsets *)outputData)->offsetToBoxes);
+            FallbackLayer::GetBuildStats(tracker, pNodes, numNodes, true, simdLevelUsed, *pStats);
+        }
+        return;
+    }
+
+    if (inputs.Type != D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL)
+    {
+        ThrowFailure(E_INVALIDARG, L"Unrecognized D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE provided");
+    }
+
+    FallbackLayer::TrackedVector<UINT> geometryPrimitiveOffsets(&tracker);
+    FallbackLayer::BuildUniformBVH(inputs, settings, &tracker, bvh, geometryPrimitiveOffsets, simdLevelUsed);
+
+    // A single leaf has nothing to collapse, it stays an Fp32Bvh2
+    FallbackLayer::TrackedVector<FallbackLayer::QuantizedBvh4Node> quantizedNodes(&tracker);
+    float bvh4SahCost = 0.0f;
+    if (settings.NodeFormat == FallbackLayer::CpuBvhNodeFormat::QuantizedBvh4 && !bvh.m_nodes.empty() && !bvh.m_nodes[0].leaf)
+    {
+        bvh4SahCost = FallbackLayer::ConvertToQuantizedBvh4(bvh.m_nodes.data(), (UINT)bvh.m_nodes.size(), &tracker, quantizedNodes);
+    }
+
+    if (pStats)
+    {
+        FallbackLayer::GetBuildStats(tracker, bvh.m_nodes.data(), (UINT)bvh.m_nodes.size(), false, simdLevelUsed, *pStats);
+        if (!quantizedNodes.empty())
+        {
+            AABB rootBox;
+            FallbackLayer::DecompressAABB(rootBox, bvh.m_nodes[0]);
+            pStats->NumQuantizedNodes = (UINT)quantizedNodes.size();
+            pStats->Bvh4SahCost = bvh4SahCost;
+            pStats->QuantizedSahCost = FallbackLayer::ComputeQuantizedBvh4SahCost(rootBox, quantizedNodes.data(), (UINT)quantizedNodes.size());
+        }
+    }
+
+    BVHOffsets offsets;
+    offsets.offsetToBoxes = sizeof(BVHOffsets);
+    const UINT sizeofBoxes = quantizedNodes.empty() ?
+        (UINT)(bvh.m_nodes.size() * sizeof(*bvh.m_nodes.data())) :
+        (UINT)(sizeof(AABBNode) + quantizedNodes.size() * sizeof(*quantizedNodes.data()));
+    offsets.offsetToVertices = offsets.offsetToBoxes + sizeofBoxes;
+    
+    UINT numPrimitives = (UINT)bvh.m_metadata.size();
+    const UINT sizeofVertices = numPrimitives * sizeof(Primitive);
+    offsets.offsetToPrimitiveMetaData = offsets.offsetToVertices + sizeofVertices;
+
+    const UINT sizeofMetadata = (UINT)(bvh.m_metadata.size() * sizeof(*bvh.m_metadata.data()));
+    offsets.totalSize = offsets.offsetToPrimitiveMetaData + sizeofMetadata;
+
+    memcpy(outputData,  &offsets, sizeof(offsets));
+    if (quantizedNodes.empty())
+    {
+        memcpy(outputData + offsets.offsetToBoxes, bvh.m_nodes.data(), sizeofBoxes);
+    }
+    else
+    {
+        AABBNode rootNode = bvh.m_nodes[0];
+        rootNode.nodeAllBits = FallbackLayer::QuantizedBvh4RootFlags;
+        rootNode.rightNodeIndex = (UINT)quantizedNodes.size();
+        memcpy(outputData + offsets.offsetToBoxes, &rootNode, sizeof(rootNode));
+        memcpy(outputData + offsets.offsetToBoxes + sizeof(rootNode), quantizedNodes.data(), sizeofBoxes - sizeof(rootNode));
+    }
+
+    Primitive *pPrimitives = (Primitive *)(outputData + offsets.offsetToVertices);
+    FallbackLayer::WritePrimitives(pDesc->Inputs, settings, geometryPrimitiveOffsets, bvh.m_metadata, pPrimitives);
     memcpy(outputData + offsets.offsetToPrimitiveMetaData, bvh.m_metadata.data(), sizeofMetadata);
 }
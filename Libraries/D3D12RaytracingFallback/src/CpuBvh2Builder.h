@@ -0,0 +1,140 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+#pragma once
+
+namespace FallbackLayer
+{
+    enum class CpuBvh2BuilderType
+    {
+        // Original single-threaded builder and the default, so existing callers keep
+        // getting the same BVH layout
+        Serial,
+
+        // Task-parallel binned SAH builder that partitions primitives in place. Opt-in,
+        // it picks different splits than Serial so its layout differs. Bottom levels are
+        // treelet reordered afterwards unless PREFER_FAST_BUILD is set.
+        ParallelBinnedSah,
+    };
+
+    // Instruction set used by the binning kernels of the parallel builder, in
+    // increasing order. Every level produces bit-identical output, Scalar is the
+    // reference implementation.
+    enum class CpuBvh2SimdLevel
+    {
+        Auto,
+        Scalar,
+        Sse41,
+        Avx2,
+    };
+
+    enum class CpuBvhNodeFormat
+    {
+        // Binary AABBNodes with fp32 boxes, the layout the GPU builders and the
+        // traversal shader use
+        Fp32Bvh2,
+
+        // 4-wide QuantizedBvh4Nodes with 8-bit child boxes, about half the node
+        // memory of Fp32Bvh2. Only understood by TraceRaysOnCpu and BvhValidator.
+        // Top level builds ignore it.
+        QuantizedBvh4,
+    };
+
+    struct CpuBvh2BuildSettings
+    {
+        CpuBvh2BuilderType BuilderType = CpuBvh2BuilderType::Serial;
+
+        // Number of threads the builder may use, 0 uses all hardware threads.
+        // The output of the parallel builder is bit-identical for any value.
+        UINT NumThreads = 0;
+
+        UINT MaxPrimitivesInLeaf = MAX_TRIS_IN_LEAF;
+
+        // Auto picks the best level the CPU supports, higher levels than the CPU
+        // supports fall back to the best supported one
+        CpuBvh2SimdLevel SimdLevel = CpuBvh2SimdLevel::Auto;
+
+        CpuBvhNodeFormat NodeFormat = CpuBvhNodeFormat::Fp32Bvh2;
+    };
+
+    struct CpuBvh2BuildStats
+    {
+        // Heap allocations made and peak heap memory held by the builder,
+        // including the input boxes and the output before it's copied out.
+        // The std::async state of work run on other threads isn't counted
+        UINT64 NumHeapAllocations;
+        UINT64 PeakMemoryInBytes;
+
+        UINT NumNodes;
+        UINT NumLeaves;
+
+        // Level the binning kernels actually ran with
+        CpuBvh2SimdLevel SimdLevel;
+
+        // SAH cost of the output normalized to the root box, after any treelet reordering
+        float SahCost;
+
+        // QuantizedBvh4 bottom levels only, 0 otherwise. The counts and SahCost
+        // above describe the binary tree the 4-wide nodes were collapsed from.
+        UINT NumQuantizedNodes;
+
+        // SAH cost of the 4-wide tree with the exact child boxes and with the
+        // quantized boxes traversal actually tests, the difference is what the
+        // quantization costs
+        float Bvh4SahCost;
+        float QuantizedSahCost;
+    };
+
+    // A QuantizedBvh4 bottom level starts with a regular AABBNode holding the fp32
+    // box of the whole BVH so top level builds can read it like any other bottom
+    // level. Its flags are QuantizedBvh4RootFlags, which no binary node can have
+    // (an internal node pointing back at the root), and rightNodeIndex holds the
+    // number of QuantizedBvh4Nodes that follow it, the first one being the root.
+    // Primitives and metadata are laid out the same as in Fp32Bvh2.
+    //
+    // A bottom level that fits in a single leaf is always written as Fp32Bvh2.
+    static const UINT QuantizedBvh4RootFlags = 0x07000000;
+    static const UINT QuantizedBvh4LeafFlag = 0x80000000;
+    static const UINT QuantizedBvh4Width = 4;
+
+    struct QuantizedBvh4Node
+    {
+        // A child's bounds on an axis are origin + q * 2^exponent, q being its
+        // childMin/childMax. Bounds are rounded outwards, so they always contain
+        // the fp32 box of the child.
+        float origin[3];
+        INT8  exponent[3];
+        UINT8 numChildren;
+
+        // Same bits as AABBNode::nodeAllBits of a leaf when QuantizedBvh4LeafFlag
+        // is set, otherwise the index of the child's QuantizedBvh4Node
+        UINT  childFlags[QuantizedBvh4Width];
+
+        // [axis][child], so a row loads the bounds of all children on an axis
+        UINT8 childMin[3][QuantizedBvh4Width];
+        UINT8 childMax[3][QuantizedBvh4Width];
+
+        UINT  padding[2];
+    };
+    static_assert(sizeof(QuantizedBvh4Node) == 2 * sizeof(AABBNode), "QuantizedBvh4Node should be the size of two binary nodes");
+
+    bool IsQuantizedBvh4(const BYTE *pBottomLevel);
+
+    void DecodeQuantizedBvh4ChildBox(const QuantizedBvh4Node &node, UINT child, AABB &box);
+
+    // Best level the CPU and OS support, what Auto resolves to
+    CpuBvh2SimdLevel GetSupportedCpuBvh2SimdLevel();
+}
+
+void BuildRaytracingAccelerationStructureOnCpu(
+    _In_  const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC *pDesc,
+    _In_  const FallbackLayer::CpuBvh2BuildSettings &settings,
+    _Out_ void *pData,
+    _Out_opt_ FallbackLayer::CpuBvh2BuildStats *pStats = nullptr);
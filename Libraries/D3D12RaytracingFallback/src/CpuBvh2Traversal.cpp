@@ -0,0 +1,956 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+#include "pch.h"
+
+// CPU port of Traverse() in TraverseFunction.hlsli. Node visit order, box and
+// triangle tests, opacity and culling follow the shader so CPU and GPU traces of the
+// same acceleration structure agree.
+namespace FallbackLayer
+{
+    // Only a zero length ray has no direction to pick, keeps rcp(0) from producing
+    // inf * 0 = NaN in the box tests
+    static const float MaxInverseDirection = 1e30f;
+
+    // Same as RayData in TraverseFunction.hlsli, 16 byte rows so the box tests can
+    // load them directly
+    struct TraversalRay
+    {
+        float Origin[4];
+        float Direction[4];
+        float InverseDirection[4];
+        float OriginTimesRayInverseDirection[4];
+        float Shear[3];
+        int   SwizzledIndices[3];
+    };
+
+    static int GetIndexOfBiggestChannel(const float vec[3])
+    {
+        if (vec[0] > vec[1] && vec[0] > vec[2])
+        {
+            return 0;
+        }
+        else if (vec[1] > vec[2])
+        {
+            return 1;
+        }
+        else
+        {
+            return 2;
+        }
+    }
+
+    static void GetRayData(const float origin[3], const float direction[3], TraversalRay &ray)
+    {
+        float absDirection[3];
+        for (UINT axis = 0; axis < 3; axis++)
+        {
+            ray.Origin[axis] = origin[axis];
+            ray.Direction[axis] = direction[axis];
+
+            float inverseDirection = MaxInverseDirection;
+            if (direction[axis] != 0.0f)
+            {
+                inverseDirection = std::max(-MaxInverseDirection, std::min(1.0f / direction[axis], MaxInverseDirection));
+            }
+            ray.InverseDirection[axis] = inverseDirection;
+            ray.OriginTimesRayInverseDirection[axis] = origin[axis] * inverseDirection;
+            absDirection[axis] = fabsf(direction[axis]);
+        }
+        ray.Origin[3] = ray.Direction[3] = 0.0f;
+        ray.InverseDirection[3] = ray.OriginTimesRayInverseDirection[3] = 0.0f;
+
+        const int zIndex = GetIndexOfBiggestChannel(absDirection);
+        ray.SwizzledIndices[0] = (zIndex + 1) % 3;
+        ray.SwizzledIndices[1] = (zIndex + 2) % 3;
+        ray.SwizzledIndices[2] = zIndex;
+        if (direction[zIndex] < 0.0f)
+        {
+            std::swap(ray.SwizzledIndices[0], ray.SwizzledIndices[1]);
+        }
+
+        ray.Shear[0] = direction[ray.SwizzledIndices[0]] / direction[zIndex];
+        ray.Shear[1] = direction[ray.SwizzledIndices[1]] / direction[zIndex];
+        ray.Shear[2] = 1.0f / direction[zIndex];
+    }
+
+    //
+    // Ray/AABB intersection, same separating axes test as RayBoxTest(). Each
+    // version tests both children of a node and returns identical results.
+    //
+    struct ChildBoxTestResult
+    {
+        float LeftT;
+        float RightT;
+        bool  LeftHit;
+        bool  RightHit;
+    };
+
+    typedef void(*ChildBoxTestFunction)(
+        const TraversalRay &ray,
+        float closestT,
+        const AABBNode &left,
+        const AABBNode &right,
+        ChildBoxTestResult &result);
+
+    static bool RayBoxTest(float &resultT, float closestT, const TraversalRay &ray, const AABBNode &box)
+    {
+        float minT = -FLT_MAX;
+        float maxT = FLT_MAX;
+        for (UINT axis = 0; axis < 3; axis++)
+        {
+            const float relativeMiddle = box.center[axis] * ray.InverseDirection[axis] - ray.OriginTimesRayInverseDirection[axis];
+            const float extent = box.halfDim[axis] * fabsf(ray.InverseDirection[axis]);
+            minT = std::max(minT, relativeMiddle - extent);
+            maxT = std::min(maxT, relativeMiddle + extent);
+        }
+
+        resultT = std::max(minT, 0.0f);
+        return resultT < std::min(maxT, closestT);
+    }
+
+    static void TestChildBoxesScalar(
+        const TraversalRay &ray,
+        float closestT,
+        const AABBNode &left,
+        const AABBNode &right,
+        ChildBoxTestResult &result)
+    {
+        result.LeftHit = RayBoxTest(result.LeftT, closestT, ray, left);
+        result.RightHit = RayBoxTest(result.RightT, closestT, ray, right);
+    }
+
+    // center and halfDim are followed by the node flags, lane 3 of each is replaced
+    // so whatever bits the flags hold can't leak into the result
+    static void TestChildBoxesSse41(
+        const TraversalRay &ray,
+        float closestT,
+        const AABBNode &left,
+        const AABBNode &right,
+        ChildBoxTestResult &result)
+    {
+        const __m128 inverseDirection = _mm_loadu_ps(ray.InverseDirection);
+        const __m128 absInverseDirection = _mm_andnot_ps(_mm_set1_ps(-0.0f), inverseDirection);
+        const __m128 originTimesInverseDirection = _mm_loadu_ps(ray.OriginTimesRayInverseDirection);
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 closest = _mm_set1_ps(closestT);
+
+        const AABBNode *pNodes[2] = { &left, &right };
+        float entryT[2];
+        float exitT[2];
+        for (UINT child = 0; child < 2; child++)
+        {
+            const __m128 relativeMiddle = _mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(pNodes[child]->center), inverseDirection), originTimesInverseDirection);
+            const __m128 extent = _mm_mul_ps(_mm_loadu_ps(pNodes[child]->halfDim), absInverseDirection);
+            __m128 minL = _mm_blend_ps(_mm_sub_ps(relativeMiddle, extent), zero, 0x8);
+            __m128 maxL = _mm_blend_ps(_mm_add_ps(relativeMiddle, extent), closest, 0x8);
+
+            minL = _mm_max_ps(minL, _mm_shuffle_ps(minL, minL, _MM_SHUFFLE(1, 0, 3, 2)));
+            minL = _mm_max_ps(minL, _mm_shuffle_ps(minL, minL, _MM_SHUFFLE(2, 3, 0, 1)));
+            maxL = _mm_min_ps(maxL, _mm_shuffle_ps(maxL, maxL, _MM_SHUFFLE(1, 0, 3, 2)));
+            maxL = _mm_min_ps(maxL, _mm_shuffle_ps(maxL, maxL, _MM_SHUFFLE(2, 3, 0, 1)));
+
+            // Lane 3 of minL is 0, so this is already max(minT, 0)
+            entryT[child] = _mm_cvtss_f32(minL);
+            exitT[child] = _mm_cvtss_f32(maxL);
+        }
+
+        result.LeftT = entryT[0];
+        result.RightT = entryT[1];
+        result.LeftHit = entryT[0] < exitT[0];
+        result.RightHit = entryT[1] < exitT[1];
+    }
+
+    // Same as the SSE version with one child in each 128-bit lane
+    static void TestChildBoxesAvx2(
+        const TraversalRay &ray,
+        float closestT,
+        const AABBNode &left,
+        const AABBNode &right,
+        ChildBoxTestResult &result)
+    {
+        const __m256 inverseDirection = _mm256_broadcast_ps((const __m128 *)ray.InverseDirection);
+        const __m256 absInverseDirection = _mm256_andnot_ps(_mm256_set1_ps(-0.0f), inverseDirection);
+        const __m256 originTimesInverseDirection = _mm256_broadcast_ps((const __m128 *)ray.OriginTimesRayInverseDirection);
+
+        const __m256 center = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(left.center)), _mm_loadu_ps(right.center), 1);
+        const __m256 halfDim = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(left.halfDim)), _mm_loadu_ps(right.halfDim), 1);
+
+        const __m256 relativeMiddle = _mm256_sub_ps(_mm256_mul_ps(center, inverseDirection), originTimesInverseDirection);
+        const __m256 extent = _mm256_mul_ps(halfDim, absInverseDirection);
+        __m256 minL = _mm256_blend_ps(_mm256_sub_ps(relativeMiddle, extent), _mm256_setzero_ps(), 0x88);
+        __m256 maxL = _mm256_blend_ps(_mm256_add_ps(relativeMiddle, extent), _mm256_set1_ps(closestT), 0x88);
+
+        minL = _mm256_max_ps(minL, _mm256_permute_ps(minL, _MM_SHUFFLE(1, 0, 3, 2)));
+        minL = _mm256_max_ps(minL, _mm256_permute_ps(minL, _MM_SHUFFLE(2, 3, 0, 1)));
+        maxL = _mm256_min_ps(maxL, _mm256_permute_ps(maxL, _MM_SHUFFLE(1, 0, 3, 2)));
+        maxL = _mm256_min_ps(maxL, _mm256_permute_ps(maxL, _MM_SHUFFLE(2, 3, 0, 1)));
+
+        const __m128 entryT = _mm_unpacklo_ps(_mm256_castps256_ps128(minL), _mm256_extractf128_ps(minL, 1));
+        const __m128 exitT = _mm_unpacklo_ps(_mm256_castps256_ps128(maxL), _mm256_extractf128_ps(maxL, 1));
+        const int hitMask = _mm_movemask_ps(_mm_cmplt_ps(entryT, exitT));
+
+        float entry[4];
+        _mm_storeu_ps(entry, entryT);
+        result.LeftT = entry[0];
+        result.RightT = entry[1];
+        result.LeftHit = (hitMask & 0x1) != 0;
+        result.RightHit = (hitMask & 0x2) != 0;
+    }
+
+    //
+    // Ray/QuantizedBvh4Node intersection. Decodes the boxes of all children of the
+    // node and runs the slab test on them, each version returns identical results.
+    //
+
+    struct QuantizedChildBoxTestResult
+    {
+        float EntryT[QuantizedBvh4Width];
+        UINT  HitMask;
+    };
+
+    typedef void(*QuantizedChildBoxTestFunction)(
+        const TraversalRay &ray,
+        float closestT,
+        const QuantizedBvh4Node &node,
+        QuantizedChildBoxTestResult &result);
+
+    static void TestQuantizedChildBoxesScalar(
+        const TraversalRay &ray,
+        float closestT,
+        const QuantizedBvh4Node &node,
+        QuantizedChildBoxTestResult &result)
+    {
+        result.HitMask = 0;
+        for (UINT child = 0; child < node.numChildren; child++)
+        {
+            AABB box;
+            DecodeQuantizedBvh4ChildBox(node, child, box);
+
+            float entryT = 0.0f;
+            float exitT = closestT;
+            for (UINT axis = 0; axis < 3; axis++)
+            {
+                const float t0 = box.minArr[axis] * ray.InverseDirection[axis] - ray.OriginTimesRayInverseDirection[axis];
+                const float t1 = box.maxArr[axis] * ray.InverseDirection[axis] - ray.OriginTimesRayInverseDirection[axis];
+                entryT = std::max(entryT, std::min(t0, t1));
+                exitT = std::min(exitT, std::max(t0, t1));
+            }
+
+            result.EntryT[child] = entryT;
+            result.HitMask |= (entryT < exitT) ? (1u << child) : 0u;
+        }
+    }
+
+    // One child per lane, the quantized bounds of an axis are stored next to each
+    // other so every axis is a single 32-bit load
+    static void TestQuantizedChildBoxesSse41(
+        const TraversalRay &ray,
+        float closestT,
+        const QuantizedBvh4Node &node,
+        QuantizedChildBoxTestResult &result)
+    {
+        __m128 entryT = _mm_setzero_ps();
+        __m128 exitT = _mm_set1_ps(closestT);
+        for (UINT axis = 0; axis < 3; axis++)
+        {
+            const __m128 origin = _mm_set1_ps(node.origin[axis]);
+            const __m128 scale = _mm_set1_ps(ldexpf(1.0f, node.exponent[axis]));
+            const __m128 quantizedMin = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(*(const int *)node.childMin[axis])));
+            const __m128 quantizedMax = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(*(const int *)node.childMax[axis])));
+            const __m128 boxMin = _mm_add_ps(origin, _mm_mul_ps(quantizedMin, scale));
+            const __m128 boxMax = _mm_add_ps(origin, _mm_mul_ps(quantizedMax, scale));
+
+            const __m128 inverseDirection = _mm_set1_ps(ray.InverseDirection[axis]);
+            const __m128 originTimesInverseDirection = _mm_set1_ps(ray.OriginTimesRayInverseDirection[axis]);
+            const __m128 t0 = _mm_sub_ps(_mm_mul_ps(boxMin, inverseDirection), originTimesInverseDirection);
+            const __m128 t1 = _mm_sub_ps(_mm_mul_ps(boxMax, inverseDirection), originTimesInverseDirection);
+            entryT = _mm_max_ps(entryT, _mm_min_ps(t0, t1));
+            exitT = _mm_min_ps(exitT, _mm_max_ps(t0, t1));
+        }
+
+        _mm_storeu_ps(result.EntryT, entryT);
+        result.HitMask = _mm_movemask_ps(_mm_cmplt_ps(entryT, exitT)) & ((1u << node.numChildren) - 1);
+    }
+
+    //
+    // Ray/triangle intersection
+    //
+
+    struct TriangleTestResult
+    {
+        float T;
+        float Barycentrics[2];
+        bool  FrontFace;
+    };
+
+    struct CullingFlags
+    {
+        bool UseFrontfaceCulling;
+        bool UseBackfaceCulling;
+        bool FlipFaces;
+    };
+
+    static CullingFlags GetCullingFlags(UINT instanceFlags, UINT rayFlags)
+    {
+        const bool useCulling = !(instanceFlags & D3D12_RAYTRACING_INSTANCE_FLAG_TRIANGLE_CULL_DISABLE);
+        const bool flipFaces = (instanceFlags & D3D12_RAYTRACING_INSTANCE_FLAG_TRIANGLE_FRONT_COUNTERCLOCKWISE) != 0;
+        const UINT backFaceCullingFlag = flipFaces ? D3D12_RAY_FLAG_CULL_FRONT_FACING_TRIANGLES : D3D12_RAY_FLAG_CULL_BACK_FACING_TRIANGLES;
+        const UINT frontFaceCullingFlag = flipFaces ? D3D12_RAY_FLAG_CULL_BACK_FACING_TRIANGLES : D3D12_RAY_FLAG_CULL_FRONT_FACING_TRIANGLES;
+
+        CullingFlags flags;
+        flags.UseBackfaceCulling = useCulling && (rayFlags & backFaceCullingFlag);
+        flags.UseFrontfaceCulling = useCulling && (rayFlags & frontFaceCullingFlag);
+        flags.FlipFaces = flipFaces;
+        return flags;
+    }
+
+    static void Swizzle(const float3 &v, const float3 &origin, const int swizzledIndices[3], float result[3])
+    {
+        const float relative[3] = { v.x - origin.x, v.y - origin.y, v.z - origin.z };
+        for (UINT i = 0; i < 3; i++)
+        {
+            result[i] = relative[swizzledIndices[i]];
+        }
+    }
+
+    // Line by line port of RayTriangleIntersect(), Woop/Benthin/Wald 2013:
+    // "Watertight Ray/Triangle Intersection"
+    static bool RayTriangleIntersectWatertight(
+        float hitT,
+        const CullingFlags &culling,
+        const TraversalRay &ray,
+        const Triangle &triangle,
+        TriangleTestResult &result)
+    {
+        const float3 origin = { ray.Origin[0], ray.Origin[1], ray.Origin[2] };
+        float A[3], B[3], C[3];
+        Swizzle(triangle.v0, origin, ray.SwizzledIndices, A);
+        Swizzle(triangle.v1, origin, ray.SwizzledIndices, B);
+        Swizzle(triangle.v2, origin, ray.SwizzledIndices, C);
+
+        for (UINT i = 0; i < 2; i++)
+        {
+            A[i] = A[i] - ray.Shear[i] * A[2];
+            B[i] = B[i] - ray.Shear[i] * B[2];
+            C[i] = C[i] - ray.Shear[i] * C[2];
+        }
+        const float U = C[0] * B[1] - C[1] * B[0];
+        const float V = A[0] * C[1] - A[1] * C[0];
+        const float W = B[0] * A[1] - B[1] * A[0];
+
+        const float det = U + V + W;
+        if (culling.UseFrontfaceCulling)
+        {
+            if (U > 0.0f || V > 0.0f || W > 0.0f) return false;
+        }
+        else if (culling.UseBackfaceCulling)
+        {
+            if (U < 0.0f || V < 0.0f || W < 0.0f) return false;
+        }
+        else
+        {
+            if ((U < 0.0f || V < 0.0f || W < 0.0f) &&
+                (U > 0.0f || V > 0.0f || W > 0.0f)) return false;
+        }
+
+        if (det == 0.0f) return false;
+        A[2] = ray.Shear[2] * A[2];
+        B[2] = ray.Shear[2] * B[2];
+        C[2] = ray.Shear[2] * C[2];
+        const float T = U * A[2] + V * B[2] + W * C[2];
+
+        if (culling.UseFrontfaceCulling)
+        {
+            if (T > 0.0f || T < hitT * det)
+                return false;
+        }
+        else if (culling.UseBackfaceCulling)
+        {
+            if (T < 0.0f || T > hitT * det)
+                return false;
+        }
+        else
+        {
+            float signCorrectedT = fabsf(T);
+            if ((T > 0.0f) != (det > 0.0f))
+            {
+                signCorrectedT = -signCorrectedT;
+            }
+
+            if (signCorrectedT < 0.0f || signCorrectedT > hitT * fabsf(det))
+            {
+                return false;
+            }
+        }
+
+        const float rcpDet = 1.0f / det;
+        result.Barycentrics[0] = V * rcpDet;
+        result.Barycentrics[1] = W * rcpDet;
+        result.T = T * rcpDet;
+
+        // Backface culling keeps the positive side
+        result.FrontFace = (det > 0.0f) != culling.FlipFaces;
+        return true;
+    }
+
+    // Moller/Trumbore 1997: "Fast, Minimum Storage Ray/Triangle Intersection".
+    // Faces and barycentrics are oriented the same way as the watertight test.
+    static bool RayTriangleIntersectMollerTrumbore(
+        float hitT,
+        const CullingFlags &culling,
+        const TraversalRay &ray,
+        const Triangle &triangle,
+        TriangleTestResult &result)
+    {
+        const float3 &v0 = triangle.v0;
+        const float edge1[3] = { triangle.v1.x - v0.x, triangle.v1.y - v0.y, triangle.v1.z - v0.z };
+        const float edge2[3] = { triangle.v2.x - v0.x, triangle.v2.y - v0.y, triangle.v2.z - v0.z };
+        const float *d = ray.Direction;
+
+        const float p[3] = {
+            d[1] * edge2[2] - d[2] * edge2[1],
+            d[2] * edge2[0] - d[0] * edge2[2],
+            d[0] * edge2[1] - d[1] * edge2[0] };
+        const float det = edge1[0] * p[0] + edge1[1] * p[1] + edge1[2] * p[2];
+        if (det == 0.0f) return false;
+
+        // det has the same sign as the watertight determinant
+        const bool positiveSide = det > 0.0f;
+        const bool frontFace = positiveSide != culling.FlipFaces;
+        if ((culling.UseFrontfaceCulling && positiveSide) || (culling.UseBackfaceCulling && !positiveSide))
+        {
+            return false;
+        }
+
+        const float inverseDet = 1.0f / det;
+        const float s[3] = { ray.Origin[0] - v0.x, ray.Origin[1] - v0.y, ray.Origin[2] - v0.z };
+        const float u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inverseDet;
+        if (u < 0.0f || u > 1.0f) return false;
+
+        const float q[3] = {
+            s[1] * edge1[2] - s[2] * edge1[1],
+            s[2] * edge1[0] - s[0] * edge1[2],
+            s[0] * edge1[1] - s[1] * edge1[0] };
+        const float v = (d[0] * q[0] + d[1] * q[1] + d[2] * q[2]) * inverseDet;
+        if (v < 0.0f || u + v > 1.0f) return false;
+
+        const float t = (edge2[0] * q[0] + edge2[1] * q[1] + edge2[2] * q[2]) * inverseDet;
+        if (t < 0.0f || t > hitT) return false;
+
+        result.Barycentrics[0] = u;
+        result.Barycentrics[1] = v;
+        result.T = t;
+        result.FrontFace = frontFace;
+        return true;
+    }
+
+    // Entry point of the ray into the box, stands in for an intersection shader
+    static bool RayProceduralBoxIntersect(const TraversalRay &ray, float tMin, const AABB &box, float &hitT)
+    {
+        float minT = -FLT_MAX;
+        float maxT = FLT_MAX;
+        for (UINT axis = 0; axis < 3; axis++)
+        {
+            const float t0 = (box.minArr[axis] - ray.Origin[axis]) * ray.InverseDirection[axis];
+            const float t1 = (box.maxArr[axis] - ray.Origin[axis]) * ray.InverseDirection[axis];
+            minT = std::max(minT, std::min(t0, t1));
+            maxT = std::min(maxT, std::max(t0, t1));
+        }
+
+        if (minT > maxT || maxT < tMin)
+        {
+            return false;
+        }
+        hitT = std::max(minT, tMin);
+        return true;
+    }
+
+    static bool IsOpaque(bool geomOpaque, UINT instanceFlags, UINT rayFlags)
+    {
+        bool opaque = geomOpaque;
+
+        if (instanceFlags & D3D12_RAYTRACING_INSTANCE_FLAG_FORCE_OPAQUE)
+            opaque = true;
+        else if (instanceFlags & D3D12_RAYTRACING_INSTANCE_FLAG_FORCE_NON_OPAQUE)
+            opaque = false;
+
+        if (rayFlags & D3D12_RAY_FLAG_FORCE_OPAQUE)
+            opaque = true;
+        else if (rayFlags & D3D12_RAY_FLAG_FORCE_NON_OPAQUE)
+            opaque = false;
+
+        return opaque;
+    }
+
+    static bool Cull(bool opaque, UINT rayFlags)
+    {
+        return (opaque && (rayFlags & D3D12_RAY_FLAG_CULL_OPAQUE)) || (!opaque && (rayFlags & D3D12_RAY_FLAG_CULL_NON_OPAQUE));
+    }
+
+    //
+    // Traversal
+    //
+
+    struct TraceCounters
+    {
+        UINT64 NumHits;
+        UINT64 NumNodesVisited;
+        UINT64 NumPrimitiveTests;
+        UINT64 NumInstancesVisited;
+    };
+
+    struct InstanceState
+    {
+        UINT InstanceIndex;
+        UINT InstanceID;
+        UINT InstanceFlags;
+    };
+
+    // Everything a thread needs to trace a single ray, the stack is reused across rays
+    struct RayState
+    {
+        UINT rayIndex;
+        float tMin;
+        CpuRayHit closestHit;
+        bool endSearch;
+
+        std::vector<UINT> &stack;
+        TraceCounters &counters;
+    };
+
+    class CpuTraversal
+    {
+    public:
+        CpuTraversal(
+            const CpuTraceSettings &settings,
+            ChildBoxTestFunction pTestChildBoxes,
+            QuantizedChildBoxTestFunction pTestQuantizedChildBoxes) :
+            m_settings(settings),
+            m_pTestChildBoxes(pTestChildBoxes),
+            m_pTestQuantizedChildBoxes(pTestQuantizedChildBoxes)
+        {
+        }
+
+        void TraceTopLevel(const BYTE *pTopLevel, const CpuRay &worldRay, RayState &state) const
+        {
+            const BVHOffsets &offsets = *(const BVHOffsets *)pTopLevel;
+            const AABBNode *pNodes = (const AABBNode *)(pTopLevel + offsets.offsetToBoxes);
+            const BVHMetadata *pMetadata = (const BVHMetadata *)(pTopLevel + offsets.offsetToVertices);
+
+            TraversalRay ray;
+            GetRayData(worldRay.Origin, worldRay.Direction, ray);
+
+            float unusedT;
+            if (!RayBoxTest(unusedT, state.closestHit.T, ray, pNodes[0]))
+            {
+                return;
+            }
+
+            std::vector<UINT> &stack = state.stack;
+            stack.push_back(0);
+            while (!stack.empty() && !state.endSearch)
+            {
+                const AABBNode &node = pNodes[stack.back()];
+                stack.pop_back();
+                state.counters.NumNodesVisited++;
+
+                if (!node.leaf)
+                {
+                    PushChildren(ray, pNodes, node, state);
+                    continue;
+                }
+
+                const UINT leafIndex = node.leafNode.firstTriangleId;
+                const BVHMetadata &metadata = pMetadata[leafIndex];
+                const D3D12_RAYTRACING_FALLBACK_INSTANCE_DESC &instanceDesc = metadata.instanceDesc;
+                if (!(instanceDesc.InstanceMask & m_settings.InstanceInclusionMask))
+                {
+                    continue;
+                }
+                state.counters.NumInstancesVisited++;
+
+                // The instance desc in the top level holds the world to object transform
+                const float(&worldToObject)[3][4] = instanceDesc.Transform;
+                float objectOrigin[3], objectDirection[3];
+                for (UINT row = 0; row < 3; row++)
+                {
+                    objectOrigin[row] = worldToObject[row][0] * worldRay.Origin[0] +
+                        worldToObject[row][1] * worldRay.Origin[1] +
+                        worldToObject[row][2] * worldRay.Origin[2] +
+                        worldToObject[row][3];
+                    objectDirection[row] = worldToObject[row][0] * worldRay.Direction[0] +
+                        worldToObject[row][1] * worldRay.Direction[1] +
+                        worldToObject[row][2] * worldRay.Direction[2];
+                }
+
+                TraversalRay objectRay;
+                GetRayData(objectOrigin, objectDirection, objectRay);
+
+                InstanceState instance;
+                instance.InstanceIndex = metadata.InstanceIndex;
+                instance.InstanceID = instanceDesc.InstanceID;
+                instance.InstanceFlags = instanceDesc.Flags;
+                TraceBottomLevel((const BYTE *)instanceDesc.AccelerationStructure.GpuVA, objectRay, instance, state);
+            }
+            stack.clear();
+        }
+
+        // Uses the stack above whatever the top level left on it
+        void TraceBottomLevel(const BYTE *pBottomLevel, const TraversalRay &ray, const InstanceState &instance, RayState &state) const
+        {
+            if (IsQuantizedBvh4(pBottomLevel))
+            {
+                TraceQuantizedBottomLevel(pBottomLevel, ray, instance, state);
+                return;
+            }
+
+            const BVHOffsets &offsets = *(const BVHOffsets *)pBottomLevel;
+            const AABBNode *pNodes = (const AABBNode *)(pBottomLevel + offsets.offsetToBoxes);
+            const Primitive *pPrimitives = (const Primitive *)(pBottomLevel + offsets.offsetToVertices);
+            const PrimitiveMetaData *pMetadata = (const PrimitiveMetaData *)(pBottomLevel + offsets.offsetToPrimitiveMetaData);
+
+            const CullingFlags culling = GetCullingFlags(instance.InstanceFlags, m_settings.RayFlags);
+
+            // Like the shader the root goes on the stack untested, the top level
+            // already tested the instance's box
+            std::vector<UINT> &stack = state.stack;
+            const size_t stackBase = stack.size();
+            stack.push_back(0);
+            while (stack.size() > stackBase && !state.endSearch)
+            {
+                const AABBNode &node = pNodes[stack.back()];
+                stack.pop_back();
+                state.counters.NumNodesVisited++;
+
+                if (!node.leaf)
+                {
+                    PushChildren(ray, pNodes, node, state);
+                    continue;
+                }
+
+                // Same fields TestLeafNodeIntersections() reads
+                const UINT firstPrimitive = node.leafNode.firstTriangleId;
+                const UINT numPrimitives = node.numTriangles;
+                for (UINT i = 0; i < numPrimitives && !state.endSearch; i++)
+                {
+                    TestPrimitive(ray, pPrimitives[firstPrimitive + i], pMetadata[firstPrimitive + i], culling, instance, state);
+                }
+            }
+            stack.resize(stackBase);
+        }
+
+        // The stack holds QuantizedBvh4Node indices and, with QuantizedBvh4LeafFlag
+        // set, the flags of leaves whose box was hit, so a leaf is tested when it's
+        // popped just like a binary leaf node
+        void TraceQuantizedBottomLevel(const BYTE *pBottomLevel, const TraversalRay &ray, const InstanceState &instance, RayState &state) const
+        {
+            const BVHOffsets &offsets = *(const BVHOffsets *)pBottomLevel;
+            const QuantizedBvh4Node *pNodes = (const QuantizedBvh4Node *)(pBottomLevel + offsets.offsetToBoxes + sizeof(AABBNode));
+            const Primitive *pPrimitives = (const Primitive *)(pBottomLevel + offsets.offsetToVertices);
+            const PrimitiveMetaData *pMetadata = (const PrimitiveMetaData *)(pBottomLevel + offsets.offsetToPrimitiveMetaData);
+
+            const CullingFlags culling = GetCullingFlags(instance.InstanceFlags, m_settings.RayFlags);
+
+            std::vector<UINT> &stack = state.stack;
+            const size_t stackBase = stack.size();
+            stack.push_back(0);
+            while (stack.size() > stackBase && !state.endSearch)
+            {
+                const UINT entry = stack.back();
+                stack.pop_back();
+                state.counters.NumNodesVisited++;
+
+                if (!(entry & QuantizedBvh4LeafFlag))
+                {
+                    PushQuantizedChildren(ray, pNodes[entry], state);
+                    continue;
+                }
+
+                AABBNode leaf;
+                leaf.nodeAllBits = entry;
+                const UINT firstPrimitive = leaf.leafNode.firstTriangleId;
+                const UINT numPrimitives = leaf.leafNode.numTriangleIds;
+                for (UINT i = 0; i < numPrimitives && !state.endSearch; i++)
+                {
+                    TestPrimitive(ray, pPrimitives[firstPrimitive + i], pMetadata[firstPrimitive + i], culling, instance, state);
+                }
+            }
+            stack.resize(stackBase);
+        }
+
+    private:
+        // Hit children go on the stack farthest first so the nearest is popped next,
+        // ties keep the order the builder wrote them in
+        void PushQuantizedChildren(const TraversalRay &ray, const QuantizedBvh4Node &node, RayState &state) const
+        {
+            QuantizedChildBoxTestResult result;
+            m_pTestQuantizedChildBoxes(ray, state.closestHit.T, node, result);
+
+            UINT hitChildren[QuantizedBvh4Width];
+            UINT numHitChildren = 0;
+            for (UINT child = 0; child < node.numChildren; child++)
+            {
+                if (!(result.HitMask & (1u << child)))
+                {
+                    continue;
+                }
+
+                UINT insertAt = numHitChildren++;
+                for (; insertAt > 0 && result.EntryT[hitChildren[insertAt - 1]] < result.EntryT[child]; insertAt--)
+                {
+                    hitChildren[insertAt] = hitChildren[insertAt - 1];
+                }
+                hitChildren[insertAt] = child;
+            }
+
+            for (UINT i = 0; i < numHitChildren; i++)
+            {
+                state.stack.push_back(node.childFlags[hitChildren[i]]);
+            }
+        }
+
+        // Nearer child goes on top, on a tie the left child since it's encoded to
+        // have fewer primitives
+        void PushChildren(const TraversalRay &ray, const AABBNode *pNodes, const AABBNode &node, RayState &state) const
+        {
+            const UINT leftChildIndex = node.internalNode.leftNodeIndex;
+            const UINT rightChildIndex = node.rightNodeIndex;
+
+            ChildBoxTestResult result;
+            m_pTestChildBoxes(ray, state.closestHit.T, pNodes[leftChildIndex], pNodes[rightChildIndex], result);
+
+            if (result.LeftHit && result.RightHit)
+            {
+                const bool traverseRightSideFirst = result.RightT < result.LeftT;
+                state.stack.push_back(traverseRightSideFirst ? leftChildIndex : rightChildIndex);
+                state.stack.push_back(traverseRightSideFirst ? rightChildIndex : leftChildIndex);
+            }
+            else if (result.LeftHit || result.RightHit)
+            {
+                state.stack.push_back(result.RightHit ? rightChildIndex : leftChildIndex);
+            }
+        }
+
+        void TestPrimitive(
+            const TraversalRay &ray,
+            const Primitive &primitive,
+            const PrimitiveMetaData &metadata,
+            const CullingFlags &culling,
+            const InstanceState &instance,
+            RayState &state) const
+        {
+            const bool geomOpaque = (metadata.GeometryFlags & D3D12_RAYTRACING_GEOMETRY_FLAG_OPAQUE) != 0;
+            const bool opaque = IsOpaque(geomOpaque, instance.InstanceFlags, m_settings.RayFlags);
+            if (Cull(opaque, m_settings.RayFlags))
+            {
+                return;
+            }
+            state.counters.NumPrimitiveTests++;
+
+            CpuRayHit candidateHit = {};
+            if (primitive.PrimitiveType == PROCEDURAL_PRIMITIVE_TYPE)
+            {
+                float hitT;
+                UINT hitKind = 0;
+                bool bHit;
+                if (m_settings.pIntersectionCallback)
+                {
+                    bHit = m_settings.pIntersectionCallback(m_settings.pCallbackContext, state.rayIndex, ray.Origin, ray.Direction, primitive.aabb, hitT, hitKind);
+                }
+                else
+                {
+                    bHit = RayProceduralBoxIntersect(ray, state.tMin, primitive.aabb, hitT);
+                }
+
+                // Same acceptance as Fallback_ReportHit()
+                if (!bHit || hitT < state.tMin || state.closestHit.T <= hitT)
+                {
+                    return;
+                }
+                candidateHit.T = hitT;
+                candidateHit.HitKind = hitKind;
+            }
+            else
+            {
+                TriangleTestResult result;
+                const bool bHit = (m_settings.TriangleTest == CpuTriangleIntersectionTest::MollerTrumbore) ?
+                    RayTriangleIntersectMollerTrumbore(state.closestHit.T, culling, ray, primitive.triangle, result) :
+                    RayTriangleIntersectWatertight(state.closestHit.T, culling, ray, primitive.triangle, result);
+
+                // Same acceptance as TestLeafNodeIntersections()
+                if (!bHit || !(result.T < state.closestHit.T && result.T > state.tMin))
+                {
+                    return;
+                }
+                candidateHit.T = result.T;
+                candidateHit.Barycentrics[0] = result.Barycentrics[0];
+                candidateHit.Barycentrics[1] = result.Barycentrics[1];
+                candidateHit.HitKind = result.FrontFace ? HitKindTriangleFrontFace : HitKindTriangleBackFace;
+            }
+            candidateHit.PrimitiveIndex = metadata.PrimitiveIndex;
+            candidateHit.GeometryContributionToHitGroupIndex = metadata.GeometryContributionToHitGroupIndex;
+            candidateHit.InstanceIndex = instance.InstanceIndex;
+            candidateHit.InstanceID = instance.InstanceID;
+
+            CpuAnyHitResult anyHitResult = CpuAnyHitResult::Accept;
+            if (!opaque && m_settings.pAnyHitCallback)
+            {
+                anyHitResult = m_settings.pAnyHitCallback(m_settings.pCallbackContext, state.rayIndex, candidateHit);
+            }
+
+            if (anyHitResult != CpuAnyHitResult::Ignore)
+            {
+                state.closestHit = candidateHit;
+            }
+            state.endSearch = (anyHitResult == CpuAnyHitResult::AcceptAndEndSearch) ||
+                (anyHitResult == CpuAnyHitResult::Accept && (m_settings.RayFlags & D3D12_RAY_FLAG_ACCEPT_FIRST_HIT_AND_END_SEARCH));
+        }
+
+        const CpuTraceSettings &m_settings;
+        ChildBoxTestFunction m_pTestChildBoxes;
+        QuantizedChildBoxTestFunction m_pTestQuantizedChildBoxes;
+    };
+
+    static ChildBoxTestFunction GetChildBoxTestFunction(CpuBvh2SimdLevel simdLevel)
+    {
+        switch (simdLevel)
+        {
+        case CpuBvh2SimdLevel::Avx2:
+            return TestChildBoxesAvx2;
+        case CpuBvh2SimdLevel::Sse41:
+            return TestChildBoxesSse41;
+        case CpuBvh2SimdLevel::Scalar:
+            return TestChildBoxesScalar;
+        default:
+            ThrowFailure(E_INVALIDARG, L"Unrecognized CpuBvh2SimdLevel");
+            return nullptr;
+        }
+    }
+
+    // A 4-wide node already fills an SSE register, AVX2 has nothing to add
+    static QuantizedChildBoxTestFunction GetQuantizedChildBoxTestFunction(CpuBvh2SimdLevel simdLevel)
+    {
+        switch (simdLevel)
+        {
+        case CpuBvh2SimdLevel::Avx2:
+        case CpuBvh2SimdLevel::Sse41:
+            return TestQuantizedChildBoxesSse41;
+        case CpuBvh2SimdLevel::Scalar:
+            return TestQuantizedChildBoxesScalar;
+        default:
+            ThrowFailure(E_INVALIDARG, L"Unrecognized CpuBvh2SimdLevel");
+            return nullptr;
+        }
+    }
+}
+
+void TraceRaysOnCpu(
+    _In_  const void *pAccelerationStructure,
+    _In_  D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE type,
+    _In_reads_(numRays) const FallbackLayer::CpuRay *pRays,
+    _In_  UINT numRays,
+    _In_  const FallbackLayer::CpuTraceSettings &settings,
+    _Out_writes_(numRays) FallbackLayer::CpuRayHit *pHits,
+    _Out_opt_ FallbackLayer::CpuTraceStats *pStats)
+{
+    using namespace FallbackLayer;
+
+    if (!pAccelerationStructure || (numRays && (!pRays || !pHits)))
+    {
+        ThrowFailure(E_INVALIDARG, L"TraceRaysOnCpu requires an acceleration structure, rays and hits");
+    }
+    if (type != D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL && type != D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL)
+    {
+        ThrowFailure(E_INVALIDARG, L"Unrecognized D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE provided");
+    }
+
+    const CpuBvh2SimdLevel supportedSimdLevel = GetSupportedCpuBvh2SimdLevel();
+    const CpuBvh2SimdLevel simdLevel = (settings.SimdLevel == CpuBvh2SimdLevel::Auto) ?
+        supportedSimdLevel : std::min(settings.SimdLevel, supportedSimdLevel);
+    const CpuTraversal traversal(settings, GetChildBoxTestFunction(simdLevel), GetQuantizedChildBoxTestFunction(simdLevel));
+
+    const BYTE *pData = (const BYTE *)pAccelerationStructure;
+    const bool bTopLevel = type == D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL;
+    const UINT raysPerPacket = std::max(1u, settings.RaysPerPacket);
+    const UINT numPackets = numRays ? DivideAndRoundUp(numRays, raysPerPacket) : 0;
+    const UINT numThreads = std::min(
+        settings.NumThreads ? settings.NumThreads : std::max(1u, std::thread::hardware_concurrency()),
+        std::max(1u, numPackets));
+
+    const auto startTime = std::chrono::high_resolution_clock::now();
+
+    std::atomic<UINT> nextPacket(0);
+    std::vector<TraceCounters> threadCounters(numThreads);
+    auto tracePackets = [&](UINT threadIndex)
+    {
+        TraceCounters &counters = threadCounters[threadIndex];
+        counters = {};
+        std::vector<UINT> stack;
+        stack.reserve(128);
+
+        for (UINT packet = nextPacket++; packet < numPackets; packet = nextPacket++)
+        {
+            const UINT end = std::min(numRays, (packet + 1) * raysPerPacket);
+            for (UINT rayIndex = packet * raysPerPacket; rayIndex < end; rayIndex++)
+            {
+                const CpuRay &ray = pRays[rayIndex];
+                RayState state = { rayIndex, ray.TMin, {}, false, stack, counters };
+                state.closestHit.T = ray.TMax;
+                state.closestHit.InstanceIndex = NoHitInstanceIndex;
+
+                if (bTopLevel)
+                {
+                    traversal.TraceTopLevel(pData, ray, state);
+                }
+                else
+                {
+                    TraversalRay traversalRay;
+                    GetRayData(ray.Origin, ray.Direction, traversalRay);
+
+                    const InstanceState instance = {};
+                    traversal.TraceBottomLevel(pData, traversalRay, instance, state);
+                }
+
+                counters.NumHits += (state.closestHit.InstanceIndex != NoHitInstanceIndex);
+                pHits[rayIndex] = state.closestHit;
+            }
+        }
+    };
+
+    std::vector<std::future<void>> workers;
+    for (UINT threadIndex = 1; threadIndex < numThreads; threadIndex++)
+    {
+        workers.push_back(std::async(std::launch::async, tracePackets, threadIndex));
+    }
+    tracePackets(0);
+    for (auto &worker : workers)
+    {
+        worker.get();
+    }
+
+    if (pStats)
+    {
+        const std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - startTime;
+
+        *pStats = {};
+        for (const TraceCounters &counters : threadCounters)
+        {
+            pStats->NumHits += counters.NumHits;
+            pStats->NumNodesVisited += counters.NumNodesVisited;
+            pStats->NumPrimitiveTests += counters.NumPrimitiveTests;
+            pStats->NumInstancesVisited += counters.NumInstancesVisited;
+        }
+        pStats->NumRays = numRays;
+        pStats->ElapsedSeconds = elapsed.count();
+        pStats->RaysPerSecond = elapsed.count() > 0.0 ? numRays / elapsed.count() : 0.0;
+        pStats->SimdLevel = simdLevel;
+    }
+}
@@ -0,0 +1,125 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+#pragma once
+
+namespace FallbackLayer
+{
+    struct CpuRay
+    {
+        float Origin[3];
+        float TMin;
+        float Direction[3];
+        float TMax;
+    };
+
+    struct CpuRayHit
+    {
+        // TMax of the ray if nothing was hit
+        float T;
+        float Barycentrics[2];
+        UINT HitKind;
+
+        UINT PrimitiveIndex;
+        UINT GeometryContributionToHitGroupIndex;
+
+        // NoHitInstanceIndex if nothing was hit. Bottom-level traces report instance 0.
+        UINT InstanceIndex;
+        UINT InstanceID;
+    };
+
+    static const UINT NoHitInstanceIndex = ~0u;
+
+    // HIT_KIND_TRIANGLE_FRONT_FACE/HIT_KIND_TRIANGLE_BACK_FACE in HLSL
+    static const UINT HitKindTriangleFrontFace = 0xFE;
+    static const UINT HitKindTriangleBackFace = 0xFF;
+
+    // Result of an any-hit callback, same meaning as the IGNORE/ACCEPT/END_SEARCH
+    // values TraverseFunction.hlsli gets back from any-hit shaders
+    enum class CpuAnyHitResult
+    {
+        Ignore,
+        Accept,
+        AcceptAndEndSearch,
+    };
+
+    // Called for candidate hits on non-opaque geometry
+    typedef CpuAnyHitResult(*CpuAnyHitCallback)(void *pContext, UINT rayIndex, const CpuRayHit &candidateHit);
+
+    // Called for procedural primitives in place of an intersection shader. Returns
+    // true and fills in T and HitKind if the object space ray hits the primitive.
+    // Without one, procedural primitives are hit where the ray enters their box.
+    typedef bool(*CpuIntersectionCallback)(
+        void *pContext,
+        UINT rayIndex,
+        const float objectRayOrigin[3],
+        const float objectRayDirection[3],
+        const AABB &primitiveBox,
+        float &hitT,
+        UINT &hitKind);
+
+    enum class CpuTriangleIntersectionTest
+    {
+        // Watertight test from TraverseFunction.hlsli, matches the GPU traversal
+        Watertight,
+
+        // Moller-Trumbore, cheaper but can miss hits exactly on shared edges
+        MollerTrumbore,
+    };
+
+    struct CpuTraceSettings
+    {
+        // D3D12_RAY_FLAGS applied to every ray
+        UINT RayFlags = D3D12_RAY_FLAG_NONE;
+        UINT InstanceInclusionMask = 0xff;
+
+        CpuTriangleIntersectionTest TriangleTest = CpuTriangleIntersectionTest::Watertight;
+
+        // Number of threads tracing rays, 0 uses all hardware threads. Rays are handed
+        // out to threads in packets of RaysPerPacket consecutive rays.
+        UINT NumThreads = 0;
+        UINT RaysPerPacket = 256;
+
+        // Ray/box tests only, every level returns identical hits
+        CpuBvh2SimdLevel SimdLevel = CpuBvh2SimdLevel::Auto;
+
+        CpuAnyHitCallback pAnyHitCallback = nullptr;
+        CpuIntersectionCallback pIntersectionCallback = nullptr;
+        void *pCallbackContext = nullptr;
+    };
+
+    struct CpuTraceStats
+    {
+        UINT64 NumRays;
+        UINT64 NumHits;
+        UINT64 NumNodesVisited;
+        UINT64 NumPrimitiveTests;
+        UINT64 NumInstancesVisited;
+
+        double ElapsedSeconds;
+        double RaysPerSecond;
+
+        CpuBvh2SimdLevel SimdLevel;
+    };
+}
+
+// Traces rays against an acceleration structure in the fallback layer's memory
+// layout. Like the rest of the CPU path, every GPU VA in the acceleration structure
+// (bottom-level pointers in instance descs) must be a CPU pointer. Bottom levels
+// built with CpuBvhNodeFormat::QuantizedBvh4 are traced too, on their own or
+// through instances.
+void TraceRaysOnCpu(
+    _In_  const void *pAccelerationStructure,
+    _In_  D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE type,
+    _In_reads_(numRays) const FallbackLayer::CpuRay *pRays,
+    _In_  UINT numRays,
+    _In_  const FallbackLayer::CpuTraceSettings &settings,
+    _Out_writes_(numRays) FallbackLayer::CpuRayHit *pHits,
+    _Out_opt_ FallbackLayer::CpuTraceStats *pStats = nullptr);
@@ -0,0 +1,302 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+#include "stdafx.h"
+
+namespace FallbackLayerBenchmark
+{
+    //
+    // On-disk layout of MiniEngine's .h3d files (see MiniEngine/Model/Model.h).
+    // Math::Vector3 is a 16 byte aligned SIMD register, hence the padded float4s.
+    //
+    namespace H3D
+    {
+        struct alignas(16) Float3
+        {
+            float x, y, z, w;
+        };
+
+        struct BoundingBox
+        {
+            Float3 min;
+            Float3 max;
+        };
+
+        // Revision 1 and 2 files start with this, revision 0 files start with the Header.
+        // Only revision 1 is read here, revision 2 chunks are compressed.
+        struct FileHeader
+        {
+            UINT32 magic;
+            UINT32 version;
+            UINT32 sectionAlignment;
+            UINT32 indexSize;
+            UINT64 vertexDataOffset;
+            UINT64 indexDataOffset;
+            UINT64 vertexDataDepthOffset;
+            UINT64 indexDataDepthOffset;
+        };
+        static const UINT32 FileMagic = 0x20443348; // "H3D "
+
+        struct Header
+        {
+            UINT32 meshCount;
+            UINT32 materialCount;
+            UINT32 vertexDataByteSize;
+            UINT32 indexDataByteSize;
+            UINT32 vertexDataByteSizeDepth;
+            BoundingBox boundingBox;
+        };
+
+        enum
+        {
+            attrib_position = 0,
+            attrib_format_float = 5,
+            maxAttribs = 16,
+        };
+
+        struct Attrib
+        {
+            UINT16 offset;
+            UINT16 normalized;
+            UINT16 components;
+            UINT16 format;
+        };
+
+        struct Mesh
+        {
+            BoundingBox boundingBox;
+
+            UINT32 materialIndex;
+
+            UINT32 attribsEnabled;
+            UINT32 attribsEnabledDepth;
+            UINT32 vertexStride;
+            UINT32 vertexStrideDepth;
+            Attrib attrib[maxAttribs];
+            Attrib attribDepth[maxAttribs];
+
+            UINT32 vertexDataByteOffset;
+            UINT32 vertexCount;
+            UINT32 indexDataByteOffset;
+            UINT32 indexCount;
+
+            UINT32 vertexDataByteOffsetDepth;
+            UINT32 vertexCountDepth;
+        };
+
+        // Materials aren't needed to build a BVH and are skipped over
+        static const UINT SizeOfMaterial = 992;
+
+        static_assert(sizeof(FileHeader) == 48, "H3D file header layout doesn't match MiniEngine");
+        static_assert(sizeof(Header) == 64, "H3D header layout doesn't match MiniEngine");
+        static_assert(sizeof(Mesh) == 336, "H3D mesh layout doesn't match MiniEngine");
+    }
+
+    static D3D12_RAYTRACING_GEOMETRY_DESC CreateTriangleGeometryDesc(
+        const BYTE *pVertexData,
+        UINT vertexCount,
+        UINT vertexStride,
+        const BYTE *pIndexData,
+        UINT indexCount,
+        DXGI_FORMAT indexFormat)
+    {
+        D3D12_RAYTRACING_GEOMETRY_DESC geometryDesc = {};
+        geometryDesc.Type = D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES;
+        geometryDesc.Flags = D3D12_RAYTRACING_GEOMETRY_FLAG_OPAQUE;
+
+        auto &triangles = geometryDesc.Triangles;
+        triangles.VertexBuffer.StartAddress = (D3D12_GPU_VIRTUAL_ADDRESS)pVertexData;
+        triangles.VertexBuffer.StrideInBytes = vertexStride;
+        triangles.VertexCount = vertexCount;
+        triangles.VertexFormat = DXGI_FORMAT_R32G32B32_FLOAT;
+        triangles.IndexBuffer = (D3D12_GPU_VIRTUAL_ADDRESS)pIndexData;
+        triangles.IndexCount = indexCount;
+        triangles.IndexFormat = indexFormat;
+        return geometryDesc;
+    }
+
+    BenchmarkMesh CreateUniformGrid(UINT quadsPerSide)
+    {
+        const UINT verticesPerSide = quadsPerSide + 1;
+        const float spacing = 1.0f / quadsPerSide;
+
+        BenchmarkMesh mesh;
+        mesh.Name = "UniformGrid" + std::to_string(quadsPerSide) + "x" + std::to_string(quadsPerSide);
+        mesh.NumTriangles = 2 * quadsPerSide * quadsPerSide;
+
+        std::vector<float> vertices;
+        vertices.reserve(3 * verticesPerSide * verticesPerSide);
+        for (UINT z = 0; z < verticesPerSide; z++)
+        {
+            for (UINT x = 0; x < verticesPerSide; x++)
+            {
+                vertices.push_back(x * spacing);
+                vertices.push_back(0.0f);
+                vertices.push_back(z * spacing);
+            }
+        }
+
+        std::vector<UINT32> indices;
+        indices.reserve(3 * mesh.NumTriangles);
+        for (UINT z = 0; z < quadsPerSide; z++)
+        {
+            for (UINT x = 0; x < quadsPerSide; x++)
+            {
+                const UINT32 corner = z * verticesPerSide + x;
+                indices.insert(indices.end(), { corner, corner + verticesPerSide, corner + 1 });
+                indices.insert(indices.end(), { corner + 1, corner + verticesPerSide, corner + verticesPerSide + 1 });
+            }
+        }
+
+        mesh.VertexData.assign((const BYTE *)vertices.data(), (const BYTE *)(vertices.data() + vertices.size()));
+        mesh.IndexData.assign((const BYTE *)indices.data(), (const BYTE *)(indices.data() + indices.size()));
+        mesh.GeometryDescs.push_back(CreateTriangleGeometryDesc(
+            mesh.VertexData.data(), (UINT)vertices.size() / 3, sizeof(float) * 3,
+            mesh.IndexData.data(), (UINT)indices.size(), DXGI_FORMAT_R32_UINT));
+        return mesh;
+    }
+
+    BenchmarkMesh CreateSkinnyTriangles(UINT numTriangles, UINT seed)
+    {
+        const float length = 0.5f;
+        const float width = 0.001f;
+
+        BenchmarkMesh mesh;
+        mesh.Name = "SkinnyTriangles" + std::to_string(numTriangles);
+        mesh.NumTriangles = numTriangles;
+
+        std::mt19937 generator(seed);
+        std::uniform_real_distribution<float> unitDistribution(0.0f, 1.0f);
+        std::normal_distribution<float> directionDistribution;
+
+        std::vector<float> vertices;
+        vertices.reserve(9 * numTriangles);
+        for (UINT i = 0; i < numTriangles; i++)
+        {
+            float origin[3];
+            float direction[3];
+            for (UINT axis = 0; axis < 3; axis++)
+            {
+                origin[axis] = unitDistribution(generator);
+                direction[axis] = directionDistribution(generator);
+            }
+            const float directionLength = std::max(1e-6f, sqrtf(direction[0] * direction[0] + direction[1] * direction[1] + direction[2] * direction[2]));
+
+            // The third vertex sits next to the first one, off to the side along
+            // whichever axis the triangle is least aligned with
+            UINT sideAxis = 0;
+            for (UINT axis = 1; axis < 3; axis++)
+            {
+                if (fabsf(direction[axis]) < fabsf(direction[sideAxis])) sideAxis = axis;
+            }
+
+            for (UINT axis = 0; axis < 3; axis++) vertices.push_back(origin[axis]);
+            for (UINT axis = 0; axis < 3; axis++) vertices.push_back(origin[axis] + direction[axis] * length / directionLength);
+            for (UINT axis = 0; axis < 3; axis++) vertices.push_back(origin[axis] + (axis == sideAxis ? width : 0.0f));
+        }
+
+        // Non-indexed, every triangle has its own vertices
+        mesh.VertexData.assign((const BYTE *)vertices.data(), (const BYTE *)(vertices.data() + vertices.size()));
+        mesh.GeometryDescs.push_back(CreateTriangleGeometryDesc(
+            mesh.VertexData.data(), 3 * numTriangles, sizeof(float) * 3,
+            nullptr, 0, DXGI_FORMAT_UNKNOWN));
+        return mesh;
+    }
+
+    bool LoadH3DModel(const std::string &filename, BenchmarkMesh &mesh, std::string &errorMessage)
+    {
+        std::ifstream file(filename, std::ios::binary);
+        if (!file)
+        {
+            errorMessage = "Failed to open " + filename;
+            return false;
+        }
+
+        H3D::FileHeader fileHeader = {};
+        file.read((char *)&fileHeader.magic, sizeof(fileHeader.magic));
+        file.seekg(0);
+        const bool hasFileHeader = file && fileHeader.magic == H3D::FileMagic;
+        if (hasFileHeader)
+        {
+            file.read((char *)&fileHeader, sizeof(fileHeader));
+            if (file && fileHeader.version != 1)
+            {
+                // Revision 2 files are chunked and compressed, the sections can't be read in place
+                errorMessage = filename + " is a chunked .h3d file, convert it again without -compress or -quantize";
+                return false;
+            }
+        }
+
+        H3D::Header header = {};
+        std::vector<H3D::Mesh> h3dMeshes;
+        file.read((char *)&header, sizeof(header));
+        if (file)
+        {
+            h3dMeshes.resize(header.meshCount);
+            file.read((char *)h3dMeshes.data(), h3dMeshes.size() * sizeof(H3D::Mesh));
+            file.seekg((std::streamoff)header.materialCount * H3D::SizeOfMaterial, std::ios::cur);
+        }
+
+        // Revision 0 sections are packed right after the materials
+        mesh.VertexData.resize(header.vertexDataByteSize);
+        mesh.IndexData.resize(header.indexDataByteSize);
+        if (file)
+        {
+            if (hasFileHeader) file.seekg((std::streamoff)fileHeader.vertexDataOffset);
+            file.read((char *)mesh.VertexData.data(), mesh.VertexData.size());
+            if (hasFileHeader) file.seekg((std::streamoff)fileHeader.indexDataOffset);
+            file.read((char *)mesh.IndexData.data(), mesh.IndexData.size());
+        }
+        if (!file)
+        {
+            errorMessage = filename + " is truncated or isn't an .h3d file";
+            return false;
+        }
+
+        const size_t slash = filename.find_last_of("/\\");
+        mesh.Name = (slash == std::string::npos) ? filename : filename.substr(slash + 1);
+        mesh.NumTriangles = 0;
+        mesh.GeometryDescs.clear();
+
+        // Revision 0 doesn't store the index size, 32-bit models have four bytes of index data per index
+        UINT64 totalIndexCount = 0;
+        for (const H3D::Mesh &h3dMesh : h3dMeshes)
+        {
+            totalIndexCount += h3dMesh.indexCount;
+        }
+        const bool is32BitIndices = hasFileHeader ?
+            fileHeader.indexSize == sizeof(UINT32) :
+            totalIndexCount > 0 && header.indexDataByteSize == totalIndexCount * sizeof(UINT32);
+        const UINT indexSize = is32BitIndices ? sizeof(UINT32) : sizeof(UINT16);
+
+        for (const H3D::Mesh &h3dMesh : h3dMeshes)
+        {
+            const H3D::Attrib &position = h3dMesh.attrib[H3D::attrib_position];
+            if (position.format != H3D::attrib_format_float || position.components != 3 ||
+                h3dMesh.vertexDataByteOffset + (UINT64)h3dMesh.vertexCount * h3dMesh.vertexStride > mesh.VertexData.size() ||
+                h3dMesh.indexDataByteOffset + (UINT64)h3dMesh.indexCount * indexSize > mesh.IndexData.size())
+            {
+                errorMessage = filename + " has a mesh without float3 positions or with out of range vertex/index data";
+                return false;
+            }
+
+            // H3D indices are relative to the mesh's first vertex
+            mesh.GeometryDescs.push_back(CreateTriangleGeometryDesc(
+                mesh.VertexData.data() + h3dMesh.vertexDataByteOffset + position.offset,
+                h3dMesh.vertexCount,
+                h3dMesh.vertexStride,
+                mesh.IndexData.data() + h3dMesh.indexDataByteOffset,
+                h3dMesh.indexCount,
+                is32BitIndices ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT));
+            mesh.NumTriangles += h3dMesh.indexCount / 3;
+        }
+        return true;
+    }
+}
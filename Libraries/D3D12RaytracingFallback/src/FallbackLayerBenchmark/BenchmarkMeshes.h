@@ -0,0 +1,38 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+#pragma once
+
+namespace FallbackLayerBenchmark
+{
+    // Triangle geometry ready to be handed to the CPU builder. The geometry descs
+    // point straight into VertexData/IndexData, which the CPU builder reads as if
+    // they were GPU VAs.
+    struct BenchmarkMesh
+    {
+        std::string Name;
+        std::vector<BYTE> VertexData;
+        std::vector<BYTE> IndexData;
+        std::vector<D3D12_RAYTRACING_GEOMETRY_DESC> GeometryDescs;
+        UINT NumTriangles = 0;
+    };
+
+    // Flat NxN grid of quads, two triangles each. Evenly sized, non-overlapping
+    // triangles are close to the best case for a SAH builder.
+    BenchmarkMesh CreateUniformGrid(UINT quadsPerSide);
+
+    // Long, thin triangles at random orientations. Their boxes are mostly empty
+    // and overlap heavily, which is close to the worst case for a SAH builder.
+    BenchmarkMesh CreateSkinnyTriangles(UINT numTriangles, UINT seed);
+
+    // Loads the main vertex stream of every mesh in a MiniEngine .h3d model, one
+    // geometry desc per mesh. Returns false and fills errorMessage on failure.
+    bool LoadH3DModel(const std::string &filename, BenchmarkMesh &mesh, std::string &errorMessage);
+}
@@ -0,0 +1,525 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+//
+// Builds bottom-level BVHs with the CPU builder for a set of procedural meshes
+// and any .h3d models passed on the command line, and reports build throughput
+// and tree quality as JSON so results can be compared across commits. Every
+// build is repeated with CpuBvhNodeFormat::QuantizedBvh4 and both outputs are
+// traced with the same random rays to compare size and traversal cost:
+//
+//   FallbackLayerBenchmark.exe [options] [model.h3d ...]
+//     --threads <n>       builder threads, 0 (default) uses all hardware threads
+//     --iterations <n>    timed builds per mesh and build flag, default 5
+//     --max-leaf <n>      MaxPrimitivesInLeaf, default MAX_TRIS_IN_LEAF
+//     --simd <level>      auto (default), scalar, sse41 or avx2
+//     --rays <n>          rays traced against each node format, default 65536
+//     --serial            use the serial reference builder
+//     --no-procedural     only benchmark the models given on the command line
+//     --json <file>       write the JSON report to a file rather than stdout
+//
+#include "stdafx.h"
+
+using namespace FallbackLayer;
+using namespace FallbackLayerBenchmark;
+
+namespace FallbackLayerBenchmark
+{
+    struct BenchmarkOptions
+    {
+        // Measures the parallel builder unless --serial is given
+        BenchmarkOptions()
+        {
+            Settings.BuilderType = CpuBvh2BuilderType::ParallelBinnedSah;
+        }
+
+        CpuBvh2BuildSettings Settings;
+        UINT NumIterations = 5;
+        UINT NumRays = 64 * 1024;
+        bool bProceduralMeshes = true;
+        std::string JsonFilename;
+        std::vector<std::string> ModelFilenames;
+    };
+
+    struct BuildFlagsConfig
+    {
+        const char *Name;
+        D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS Flags;
+    };
+
+    static const BuildFlagsConfig BuildFlagsConfigs[] =
+    {
+        { "PreferFastBuild", D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_BUILD },
+        { "Default", D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_NONE },
+        { "PreferFastTrace", D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE },
+    };
+
+    // Tree shape measured by walking the output nodes
+    struct TreeShape
+    {
+        UINT MaxDepth = 0;
+        double AverageLeafDepth = 0.0;
+
+        // Number of leaves indexed by the number of primitives they hold
+        std::vector<UINT> LeafSizeHistogram;
+    };
+
+    // Size and trace cost of one node format of the same BVH
+    struct NodeFormatResult
+    {
+        UINT NodeBytes;
+        UINT OutputBytes;
+        float SahCost;
+
+        UINT64 NumHits;
+        double RaysPerSecond;
+        double NodesVisitedPerRay;
+        double PrimitiveTestsPerRay;
+    };
+
+    struct BenchmarkResult
+    {
+        std::string MeshName;
+        const char *BuildFlagsName;
+        UINT NumTriangles;
+        UINT NumGeometries;
+
+        double MinBuildSeconds;
+        double MedianBuildSeconds;
+        double TrianglesPerSecond;
+
+        CpuBvh2BuildStats Stats;
+        TreeShape Shape;
+        UINT OutputSizeInBytes;
+
+        NodeFormatResult Fp32Bvh2;
+        NodeFormatResult QuantizedBvh4;
+    };
+
+    static const char *GetSimdLevelName(CpuBvh2SimdLevel level)
+    {
+        switch (level)
+        {
+        case CpuBvh2SimdLevel::Scalar: return "Scalar";
+        case CpuBvh2SimdLevel::Sse41: return "SSE4.1";
+        case CpuBvh2SimdLevel::Avx2: return "AVX2";
+        default: return "Auto";
+        }
+    }
+
+    static TreeShape MeasureTreeShape(const BYTE *pBottomLevel)
+    {
+        const BVHOffsets &offsets = *(const BVHOffsets *)pBottomLevel;
+        const AABBNode *pNodes = (const AABBNode *)(pBottomLevel + offsets.offsetToBoxes);
+
+        TreeShape shape;
+        UINT64 totalLeafDepth = 0;
+        UINT numLeaves = 0;
+
+        // Nodes are stored depth first with the right child directly after its parent
+        std::vector<std::pair<UINT, UINT>> stack;
+        stack.push_back({ 0, 0 });
+        while (!stack.empty())
+        {
+            const UINT nodeIndex = stack.back().first;
+            const UINT depth = stack.back().second;
+            stack.pop_back();
+
+            const AABBNode &node = pNodes[nodeIndex];
+            shape.MaxDepth = std::max(shape.MaxDepth, depth);
+            if (node.leaf)
+            {
+                const UINT numPrimitives = node.leafNode.numTriangleIds;
+                if (numPrimitives >= shape.LeafSizeHistogram.size())
+                {
+                    shape.LeafSizeHistogram.resize(numPrimitives + 1);
+                }
+                shape.LeafSizeHistogram[numPrimitives]++;
+                totalLeafDepth += depth;
+                numLeaves++;
+            }
+            else
+            {
+                stack.push_back({ node.internalNode.leftNodeIndex, depth + 1 });
+                stack.push_back({ nodeIndex + 1, depth + 1 });
+            }
+        }
+
+        shape.AverageLeafDepth = numLeaves ? (double)totalLeafDepth / numLeaves : 0.0;
+        return shape;
+    }
+
+    // Rays from random points on a sphere around the root box towards random
+    // points inside it, so flat meshes are hit from above rather than grazed.
+    // Fixed seed, every format and every run traces the same rays.
+    static std::vector<CpuRay> CreateBenchmarkRays(const BYTE *pBottomLevel, UINT numRays)
+    {
+        const BVHOffsets &offsets = *(const BVHOffsets *)pBottomLevel;
+        const AABBNode &root = *(const AABBNode *)(pBottomLevel + offsets.offsetToBoxes);
+        const float radius = 2.0f * sqrtf(root.halfDim[0] * root.halfDim[0] + root.halfDim[1] * root.halfDim[1] + root.halfDim[2] * root.halfDim[2]);
+
+        std::mt19937 generator(numRays);
+        std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+        std::normal_distribution<float> directionDistribution;
+
+        std::vector<CpuRay> rays(numRays);
+        for (CpuRay &ray : rays)
+        {
+            float direction[3];
+            for (UINT axis = 0; axis < 3; axis++)
+            {
+                direction[axis] = directionDistribution(generator);
+            }
+            const float length = std::max(1e-6f, sqrtf(direction[0] * direction[0] + direction[1] * direction[1] + direction[2] * direction[2]));
+
+            ray = {};
+            for (UINT axis = 0; axis < 3; axis++)
+            {
+                ray.Origin[axis] = root.center[axis] + radius * direction[axis] / length;
+                ray.Direction[axis] = root.center[axis] + root.halfDim[axis] * distribution(generator) - ray.Origin[axis];
+            }
+            ray.TMin = 0.0f;
+            ray.TMax = FLT_MAX;
+        }
+        return rays;
+    }
+
+    static NodeFormatResult MeasureNodeFormat(
+        const BYTE *pBottomLevel,
+        float sahCost,
+        const std::vector<CpuRay> &rays,
+        const BenchmarkOptions &options)
+    {
+        const BVHOffsets &offsets = *(const BVHOffsets *)pBottomLevel;
+
+        NodeFormatResult result = {};
+        result.NodeBytes = offsets.offsetToVertices - offsets.offsetToBoxes;
+        result.OutputBytes = offsets.totalSize;
+        result.SahCost = sahCost;
+        if (rays.empty())
+        {
+            return result;
+        }
+
+        CpuTraceSettings traceSettings;
+        traceSettings.NumThreads = options.Settings.NumThreads;
+        traceSettings.SimdLevel = options.Settings.SimdLevel;
+
+        // Counters are the same every run, only the best time is kept
+        std::vector<CpuRayHit> hits(rays.size());
+        for (UINT i = 0; i < options.NumIterations; i++)
+        {
+            CpuTraceStats stats;
+            TraceRaysOnCpu(pBottomLevel, D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL, rays.data(), (UINT)rays.size(), traceSettings, hits.data(), &stats);
+            result.NumHits = stats.NumHits;
+            result.RaysPerSecond = std::max(result.RaysPerSecond, stats.RaysPerSecond);
+            result.NodesVisitedPerRay = (double)stats.NumNodesVisited / rays.size();
+            result.PrimitiveTestsPerRay = (double)stats.NumPrimitiveTests / rays.size();
+        }
+        return result;
+    }
+
+    static BenchmarkResult RunBenchmark(
+        const BenchmarkMesh &mesh,
+        const BuildFlagsConfig &buildFlags,
+        const BenchmarkOptions &options)
+    {
+        D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC desc = {};
+        desc.Inputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
+        desc.Inputs.Flags = buildFlags.Flags;
+        desc.Inputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
+        desc.Inputs.NumDescs = (UINT)mesh.GeometryDescs.size();
+        desc.Inputs.pGeometryDescs = mesh.GeometryDescs.data();
+
+        // Same upper bound GetRaytracingAccelerationStructurePrebuildInfo uses, a
+        // binary tree with one primitive per leaf
+        const UINT64 maxOutputSize = sizeof(BVHOffsets) +
+            (2 * (UINT64)mesh.NumTriangles - 1) * sizeof(AABBNode) +
+            (UINT64)mesh.NumTriangles * (sizeof(Primitive) + sizeof(PrimitiveMetaData));
+        std::unique_ptr<BYTE[]> pOutput(new BYTE[maxOutputSize]);
+
+        BenchmarkResult result = {};
+        result.MeshName = mesh.Name;
+        result.BuildFlagsName = buildFlags.Name;
+        result.NumTriangles = mesh.NumTriangles;
+        result.NumGeometries = desc.Inputs.NumDescs;
+
+        // Untimed warm-up so the first iteration doesn't pay for page faults on
+        // the output or spinning up the thread pool
+        BuildRaytracingAccelerationStructureOnCpu(&desc, options.Settings, pOutput.get());
+
+        std::vector<double> buildSeconds;
+        for (UINT i = 0; i < options.NumIterations; i++)
+        {
+            const auto start = std::chrono::high_resolution_clock::now();
+            BuildRaytracingAccelerationStructureOnCpu(&desc, options.Settings, pOutput.get(), &result.Stats);
+            const auto end = std::chrono::high_resolution_clock::now();
+            buildSeconds.push_back(std::chrono::duration<double>(end - start).count());
+        }
+
+        std::sort(buildSeconds.begin(), buildSeconds.end());
+        result.MinBuildSeconds = buildSeconds.front();
+        result.MedianBuildSeconds = buildSeconds[buildSeconds.size() / 2];
+        result.TrianglesPerSecond = result.MedianBuildSeconds > 0.0 ? mesh.NumTriangles / result.MedianBuildSeconds : 0.0;
+
+        result.Shape = MeasureTreeShape(pOutput.get());
+        result.OutputSizeInBytes = ((const BVHOffsets *)pOutput.get())->totalSize;
+
+        // The quantized output is never larger than the binary one, the same
+        // upper bound covers it
+        CpuBvh2BuildSettings quantizedSettings = options.Settings;
+        quantizedSettings.NodeFormat = CpuBvhNodeFormat::QuantizedBvh4;
+        CpuBvh2BuildStats quantizedStats;
+        std::unique_ptr<BYTE[]> pQuantizedOutput(new BYTE[maxOutputSize]);
+        BuildRaytracingAccelerationStructureOnCpu(&desc, quantizedSettings, pQuantizedOutput.get(), &quantizedStats);
+
+        const std::vector<CpuRay> rays = CreateBenchmarkRays(pOutput.get(), options.NumRays);
+        result.Fp32Bvh2 = MeasureNodeFormat(pOutput.get(), result.Stats.SahCost, rays, options);
+        result.QuantizedBvh4 = MeasureNodeFormat(pQuantizedOutput.get(), quantizedStats.QuantizedSahCost, rays, options);
+        if (result.Fp32Bvh2.NumHits != result.QuantizedBvh4.NumHits)
+        {
+            fprintf(stderr, "Warning: %s hit %llu rays with fp32 nodes and %llu with quantized nodes\n",
+                mesh.Name.c_str(), result.Fp32Bvh2.NumHits, result.QuantizedBvh4.NumHits);
+        }
+        return result;
+    }
+
+    static std::string EscapeJsonString(const std::string &value)
+    {
+        std::string escaped;
+        for (char c : value)
+        {
+            if (c == '"' || c == '\\')
+            {
+                escaped += '\\';
+                escaped += c;
+            }
+            else if ((unsigned char)c < 0x20)
+            {
+                char buffer[8];
+                sprintf_s(buffer, "\\u%04x", (unsigned char)c);
+                escaped += buffer;
+            }
+            else
+            {
+                escaped += c;
+            }
+        }
+        return escaped;
+    }
+
+    static void WriteNodeFormatJson(std::ostream &out, const char *name, const NodeFormatResult &result, bool bLast)
+    {
+        out << "        \"" << name << "\": { ";
+        out << "\"nodeBytes\": " << result.NodeBytes << ", ";
+        out << "\"outputBytes\": " << result.OutputBytes << ", ";
+        out << "\"sahCost\": " << result.SahCost << ", ";
+        out << "\"numHits\": " << result.NumHits << ", ";
+        out << "\"raysPerSecond\": " << result.RaysPerSecond << ", ";
+        out << "\"nodesVisitedPerRay\": " << result.NodesVisitedPerRay << ", ";
+        out << "\"primitiveTestsPerRay\": " << result.PrimitiveTestsPerRay;
+        out << " }" << (bLast ? "" : ",") << "\n";
+    }
+
+    static void WriteJsonReport(
+        std::ostream &out,
+        const BenchmarkOptions &options,
+        const std::vector<BenchmarkResult> &results)
+    {
+        const UINT numThreads = options.Settings.NumThreads ? options.Settings.NumThreads : std::max(1u, std::thread::hardware_concurrency());
+
+        out << "{\n";
+        out << "  \"builder\": \"" << (options.Settings.BuilderType == CpuBvh2BuilderType::Serial ? "Serial" : "ParallelBinnedSah") << "\",\n";
+        out << "  \"numThreads\": " << numThreads << ",\n";
+        out << "  \"maxPrimitivesInLeaf\": " << options.Settings.MaxPrimitivesInLeaf << ",\n";
+        out << "  \"iterations\": " << options.NumIterations << ",\n";
+        out << "  \"numRays\": " << options.NumRays << ",\n";
+        out << "  \"results\": [\n";
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            const BenchmarkResult &result = results[i];
+            out << "    {\n";
+            out << "      \"mesh\": \"" << EscapeJsonString(result.MeshName) << "\",\n";
+            out << "      \"buildFlags\": \"" << result.BuildFlagsName << "\",\n";
+            out << "      \"simdLevel\": \"" << GetSimdLevelName(result.Stats.SimdLevel) << "\",\n";
+            out << "      \"numTriangles\": " << result.NumTriangles << ",\n";
+            out << "      \"numGeometries\": " << result.NumGeometries << ",\n";
+            out << "      \"minBuildMs\": " << result.MinBuildSeconds * 1000.0 << ",\n";
+            out << "      \"medianBuildMs\": " << result.MedianBuildSeconds * 1000.0 << ",\n";
+            out << "      \"trianglesPerSecond\": " << result.TrianglesPerSecond << ",\n";
+            out << "      \"numNodes\": " << result.Stats.NumNodes << ",\n";
+            out << "      \"numLeaves\": " << result.Stats.NumLeaves << ",\n";
+            out << "      \"sahCost\": " << result.Stats.SahCost << ",\n";
+            out << "      \"maxDepth\": " << result.Shape.MaxDepth << ",\n";
+            out << "      \"averageLeafDepth\": " << result.Shape.AverageLeafDepth << ",\n";
+            out << "      \"leafSizeHistogram\": [";
+            for (size_t j = 0; j < result.Shape.LeafSizeHistogram.size(); j++)
+            {
+                out << (j ? ", " : "") << result.Shape.LeafSizeHistogram[j];
+            }
+            out << "],\n";
+            out << "      \"outputBytes\": " << result.OutputSizeInBytes << ",\n";
+            out << "      \"outputBytesPerTriangle\": " << (result.NumTriangles ? (double)result.OutputSizeInBytes / result.NumTriangles : 0.0) << ",\n";
+            out << "      \"peakBuildMemoryBytes\": " << result.Stats.PeakMemoryInBytes << ",\n";
+            out << "      \"numHeapAllocations\": " << result.Stats.NumHeapAllocations << ",\n";
+            out << "      \"nodeFormats\": {\n";
+            WriteNodeFormatJson(out, "fp32Bvh2", result.Fp32Bvh2, false);
+            WriteNodeFormatJson(out, "quantizedBvh4", result.QuantizedBvh4, true);
+            out << "      }\n";
+            out << "    }" << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+        out << "  ]\n";
+        out << "}\n";
+    }
+
+    static bool ParseSimdLevel(const std::string &name, CpuBvh2SimdLevel &level)
+    {
+        if (name == "auto") level = CpuBvh2SimdLevel::Auto;
+        else if (name == "scalar") level = CpuBvh2SimdLevel::Scalar;
+        else if (name == "sse41") level = CpuBvh2SimdLevel::Sse41;
+        else if (name == "avx2") level = CpuBvh2SimdLevel::Avx2;
+        else return false;
+        return true;
+    }
+
+    static bool ParseOptions(int argc, char **argv, BenchmarkOptions &options)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            const std::string arg = argv[i];
+            const bool bHasValue = i + 1 < argc;
+            if (arg == "--threads" && bHasValue)
+            {
+                options.Settings.NumThreads = (UINT)std::stoul(argv[++i]);
+            }
+            else if (arg == "--iterations" && bHasValue)
+            {
+                options.NumIterations = std::max(1u, (UINT)std::stoul(argv[++i]));
+            }
+            else if (arg == "--max-leaf" && bHasValue)
+            {
+                options.Settings.MaxPrimitivesInLeaf = std::max(1u, (UINT)std::stoul(argv[++i]));
+            }
+            else if (arg == "--rays" && bHasValue)
+            {
+                options.NumRays = (UINT)std::stoul(argv[++i]);
+            }
+            else if (arg == "--simd" && bHasValue)
+            {
+                if (!ParseSimdLevel(argv[++i], options.Settings.SimdLevel)) return false;
+            }
+            else if (arg == "--serial")
+            {
+                options.Settings.BuilderType = CpuBvh2BuilderType::Serial;
+            }
+            else if (arg == "--no-procedural")
+            {
+                options.bProceduralMeshes = false;
+            }
+            else if (arg == "--json" && bHasValue)
+            {
+                options.JsonFilename = argv[++i];
+            }
+            else if (arg.size() > 2 && arg[0] == '-' && arg[1] == '-')
+            {
+                return false;
+            }
+            else
+            {
+                options.ModelFilenames.push_back(arg);
+            }
+        }
+        return true;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    BenchmarkOptions options;
+    if (!ParseOptions(argc, argv, options))
+    {
+        fprintf(stderr,
+            "Usage: %s [--threads n] [--iterations n] [--max-leaf n] [--simd auto|scalar|sse41|avx2] [--rays n]\n"
+            "          [--serial] [--no-procedural] [--json file] [model.h3d ...]\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<BenchmarkMesh> meshes;
+    if (options.bProceduralMeshes)
+    {
+        meshes.push_back(CreateUniformGrid(64));
+        meshes.push_back(CreateUniformGrid(512));
+        meshes.push_back(CreateSkinnyTriangles(16 * 1024, 1));
+        meshes.push_back(CreateSkinnyTriangles(256 * 1024, 2));
+    }
+    for (const std::string &filename : options.ModelFilenames)
+    {
+        BenchmarkMesh mesh;
+        std::string errorMessage;
+        if (!LoadH3DModel(filename, mesh, errorMessage))
+        {
+            fprintf(stderr, "%s\n", errorMessage.c_str());
+            return 1;
+        }
+        meshes.push_back(std::move(mesh));
+    }
+
+    std::vector<BenchmarkResult> results;
+    try
+    {
+        for (const BenchmarkMesh &mesh : meshes)
+        {
+            if (mesh.NumTriangles == 0)
+            {
+                fprintf(stderr, "Skipping %s, it has no triangles\n", mesh.Name.c_str());
+                continue;
+            }
+
+            for (const BuildFlagsConfig &buildFlags : BuildFlagsConfigs)
+            {
+                results.push_back(RunBenchmark(mesh, buildFlags, options));
+
+                const BenchmarkResult &result = results.back();
+                fprintf(stderr, "%-28s %-16s %9u tris %9.3f ms %8.2f Mtris/s  SAH %8.2f  depth %3u  quantized nodes %5.1f%%  Mrays/s %6.2f -> %6.2f\n",
+                    result.MeshName.c_str(),
+                    result.BuildFlagsName,
+                    result.NumTriangles,
+                    result.MedianBuildSeconds * 1000.0,
+                    result.TrianglesPerSecond / 1e6,
+                    result.Stats.SahCost,
+                    result.Shape.MaxDepth,
+                    100.0 * result.QuantizedBvh4.NodeBytes / result.Fp32Bvh2.NodeBytes,
+                    result.Fp32Bvh2.RaysPerSecond / 1e6,
+                    result.QuantizedBvh4.RaysPerSecond / 1e6);
+            }
+        }
+    }
+    catch (const _com_error &error)
+    {
+        fprintf(stderr, "BVH build failed with HRESULT 0x%08x\n", (UINT)error.Error());
+        return 1;
+    }
+
+    if (options.JsonFilename.empty())
+    {
+        WriteJsonReport(std::cout, options, results);
+    }
+    else
+    {
+        std::ofstream jsonFile(options.JsonFilename);
+        if (!jsonFile)
+        {
+            fprintf(stderr, "Failed to open %s\n", options.JsonFilename.c_str());
+            return 1;
+        }
+        WriteJsonReport(jsonFile, options, results);
+    }
+    return 0;
+}
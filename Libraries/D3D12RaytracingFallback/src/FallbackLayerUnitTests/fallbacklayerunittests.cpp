@@ -656,6 +656,20 @@ namespace FallbackLayerUnitTests
             }
         }
 
+        TEST_METHOD(R32IndexBufferBottomLevelCpuBVHBuilder)
+        {
+            CpuGeometryDescriptor testCases[] =
+            {
+                CpuGeometryDescriptor(ReferenceVerticies0, VERTEX_COUNT(ReferenceVerticies0), ReferenceR32Indices0, ARRAYSIZE(ReferenceR32Indices0)),
+                CpuGeometryDescriptor(ReferenceVerticies1, VERTEX_COUNT(ReferenceVerticies1), ReferenceR32Indices1, ARRAYSIZE(ReferenceR32Indices1))
+            };
+
+            for (UINT testIndex = 0; testIndex < ARRAYSIZE(testCases); testIndex++)
+            {
+                TestCpuBvh2Builder(testCases[testIndex]);
+            }
+        }
+
         TEST_METHOD(RedundantTrianglesBottomLevelGpuBVHBuilder)
         {
             std::vector<float> redundantTriangles;
@@ -688,6 +702,20 @@ namespace FallbackLayerUnitTests
             }
         }
 
+        TEST_METHOD(NoIndexBufferBottomLevelCpuBVHBuilder)
+        {
+            CpuGeometryDescriptor testCases[] =
+            {
+                CpuGeometryDescriptor(ReferenceVerticies0, VERTEX_COUNT(ReferenceVerticies0)),
+                CpuGeometryDescriptor(ReferenceVerticies1, VERTEX_COUNT(ReferenceVerticies1))
+            };
+
+            for (UINT testIndex = 0; testIndex < ARRAYSIZE(testCases); testIndex++)
+            {
+                TestCpuBvh2Builder(testCases[testIndex]);
+            }
+        }
+
         TEST_METHOD(BottomLevelGpuBVHBuilderWithTransforms)
         {
             const UINT numGeoms = 10;
@@ -704,6 +732,34 @@ namespace FallbackLayerUnitTests
             TestGpuBvh2Builder(testCases.data(), numGeoms);
         }
 
+        TEST_METHOD(BottomLevelCpuBVHBuilderWithTransforms)
+        {
+            const UINT numGeoms = 10;
+            float pMatrixStorage[numGeoms * 12];
+            std::vector<CpuGeometryDescriptor> testCases;
+            srand(10);
+            for (UINT i = 0; i < numGeoms; i++)
+            {
+                float *pMatrix = pMatrixStorage + FloatsPerMatrix * i;
+                GenerateRandomTranformation(pMatrix);
+                testCases.push_back(
+                    CpuGeometryDescriptor(ReferenceVerticies0, VERTEX_COUNT(ReferenceVerticies0), nullptr, 0, DXGI_FORMAT_UNKNOWN, pMatrix));
+            }
+            TestCpuBvh2Builder(testCases.data(), numGeoms);
+        }
+
+        TEST_METHOD(MultipleGeometrySingleBottomLevelCpuBVHBuilder_ArrayOfPointersLayout)
+        {
+            CpuGeometryDescriptor testCases[] =
+            {
+                CpuGeometryDescriptor(ReferenceVerticies0, VERTEX_COUNT(ReferenceVerticies0), ReferenceIndices0, ARRAYSIZE(ReferenceIndices0)),
+                CpuGeometryDescriptor(ReferenceVerticies1, VERTEX_COUNT(ReferenceVerticies1), ReferenceR32Indices1, ARRAYSIZE(ReferenceR32Indices1)),
+                CpuGeometryDescriptor(ReferenceVerticies1, VERTEX_COUNT(ReferenceVerticies1))
+            };
+
+            TestCpuBvh2Builder(testCases, ARRAYSIZE(testCases), D3D12_ELEMENTS_LAYOUT_ARRAY_OF_POINTERS);
+        }
+
         TEST_METHOD(MultipleGeometrySingleBottomLevelGpuBVHBuilder_ArrayOfPointersLayout)
         {
             TestMultipleGeometrySingleBottomLevelGpuBVHBuilder(D3D12_ELEMENTS_LAYOUT_ARRAY_OF_POINTERS);
@@ -775,6 +831,603 @@ namespace FallbackLayerUnitTests
                 testCase);
         }
 
+        TEST_METHOD(ParallelCpuBVHBuilderIsDeterministic)
+        {
+            TriangleSoup soup = GenerateTriangleSoup(2000, [](UINT i, float offset[3])
+            {
+                offset[0] = offset[1] = offset[2] = (i % 7) * 3.0f + (i % 13);
+            });
+            CpuGeometryDescriptor testCase = soup.GetGeometry();
+
+            const UINT threadCounts[] = { 1, 2, 3, 8, 0 };
+            AssertSameOutputForThreadCounts(testCase, ParallelBuildSettings(), threadCounts, ARRAYSIZE(threadCounts),
+                D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_NONE, L"CPU BVH output differs depending on the number of threads used");
+        }
+
+        TEST_METHOD(ParallelCpuBVHBuilderAllocationCount)
+        {
+            TriangleSoup soup = GenerateTriangleSoup(1000, [](UINT i, float offset[3])
+            {
+                offset[0] = offset[1] = offset[2] = (float)i;
+            });
+            CpuGeometryDescriptor testCase = soup.GetGeometry();
+
+            CpuBvh2BuildSettings serialSettings;
+            serialSettings.BuilderType = CpuBvh2BuilderType::Serial;
+            CpuBvh2BuildStats serialStats;
+            TestCpuBvh2Builder(&testCase, 1, D3D12_ELEMENTS_LAYOUT_ARRAY, serialSettings, nullptr, &serialStats);
+
+            CpuBvh2BuildSettings parallelSettings = ParallelBuildSettings();
+            parallelSettings.NumThreads = 1;
+            CpuBvh2BuildStats parallelStats;
+            TestCpuBvh2Builder(&testCase, 1, D3D12_ELEMENTS_LAYOUT_ARRAY, parallelSettings, nullptr, &parallelStats);
+
+            // The serial builder allocates per node, the arena-backed one shouldn't
+            const UINT numTriangles = (UINT)soup.Indices.size() / 3;
+            Assert::IsTrue(serialStats.NumHeapAllocations > numTriangles, L"Unexpectedly low allocation count for the serial CPU BVH builder");
+            Assert::IsTrue(parallelStats.NumHeapAllocations < 64, L"Arena-backed CPU BVH builder is allocating per node");
+            Assert::IsTrue(parallelStats.PeakMemoryInBytes <= serialStats.PeakMemoryInBytes, L"Arena-backed CPU BVH builder uses more memory than the serial builder");
+            Assert::AreEqual(serialStats.NumNodes, parallelStats.NumNodes, L"Binary BVHs over the same triangles should have the same node count");
+        }
+
+        TEST_METHOD(SimdCpuBVHBuilderMatchesScalarReference)
+        {
+            TriangleSoup soup = GenerateRandomTriangleSoup(2000, 3, 100);
+            CpuGeometryDescriptor testCase = soup.GetGeometry();
+
+            CpuBvh2BuildSettings scalarSettings = ParallelBuildSettings();
+            scalarSettings.SimdLevel = CpuBvh2SimdLevel::Scalar;
+            CpuBvh2BuildStats scalarStats;
+            std::unique_ptr<BYTE[]> pScalarData;
+            TestCpuBvh2Builder(&testCase, 1, D3D12_ELEMENTS_LAYOUT_ARRAY, scalarSettings, &pScalarData, &scalarStats);
+            Assert::IsTrue(scalarStats.SimdLevel == CpuBvh2SimdLevel::Scalar, L"Scalar CPU BVH build didn't use the scalar kernels");
+
+            // Levels the CPU doesn't support get clamped, the output has to match either way
+            const CpuBvh2SimdLevel simdLevels[] = { CpuBvh2SimdLevel::Sse41, CpuBvh2SimdLevel::Avx2, CpuBvh2SimdLevel::Auto };
+            for (CpuBvh2SimdLevel simdLevel : simdLevels)
+            {
+                CpuBvh2BuildSettings settings = ParallelBuildSettings();
+                settings.SimdLevel = simdLevel;
+                CpuBvh2BuildStats stats;
+                std::unique_ptr<BYTE[]> pData;
+                TestCpuBvh2Builder(&testCase, 1, D3D12_ELEMENTS_LAYOUT_ARRAY, settings, &pData, &stats);
+                Assert::IsTrue(simdLevel == CpuBvh2SimdLevel::Auto || stats.SimdLevel <= simdLevel, L"CPU BVH build used a higher SIMD level than requested");
+
+                AssertSameBvhOutput(pScalarData.get(), pData.get(), L"SIMD CPU BVH output differs from the scalar reference");
+            }
+        }
+
+        TEST_METHOD(CpuBVHBuilderTreeletReorderingLowersSahCost)
+        {
+            TriangleSoup soup = GenerateRandomTriangleSoup(2000, 7, 100);
+            CpuGeometryDescriptor testCase = soup.GetGeometry();
+
+            // PREFER_FAST_BUILD skips reordering, PREFER_FAST_TRACE runs the most passes
+            const D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS buildFlags[] = {
+                D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_BUILD,
+                D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_NONE,
+                D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE };
+            float previousSahCost = FLT_MAX;
+            for (auto buildFlag : buildFlags)
+            {
+                CpuBvh2BuildStats stats;
+                TestCpuBvh2Builder(&testCase, 1, D3D12_ELEMENTS_LAYOUT_ARRAY, ParallelBuildSettings(), nullptr, &stats, buildFlag);
+                Assert::IsTrue(stats.SahCost > 0.0f, L"CPU BVH build didn't report a SAH cost");
+                Assert::IsTrue(stats.SahCost <= previousSahCost, L"Treelet reordering increased the SAH cost");
+                previousSahCost = stats.SahCost;
+            }
+
+            // Reordered subtrees are handed out to threads, the output must not depend on it
+            const UINT threadCounts[] = { 1, 3, 0 };
+            AssertSameOutputForThreadCounts(testCase, ParallelBuildSettings(), threadCounts, ARRAYSIZE(threadCounts),
+                D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE, L"Treelet reordered CPU BVH output differs depending on the number of threads used");
+
+            // The serial builder never reorders, so existing callers keep the same layout
+            std::unique_ptr<BYTE[]> pFastBuildData;
+            std::unique_ptr<BYTE[]> pFastTraceData;
+            TestCpuBvh2Builder(&testCase, 1, D3D12_ELEMENTS_LAYOUT_ARRAY, CpuBvh2BuildSettings(), &pFastBuildData, nullptr,
+                D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_BUILD);
+            TestCpuBvh2Builder(&testCase, 1, D3D12_ELEMENTS_LAYOUT_ARRAY, CpuBvh2BuildSettings(), &pFastTraceData, nullptr,
+                D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE);
+            AssertSameBvhOutput(pFastBuildData.get(), pFastTraceData.get(), L"Build flags changed the serial CPU BVH builder's output");
+        }
+
+        TEST_METHOD(LinearBvhValidatorCatchesCorruptBVHs)
+        {
+            TriangleSoup soup = GenerateRandomTriangleSoup(2000, 9, 100);
+
+            // Split across two geometries so leaves have to be mapped back through the geometry index
+            const UINT firstGeometryIndexCount = 3 * 1000;
+            CpuGeometryDescriptor testCases[] =
+            {
+                soup.GetGeometry(0, firstGeometryIndexCount),
+                soup.GetGeometry(firstGeometryIndexCount, (UINT)soup.Indices.size() - firstGeometryIndexCount),
+            };
+
+            std::unique_ptr<BYTE[]> pData;
+            TestCpuBvh2Builder(testCases, ARRAYSIZE(testCases), D3D12_ELEMENTS_LAYOUT_ARRAY, ParallelBuildSettings(), &pData);
+
+            std::wstring errorMessage;
+            const UINT threadCounts[] = { 1, 3, 0 };
+            for (UINT threadCount : threadCounts)
+            {
+                BvhValidator validator(BvhValidationMode::Linear, threadCount);
+                if (!validator.VerifyBottomLevelOutput(testCases, ARRAYSIZE(testCases), pData.get(), errorMessage))
+                {
+                    Assert::Fail(errorMessage.c_str());
+                }
+            }
+
+            // Leaves holding several primitives are only supported by the linear mode
+            CpuBvh2BuildSettings multiPrimitiveLeafSettings = ParallelBuildSettings();
+            multiPrimitiveLeafSettings.MaxPrimitivesInLeaf = 4;
+            std::unique_ptr<BYTE[]> pMultiPrimitiveLeafData;
+            BuildCpuBottomLevel(testCases, ARRAYSIZE(testCases), multiPrimitiveLeafSettings, pMultiPrimitiveLeafData);
+            if (!BvhValidator(BvhValidationMode::Linear).VerifyBottomLevelOutput(testCases, ARRAYSIZE(testCases), pMultiPrimitiveLeafData.get(), errorMessage))
+            {
+                Assert::Fail(errorMessage.c_str());
+            }
+
+            const BVHOffsets &offsets = *(BVHOffsets*)pData.get();
+            AABBNode *pNodes = (AABBNode*)(pData.get() + offsets.offsetToBoxes);
+            Primitive *pPrimitives = (Primitive*)(pData.get() + offsets.offsetToVertices);
+            PrimitiveMetaData *pMetadata = (PrimitiveMetaData*)(pData.get() + offsets.offsetToPrimitiveMetaData);
+            const UINT numNodes = (offsets.offsetToVertices - offsets.offsetToBoxes) / sizeof(AABBNode);
+            const UINT leafIndex = (UINT)(std::find_if(pNodes, pNodes + numNodes, [](const AABBNode &node) { return node.leaf != 0; }) - pNodes);
+            const UINT internalNodeIndex = 1;
+            Assert::IsTrue(leafIndex < numNodes && !pNodes[internalNodeIndex].leaf, L"Unexpected BVH shape");
+
+            std::unique_ptr<BYTE[]> pOriginalData(new BYTE[offsets.totalSize]);
+            memcpy(pOriginalData.get(), pData.get(), offsets.totalSize);
+            auto ExpectValidationFailure = [&](LPCWSTR corruption)
+            {
+                for (UINT threadCount : threadCounts)
+                {
+                    BvhValidator validator(BvhValidationMode::Linear, threadCount);
+                    Assert::IsFalse(validator.VerifyBottomLevelOutput(testCases, ARRAYSIZE(testCases), pData.get(), errorMessage), corruption);
+                }
+                memcpy(pData.get(), pOriginalData.get(), offsets.totalSize);
+            };
+
+            for (UINT axis = 0; axis < 3; axis++) pNodes[leafIndex].halfDim[axis] *= 0.1f;
+            ExpectValidationFailure(L"Shrunk leaf box wasn't caught");
+
+            pPrimitives[pNodes[leafIndex].leafNode.firstTriangleId].triangle.v[0].x += 3.0f;
+            ExpectValidationFailure(L"Moved vertex wasn't caught");
+
+            pMetadata[1] = pMetadata[0];
+            ExpectValidationFailure(L"Duplicated primitive wasn't caught");
+
+            pMetadata[0].GeometryContributionToHitGroupIndex = ARRAYSIZE(testCases);
+            ExpectValidationFailure(L"Out of range geometry index wasn't caught");
+
+            pNodes[internalNodeIndex].internalNode.leftNodeIndex = internalNodeIndex + 1;
+            ExpectValidationFailure(L"Node with two parents wasn't caught");
+
+            pNodes[internalNodeIndex].internalNode.leftNodeIndex = numNodes;
+            ExpectValidationFailure(L"Out of range child index wasn't caught");
+        }
+
+        void BuildCpuBottomLevel(
+            CpuGeometryDescriptor *pGeomDescs,
+            UINT numGeoms,
+            const CpuBvh2BuildSettings &settings,
+            std::unique_ptr<BYTE[]> &pOutputData)
+        {
+            std::vector<D3D12_RAYTRACING_GEOMETRY_DESC> geomDescs(numGeoms);
+            UINT numTriangles = 0;
+            for (UINT i = 0; i < numGeoms; i++)
+            {
+                geomDescs[i] = {};
+                geomDescs[i].Type = D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES;
+                auto &triangleDesc = geomDescs[i].Triangles;
+                triangleDesc.IndexBuffer = (D3D12_GPU_VIRTUAL_ADDRESS)pGeomDescs[i].m_pIndexBuffer;
+                triangleDesc.VertexBuffer.StartAddress = (D3D12_GPU_VIRTUAL_ADDRESS)pGeomDescs[i].m_pVertexData;
+                triangleDesc.IndexFormat = pGeomDescs[i].m_indexBufferFormat;
+                triangleDesc.IndexCount = pGeomDescs[i].m_numIndicies;
+                triangleDesc.VertexCount = pGeomDescs[i].m_numVerticies;
+                triangleDesc.VertexBuffer.StrideInBytes = sizeof(float) * 3;
+                triangleDesc.VertexFormat = DXGI_FORMAT_R32G32B32_FLOAT;
+                triangleDesc.Transform3x4 = (D3D12_GPU_VIRTUAL_ADDRESS)pGeomDescs[i].transform.data();
+                numTriangles += (pGeomDescs[i].m_pIndexBuffer ? pGeomDescs[i].m_numIndicies : pGeomDescs[i].m_numVerticies) / 3;
+            }
+
+            D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC desc = {};
+            desc.Inputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
+            desc.Inputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
+            desc.Inputs.NumDescs = numGeoms;
+            desc.Inputs.pGeometryDescs = geomDescs.data();
+
+            pOutputData = std::unique_ptr<BYTE[]>(new BYTE[sizeof(BVHOffsets) +
+                (2 * numTriangles - 1) * sizeof(AABBNode) + numTriangles * (sizeof(Primitive) + sizeof(PrimitiveMetaData))]);
+            BuildRaytracingAccelerationStructureOnCpu(&desc, settings, pOutputData.get());
+        }
+
+        void TopLevelCpuBVHBuilder(D3D12_ELEMENTS_LAYOUT layoutToTest)
+        {
+            const UINT numBottomLevels = 3;
+            const UINT numInstances = 64;
+            const UINT numTriangles = ARRAYSIZE(ReferenceIndices0) / 3;
+
+            std::vector<float> vertices[numBottomLevels];
+            std::unique_ptr<BYTE[]> pBottomLevels[numBottomLevels];
+            AABB containingBoxes[numBottomLevels];
+            for (UINT level = 0; level < numBottomLevels; level++)
+            {
+                for (UINT axis = 0; axis < 3; axis++)
+                {
+                    containingBoxes[level].minArr[axis] = FLT_MAX;
+                    containingBoxes[level].maxArr[axis] = -FLT_MAX;
+                }
+
+                for (UINT i = 0; i < ARRAYSIZE(ReferenceVerticies0); i++)
+                {
+                    const float vertex = ReferenceVerticies0[i] + level;
+                    const UINT axis = i % 3;
+                    containingBoxes[level].minArr[axis] = std::min(vertex, containingBoxes[level].minArr[axis]);
+                    containingBoxes[level].maxArr[axis] = std::max(vertex, containingBoxes[level].maxArr[axis]);
+                    vertices[level].push_back(vertex);
+                }
+
+                D3D12_RAYTRACING_GEOMETRY_DESC geometryDesc = {};
+                geometryDesc.Type = D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES;
+                geometryDesc.Triangles.IndexBuffer = (D3D12_GPU_VIRTUAL_ADDRESS)ReferenceIndices0;
+                geometryDesc.Triangles.IndexFormat = DXGI_FORMAT_R16_UINT;
+                geometryDesc.Triangles.IndexCount = ARRAYSIZE(ReferenceIndices0);
+                geometryDesc.Triangles.VertexBuffer.StartAddress = (D3D12_GPU_VIRTUAL_ADDRESS)vertices[level].data();
+                geometryDesc.Triangles.VertexBuffer.StrideInBytes = sizeof(float) * 3;
+                geometryDesc.Triangles.VertexCount = VERTEX_COUNT(ReferenceVerticies0);
+                geometryDesc.Triangles.VertexFormat = DXGI_FORMAT_R32G32B32_FLOAT;
+
+                D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC bottomLevelDesc = {};
+                bottomLevelDesc.Inputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
+                bottomLevelDesc.Inputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
+                bottomLevelDesc.Inputs.NumDescs = 1;
+                bottomLevelDesc.Inputs.pGeometryDescs = &geometryDesc;
+
+                pBottomLevels[level] = std::unique_ptr<BYTE[]>(new BYTE[sizeof(BVHOffsets) +
+                    (2 * numTriangles - 1) * sizeof(AABBNode) + numTriangles * (sizeof(Primitive) + sizeof(PrimitiveMetaData))]);
+                BuildRaytracingAccelerationStructureOnCpu(&bottomLevelDesc, pBottomLevels[level].get());
+            }
+
+            srand(10);
+            std::vector<D3D12_RAYTRACING_INSTANCE_DESC> instanceDescs(numInstances);
+            std::vector<D3D12_RAYTRACING_INSTANCE_DESC *> instanceDescPointers(numInstances);
+            AABB referenceBoxes[numInstances];
+            float *pTransformations[numInstances];
+            for (UINT i = 0; i < numInstances; i++)
+            {
+                D3D12_RAYTRACING_INSTANCE_DESC &instanceDesc = instanceDescs[i];
+                instanceDesc = {};
+                instanceDesc.InstanceID = i;
+                instanceDesc.InstanceMask = 0xff;
+                instanceDesc.AccelerationStructure = (D3D12_GPU_VIRTUAL_ADDRESS)pBottomLevels[i % numBottomLevels].get();
+                GenerateRandomTranformation(&instanceDesc.Transform[0][0]);
+
+                instanceDescPointers[i] = &instanceDesc;
+                referenceBoxes[i] = containingBoxes[i % numBottomLevels];
+                pTransformations[i] = &instanceDesc.Transform[0][0];
+            }
+
+            D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC desc = {};
+            desc.Inputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL;
+            desc.Inputs.Flags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_UPDATE;
+            desc.Inputs.DescsLayout = layoutToTest;
+            desc.Inputs.NumDescs = numInstances;
+            desc.Inputs.InstanceDescs = (layoutToTest == D3D12_ELEMENTS_LAYOUT_ARRAY) ?
+                (D3D12_GPU_VIRTUAL_ADDRESS)instanceDescs.data() :
+                (D3D12_GPU_VIRTUAL_ADDRESS)instanceDescPointers.data();
+
+            std::unique_ptr<BYTE[]> pData = std::unique_ptr<BYTE[]>(new BYTE[sizeof(BVHOffsets) +
+                (2 * numInstances - 1) * sizeof(AABBNode) + numInstances * sizeof(BVHMetadata)]);
+            CpuBvh2BuildStats stats;
+            BuildRaytracingAccelerationStructureOnCpu(&desc, ParallelBuildSettings(), pData.get(), &stats);
+            Assert::AreEqual(numInstances, stats.NumLeaves, L"Expected one top-level leaf per instance");
+
+            std::wstring errorMessage;
+            BvhValidator validator;
+            if (!validator.VerifyTopLevelOutput(referenceBoxes, pTransformations, numInstances, pData.get(), errorMessage))
+            {
+                Assert::Fail(errorMessage.c_str());
+            }
+
+            BvhValidator linearValidator(BvhValidationMode::Linear);
+            if (!linearValidator.VerifyTopLevelOutput(referenceBoxes, pTransformations, numInstances, pData.get(), errorMessage))
+            {
+                Assert::Fail(errorMessage.c_str());
+            }
+
+            // Move every instance and refit in place
+            for (UINT i = 0; i < numInstances; i++)
+            {
+                GenerateRandomTranformation(&instanceDescs[i].Transform[0][0]);
+            }
+            desc.Inputs.Flags |= D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PERFORM_UPDATE;
+            desc.SourceAccelerationStructureData = (D3D12_GPU_VIRTUAL_ADDRESS)pData.get();
+            BuildRaytracingAccelerationStructureOnCpu(&desc, ParallelBuildSettings(), pData.get(), &stats);
+            Assert::AreEqual(numInstances, stats.NumLeaves, L"Refitting changed the number of top-level leaves");
+
+            if (!validator.VerifyTopLevelOutput(referenceBoxes, pTransformations, numInstances, pData.get(), errorMessage))
+            {
+                Assert::Fail(errorMessage.c_str());
+            }
+        }
+
+        TEST_METHOD(TopLevelCpuBVHBuilderWithUpdate_ArrayLayout)
+        {
+            TopLevelCpuBVHBuilder(D3D12_ELEMENTS_LAYOUT_ARRAY);
+        }
+
+        TEST_METHOD(TopLevelCpuBVHBuilderWithUpdate_ArrayOfPointersLayout)
+        {
+            TopLevelCpuBVHBuilder(D3D12_ELEMENTS_LAYOUT_ARRAY_OF_POINTERS);
+        }
+
+        // Closest hit over every primitive of a bottom level, in double precision
+        static bool BruteForceClosestHit(const CpuRay &ray, const BYTE *pBottomLevel, const float *pObjectToWorld, double &closestT)
+        {
+            const BVHOffsets &offsets = *(const BVHOffsets *)pBottomLevel;
+            const Primitive *pPrimitives = (const Primitive *)(pBottomLevel + offsets.offsetToVertices);
+            const UINT numPrimitives = (offsets.offsetToPrimitiveMetaData - offsets.offsetToVertices) / sizeof(Primitive);
+
+            bool bHit = false;
+            for (UINT i = 0; i < numPrimitives; i++)
+            {
+                double v[3][3];
+                for (UINT vertex = 0; vertex < 3; vertex++)
+                {
+                    const float3 &p = pPrimitives[i].triangle.v[vertex];
+                    const float position[3] = { p.x, p.y, p.z };
+                    for (UINT row = 0; row < 3; row++)
+                    {
+                        v[vertex][row] = position[row];
+                        if (pObjectToWorld)
+                        {
+                            const float *m = pObjectToWorld + row * 4;
+                            v[vertex][row] = m[0] * p.x + m[1] * p.y + m[2] * p.z + m[3];
+                        }
+                    }
+                }
+
+                double edge1[3], edge2[3], s[3];
+                for (UINT axis = 0; axis < 3; axis++)
+                {
+                    edge1[axis] = v[1][axis] - v[0][axis];
+                    edge2[axis] = v[2][axis] - v[0][axis];
+                    s[axis] = ray.Origin[axis] - v[0][axis];
+                }
+                const float *d = ray.Direction;
+                const double p[3] = { d[1] * edge2[2] - d[2] * edge2[1], d[2] * edge2[0] - d[0] * edge2[2], d[0] * edge2[1] - d[1] * edge2[0] };
+                const double q[3] = { s[1] * edge1[2] - s[2] * edge1[1], s[2] * edge1[0] - s[0] * edge1[2], s[0] * edge1[1] - s[1] * edge1[0] };
+                const double det = edge1[0] * p[0] + edge1[1] * p[1] + edge1[2] * p[2];
+                if (det == 0.0) continue;
+
+                const double u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) / det;
+                const double w = (d[0] * q[0] + d[1] * q[1] + d[2] * q[2]) / det;
+                const double t = (edge2[0] * q[0] + edge2[1] * q[1] + edge2[2] * q[2]) / det;
+                if (u >= 0.0 && w >= 0.0 && u + w <= 1.0 && t > ray.TMin && t < ray.TMax && (!bHit || t < closestT))
+                {
+                    closestT = t;
+                    bHit = true;
+                }
+            }
+            return bHit;
+        }
+
+        // Rays from random points towards random points of the scene so most of them hit
+        static std::vector<CpuRay> GenerateRandomRays(UINT numRays, float sceneSize)
+        {
+            auto random = [sceneSize]() { return (rand() / (float)RAND_MAX) * sceneSize; };
+            std::vector<CpuRay> rays(numRays);
+            for (CpuRay &ray : rays)
+            {
+                for (UINT axis = 0; axis < 3; axis++)
+                {
+                    ray.Origin[axis] = random() * 1.5f - sceneSize * 0.25f;
+                    ray.Direction[axis] = random() - ray.Origin[axis];
+                }
+                ray.TMin = 0.0f;
+                ray.TMax = FLT_MAX;
+            }
+            return rays;
+        }
+
+        TEST_METHOD(CpuTraversalMatchesBruteForce)
+        {
+            TriangleSoup soup = GenerateRandomTriangleSoup(500, 11, 20);
+            CpuGeometryDescriptor testCase = soup.GetGeometry();
+
+            std::unique_ptr<BYTE[]> pData;
+            TestCpuBvh2Builder(&testCase, 1, D3D12_ELEMENTS_LAYOUT_ARRAY, ParallelBuildSettings(), &pData);
+
+            const UINT numRays = 2048;
+            const std::vector<CpuRay> rays = GenerateRandomRays(numRays, 20.0f);
+            std::vector<CpuRayHit> referenceHits(numRays);
+            CpuTraceStats stats;
+            TraceRaysOnCpu(pData.get(), D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL, rays.data(), numRays, CpuTraceSettings(), referenceHits.data(), &stats);
+            Assert::IsTrue(stats.NumRays == numRays && stats.NumHits > 0, L"CPU traversal didn't hit anything");
+
+            for (UINT i = 0; i < numRays; i++)
+            {
+                double closestT;
+                const bool bHit = BruteForceClosestHit(rays[i], pData.get(), nullptr, closestT);
+                Assert::AreEqual(bHit, referenceHits[i].InstanceIndex != NoHitInstanceIndex, L"CPU traversal hit/miss differs from brute force");
+                if (bHit)
+                {
+                    Assert::IsTrue(fabs(referenceHits[i].T - closestT) <= 1e-4 * closestT, L"CPU traversal didn't find the closest hit");
+                }
+            }
+
+            // Every box test kernel and any split of the rays across threads gives the same hits
+            const CpuBvh2SimdLevel simdLevels[] = { CpuBvh2SimdLevel::Scalar, CpuBvh2SimdLevel::Sse41, CpuBvh2SimdLevel::Avx2 };
+            const UINT threadCounts[] = { 1, 3, 0 };
+            for (CpuBvh2SimdLevel simdLevel : simdLevels)
+            {
+                for (UINT threadCount : threadCounts)
+                {
+                    CpuTraceSettings settings;
+                    settings.SimdLevel = simdLevel;
+                    settings.NumThreads = threadCount;
+                    settings.RaysPerPacket = 64;
+
+                    std::vector<CpuRayHit> hits(numRays);
+                    TraceRaysOnCpu(pData.get(), D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL, rays.data(), numRays, settings, hits.data());
+                    Assert::IsTrue(memcmp(referenceHits.data(), hits.data(), numRays * sizeof(CpuRayHit)) == 0,
+                        L"CPU traversal results depend on the SIMD level or number of threads");
+                }
+            }
+
+            // Both triangle tests agree on which side was hit
+            const CpuTriangleIntersectionTest triangleTests[] = { CpuTriangleIntersectionTest::Watertight, CpuTriangleIntersectionTest::MollerTrumbore };
+            for (CpuTriangleIntersectionTest triangleTest : triangleTests)
+            {
+                CpuTraceSettings settings;
+                settings.RayFlags = D3D12_RAY_FLAG_CULL_BACK_FACING_TRIANGLES;
+                settings.TriangleTest = triangleTest;
+
+                std::vector<CpuRayHit> hits(numRays);
+                TraceRaysOnCpu(pData.get(), D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL, rays.data(), numRays, settings, hits.data());
+                for (const CpuRayHit &hit : hits)
+                {
+                    Assert::IsTrue(hit.InstanceIndex == NoHitInstanceIndex || hit.HitKind == HitKindTriangleFrontFace,
+                        L"Back face culling returned a back face hit");
+                }
+            }
+        }
+
+        TEST_METHOD(QuantizedBvh4MatchesFp32Bvh2)
+        {
+            TriangleSoup soup = GenerateRandomTriangleSoup(500, 13, 20);
+            CpuGeometryDescriptor testCase = soup.GetGeometry();
+
+            const UINT numRays = 2048;
+            const std::vector<CpuRay> rays = GenerateRandomRays(numRays, 20.0f);
+            const UINT leafSizes[] = { 1, 4 };
+            for (UINT leafSize : leafSizes)
+            {
+                CpuBvh2BuildSettings settings = ParallelBuildSettings();
+                settings.MaxPrimitivesInLeaf = leafSize;
+                std::unique_ptr<BYTE[]> pFp32Data;
+                TestCpuBvh2Builder(&testCase, 1, D3D12_ELEMENTS_LAYOUT_ARRAY, settings, &pFp32Data);
+
+                // TestCpuBvh2Builder validates the quantized output too
+                settings.NodeFormat = CpuBvhNodeFormat::QuantizedBvh4;
+                std::unique_ptr<BYTE[]> pQuantizedData;
+                CpuBvh2BuildStats stats;
+                TestCpuBvh2Builder(&testCase, 1, D3D12_ELEMENTS_LAYOUT_ARRAY, settings, &pQuantizedData, &stats);
+
+                const BVHOffsets &fp32Offsets = *(const BVHOffsets *)pFp32Data.get();
+                const BVHOffsets &quantizedOffsets = *(const BVHOffsets *)pQuantizedData.get();
+                Assert::IsTrue(!IsQuantizedBvh4(pFp32Data.get()) && IsQuantizedBvh4(pQuantizedData.get()), L"Node format wasn't honored");
+                Assert::IsTrue(stats.NumQuantizedNodes > 0 && stats.QuantizedSahCost >= stats.Bvh4SahCost, L"Unexpected quantized build stats");
+                Assert::IsTrue(5 * (quantizedOffsets.offsetToVertices - quantizedOffsets.offsetToBoxes) < 3 * (fp32Offsets.offsetToVertices - fp32Offsets.offsetToBoxes),
+                    L"Quantized nodes should take about half the memory of fp32 nodes");
+
+                std::vector<CpuRayHit> fp32Hits(numRays);
+                TraceRaysOnCpu(pFp32Data.get(), D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL, rays.data(), numRays, CpuTraceSettings(), fp32Hits.data());
+
+                // Quantized boxes only ever grow, so every level finds the same closest hits.
+                // Overlapping copies of the mesh can tie, so only T is compared.
+                const CpuBvh2SimdLevel simdLevels[] = { CpuBvh2SimdLevel::Scalar, CpuBvh2SimdLevel::Sse41, CpuBvh2SimdLevel::Avx2 };
+                for (CpuBvh2SimdLevel simdLevel : simdLevels)
+                {
+                    CpuTraceSettings traceSettings;
+                    traceSettings.SimdLevel = simdLevel;
+                    std::vector<CpuRayHit> quantizedHits(numRays);
+                    TraceRaysOnCpu(pQuantizedData.get(), D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL, rays.data(), numRays, traceSettings, quantizedHits.data());
+                    for (UINT i = 0; i < numRays; i++)
+                    {
+                        Assert::AreEqual(fp32Hits[i].InstanceIndex, quantizedHits[i].InstanceIndex, L"Quantized traversal hit/miss differs from fp32 traversal");
+                        Assert::AreEqual(fp32Hits[i].T, quantizedHits[i].T, L"Quantized traversal didn't find the same closest hit");
+                    }
+                }
+            }
+        }
+
+        TEST_METHOD(CpuTraversalTopLevelMatchesBruteForce)
+        {
+            CpuGeometryDescriptor testCase(ReferenceVerticies0, VERTEX_COUNT(ReferenceVerticies0), ReferenceIndices0, ARRAYSIZE(ReferenceIndices0));
+            std::unique_ptr<BYTE[]> pBottomLevel;
+            TestCpuBvh2Builder(&testCase, 1, D3D12_ELEMENTS_LAYOUT_ARRAY, ParallelBuildSettings(), &pBottomLevel);
+
+            const UINT numInstances = 32;
+            srand(12);
+            std::vector<D3D12_RAYTRACING_INSTANCE_DESC> instanceDescs(numInstances);
+            for (UINT i = 0; i < numInstances; i++)
+            {
+                D3D12_RAYTRACING_INSTANCE_DESC &instanceDesc = instanceDescs[i];
+                instanceDesc = {};
+                instanceDesc.InstanceID = 100 + i;
+                instanceDesc.InstanceMask = (i % 4 == 0) ? 0x2 : 0x1;
+                instanceDesc.AccelerationStructure = (D3D12_GPU_VIRTUAL_ADDRESS)pBottomLevel.get();
+                GenerateRandomTranformation(&instanceDesc.Transform[0][0]);
+            }
+
+            D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC desc = {};
+            desc.Inputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL;
+            desc.Inputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
+            desc.Inputs.NumDescs = numInstances;
+            desc.Inputs.InstanceDescs = (D3D12_GPU_VIRTUAL_ADDRESS)instanceDescs.data();
+
+            std::unique_ptr<BYTE[]> pData = std::unique_ptr<BYTE[]>(new BYTE[sizeof(BVHOffsets) +
+                (2 * numInstances - 1) * sizeof(AABBNode) + numInstances * sizeof(BVHMetadata)]);
+            BuildRaytracingAccelerationStructureOnCpu(&desc, ParallelBuildSettings(), pData.get());
+
+            // Aim at the instances, instances with mask 0x2 are skipped
+            const UINT numRays = 2048;
+            std::vector<CpuRay> rays = GenerateRandomRays(numRays, 100.0f);
+            for (CpuRay &ray : rays)
+            {
+                const D3D12_RAYTRACING_INSTANCE_DESC &target = instanceDescs[rand() % numInstances];
+                for (UINT axis = 0; axis < 3; axis++)
+                {
+                    ray.Direction[axis] = target.Transform[axis][3] + rand() / (float)RAND_MAX - ray.Origin[axis];
+                }
+            }
+            CpuTraceSettings settings;
+            settings.InstanceInclusionMask = 0x1;
+            std::vector<CpuRayHit> hits(numRays);
+            CpuTraceStats stats;
+            TraceRaysOnCpu(pData.get(), D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL, rays.data(), numRays, settings, hits.data(), &stats);
+
+            for (UINT i = 0; i < numRays; i++)
+            {
+                bool bHit = false;
+                double closestT = DBL_MAX;
+                for (UINT instance = 0; instance < numInstances; instance++)
+                {
+                    double instanceT;
+                    if ((instanceDescs[instance].InstanceMask & settings.InstanceInclusionMask) &&
+                        BruteForceClosestHit(rays[i], pBottomLevel.get(), &instanceDescs[instance].Transform[0][0], instanceT) &&
+                        instanceT < closestT)
+                    {
+                        closestT = instanceT;
+                        bHit = true;
+                    }
+                }
+
+                const CpuRayHit &hit = hits[i];
+                Assert::AreEqual(bHit, hit.InstanceIndex != NoHitInstanceIndex, L"CPU top level traversal hit/miss differs from brute force");
+                if (bHit)
+                {
+                    Assert::IsTrue(fabs(hit.T - closestT) <= 1e-4 * closestT, L"CPU top level traversal didn't find the closest hit");
+
+                    // Instances without a translation overlap, so any of them can be the closest
+                    Assert::IsTrue(hit.InstanceIndex < numInstances && (instanceDescs[hit.InstanceIndex].InstanceMask & settings.InstanceInclusionMask),
+                        L"CPU top level traversal hit a masked out instance");
+                    Assert::AreEqual((UINT)instanceDescs[hit.InstanceIndex].InstanceID, hit.InstanceID, L"CPU top level traversal reported the wrong InstanceID");
+                }
+            }
+
+            // Ending the search on the first hit still finds a hit for every ray that has one
+            settings.RayFlags = D3D12_RAY_FLAG_ACCEPT_FIRST_HIT_AND_END_SEARCH;
+            std::vector<CpuRayHit> firstHits(numRays);
+            CpuTraceStats firstHitStats;
+            TraceRaysOnCpu(pData.get(), D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL, rays.data(), numRays, settings, firstHits.data(), &firstHitStats);
+            Assert::IsTrue(firstHitStats.NumHits == stats.NumHits, L"Accepting the first hit changed which rays hit");
+            Assert::IsTrue(firstHitStats.NumNodesVisited <= stats.NumNodesVisited, L"Accepting the first hit visited more nodes");
+        }
+
         template <UINT numBottomLevels>
         void SimpleTopLevelGpuBVHBuilder(
             D3D12_ELEMENTS_LAYOUT layoutToTest,
@@ -1341,7 +1994,108 @@ namespace FallbackLayerUnitTests
             }
         }
 
-        void TestCpuBvh2Builder(CpuGeometryDescriptor *pGeomDescs, UINT numGeoms, D3D12_ELEMENTS_LAYOUT layoutToTest = D3D12_ELEMENTS_LAYOUT_ARRAY)
+        // The CPU builder defaults to the serial reference, tests of the parallel one opt in
+        static CpuBvh2BuildSettings ParallelBuildSettings()
+        {
+            CpuBvh2BuildSettings settings;
+            settings.BuilderType = CpuBvh2BuilderType::ParallelBinnedSah;
+            return settings;
+        }
+
+        // Copies of the reference mesh, each moved by its own offset
+        struct TriangleSoup
+        {
+            std::vector<float> Vertices;
+            std::vector<UINT16> Indices;
+
+            CpuGeometryDescriptor GetGeometry() const
+            {
+                return GetGeometry(0, (UINT)Indices.size());
+            }
+
+            CpuGeometryDescriptor GetGeometry(UINT firstIndex, UINT numIndices) const
+            {
+                return CpuGeometryDescriptor(Vertices.data(), (UINT)(Vertices.size() / 3), Indices.data() + firstIndex, numIndices);
+            }
+        };
+
+        // getOffset(copyIndex, offset) fills in the translation of each copy
+        template<typename GetOffset>
+        static TriangleSoup GenerateTriangleSoup(UINT numCopies, GetOffset getOffset)
+        {
+            TriangleSoup soup;
+            soup.Vertices.reserve(numCopies * ARRAYSIZE(ReferenceVerticies0));
+            soup.Indices.reserve(numCopies * ARRAYSIZE(ReferenceIndices0));
+            for (UINT i = 0; i < numCopies; i++)
+            {
+                float offset[3];
+                getOffset(i, offset);
+                for (UINT f = 0; f < ARRAYSIZE(ReferenceVerticies0); f++)
+                {
+                    soup.Vertices.push_back(ReferenceVerticies0[f] + offset[f % 3]);
+                }
+
+                for (UINT16 index : ReferenceIndices0)
+                {
+                    soup.Indices.push_back(index + (UINT16)ARRAYSIZE(ReferenceIndices0) * i);
+                }
+            }
+            return soup;
+        }
+
+        // Offsets are whole numbers in [0, maxOffset) per axis, a seed always gives the same soup
+        static TriangleSoup GenerateRandomTriangleSoup(UINT numCopies, unsigned int seed, int maxOffset)
+        {
+            srand(seed);
+            return GenerateTriangleSoup(numCopies, [maxOffset](UINT, float offset[3])
+            {
+                for (UINT axis = 0; axis < 3; axis++)
+                {
+                    offset[axis] = (float)(rand() % maxOffset);
+                }
+            });
+        }
+
+        static void AssertSameBvhOutput(const BYTE *pExpected, const BYTE *pActual, LPCWSTR message)
+        {
+            const BVHOffsets &offsets = *(const BVHOffsets*)pExpected;
+            Assert::IsTrue(memcmp(pExpected, pActual, offsets.totalSize) == 0, message);
+        }
+
+        // Builds once per thread count and checks every build matches the first one
+        void AssertSameOutputForThreadCounts(
+            CpuGeometryDescriptor &testCase,
+            const CpuBvh2BuildSettings &baseSettings,
+            const UINT *pThreadCounts,
+            UINT numThreadCounts,
+            D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS buildFlags,
+            LPCWSTR message)
+        {
+            std::unique_ptr<BYTE[]> pReferenceData;
+            for (UINT i = 0; i < numThreadCounts; i++)
+            {
+                CpuBvh2BuildSettings settings = baseSettings;
+                settings.NumThreads = pThreadCounts[i];
+
+                std::unique_ptr<BYTE[]> pData;
+                TestCpuBvh2Builder(&testCase, 1, D3D12_ELEMENTS_LAYOUT_ARRAY, settings, &pData, nullptr, buildFlags);
+                if (!pReferenceData)
+                {
+                    pReferenceData = std::move(pData);
+                    continue;
+                }
+                AssertSameBvhOutput(pReferenceData.get(), pData.get(), message);
+            }
+        }
+
+        void TestCpuBvh2Builder(
+            CpuGeometryDescriptor *pGeomDescs,
+            UINT numGeoms,
+            D3D12_ELEMENTS_LAYOUT layoutToTest = D3D12_ELEMENTS_LAYOUT_ARRAY,
+            const CpuBvh2BuildSettings &settings = CpuBvh2BuildSettings(),
+            std::unique_ptr<BYTE[]> *pOutputData = nullptr,
+            CpuBvh2BuildStats *pStats = nullptr,
+            D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS buildFlags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_NONE)
         {
             ID3D12Device &device = m_d3d12Context.GetDevice();
             std::unique_ptr<FallbackLayer::IAccelerationStructureBuilder> pBuilder =
@@ -1350,6 +2104,7 @@ namespace FallbackLayerUnitTests
             InternalFallbackBuilder builderWrapper(pBuilder.get());
 
             std::vector<D3D12_RAYTRACING_GEOMETRY_DESC> geomDescs(numGeoms);
+            std::vector<D3D12_RAYTRACING_GEOMETRY_DESC *> geomDescPointers(numGeoms);
             for (UINT i = 0; i < numGeoms; i++)
             {
                 geomDescs[i].Type = D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES;
@@ -1360,6 +2115,11 @@ namespace FallbackLayerUnitTests
                 triangleDesc.IndexCount = pGeomDescs[i].m_numIndicies;
                 triangleDesc.VertexCount = pGeomDescs[i].m_numVerticies;
                 triangleDesc.VertexBuffer.StrideInBytes = sizeof(float) * 3;
+                triangleDesc.VertexFormat = DXGI_FORMAT_R32G32B32_FLOAT;
+
+                // The CPU builder reads every "GPU VA" directly
+                triangleDesc.Transform3x4 = (D3D12_GPU_VIRTUAL_ADDRESS)pGeomDescs[i].transform.data();
+                geomDescPointers[i] = &geomDescs[i];
             }
 
             D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO prebuildInfo;
@@ -1373,18 +2133,31 @@ namespace FallbackLayerUnitTests
 
             D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC desc = {};
             D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS &inputs = desc.Inputs;
-            inputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
+            inputs.DescsLayout = layoutToTest;
             inputs.NumDescs = numGeoms;
             inputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
-            inputs.pGeometryDescs = geomDescs.data();
+            inputs.Flags = buildFlags;
+            if (layoutToTest == D3D12_ELEMENTS_LAYOUT_ARRAY)
+            {
+                inputs.pGeometryDescs = geomDescs.data();
+            }
+            else
+            {
+                inputs.ppGeometryDescs = geomDescPointers.data();
+            }
 
-            BuildRaytracingAccelerationStructureOnCpu(&desc, pData.get());
+            BuildRaytracingAccelerationStructureOnCpu(&desc, settings, pData.get(), pStats);
             std::wstring errorMessage;
             auto &validator = FallbackLayer::GetAccelerationStructureValidator(pBuilder->GetAccelerationStructureType());
             if (!validator.VerifyBottomLevelOutput(pGeomDescs, numGeoms, pData.get(), errorMessage))
             {
                 Assert::Fail(errorMessage.c_str());
             }
+
+            if (pOutputData)
+            {
+                *pOutputData = std::move(pData);
+            }
         }
 
         void TestCpuBvh2Builder(CpuGeometryDescriptor &geomDesc)
@@ -33,23 +33,7 @@ struct InputConstants
 
 static const uint FullTreeletSize = 7;
 
-#ifdef HLSL
-// These need to be UAVs despite being read-only because the fallback layer only gets a 
-// GPU VA and the API doesn't allow any way to transition that GPU VA from UAV->SRV
-RWStructuredBuffer<Primitive> InputBuffer : UAV_REGISTER(ElementBufferRegister);
-
-globallycoherent RWByteAddressBuffer NumTrianglesBuffer : UAV_REGISTER(NumTrianglesBufferRegister);
-globallycoherent RWStructuredBuffer<HierarchyNode> hierarchyBuffer : UAV_REGISTER(HierarchyBufferRegister);
-globallycoherent RWStructuredBuffer<AABB> AABBBuffer : UAV_REGISTER(AABBBufferRegister);
-
-globallycoherent RWByteAddressBuffer BaseTreeletsCountBuffer : UAV_REGISTER(BaseTreeletsCountBufferRegister);
-RWStructuredBuffer<uint> BaseTreeletsIndexBuffer : UAV_REGISTER(BaseTreeletsIndexBufferRegister);
-
-cbuffer TreeletConstants : CONSTANT_REGISTER(ConstantsRegister)
-{
-    InputConstants Constants;
-};
-
+// Shared with the CPU treelet reorder in CpuBVH2Builder.cpp
 #define BIT(x) (1 << (x))
 
 static const uint NumInternalTreeletNodes = FullTreeletSize - 1;
@@ -72,6 +56,23 @@ static const uint BitPermutations[FullTreeletSize - 2][35] = {
     { 0x3f, 0x5f, 0x6f, 0x77, 0x7b, 0x7d, 0x7e, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }
 };
 
+#ifdef HLSL
+// These need to be UAVs despite being read-only because the fallback layer only gets a 
+// GPU VA and the API doesn't allow any way to transition that GPU VA from UAV->SRV
+RWStructuredBuffer<Primitive> InputBuffer : UAV_REGISTER(ElementBufferRegister);
+
+globallycoherent RWByteAddressBuffer NumTrianglesBuffer : UAV_REGISTER(NumTrianglesBufferRegister);
+globallycoherent RWStructuredBuffer<HierarchyNode> hierarchyBuffer : UAV_REGISTER(HierarchyBufferRegister);
+globallycoherent RWStructuredBuffer<AABB> AABBBuffer : UAV_REGISTER(AABBBufferRegister);
+
+globallycoherent RWByteAddressBuffer BaseTreeletsCountBuffer : UAV_REGISTER(BaseTreeletsCountBufferRegister);
+RWStructuredBuffer<uint> BaseTreeletsIndexBuffer : UAV_REGISTER(BaseTreeletsIndexBufferRegister);
+
+cbuffer TreeletConstants : CONSTANT_REGISTER(ConstantsRegister)
+{
+    InputConstants Constants;
+};
+
 uint GetBitPermutation(uint numBitsSet, uint n)
 {
     // GetBitPermutation is always called with numBitsSet == [2, FullTreeletSize]
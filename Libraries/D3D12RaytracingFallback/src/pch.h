@@ -15,6 +15,8 @@
 #endif
 #include <windows.h>
 #include <DirectXMath.h>
+#include <intrin.h>
+#include <immintrin.h>
 #include <assert.h>
 #include <comdef.h>
 #include <atlbase.h>
@@ -25,6 +27,10 @@
 #include <unordered_set>
 #include <map>
 #include <deque>
+#include <atomic>
+#include <future>
+#include <thread>
+#include <chrono>
 #include <string>
 #include <strsafe.h>
 #include "d3d12_1.h"
@@ -86,6 +92,8 @@
 #include "GpuBvh2Copy.h"
 #include "TreeletReorder.h"
 #include "GpuBvh2Builder.h"
+#include "CpuBvh2Builder.h"
+#include "CpuBvh2Traversal.h"
 
 // Dispatchers
 #include "UberShaderBindings.h"
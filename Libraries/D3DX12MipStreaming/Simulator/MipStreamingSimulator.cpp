@@ -0,0 +1,657 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+// Flies a camera over a grid of images laid out like the D3D12MemoryManagement demo's and
+// streams their mips through a MipStreamingScheduler. There is no GPU: a batch costs a fixed
+// amount of time plus its bytes over a fixed bandwidth, and time is simulated, so a camera
+// path always produces the same paging. Reports how long images stay blurrier than they are
+// drawn and how far streaming goes over the budget.
+
+#include "SimulatorPlatform.h"
+#include "../d3dx12MipStreaming.h"
+
+#include <algorithm>
+#include <math.h>
+#include <memory>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+using namespace D3DX12MipStreaming;
+
+namespace
+{
+    // The demo's layout: square images in columns of NumRows, RenderTileSize units apart
+    const float RenderTileSize = 256.0f;
+    const float ImagePitch = RenderTileSize + 8.0f;
+    const float PrefetchDistance = 600.0f;
+    const float ScreenWidth = 1920.0f;
+    const float ScreenHeight = 1080.0f;
+    const double FrameMicroseconds = 1000000.0 / 60.0;
+    const double MB = 1024.0 * 1024.0;
+
+    // BC7 textures in 64KB tiles of 256x256 texels. Mips smaller than a tile are packed.
+    const UINT32 TileTexels = 256;
+    const UINT64 TileBytes = 64 * 1024;
+
+    enum class CameraPath
+    {
+        Pan,
+        Zoom,
+        Tour
+    };
+
+    struct SimulatorOptions
+    {
+        UINT32 Seed;
+        UINT32 NumRows;
+        UINT32 NumColumns;
+        UINT32 NumFrames;
+        UINT32 BudgetMB;
+        UINT32 BudgetDropPercent;
+        UINT32 BandwidthMBps;
+        UINT32 BatchCostMicroseconds;
+        QUEUE_ORDER Order;
+        UINT32 MaxLoadsPerBatch;
+        UINT32 MaxLoadsPerTexture;
+    };
+
+    struct Camera
+    {
+        float X;
+        float Y;
+        float Zoom;
+    };
+
+    // The camera moves smoothly from one key to the next, zooming geometrically, unless the
+    // next key is a jump
+    struct CameraKey
+    {
+        UINT32 Frame;
+        Camera Position;
+        bool Jump;
+    };
+
+    struct Image
+    {
+        float Left;
+        float Top;
+        UINT32 TexelWidth;
+        StreamedTexture Texture;
+
+        UINT8 VisibleMip;
+        UINT8 PrefetchMip;
+        float ScreenArea;
+
+        // The frame the image started being drawn blurrier than it should be, or -1
+        int BlurrySince;
+    };
+
+    struct PendingLoad
+    {
+        double CompletionTime;
+        StreamedTexture* pTexture;
+        UINT8 Mip;
+    };
+
+    struct LatencySummary
+    {
+        double Mean;
+        double P50;
+        double P99;
+        double Max;
+    };
+
+    struct SimulationResult
+    {
+        UINT64 Budget;
+        UINT64 DroppedBudget;
+        UINT64 TotalBytes;
+        UINT64 BytesLoaded;
+        UINT64 BytesEvicted;
+        UINT64 MipsLoaded;
+        UINT64 MipsEvicted;
+        UINT64 Batches;
+
+        double VisiblePixelFrames;
+        double BlurryPixelFrames;
+        double EmptyPixelFrames;
+
+        // Frames from an image being drawn blurry to it being sharp, in milliseconds
+        std::vector<double> PopLatencies;
+        UINT64 LeftScreenBlurry;
+
+        UINT32 FramesOverBudget;
+        UINT64 PeakOverBudget;
+    };
+
+    LatencySummary Summarize(std::vector<double>& Samples)
+    {
+        LatencySummary Summary = {};
+        if (Samples.empty())
+        {
+            return Summary;
+        }
+
+        std::sort(Samples.begin(), Samples.end());
+
+        double Total = 0.0;
+        for (double Sample : Samples)
+        {
+            Total += Sample;
+        }
+
+        Summary.Mean = Total / Samples.size();
+        Summary.P50 = Samples[Samples.size() / 2];
+        Summary.P99 = Samples[std::min(Samples.size() - 1, Samples.size() * 99 / 100)];
+        Summary.Max = Samples.back();
+        return Summary;
+    }
+
+    std::vector<CameraKey> BuildCameraPath(CameraPath Path, const SimulatorOptions& Options)
+    {
+        const float Width = Options.NumColumns * ImagePitch;
+        const float Height = Options.NumRows * ImagePitch;
+        const UINT32 N = Options.NumFrames;
+
+        std::vector<CameraKey> Keys;
+        switch (Path)
+        {
+        case CameraPath::Pan:
+            // Sweeps the whole grid at the demo's starting zoom
+            Keys.push_back({ 0, { 0.0f, Height * 0.5f, 1.0f }, false });
+            Keys.push_back({ N, { Width, Height * 0.5f, 1.0f }, false });
+            break;
+
+        case CameraPath::Zoom:
+            // Dives into the middle of the grid and back out
+            Keys.push_back({ 0, { Width * 0.5f, Height * 0.5f, 0.25f }, false });
+            Keys.push_back({ N / 2, { Width * 0.5f, Height * 0.5f, 8.0f }, false });
+            Keys.push_back({ N, { Width * 0.5f, Height * 0.5f, 0.25f }, false });
+            break;
+
+        case CameraPath::Tour:
+            // Pans, jumps across the grid, zooms in, pans close up and jumps back out
+            Keys.push_back({ 0, { Width * 0.1f, Height * 0.5f, 1.0f }, false });
+            Keys.push_back({ N / 4, { Width * 0.3f, Height * 0.5f, 1.0f }, false });
+            Keys.push_back({ N / 4, { Width * 0.7f, Height * 0.25f, 2.0f }, true });
+            Keys.push_back({ N / 2, { Width * 0.7f, Height * 0.25f, 6.0f }, false });
+            Keys.push_back({ N * 3 / 4, { Width * 0.75f, Height * 0.75f, 6.0f }, false });
+            Keys.push_back({ N * 3 / 4, { Width * 0.2f, Height * 0.5f, 0.5f }, true });
+            Keys.push_back({ N, { Width * 0.25f, Height * 0.5f, 0.5f }, false });
+            break;
+        }
+        return Keys;
+    }
+
+    Camera EvaluateCameraPath(const std::vector<CameraKey>& Keys, UINT32 Frame)
+    {
+        size_t Current = 0;
+        while (Current + 1 < Keys.size() && Keys[Current + 1].Frame <= Frame)
+        {
+            Current++;
+        }
+
+        const CameraKey& From = Keys[Current];
+        if (Current + 1 == Keys.size() || Keys[Current + 1].Jump)
+        {
+            return From.Position;
+        }
+
+        const CameraKey& To = Keys[Current + 1];
+        const float T = float(Frame - From.Frame) / float(To.Frame - From.Frame);
+
+        Camera Result;
+        Result.X = From.Position.X + (To.Position.X - From.Position.X) * T;
+        Result.Y = From.Position.Y + (To.Position.Y - From.Position.Y) * T;
+        Result.Zoom = From.Position.Zoom * powf(To.Position.Zoom / From.Position.Zoom, T);
+        return Result;
+    }
+
+    // The overlap of two ranges, or 0
+    float Overlap(float MinA, float MaxA, float MinB, float MaxB)
+    {
+        const float Size = std::min(MaxA, MaxB) - std::max(MinA, MinB);
+        return Size > 0.0f ? Size : 0.0f;
+    }
+
+    //
+    // The demo's CalculateImagePagingData: an image on screen needs the mip it is drawn with
+    // and prefetches the next one, an image within PrefetchDistance of the screen prefetches the
+    // mip it would be drawn with, and anything further away needs nothing.
+    //
+    void CalculateImagePagingData(const Image& Img, const Camera& View, UINT8* pVisibleMip, UINT8* pPrefetchMip, float* pScreenArea)
+    {
+        const float HalfWidth = ScreenWidth * 0.5f / View.Zoom;
+        const float HalfHeight = ScreenHeight * 0.5f / View.Zoom;
+        const float Prefetch = PrefetchDistance / View.Zoom;
+
+        const float Right = Img.Left + RenderTileSize;
+        const float Bottom = Img.Top + RenderTileSize;
+
+        const float VisibleWidth = Overlap(Img.Left, Right, View.X - HalfWidth, View.X + HalfWidth);
+        const float VisibleHeight = Overlap(Img.Top, Bottom, View.Y - HalfHeight, View.Y + HalfHeight);
+
+        const float PixelWidth = RenderTileSize * View.Zoom;
+        UINT8 RequiredMip = UINT8(CalculateRequiredMip(Img.TexelWidth, PixelWidth));
+        RequiredMip = std::min(RequiredMip, Img.Texture.GetPackedMip());
+
+        if (VisibleWidth > 0.0f && VisibleHeight > 0.0f)
+        {
+            *pVisibleMip = RequiredMip;
+            *pPrefetchMip = RequiredMip > 0 ? UINT8(RequiredMip - 1) : 0;
+            *pScreenArea = VisibleWidth * VisibleHeight * View.Zoom * View.Zoom;
+        }
+        else if (Overlap(Img.Left, Right, View.X - HalfWidth - Prefetch, View.X + HalfWidth + Prefetch) > 0.0f &&
+                 Overlap(Img.Top, Bottom, View.Y - HalfHeight - Prefetch, View.Y + HalfHeight + Prefetch) > 0.0f)
+        {
+            *pVisibleMip = MIP_STREAMING_UNDEFINED_MIP;
+            *pPrefetchMip = RequiredMip;
+            *pScreenArea = PixelWidth * PixelWidth;
+        }
+        else
+        {
+            *pVisibleMip = MIP_STREAMING_UNDEFINED_MIP;
+            *pPrefetchMip = MIP_STREAMING_UNDEFINED_MIP;
+            *pScreenArea = 0.0f;
+        }
+    }
+
+    // Square BC7 textures from 512 to 4096 texels wide
+    UINT64 InitializeImages(Image* pImages, const SimulatorOptions& Options)
+    {
+        std::mt19937 Random(Options.Seed);
+
+        UINT64 TotalBytes = 0;
+        const UINT32 NumImages = Options.NumRows * Options.NumColumns;
+        for (UINT32 i = 0; i < NumImages; i++)
+        {
+            Image& Img = pImages[i];
+            Img.Left = (i / Options.NumRows) * ImagePitch;
+            Img.Top = (i % Options.NumRows) * ImagePitch;
+            Img.TexelWidth = 512u << (Random() % 4);
+            Img.VisibleMip = MIP_STREAMING_UNDEFINED_MIP;
+            Img.PrefetchMip = MIP_STREAMING_UNDEFINED_MIP;
+            Img.ScreenArea = 0.0f;
+            Img.BlurrySince = -1;
+
+            UINT64 MipSizes[MIP_STREAMING_MAX_MIPS];
+            UINT8 PackedMip = 0;
+            for (UINT32 Width = Img.TexelWidth; Width >= TileTexels; Width /= 2)
+            {
+                const UINT64 Tiles = Width / TileTexels;
+                MipSizes[PackedMip++] = Tiles * Tiles * TileBytes;
+            }
+            MipSizes[PackedMip] = TileBytes;
+
+            Img.Texture.Initialize(PackedMip, MipSizes);
+            for (UINT32 Mip = 0; Mip <= PackedMip; Mip++)
+            {
+                TotalBytes += MipSizes[Mip];
+            }
+        }
+        return TotalBytes;
+    }
+
+    SimulationResult Simulate(CameraPath Path, const SimulatorOptions& Options)
+    {
+        SimulationResult Result = {};
+
+        const UINT32 NumImages = Options.NumRows * Options.NumColumns;
+        std::unique_ptr<Image[]> Images(new Image[NumImages]);
+        Result.TotalBytes = InitializeImages(Images.get(), Options);
+
+        Result.Budget = UINT64(Options.BudgetMB) * 1024 * 1024;
+        Result.DroppedBudget = Result.Budget * Options.BudgetDropPercent / 100;
+        const UINT32 BudgetDropFrame = Options.NumFrames * 2 / 3;
+        FixedBudgetModel Budget(Result.Budget);
+
+        // A batch copies about a frame's worth of data, so priorities are revisited every frame
+        const double BytesPerMicrosecond = Options.BandwidthMBps * MB / 1000000.0;
+
+        SchedulerDesc Desc = DefaultSchedulerDesc();
+        Desc.Order = Options.Order;
+        Desc.MaxLoadsPerBatch = Options.MaxLoadsPerBatch;
+        Desc.MaxLoadsPerTexture = Options.MaxLoadsPerTexture;
+        Desc.MaxBytesPerBatch = UINT64(BytesPerMicrosecond * FrameMicroseconds);
+
+        MipStreamingScheduler Scheduler;
+        Scheduler.Initialize(&Budget, Desc);
+        for (UINT32 i = 0; i < NumImages; i++)
+        {
+            Scheduler.BeginTracking(&Images[i].Texture);
+        }
+
+        const std::vector<CameraKey> Keys = BuildCameraPath(Path, Options);
+
+        StreamingBatch Batch;
+        std::vector<PendingLoad> Pending;
+        size_t NextCompletion = 0;
+        double WorkerTime = 0.0;
+        UINT64 CurrentBudget = Result.Budget;
+
+        auto CompleteLoads = [&](double Time)
+        {
+            while (NextCompletion < Pending.size() && Pending[NextCompletion].CompletionTime <= Time)
+            {
+                Scheduler.MipLoaded(Pending[NextCompletion].pTexture, Pending[NextCompletion].Mip);
+                NextCompletion++;
+            }
+        };
+
+        auto RecordOverBudget = [&]()
+        {
+            const UINT64 Streamed = Scheduler.GetStreamedBytes();
+            if (Streamed > CurrentBudget)
+            {
+                Result.PeakOverBudget = std::max(Result.PeakOverBudget, Streamed - CurrentBudget);
+                return true;
+            }
+            return false;
+        };
+
+        for (UINT32 Frame = 0; Frame < Options.NumFrames; Frame++)
+        {
+            const double FrameStart = Frame * FrameMicroseconds;
+            const double FrameEnd = FrameStart + FrameMicroseconds;
+
+            const Camera View = EvaluateCameraPath(Keys, Frame);
+            for (UINT32 i = 0; i < NumImages; i++)
+            {
+                Image& Img = Images[i];
+
+                UINT8 VisibleMip;
+                UINT8 PrefetchMip;
+                float ScreenArea;
+                CalculateImagePagingData(Img, View, &VisibleMip, &PrefetchMip, &ScreenArea);
+
+                if (VisibleMip != Img.VisibleMip || PrefetchMip != Img.PrefetchMip || ScreenArea != Img.ScreenArea)
+                {
+                    Img.VisibleMip = VisibleMip;
+                    Img.PrefetchMip = PrefetchMip;
+                    Img.ScreenArea = ScreenArea;
+                    Scheduler.UpdateVisibility(&Img.Texture, VisibleMip, PrefetchMip, ScreenArea);
+                }
+            }
+
+            // The frame is drawn with whatever finished loading before it started
+            CompleteLoads(FrameStart);
+            for (UINT32 i = 0; i < NumImages; i++)
+            {
+                Image& Img = Images[i];
+                const UINT8 ResidentMip = Img.Texture.GetResidentMip();
+                const bool IsVisible = Img.VisibleMip != MIP_STREAMING_UNDEFINED_MIP;
+                const bool IsBlurry = IsVisible && ResidentMip > Img.VisibleMip;
+
+                if (IsVisible)
+                {
+                    Result.VisiblePixelFrames += Img.ScreenArea;
+                }
+                if (IsBlurry)
+                {
+                    Result.BlurryPixelFrames += Img.ScreenArea;
+                    if (ResidentMip > Img.Texture.GetPackedMip())
+                    {
+                        Result.EmptyPixelFrames += Img.ScreenArea;
+                    }
+                    if (Img.BlurrySince < 0)
+                    {
+                        Img.BlurrySince = int(Frame);
+                    }
+                }
+                else if (Img.BlurrySince >= 0)
+                {
+                    if (IsVisible)
+                    {
+                        Result.PopLatencies.push_back((Frame - Img.BlurrySince) * FrameMicroseconds / 1000.0);
+                    }
+                    else
+                    {
+                        Result.LeftScreenBlurry++;
+                    }
+                    Img.BlurrySince = -1;
+                }
+            }
+
+            if (RecordOverBudget())
+            {
+                Result.FramesOverBudget++;
+            }
+
+            // Arrives between frames, like a budget change notification
+            if (Frame == BudgetDropFrame && Options.BudgetDropPercent != 100)
+            {
+                CurrentBudget = Result.DroppedBudget;
+                Budget.SetBudget(CurrentBudget);
+            }
+
+            //
+            // The paging thread wakes for the frame's visibility updates and keeps paging until
+            // it runs out of work. Its loads finish once the batch's copies are done.
+            //
+            WorkerTime = std::max(WorkerTime, FrameStart);
+            while (WorkerTime < FrameEnd)
+            {
+                CompleteLoads(WorkerTime);
+                Scheduler.SelectBatch(&Batch);
+                RecordOverBudget();
+
+                if (Batch.Loads.empty() && Batch.Evictions.empty())
+                {
+                    break;
+                }
+
+                Result.Batches++;
+                for (const MipOperation& Eviction : Batch.Evictions)
+                {
+                    Result.BytesEvicted += Eviction.pTexture->GetMipSize(Eviction.Mip);
+                    Result.MipsEvicted++;
+                }
+
+                WorkerTime += Options.BatchCostMicroseconds + Batch.LoadBytes / BytesPerMicrosecond;
+                for (const MipOperation& Load : Batch.Loads)
+                {
+                    Pending.push_back({ WorkerTime, Load.pTexture, Load.Mip });
+                    Result.BytesLoaded += Load.pTexture->GetMipSize(Load.Mip);
+                    Result.MipsLoaded++;
+                }
+            }
+        }
+
+        for (UINT32 i = 0; i < NumImages; i++)
+        {
+            Scheduler.EndTracking(&Images[i].Texture);
+        }
+        return Result;
+    }
+
+    const char* PathName(CameraPath Path)
+    {
+        switch (Path)
+        {
+        case CameraPath::Zoom:
+            return "zoom";
+        case CameraPath::Tour:
+            return "tour";
+        default:
+            return "pan";
+        }
+    }
+
+    void PrintResult(CameraPath Path, const SimulatorOptions& Options, SimulationResult& Result)
+    {
+        const LatencySummary Latency = Summarize(Result.PopLatencies);
+        const double Visible = Result.VisiblePixelFrames > 0.0 ? Result.VisiblePixelFrames : 1.0;
+
+        printf("%s (%s, %u per batch, %u per texture)\n", PathName(Path),
+            Options.Order == QUEUE_ORDER::FIFO ? "fifo" : "error", Options.MaxLoadsPerBatch, Options.MaxLoadsPerTexture);
+        printf("  frames                  %u, %u images, %.1f MB of mips\n", Options.NumFrames, Options.NumRows * Options.NumColumns, Result.TotalBytes / MB);
+        printf("  budget                  %.1f MB, %.1f MB from frame %u\n", Result.Budget / MB, Result.DroppedBudget / MB, Options.NumFrames * 2 / 3);
+        printf("  loaded                  %.1f MB in %llu mips, %llu batches\n", Result.BytesLoaded / MB,
+            (unsigned long long)Result.MipsLoaded, (unsigned long long)Result.Batches);
+        printf("  evicted                 %.1f MB in %llu mips\n", Result.BytesEvicted / MB, (unsigned long long)Result.MipsEvicted);
+        printf("  blurry pixels           %.2f%% of visible (%.2f%% with no mips)\n",
+            100.0 * Result.BlurryPixelFrames / Visible, 100.0 * Result.EmptyPixelFrames / Visible);
+        printf("  popping latency (ms)    mean %.1f  p50 %.1f  p99 %.1f  max %.1f  (%llu pops, %llu left the screen blurry)\n",
+            Latency.Mean, Latency.P50, Latency.P99, Latency.Max,
+            (unsigned long long)Result.PopLatencies.size(), (unsigned long long)Result.LeftScreenBlurry);
+        printf("  over budget             %u frames, peak %.1f MB\n", Result.FramesOverBudget, Result.PeakOverBudget / MB);
+    }
+
+    void PrintUsage()
+    {
+        printf(
+            "Usage: MipStreamingSimulator [options]\n"
+            "\n"
+            "Runs each camera path with the demo's one mip per wakeup in arrival order, then with\n"
+            "batches ordered by screen-space error, unless --order or --batch is given.\n"
+            "\n"
+            "  --path <pan|zoom|tour>    run only this camera path\n"
+            "  --seed <n>                texture size seed (1)\n"
+            "  --rows <n>                image rows (8)\n"
+            "  --columns <n>             image columns (128)\n"
+            "  --frames <n>              frames per camera path (1200)\n"
+            "  --budget <MB>             streaming budget (512)\n"
+            "  --budget-drop <percent>   budget left after 2/3 of the frames, 100 keeps it (50)\n"
+            "  --bandwidth <MB/s>        copy bandwidth (2000)\n"
+            "  --batch-cost <us>         fixed cost of each batch (250)\n"
+            "  --order <fifo|error>      load queue order\n"
+            "  --batch <n>               most mips per batch\n"
+            "  --per-texture <n>         most mips of one texture per batch (4)\n");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    SimulatorOptions Options;
+    Options.Seed = 1;
+    Options.NumRows = 8;
+    Options.NumColumns = 128;
+    Options.NumFrames = 1200;
+    Options.BudgetMB = 512;
+    Options.BudgetDropPercent = 50;
+    Options.BandwidthMBps = 2000;
+    Options.BatchCostMicroseconds = 250;
+    Options.Order = QUEUE_ORDER::SCREEN_SPACE_ERROR;
+    Options.MaxLoadsPerBatch = 16;
+    Options.MaxLoadsPerTexture = 4;
+
+    std::vector<CameraPath> Paths;
+    bool OrderGiven = false;
+    bool BatchGiven = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char* pArg = argv[i];
+        const char* pValue = i + 1 < argc ? argv[i + 1] : nullptr;
+
+        if (strcmp(pArg, "--help") == 0 || pValue == nullptr)
+        {
+            PrintUsage();
+            return strcmp(pArg, "--help") == 0 ? 0 : 1;
+        }
+
+        i++;
+        const UINT32 Number = UINT32(strtoul(pValue, nullptr, 10));
+        if (strcmp(pArg, "--path") == 0)
+        {
+            if (strcmp(pValue, "pan") == 0)
+            {
+                Paths.push_back(CameraPath::Pan);
+            }
+            else if (strcmp(pValue, "zoom") == 0)
+            {
+                Paths.push_back(CameraPath::Zoom);
+            }
+            else if (strcmp(pValue, "tour") == 0)
+            {
+                Paths.push_back(CameraPath::Tour);
+            }
+            else
+            {
+                PrintUsage();
+                return 1;
+            }
+        }
+        else if (strcmp(pArg, "--order") == 0)
+        {
+            if (strcmp(pValue, "fifo") == 0)
+            {
+                Options.Order = QUEUE_ORDER::FIFO;
+            }
+            else if (strcmp(pValue, "error") == 0)
+            {
+                Options.Order = QUEUE_ORDER::SCREEN_SPACE_ERROR;
+            }
+            else
+            {
+                PrintUsage();
+                return 1;
+            }
+            OrderGiven = true;
+        }
+        else if (strcmp(pArg, "--batch") == 0)
+        {
+            Options.MaxLoadsPerBatch = std::max(Number, 1u);
+            BatchGiven = true;
+        }
+        else if (strcmp(pArg, "--seed") == 0) Options.Seed = Number;
+        else if (strcmp(pArg, "--rows") == 0) Options.NumRows = std::max(Number, 1u);
+        else if (strcmp(pArg, "--columns") == 0) Options.NumColumns = std::max(Number, 1u);
+        else if (strcmp(pArg, "--frames") == 0) Options.NumFrames = std::max(Number, 4u);
+        else if (strcmp(pArg, "--budget") == 0) Options.BudgetMB = Number;
+        else if (strcmp(pArg, "--budget-drop") == 0) Options.BudgetDropPercent = std::min(Number, 100u);
+        else if (strcmp(pArg, "--bandwidth") == 0) Options.BandwidthMBps = std::max(Number, 1u);
+        else if (strcmp(pArg, "--batch-cost") == 0) Options.BatchCostMicroseconds = Number;
+        else if (strcmp(pArg, "--per-texture") == 0) Options.MaxLoadsPerTexture = std::max(Number, 1u);
+        else
+        {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    if (Paths.empty())
+    {
+        Paths.push_back(CameraPath::Pan);
+        Paths.push_back(CameraPath::Zoom);
+        Paths.push_back(CameraPath::Tour);
+    }
+
+    // The demo's paging thread, then the scheduler's defaults
+    std::vector<SimulatorOptions> Configurations;
+    if (OrderGiven || BatchGiven)
+    {
+        Configurations.push_back(Options);
+    }
+    else
+    {
+        SimulatorOptions Demo = Options;
+        Demo.Order = QUEUE_ORDER::FIFO;
+        Demo.MaxLoadsPerBatch = 1;
+        Demo.MaxLoadsPerTexture = 1;
+        Configurations.push_back(Demo);
+        Configurations.push_back(Options);
+    }
+
+    for (CameraPath Path : Paths)
+    {
+        for (const SimulatorOptions& Configuration : Configurations)
+        {
+            SimulationResult Result = Simulate(Path, Configuration);
+            PrintResult(Path, Configuration, Result);
+        }
+    }
+
+    return 0;
+}
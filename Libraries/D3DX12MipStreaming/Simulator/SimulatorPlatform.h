@@ -0,0 +1,33 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+// Everything d3dx12MipStreaming.h expects to be included before it. On Windows that is the
+// real SDK. Elsewhere the DXGI budget model is compiled out and only the Win32 integer types
+// the scheduler names are provided here.
+
+#pragma once
+
+#ifdef _WIN32
+
+#define NOMINMAX
+#include <windows.h>
+#include <dxgi1_4.h>
+
+#else
+
+#include <stdint.h>
+
+typedef uint8_t UINT8;
+typedef uint32_t UINT;
+typedef uint32_t UINT32;
+typedef uint64_t UINT64;
+
+#endif
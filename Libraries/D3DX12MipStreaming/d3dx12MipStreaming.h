@@ -0,0 +1,1020 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <math.h>
+#include <mutex>
+#include <string.h>
+#include <vector>
+
+namespace D3DX12MipStreaming
+{
+    // Mip 0 is the most detailed level. Each texture's mips are tracked in 32 bit masks.
+#define MIP_STREAMING_MAX_MIPS 16
+#define MIP_STREAMING_UNDEFINED_MIP 0xFF
+    static_assert(MIP_STREAMING_MAX_MIPS < 32, "Mips are tracked in 32 bit masks");
+
+    // The DXGI budget model needs dxgi1_4.h. Without it the app passes a budget model of its own.
+#ifndef MIP_STREAMING_DXGI_BUDGET_MODEL
+#ifdef _WIN32
+#define MIP_STREAMING_DXGI_BUDGET_MODEL 1
+#else
+#define MIP_STREAMING_DXGI_BUDGET_MODEL 0
+#endif
+#endif
+
+    // The scheduler loads mips of higher priority textures first. Within a priority the texture
+    // with the largest screen-space error goes first.
+    enum class STREAMING_PRIORITY : UINT8
+    {
+        // The texture is near the camera and has no mips at all
+        VERY_HIGH,
+        // The texture is on screen at less detail than it is drawn with
+        HIGH,
+        // The texture has no mips at all, or is near the camera at less detail than it will need
+        MEDIUM,
+        // Nothing needs the texture, but it isn't fully loaded either
+        LOW,
+        NONE
+    };
+
+    static const UINT32 NumStreamingPriorities = UINT32(STREAMING_PRIORITY::NONE);
+
+    // Which mips a load may trim to make room for itself when the budget is exhausted, so that a
+    // prefetch can't trim what is on screen and two textures can't keep trimming each other.
+    enum class TRIM_PASS : UINT8
+    {
+        NONE,
+        // Mips more detailed than any camera nearby needs
+        NON_PREFETCHABLE,
+        // Mips more detailed than the texture is drawn with
+        NON_VISIBLE,
+        // Any mip but the packed ones
+        VISIBLE
+    };
+
+    enum class QUEUE_ORDER
+    {
+        // Largest screen-space error first
+        SCREEN_SPACE_ERROR,
+        // The order the textures last changed in
+        FIFO
+    };
+
+    // The mip a texture TexelWidth texels wide is sampled at when it is drawn PixelWidth pixels wide
+    inline float CalculateRequiredMip(UINT32 TexelWidth, float PixelWidth)
+    {
+        if (PixelWidth <= 0.0f)
+        {
+            return float(MIP_STREAMING_MAX_MIPS);
+        }
+
+        const float Mip = log2f(float(TexelWidth) / PixelWidth);
+        return Mip > 0.0f ? Mip : 0.0f;
+    }
+
+    // One per streamed texture, owned by the app. Only the accessors are meant for the app, the
+    // rest belongs to the scheduler that tracks it.
+    struct StreamedTexture
+    {
+        StreamedTexture() :
+            PackedMip(0),
+            ResidentMip(0),
+            RequestedMip(0),
+            LoadedMask(0),
+            InFlightMask(0),
+            VisibleMip(MIP_STREAMING_UNDEFINED_MIP),
+            PrefetchMip(MIP_STREAMING_UNDEFINED_MIP),
+            ScreenArea(0.0f),
+            PendingVisibleMip(MIP_STREAMING_UNDEFINED_MIP),
+            PendingPrefetchMip(MIP_STREAMING_UNDEFINED_MIP),
+            PendingScreenArea(0.0f),
+            UpdatePending(false),
+            IsTracked(false),
+            Priority(STREAMING_PRIORITY::NONE),
+            TrimLimit(TRIM_PASS::NONE),
+            IgnoreBudget(false),
+            Urgent(false),
+            LoadKey(0.0),
+            LoadSequence(0),
+            LoadHeapIndex(UINT32(-1)),
+            TrimClass(TRIM_PASS::NONE),
+            TrimMip(0),
+            TrimKey(0.0),
+            TrimHeapIndex(UINT32(-1)),
+            BatchID(0),
+            BatchLoads(0)
+        {
+            memset(MipSizes, 0, sizeof(MipSizes));
+        }
+
+        // pMipSizes holds the size of every mip from 0 to PackedMip. The mips from PackedMip on are
+        // loaded and evicted together as the texture's minimum working set, so pMipSizes[PackedMip]
+        // is their combined size.
+        bool Initialize(UINT8 PackedMipIn, const UINT64* pMipSizes)
+        {
+            if (PackedMipIn >= MIP_STREAMING_MAX_MIPS - 1)
+            {
+                return false;
+            }
+
+            PackedMip = PackedMipIn;
+            for (UINT32 i = 0; i <= PackedMip; i++)
+            {
+                MipSizes[i] = pMipSizes[i];
+            }
+
+            // Nothing is resident until the packed mips are loaded
+            ResidentMip = UINT8(PackedMip + 1);
+            RequestedMip = UINT8(PackedMip + 1);
+            return true;
+        }
+
+        // The most detailed mip that may be sampled, or PackedMip + 1 while nothing is resident.
+        // Safe to call while the scheduler runs on another thread.
+        UINT8 GetResidentMip() const
+        {
+            return ResidentMip.load(std::memory_order_acquire);
+        }
+
+        UINT8 GetPackedMip() const
+        {
+            return PackedMip;
+        }
+
+        UINT64 GetMipSize(UINT8 Mip) const
+        {
+            return MipSizes[Mip < PackedMip ? Mip : PackedMip];
+        }
+
+        UINT64 MipSizes[MIP_STREAMING_MAX_MIPS];
+        UINT8 PackedMip;
+
+        // The most detailed contiguous mips that are loaded, and that are loaded or loading
+        std::atomic<UINT8> ResidentMip;
+        UINT8 RequestedMip;
+        UINT32 LoadedMask;
+        UINT32 InFlightMask;
+
+        // What the camera needs, as of the last visibility update the scheduler applied
+        UINT8 VisibleMip;
+        UINT8 PrefetchMip;
+        float ScreenArea;
+
+        // The latest visibility update, written under the scheduler's lock by any thread
+        UINT8 PendingVisibleMip;
+        UINT8 PendingPrefetchMip;
+        float PendingScreenArea;
+        bool UpdatePending;
+
+        bool IsTracked;
+
+        // The load queue this texture is in, and how its next load is treated
+        STREAMING_PRIORITY Priority;
+        TRIM_PASS TrimLimit;
+        bool IgnoreBudget;
+        bool Urgent;
+        double LoadKey;
+        UINT64 LoadSequence;
+        UINT32 LoadHeapIndex;
+
+        // The mip the texture would give up first when others need room, and what it would cost
+        TRIM_PASS TrimClass;
+        UINT8 TrimMip;
+        double TrimKey;
+        UINT32 TrimHeapIndex;
+
+        // Loads handed out by the current batch
+        UINT64 BatchID;
+        UINT32 BatchLoads;
+    };
+
+    // How much memory the streamed mips may occupy
+    class BudgetModel
+    {
+    public:
+        virtual ~BudgetModel() {}
+
+        // StreamedBytes is what the scheduler has resident or loading, so a model built on the
+        // process's total usage can tell the scheduler's share from everything else.
+        virtual UINT64 GetStreamingBudget(UINT64 StreamedBytes) = 0;
+    };
+
+    // A budget the app sets, e.g. a share of memory it worked out itself or a simulated one
+    class FixedBudgetModel : public BudgetModel
+    {
+    public:
+        FixedBudgetModel(UINT64 BudgetIn = 0) :
+            Budget(BudgetIn)
+        {
+        }
+
+        void SetBudget(UINT64 BudgetIn)
+        {
+            Budget = BudgetIn;
+        }
+
+        virtual UINT64 GetStreamingBudget(UINT64) override
+        {
+            return Budget;
+        }
+
+    private:
+        std::atomic<UINT64> Budget;
+    };
+
+#if MIP_STREAMING_DXGI_BUDGET_MODEL
+    // The local segment budget DXGI reports, less whatever else the process has resident
+    class DXGIBudgetModel : public BudgetModel
+    {
+    public:
+        DXGIBudgetModel() :
+            Adapter(nullptr),
+            NodeIndex(0)
+        {
+        }
+
+        // NOTE: This is an index not a mask. The majority of D3D12 uses bit masks to identify a GPU node whereas DXGI uses 0 based indices.
+        void Initialize(IDXGIAdapter3* ParentAdapter, UINT DeviceNodeIndex)
+        {
+            Adapter = ParentAdapter;
+            NodeIndex = DeviceNodeIndex;
+        }
+
+        virtual UINT64 GetStreamingBudget(UINT64 StreamedBytes) override
+        {
+            DXGI_QUERY_VIDEO_MEMORY_INFO Info;
+            if (FAILED(Adapter->QueryVideoMemoryInfo(NodeIndex, DXGI_MEMORY_SEGMENT_GROUP_LOCAL, &Info)))
+            {
+                // Hold steady rather than trim everything
+                return StreamedBytes;
+            }
+
+            const UINT64 OtherUsage = Info.CurrentUsage > StreamedBytes ? Info.CurrentUsage - StreamedBytes : 0;
+            return Info.Budget > OtherUsage ? Info.Budget - OtherUsage : 0;
+        }
+
+    private:
+        IDXGIAdapter3* Adapter;
+        UINT NodeIndex;
+    };
+#endif
+
+    namespace Internal
+    {
+        // A binary heap of textures that knows where each texture is, so one can be removed or
+        // re-keyed without a search. Traits::Before orders it and Traits::Index is the slot.
+        template <typename Traits>
+        class TextureHeap
+        {
+        public:
+            static const UINT32 InvalidIndex = UINT32(-1);
+
+            bool IsEmpty() const
+            {
+                return Entries.empty();
+            }
+
+            StreamedTexture* Top() const
+            {
+                return Entries[0];
+            }
+
+            void Insert(StreamedTexture* pTexture)
+            {
+                Traits::Index(pTexture) = UINT32(Entries.size());
+                Entries.push_back(pTexture);
+                SiftUp(UINT32(Entries.size() - 1));
+            }
+
+            void Remove(StreamedTexture* pTexture)
+            {
+                const UINT32 Index = Traits::Index(pTexture);
+                const UINT32 Last = UINT32(Entries.size() - 1);
+
+                Traits::Index(pTexture) = InvalidIndex;
+                if (Index != Last)
+                {
+                    Entries[Index] = Entries[Last];
+                    Traits::Index(Entries[Index]) = Index;
+                    Entries.pop_back();
+                    SiftDown(SiftUp(Index));
+                }
+                else
+                {
+                    Entries.pop_back();
+                }
+            }
+
+            void Clear()
+            {
+                for (StreamedTexture* pTexture : Entries)
+                {
+                    Traits::Index(pTexture) = InvalidIndex;
+                }
+                Entries.clear();
+            }
+
+        private:
+            UINT32 SiftUp(UINT32 Index)
+            {
+                while (Index > 0)
+                {
+                    const UINT32 Parent = (Index - 1) / 2;
+                    if (Traits::Before(Entries[Index], Entries[Parent]) == false)
+                    {
+                        break;
+                    }
+                    Swap(Index, Parent);
+                    Index = Parent;
+                }
+                return Index;
+            }
+
+            void SiftDown(UINT32 Index)
+            {
+                const UINT32 Count = UINT32(Entries.size());
+                while (true)
+                {
+                    const UINT32 Left = Index * 2 + 1;
+                    const UINT32 Right = Left + 1;
+                    UINT32 First = Index;
+
+                    if (Left < Count && Traits::Before(Entries[Left], Entries[First]))
+                    {
+                        First = Left;
+                    }
+                    if (Right < Count && Traits::Before(Entries[Right], Entries[First]))
+                    {
+                        First = Right;
+                    }
+                    if (First == Index)
+                    {
+                        return;
+                    }
+                    Swap(Index, First);
+                    Index = First;
+                }
+            }
+
+            void Swap(UINT32 A, UINT32 B)
+            {
+                StreamedTexture* pTemp = Entries[A];
+                Entries[A] = Entries[B];
+                Entries[B] = pTemp;
+                Traits::Index(Entries[A]) = A;
+                Traits::Index(Entries[B]) = B;
+            }
+
+            std::vector<StreamedTexture*> Entries;
+        };
+
+        // Urgent loads first, then the largest error, then the longest waiting
+        struct LoadOrder
+        {
+            static bool Before(const StreamedTexture* pA, const StreamedTexture* pB)
+            {
+                if (pA->Urgent != pB->Urgent)
+                {
+                    return pA->Urgent;
+                }
+                if (pA->LoadKey != pB->LoadKey)
+                {
+                    return pA->LoadKey > pB->LoadKey;
+                }
+                return pA->LoadSequence < pB->LoadSequence;
+            }
+
+            static UINT32& Index(StreamedTexture* pTexture)
+            {
+                return pTexture->LoadHeapIndex;
+            }
+        };
+
+        // The least needed mips first, then the least error, then the largest mip
+        struct TrimOrder
+        {
+            static bool Before(const StreamedTexture* pA, const StreamedTexture* pB)
+            {
+                if (pA->TrimClass != pB->TrimClass)
+                {
+                    return pA->TrimClass < pB->TrimClass;
+                }
+                if (pA->TrimKey != pB->TrimKey)
+                {
+                    return pA->TrimKey < pB->TrimKey;
+                }
+
+                const UINT64 SizeA = pA->MipSizes[pA->TrimMip];
+                const UINT64 SizeB = pB->MipSizes[pB->TrimMip];
+                if (SizeA != SizeB)
+                {
+                    return SizeA > SizeB;
+                }
+                return pA->LoadSequence < pB->LoadSequence;
+            }
+
+            static UINT32& Index(StreamedTexture* pTexture)
+            {
+                return pTexture->TrimHeapIndex;
+            }
+        };
+
+        // The pixels a texture covers, weighted by how many times too coarse its texels are
+        inline double ScreenSpaceError(float ScreenArea, UINT32 Mip, UINT32 TargetMip)
+        {
+            if (Mip <= TargetMip)
+            {
+                return 0.0;
+            }
+            return double(ScreenArea) * (ldexp(1.0, int(Mip - TargetMip)) - 1.0);
+        }
+    }
+
+    struct SchedulerDesc
+    {
+        QUEUE_ORDER Order;
+
+        // The most mips one batch may load and the most bytes they may add up to. A batch always
+        // loads at least one mip.
+        UINT32 MaxLoadsPerBatch;
+        UINT64 MaxBytesPerBatch;
+
+        // The most mips of a single texture one batch may load, so a texture far from its target
+        // can't take a whole batch
+        UINT32 MaxLoadsPerTexture;
+
+        // Loads that count against the budget keep this much below it, plus BudgetBiasPerPriority
+        // for each priority below VERY_HIGH. Drivers and the kernel may size a mip a little
+        // differently than the app does.
+        UINT64 BudgetBias;
+        UINT64 BudgetBiasPerPriority;
+    };
+
+    inline SchedulerDesc DefaultSchedulerDesc()
+    {
+        SchedulerDesc Desc;
+        Desc.Order = QUEUE_ORDER::SCREEN_SPACE_ERROR;
+        Desc.MaxLoadsPerBatch = 16;
+        Desc.MaxBytesPerBatch = 64 * 1024 * 1024;
+        Desc.MaxLoadsPerTexture = 4;
+        Desc.BudgetBias = 1024 * 1024;
+        Desc.BudgetBiasPerPriority = 8 * 1024 * 1024;
+        return Desc;
+    }
+
+    struct MipOperation
+    {
+        StreamedTexture* pTexture;
+        UINT8 Mip;
+    };
+
+    // The paging work chosen by one SelectBatch call. Evictions come first since the loads were
+    // budgeted against the room they make. The mips they name are no longer reported resident,
+    // but the GPU may still be using them from earlier frames.
+    struct StreamingBatch
+    {
+        StreamingBatch() :
+            LoadBytes(0),
+            MoreWork(false)
+        {
+        }
+
+        std::vector<MipOperation> Evictions;
+        std::vector<MipOperation> Loads;
+        UINT64 LoadBytes;
+
+        // The batch limits left loads queued, call SelectBatch again without waiting
+        bool MoreWork;
+    };
+
+    // Decides which mips to load and which to evict, in the order the D3D12MemoryManagement demo's
+    // paging thread does, but with the work queues keyed by screen-space error and several mips
+    // chosen per wakeup. The app does the loading and evicting.
+    //
+    // UpdateVisibility, Wake and Shutdown may be called from any thread. Everything else belongs to
+    // the thread doing the paging.
+    class MipStreamingScheduler
+    {
+    public:
+        MipStreamingScheduler() :
+            pBudgetModel(nullptr),
+            StreamedBytes(0),
+            NextLoadSequence(0),
+            CurrentBatchID(0),
+            WakeRequested(false),
+            ShutdownRequested(false)
+        {
+            Desc = DefaultSchedulerDesc();
+        }
+
+        void Initialize(BudgetModel* pBudgetModelIn, const SchedulerDesc& DescIn = DefaultSchedulerDesc())
+        {
+            pBudgetModel = pBudgetModelIn;
+            Desc = DescIn;
+            if (Desc.MaxLoadsPerBatch == 0)
+            {
+                Desc.MaxLoadsPerBatch = 1;
+            }
+            if (Desc.MaxLoadsPerTexture == 0)
+            {
+                Desc.MaxLoadsPerTexture = 1;
+            }
+        }
+
+        // The texture starts out with nothing resident. Its packed mips are queued right away.
+        void BeginTracking(StreamedTexture* pTexture)
+        {
+            pTexture->IsTracked = true;
+            Reprioritize(pTexture);
+        }
+
+        // Forgets the texture along with its loads still in flight, which must not be reported.
+        // Its memory is the app's to release.
+        void EndTracking(StreamedTexture* pTexture)
+        {
+            {
+                std::lock_guard<std::mutex> Lock(Mutex);
+                if (pTexture->UpdatePending)
+                {
+                    for (size_t i = 0; i < PendingUpdates.size(); i++)
+                    {
+                        if (PendingUpdates[i] == pTexture)
+                        {
+                            PendingUpdates[i] = PendingUpdates.back();
+                            PendingUpdates.pop_back();
+                            break;
+                        }
+                    }
+                    pTexture->UpdatePending = false;
+                }
+            }
+
+            RemoveFromQueues(pTexture);
+            StreamedBytes -= GetBytesHeld(pTexture);
+
+            pTexture->LoadedMask = 0;
+            pTexture->InFlightMask = 0;
+            UpdateMips(pTexture);
+            pTexture->IsTracked = false;
+        }
+
+        // VisibleMip is the mip the texture is drawn with, or MIP_STREAMING_UNDEFINED_MIP when it is
+        // off screen. PrefetchMip is the mip to have ready for where the camera may go next, or
+        // MIP_STREAMING_UNDEFINED_MIP when it is far away. ScreenArea is the pixels the texture
+        // covers, or would cover once in view, and weighs its error against other textures.
+        void UpdateVisibility(StreamedTexture* pTexture, UINT8 VisibleMip, UINT8 PrefetchMip, float ScreenArea)
+        {
+            {
+                std::lock_guard<std::mutex> Lock(Mutex);
+                pTexture->PendingVisibleMip = VisibleMip;
+                pTexture->PendingPrefetchMip = PrefetchMip;
+                pTexture->PendingScreenArea = ScreenArea;
+                if (pTexture->UpdatePending == false)
+                {
+                    pTexture->UpdatePending = true;
+                    PendingUpdates.push_back(pTexture);
+                }
+            }
+            WorkAvailable.notify_one();
+        }
+
+        // Ends a WaitForWork, e.g. when the budget changed or loads completed
+        void Wake()
+        {
+            {
+                std::lock_guard<std::mutex> Lock(Mutex);
+                WakeRequested = true;
+            }
+            WorkAvailable.notify_one();
+        }
+
+        void Shutdown()
+        {
+            {
+                std::lock_guard<std::mutex> Lock(Mutex);
+                ShutdownRequested = true;
+            }
+            WorkAvailable.notify_all();
+        }
+
+        // Blocks until there are visibility updates or Wake is called. Returns false once Shutdown
+        // has been called.
+        bool WaitForWork()
+        {
+            std::unique_lock<std::mutex> Lock(Mutex);
+            WorkAvailable.wait(Lock, [this] { return PendingUpdates.empty() == false || WakeRequested || ShutdownRequested; });
+            WakeRequested = false;
+            return ShutdownRequested == false;
+        }
+
+        // Applies the visibility updates, then picks the next loads in priority order until the
+        // batch is full or nothing else fits the budget. Loads that don't fit may trim less needed
+        // mips, as far as their TRIM_PASS allows.
+        void SelectBatch(StreamingBatch* pBatch)
+        {
+            pBatch->Evictions.clear();
+            pBatch->Loads.clear();
+            pBatch->LoadBytes = 0;
+            pBatch->MoreWork = false;
+
+            ApplyVisibilityUpdates();
+
+            CurrentBatchID++;
+            const UINT64 Budget = pBudgetModel->GetStreamingBudget(StreamedBytes);
+
+            // The budget may have dropped since the last batch
+            if (StreamedBytes > Budget)
+            {
+                TrimToTarget(TRIM_PASS::VISIBLE, Budget, pBatch);
+            }
+
+            bool Blocked[NumStreamingPriorities] = {};
+            while (pBatch->Loads.size() < Desc.MaxLoadsPerBatch)
+            {
+                StreamedTexture* pTexture = nullptr;
+                UINT32 Priority = 0;
+                for (; Priority < NumStreamingPriorities; Priority++)
+                {
+                    if (Blocked[Priority] == false && LoadQueues[Priority].IsEmpty() == false)
+                    {
+                        pTexture = LoadQueues[Priority].Top();
+                        break;
+                    }
+                }
+
+                if (pTexture == nullptr)
+                {
+                    break;
+                }
+
+                if (pTexture->BatchID != CurrentBatchID)
+                {
+                    pTexture->BatchID = CurrentBatchID;
+                    pTexture->BatchLoads = 0;
+                }
+
+                // Set the texture aside until the batch is done and look at the next one
+                if (pTexture->BatchLoads >= Desc.MaxLoadsPerTexture)
+                {
+                    LoadQueues[Priority].Remove(pTexture);
+                    DeferredTextures.push_back(pTexture);
+                    pBatch->MoreWork = true;
+                    continue;
+                }
+
+                const UINT8 Mip = GetNextMipToLoad(pTexture);
+                const UINT64 Size = pTexture->MipSizes[Mip];
+
+                if (pBatch->Loads.empty() == false && pBatch->LoadBytes + Size > Desc.MaxBytesPerBatch)
+                {
+                    pBatch->MoreWork = true;
+                    break;
+                }
+
+                //
+                // Packed mips are the minimum working set and are loaded regardless of the budget.
+                // Everything else has to fit under it, less a bias that grows as the priority drops,
+                // or trim less important mips to make room. When that fails, lower priorities may
+                // still have something that fits.
+                //
+                if (pTexture->IgnoreBudget == false)
+                {
+                    const UINT64 Bias = Desc.BudgetBias + Desc.BudgetBiasPerPriority * Priority;
+                    if (StreamedBytes + Size + Bias > Budget)
+                    {
+                        const UINT64 Target = Budget > Size + Bias ? Budget - (Size + Bias) : 0;
+
+                        RemoveTrimCandidate(pTexture);
+                        const bool Trimmed = TrimToTarget(pTexture->TrimLimit, Target, pBatch);
+                        UpdateTrimCandidate(pTexture);
+
+                        if (Trimmed == false)
+                        {
+                            Blocked[Priority] = true;
+                            continue;
+                        }
+                    }
+                }
+
+                const TRIM_PASS TrimLimit = pTexture->TrimLimit;
+
+                pTexture->InFlightMask |= 1u << Mip;
+                pTexture->BatchLoads++;
+                UpdateMips(pTexture);
+
+                StreamedBytes += Size;
+                pBatch->LoadBytes += Size;
+                pBatch->Loads.push_back({ pTexture, Mip });
+
+                Reprioritize(pTexture);
+
+                // A packed load may take us over the budget
+                if (StreamedBytes > Budget)
+                {
+                    TrimToTarget(TrimLimit, Budget, pBatch);
+                }
+            }
+
+            for (StreamedTexture* pTexture : DeferredTextures)
+            {
+                Reprioritize(pTexture);
+            }
+            DeferredTextures.clear();
+
+            if (pBatch->Loads.size() >= Desc.MaxLoadsPerBatch)
+            {
+                for (UINT32 i = 0; i < NumStreamingPriorities; i++)
+                {
+                    if (Blocked[i] == false && LoadQueues[i].IsEmpty() == false)
+                    {
+                        pBatch->MoreWork = true;
+                    }
+                }
+            }
+        }
+
+        // The mip may be sampled once the mips less detailed than it are resident too
+        void MipLoaded(StreamedTexture* pTexture, UINT8 Mip)
+        {
+            pTexture->InFlightMask &= ~(1u << Mip);
+            pTexture->LoadedMask |= 1u << Mip;
+            UpdateMips(pTexture);
+            Reprioritize(pTexture);
+        }
+
+        void MipLoadFailed(StreamedTexture* pTexture, UINT8 Mip)
+        {
+            pTexture->InFlightMask &= ~(1u << Mip);
+            StreamedBytes -= pTexture->MipSizes[Mip];
+            UpdateMips(pTexture);
+            Reprioritize(pTexture);
+        }
+
+        // The bytes of every mip resident or loading
+        UINT64 GetStreamedBytes() const
+        {
+            return StreamedBytes;
+        }
+
+    private:
+        void ApplyVisibilityUpdates()
+        {
+            {
+                std::lock_guard<std::mutex> Lock(Mutex);
+                UpdatesToApply.swap(PendingUpdates);
+                for (StreamedTexture* pTexture : UpdatesToApply)
+                {
+                    pTexture->VisibleMip = pTexture->PendingVisibleMip;
+                    pTexture->PrefetchMip = pTexture->PendingPrefetchMip;
+                    pTexture->ScreenArea = pTexture->PendingScreenArea;
+                    pTexture->UpdatePending = false;
+                }
+            }
+
+            for (StreamedTexture* pTexture : UpdatesToApply)
+            {
+                Reprioritize(pTexture);
+            }
+            UpdatesToApply.clear();
+        }
+
+        //
+        // Puts the texture in the load queue for the most important mip it is missing, the same
+        // way the demo's PagingWorkerThread::PrioritizeResource does, and refreshes which of its
+        // mips it would give up first.
+        //
+        void Reprioritize(StreamedTexture* pTexture)
+        {
+            if (pTexture->LoadHeapIndex != Internal::TextureHeap<Internal::LoadOrder>::InvalidIndex)
+            {
+                LoadQueues[UINT32(pTexture->Priority)].Remove(pTexture);
+            }
+
+            const UINT8 Requested = pTexture->RequestedMip;
+            const bool AnyPackedMipsMissing = Requested > pTexture->PackedMip;
+            const bool IsInPrefetchZone = pTexture->PrefetchMip != MIP_STREAMING_UNDEFINED_MIP;
+
+            STREAMING_PRIORITY Priority = STREAMING_PRIORITY::NONE;
+            TRIM_PASS TrimLimit = TRIM_PASS::NONE;
+            UINT8 TargetMip = 0;
+            bool IgnoreBudget = false;
+            bool Urgent = false;
+
+            if (AnyPackedMipsMissing && IsInPrefetchZone)
+            {
+                // Give the user *something* to see, even if it's just a rough color
+                Priority = STREAMING_PRIORITY::VERY_HIGH;
+                TrimLimit = TRIM_PASS::VISIBLE;
+                TargetMip = pTexture->PackedMip;
+                IgnoreBudget = true;
+            }
+            else if (pTexture->VisibleMip < Requested)
+            {
+                // What's on screen should be visually correct
+                Priority = STREAMING_PRIORITY::HIGH;
+                TrimLimit = TRIM_PASS::NON_VISIBLE;
+                TargetMip = pTexture->VisibleMip;
+            }
+            else if (AnyPackedMipsMissing)
+            {
+                // Ahead of the prefetches of its priority, but after what is on screen
+                Priority = STREAMING_PRIORITY::MEDIUM;
+                TrimLimit = TRIM_PASS::VISIBLE;
+                TargetMip = pTexture->PackedMip;
+                IgnoreBudget = true;
+                Urgent = true;
+            }
+            else if (pTexture->PrefetchMip < Requested)
+            {
+                // Reduces the popping that comes with fast camera movement
+                Priority = STREAMING_PRIORITY::MEDIUM;
+                TrimLimit = TRIM_PASS::NON_PREFETCHABLE;
+                TargetMip = pTexture->PrefetchMip;
+            }
+            else if (Requested > 0)
+            {
+                // Loaded while the budget has room so that the texture is ready before it is needed
+                Priority = STREAMING_PRIORITY::LOW;
+                TrimLimit = TRIM_PASS::NONE;
+                TargetMip = 0;
+            }
+
+            pTexture->Priority = Priority;
+            pTexture->TrimLimit = TrimLimit;
+            pTexture->IgnoreBudget = IgnoreBudget;
+            pTexture->Urgent = Urgent;
+
+            if (Priority != STREAMING_PRIORITY::NONE && pTexture->IsTracked)
+            {
+                // Nothing draws a LOW texture at the detail it is missing, so those go in arrival order
+                const UINT8 Current = AnyPackedMipsMissing ? UINT8(pTexture->PackedMip + 1) : Requested;
+                pTexture->LoadKey = 0.0;
+                if (Desc.Order == QUEUE_ORDER::SCREEN_SPACE_ERROR && Priority != STREAMING_PRIORITY::LOW)
+                {
+                    pTexture->LoadKey = Internal::ScreenSpaceError(pTexture->ScreenArea, Current, TargetMip);
+                }
+                pTexture->LoadSequence = NextLoadSequence++;
+                LoadQueues[UINT32(Priority)].Insert(pTexture);
+            }
+
+            UpdateTrimCandidate(pTexture);
+        }
+
+        // Textures loading a mip keep all of theirs until the load is done
+        void UpdateTrimCandidate(StreamedTexture* pTexture)
+        {
+            RemoveTrimCandidate(pTexture);
+
+            const UINT32 Trimmable = pTexture->LoadedMask & ((1u << pTexture->PackedMip) - 1);
+            if (pTexture->IsTracked == false || pTexture->InFlightMask != 0 || Trimmable == 0)
+            {
+                return;
+            }
+
+            UINT8 Mip = 0;
+            while ((Trimmable & (1u << Mip)) == 0)
+            {
+                Mip++;
+            }
+
+            pTexture->TrimMip = Mip;
+            if (Mip < pTexture->PrefetchMip)
+            {
+                pTexture->TrimClass = TRIM_PASS::NON_PREFETCHABLE;
+            }
+            else if (Mip < pTexture->VisibleMip)
+            {
+                pTexture->TrimClass = TRIM_PASS::NON_VISIBLE;
+            }
+            else
+            {
+                pTexture->TrimClass = TRIM_PASS::VISIBLE;
+            }
+
+            // Without errors to go by, the most detailed (largest) mips go first as in the demo
+            pTexture->TrimKey = 0.0;
+            if (Desc.Order == QUEUE_ORDER::SCREEN_SPACE_ERROR && pTexture->VisibleMip != MIP_STREAMING_UNDEFINED_MIP)
+            {
+                pTexture->TrimKey = Internal::ScreenSpaceError(pTexture->ScreenArea, Mip + 1, pTexture->VisibleMip);
+            }
+
+            TrimCandidates.Insert(pTexture);
+        }
+
+        void RemoveTrimCandidate(StreamedTexture* pTexture)
+        {
+            if (pTexture->TrimHeapIndex != Internal::TextureHeap<Internal::TrimOrder>::InvalidIndex)
+            {
+                TrimCandidates.Remove(pTexture);
+            }
+        }
+
+        void RemoveFromQueues(StreamedTexture* pTexture)
+        {
+            if (pTexture->LoadHeapIndex != Internal::TextureHeap<Internal::LoadOrder>::InvalidIndex)
+            {
+                LoadQueues[UINT32(pTexture->Priority)].Remove(pTexture);
+            }
+            RemoveTrimCandidate(pTexture);
+            pTexture->Priority = STREAMING_PRIORITY::NONE;
+        }
+
+        // Evicts the least needed mips until usage is at TargetBytes. MaxPass keeps a load from
+        // trimming mips more important than itself. Returns false if that wasn't enough.
+        bool TrimToTarget(TRIM_PASS MaxPass, UINT64 TargetBytes, StreamingBatch* pBatch)
+        {
+            while (StreamedBytes > TargetBytes)
+            {
+                if (MaxPass == TRIM_PASS::NONE || TrimCandidates.IsEmpty())
+                {
+                    return false;
+                }
+
+                StreamedTexture* pTexture = TrimCandidates.Top();
+                if (pTexture->TrimClass > MaxPass)
+                {
+                    return false;
+                }
+
+                const UINT8 Mip = pTexture->TrimMip;
+                pTexture->LoadedMask &= ~(1u << Mip);
+                StreamedBytes -= pTexture->MipSizes[Mip];
+                UpdateMips(pTexture);
+
+                pBatch->Evictions.push_back({ pTexture, Mip });
+
+                // Evicting a mip means there is some paging work to do for it again, if only a prefetch
+                Reprioritize(pTexture);
+            }
+            return true;
+        }
+
+        UINT8 GetNextMipToLoad(const StreamedTexture* pTexture) const
+        {
+            return pTexture->RequestedMip > pTexture->PackedMip ? pTexture->PackedMip : UINT8(pTexture->RequestedMip - 1);
+        }
+
+        // Walks up from the packed mips while each more detailed mip is there
+        static UINT8 GetMostDetailedContiguousMip(UINT32 Mask, UINT8 PackedMip)
+        {
+            UINT8 Mip = UINT8(PackedMip + 1);
+            while (Mip > 0 && (Mask & (1u << (Mip - 1))))
+            {
+                Mip--;
+            }
+            return Mip;
+        }
+
+        static void UpdateMips(StreamedTexture* pTexture)
+        {
+            pTexture->RequestedMip = GetMostDetailedContiguousMip(pTexture->LoadedMask | pTexture->InFlightMask, pTexture->PackedMip);
+            pTexture->ResidentMip.store(GetMostDetailedContiguousMip(pTexture->LoadedMask, pTexture->PackedMip), std::memory_order_release);
+        }
+
+        static UINT64 GetBytesHeld(const StreamedTexture* pTexture)
+        {
+            const UINT32 Held = pTexture->LoadedMask | pTexture->InFlightMask;
+
+            UINT64 Bytes = 0;
+            for (UINT32 i = 0; i <= pTexture->PackedMip; i++)
+            {
+                if (Held & (1u << i))
+                {
+                    Bytes += pTexture->MipSizes[i];
+                }
+            }
+            return Bytes;
+        }
+
+        BudgetModel* pBudgetModel;
+        SchedulerDesc Desc;
+
+        Internal::TextureHeap<Internal::LoadOrder> LoadQueues[NumStreamingPriorities];
+        Internal::TextureHeap<Internal::TrimOrder> TrimCandidates;
+        std::vector<StreamedTexture*> DeferredTextures;
+
+        UINT64 StreamedBytes;
+        UINT64 NextLoadSequence;
+        UINT64 CurrentBatchID;
+
+        // Guards the visibility updates and wake flags shared with other threads
+        std::mutex Mutex;
+        std::condition_variable WorkAvailable;
+        std::vector<StreamedTexture*> PendingUpdates;
+        std::vector<StreamedTexture*> UpdatesToApply;
+        bool WakeRequested;
+        bool ShutdownRequested;
+    };
+}
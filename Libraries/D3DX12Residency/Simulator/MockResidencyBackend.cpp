@@ -0,0 +1,483 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+#include "MockResidencyBackend.h"
+
+#include <algorithm>
+
+namespace ResidencySimulator
+{
+    struct MockPageable
+    {
+        UINT64 Size;
+        bool Resident;
+        bool Destroyed;
+    };
+
+    struct MockFence
+    {
+        UINT64 Value;
+    };
+
+    struct MockCommandList
+    {
+        std::vector<MockPageable*> References;
+    };
+
+    struct QueueOperation
+    {
+        enum Type
+        {
+            Wait,
+            Signal,
+            Execute
+        };
+
+        Type OperationType;
+        UINT64 Frame;
+        MockFence* pFence;
+        UINT64 Value;
+        std::vector<MockPageable*> References;
+    };
+
+    struct MockQueue
+    {
+        std::deque<QueueOperation> Operations;
+        std::map<std::string, std::vector<BYTE>> PrivateData;
+    };
+
+    namespace
+    {
+        template <typename To, typename From>
+        To* Mock(From* pObject)
+        {
+            return reinterpret_cast<To*>(pObject);
+        }
+
+        std::string GuidKey(const GUID& Guid)
+        {
+            return std::string(reinterpret_cast<const char*>(&Guid), sizeof(GUID));
+        }
+    }
+
+    MockResidencyBackend::MockResidencyBackend(UINT32 GpuLatencyFramesIn, UINT64 TicksPerFrameIn) :
+        GpuLatencyFrames(GpuLatencyFramesIn),
+        TicksPerFrame(TicksPerFrameIn),
+        CurrentFrame(0),
+        CurrentTime(0),
+        LocalBudget(0),
+        NonLocalBudget(0),
+        Usage(0)
+    {
+        ZeroMemory(&Counters, sizeof(Counters));
+    }
+
+    MockResidencyBackend::~MockResidencyBackend()
+    {
+        for (MockPageable* pPageable : Pageables)
+        {
+            delete pPageable;
+        }
+        for (MockFence* pFence : Fences)
+        {
+            delete pFence;
+        }
+        for (MockQueue* pQueue : Queues)
+        {
+            delete pQueue;
+        }
+    }
+
+    ID3D12Pageable* MockResidencyBackend::CreatePageable(UINT64 Size)
+    {
+        std::lock_guard<std::mutex> Lock(Mutex);
+
+        MockPageable* pPageable = new MockPageable();
+        pPageable->Size = Size;
+        pPageable->Resident = false;
+        pPageable->Destroyed = false;
+        Pageables.push_back(pPageable);
+
+        return Mock<ID3D12Pageable>(pPageable);
+    }
+
+    void MockResidencyBackend::DestroyPageable(ID3D12Pageable* pObject)
+    {
+        std::lock_guard<std::mutex> Lock(Mutex);
+
+        MockPageable* pPageable = Mock<MockPageable>(pObject);
+        if (pPageable->Resident)
+        {
+            Usage -= pPageable->Size;
+            pPageable->Resident = false;
+        }
+        pPageable->Destroyed = true;
+    }
+
+    bool MockResidencyBackend::IsResident(ID3D12Pageable* pObject)
+    {
+        std::lock_guard<std::mutex> Lock(Mutex);
+        return Mock<MockPageable>(pObject)->Resident;
+    }
+
+    ID3D12CommandQueue* MockResidencyBackend::CreateQueue()
+    {
+        std::lock_guard<std::mutex> Lock(Mutex);
+
+        MockQueue* pQueue = new MockQueue();
+        Queues.push_back(pQueue);
+        return Mock<ID3D12CommandQueue>(pQueue);
+    }
+
+    ID3D12CommandList* MockResidencyBackend::CreateCommandList(const std::vector<ID3D12Pageable*>& References)
+    {
+        MockCommandList* pCommandList = new MockCommandList();
+        pCommandList->References.reserve(References.size());
+        for (ID3D12Pageable* pObject : References)
+        {
+            pCommandList->References.push_back(Mock<MockPageable>(pObject));
+        }
+        return Mock<ID3D12CommandList>(pCommandList);
+    }
+
+    void MockResidencyBackend::DestroyCommandList(ID3D12CommandList* pCommandList)
+    {
+        delete Mock<MockCommandList>(pCommandList);
+    }
+
+    void MockResidencyBackend::SetBudget(UINT64 LocalBudgetIn, UINT64 NonLocalBudgetIn)
+    {
+        std::lock_guard<std::mutex> Lock(Mutex);
+        LocalBudget = LocalBudgetIn;
+        NonLocalBudget = NonLocalBudgetIn;
+    }
+
+    void MockResidencyBackend::BeginFrame()
+    {
+        std::unique_lock<std::mutex> Lock(Mutex);
+
+        CurrentFrame++;
+        CurrentTime += TicksPerFrame;
+
+        if (CurrentFrame >= GpuLatencyFrames && RunQueues(CurrentFrame - GpuLatencyFrames))
+        {
+            FenceSignaled.notify_all();
+        }
+    }
+
+    void MockResidencyBackend::WaitForPagingWork(ID3D12CommandQueue* pCommandQueue)
+    {
+        MockQueue* pQueue = Mock<MockQueue>(pCommandQueue);
+
+        std::unique_lock<std::mutex> Lock(Mutex);
+        FenceSignaled.wait(Lock, [pQueue]
+        {
+            for (const QueueOperation& Operation : pQueue->Operations)
+            {
+                if (Operation.OperationType == QueueOperation::Wait && Operation.pFence->Value < Operation.Value)
+                {
+                    return false;
+                }
+            }
+            return true;
+        });
+    }
+
+    void MockResidencyBackend::Flush()
+    {
+        std::lock_guard<std::mutex> Lock(Mutex);
+        if (RunQueues(MAXUINT64))
+        {
+            FenceSignaled.notify_all();
+        }
+    }
+
+    MockCounters MockResidencyBackend::GetCounters()
+    {
+        std::lock_guard<std::mutex> Lock(Mutex);
+        return Counters;
+    }
+
+    UINT64 MockResidencyBackend::GetUsage()
+    {
+        std::lock_guard<std::mutex> Lock(Mutex);
+        return Usage;
+    }
+
+    HRESULT MockResidencyBackend::CreateFence(UINT64 InitialValue, ID3D12Fence** ppFence)
+    {
+        std::lock_guard<std::mutex> Lock(Mutex);
+
+        MockFence* pFence = new MockFence();
+        pFence->Value = InitialValue;
+        Fences.push_back(pFence);
+
+        *ppFence = Mock<ID3D12Fence>(pFence);
+        return S_OK;
+    }
+
+    void MockResidencyBackend::DestroyFence(ID3D12Fence*)
+    {
+        // Queued operations may still point at the fence, it is freed with the backend
+    }
+
+    UINT64 MockResidencyBackend::GetCompletedFenceValue(ID3D12Fence* pFence)
+    {
+        std::lock_guard<std::mutex> Lock(Mutex);
+        return Mock<MockFence>(pFence)->Value;
+    }
+
+    HRESULT MockResidencyBackend::SignalFence(ID3D12Fence* pFence, UINT64 Value)
+    {
+        {
+            std::lock_guard<std::mutex> Lock(Mutex);
+            Mock<MockFence>(pFence)->Value = Value;
+        }
+        FenceSignaled.notify_all();
+        return S_OK;
+    }
+
+    HRESULT MockResidencyBackend::WaitForFence(ID3D12Fence* pFence, UINT64 Value)
+    {
+        MockFence* pMockFence = Mock<MockFence>(pFence);
+
+        std::unique_lock<std::mutex> Lock(Mutex);
+        if (pMockFence->Value >= Value)
+        {
+            return S_OK;
+        }
+
+        Counters.Stalls++;
+
+        // The GPU catches up on everything it was given while the CPU waits. What it can't
+        // reach yet sits behind a wait another thread will signal.
+        while (pMockFence->Value < Value)
+        {
+            if (RunQueues(MAXUINT64))
+            {
+                FenceSignaled.notify_all();
+            }
+            else
+            {
+                FenceSignaled.wait(Lock);
+            }
+        }
+        return S_OK;
+    }
+
+    HRESULT MockResidencyBackend::QueueSignal(ID3D12CommandQueue* pQueue, ID3D12Fence* pFence, UINT64 Value)
+    {
+        std::lock_guard<std::mutex> Lock(Mutex);
+
+        QueueOperation Operation;
+        Operation.OperationType = QueueOperation::Signal;
+        Operation.Frame = CurrentFrame;
+        Operation.pFence = Mock<MockFence>(pFence);
+        Operation.Value = Value;
+        Mock<MockQueue>(pQueue)->Operations.push_back(std::move(Operation));
+        return S_OK;
+    }
+
+    HRESULT MockResidencyBackend::QueueWait(ID3D12CommandQueue* pQueue, ID3D12Fence* pFence, UINT64 Value)
+    {
+        std::lock_guard<std::mutex> Lock(Mutex);
+
+        QueueOperation Operation;
+        Operation.OperationType = QueueOperation::Wait;
+        Operation.Frame = CurrentFrame;
+        Operation.pFence = Mock<MockFence>(pFence);
+        Operation.Value = Value;
+        Mock<MockQueue>(pQueue)->Operations.push_back(std::move(Operation));
+        return S_OK;
+    }
+
+    void MockResidencyBackend::ExecuteCommandLists(ID3D12CommandQueue* pQueue, UINT32 Count, ID3D12CommandList** ppCommandLists)
+    {
+        std::lock_guard<std::mutex> Lock(Mutex);
+
+        for (UINT32 i = 0; i < Count; i++)
+        {
+            QueueOperation Operation;
+            Operation.OperationType = QueueOperation::Execute;
+            Operation.Frame = CurrentFrame;
+            Operation.pFence = nullptr;
+            Operation.Value = 0;
+            Operation.References = Mock<MockCommandList>(ppCommandLists[i])->References;
+            Mock<MockQueue>(pQueue)->Operations.push_back(std::move(Operation));
+        }
+    }
+
+    HRESULT MockResidencyBackend::GetQueuePrivateData(ID3D12CommandQueue* pQueue, const GUID& Guid, UINT32* pSize, void* pData)
+    {
+        std::lock_guard<std::mutex> Lock(Mutex);
+
+        MockQueue* pMockQueue = Mock<MockQueue>(pQueue);
+        auto Entry = pMockQueue->PrivateData.find(GuidKey(Guid));
+        if (Entry == pMockQueue->PrivateData.end())
+        {
+            *pSize = 0;
+            return E_INVALIDARG;
+        }
+
+        if (pData != nullptr)
+        {
+            if (*pSize < Entry->second.size())
+            {
+                return E_INVALIDARG;
+            }
+            memcpy(pData, Entry->second.data(), Entry->second.size());
+        }
+        *pSize = UINT32(Entry->second.size());
+        return S_OK;
+    }
+
+    HRESULT MockResidencyBackend::SetQueuePrivateData(ID3D12CommandQueue* pQueue, const GUID& Guid, UINT32 Size, const void* pData)
+    {
+        std::lock_guard<std::mutex> Lock(Mutex);
+
+        const BYTE* pBytes = static_cast<const BYTE*>(pData);
+        Mock<MockQueue>(pQueue)->PrivateData[GuidKey(Guid)].assign(pBytes, pBytes + Size);
+        return S_OK;
+    }
+
+    HRESULT MockResidencyBackend::MakeResident(UINT32 NumObjects, ID3D12Pageable* const* ppObjects)
+    {
+        std::lock_guard<std::mutex> Lock(Mutex);
+
+        Counters.MakeResidentCalls++;
+        for (UINT32 i = 0; i < NumObjects; i++)
+        {
+            MockPageable* pPageable = Mock<MockPageable>(ppObjects[i]);
+            if (pPageable->Resident == false && pPageable->Destroyed == false)
+            {
+                pPageable->Resident = true;
+                Usage += pPageable->Size;
+                Counters.BytesMadeResident += pPageable->Size;
+                Counters.ObjectsMadeResident++;
+            }
+        }
+        return S_OK;
+    }
+
+    HRESULT MockResidencyBackend::Evict(UINT32 NumObjects, ID3D12Pageable* const* ppObjects)
+    {
+        std::lock_guard<std::mutex> Lock(Mutex);
+
+        Counters.EvictCalls++;
+        for (UINT32 i = 0; i < NumObjects; i++)
+        {
+            MockPageable* pPageable = Mock<MockPageable>(ppObjects[i]);
+            if (pPageable->Resident)
+            {
+                pPageable->Resident = false;
+                Usage -= pPageable->Size;
+                Counters.BytesEvicted += pPageable->Size;
+                Counters.ObjectsEvicted++;
+            }
+        }
+        return S_OK;
+    }
+
+    HRESULT MockResidencyBackend::QueryVideoMemoryInfo(DXGI_MEMORY_SEGMENT_GROUP Segment, DXGI_QUERY_VIDEO_MEMORY_INFO* pInfo)
+    {
+        std::lock_guard<std::mutex> Lock(Mutex);
+
+        // Everything the mock makes resident lands in local memory
+        ZeroMemory(pInfo, sizeof(*pInfo));
+        if (Segment == DXGI_MEMORY_SEGMENT_GROUP_LOCAL)
+        {
+            pInfo->Budget = LocalBudget;
+            pInfo->CurrentUsage = Usage;
+        }
+        else
+        {
+            pInfo->Budget = NonLocalBudget;
+        }
+        return S_OK;
+    }
+
+    UINT64 MockResidencyBackend::GetTimestamp()
+    {
+        std::lock_guard<std::mutex> Lock(Mutex);
+        return CurrentTime;
+    }
+
+    UINT64 MockResidencyBackend::GetTimestampFrequency()
+    {
+        return 1000000;
+    }
+
+    bool MockResidencyBackend::RunQueues(UINT64 LastFrame)
+    {
+        bool Progress = false;
+
+        // A queue may wait on a fence another queue signals, so keep going round until no
+        // queue can move
+        bool QueueMoved = true;
+        while (QueueMoved)
+        {
+            QueueMoved = false;
+            for (MockQueue* pQueue : Queues)
+            {
+                while (pQueue->Operations.empty() == false)
+                {
+                    QueueOperation& Operation = pQueue->Operations.front();
+                    if (Operation.Frame > LastFrame)
+                    {
+                        break;
+                    }
+
+                    if (Operation.OperationType == QueueOperation::Wait)
+                    {
+                        if (Operation.pFence->Value < Operation.Value)
+                        {
+                            break;
+                        }
+                    }
+                    else if (Operation.OperationType == QueueOperation::Signal)
+                    {
+                        Operation.pFence->Value = std::max(Operation.pFence->Value, Operation.Value);
+                    }
+                    else
+                    {
+                        Counters.CommandListsExecuted++;
+                        UpdatePeakUsage();
+                        for (MockPageable* pPageable : Operation.References)
+                        {
+                            if (pPageable->Resident == false)
+                            {
+                                Counters.ResidencyViolations++;
+                                break;
+                            }
+                        }
+                    }
+
+                    pQueue->Operations.pop_front();
+                    QueueMoved = true;
+                    Progress = true;
+                }
+            }
+        }
+
+        return Progress;
+    }
+
+    void MockResidencyBackend::UpdatePeakUsage()
+    {
+        Counters.PeakUsage = std::max(Counters.PeakUsage, Usage);
+
+        const UINT64 Budget = LocalBudget + NonLocalBudget;
+        if (Usage > Budget)
+        {
+            Counters.PeakOverBudget = std::max(Counters.PeakOverBudget, Usage - Budget);
+        }
+    }
+}
@@ -0,0 +1,130 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+// A ResidencyBackend with no GPU behind it. Heaps are sizes and a resident flag, queues are
+// lists of pending waits, signals and command lists, and time only moves when the caller
+// begins a frame. The GPU finishes a frame's work GpuLatencyFrames frames after it was
+// submitted, or sooner when the CPU blocks on one of its fences, so the same trace always
+// produces the same paging decisions.
+
+#pragma once
+
+#include "SimulatorPlatform.h"
+#include "../d3dx12Residency.h"
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace ResidencySimulator
+{
+    struct MockPageable;
+    struct MockFence;
+    struct MockQueue;
+
+    struct MockCounters
+    {
+        UINT64 BytesMadeResident;
+        UINT64 BytesEvicted;
+        UINT64 MakeResidentCalls;
+        UINT64 EvictCalls;
+        UINT64 ObjectsMadeResident;
+        UINT64 ObjectsEvicted;
+        // CPU waits on a fence the GPU had not reached yet
+        UINT64 Stalls;
+        // Command lists executed while a heap they reference was evicted
+        UINT64 ResidencyViolations;
+        UINT64 CommandListsExecuted;
+        // Most memory resident while the GPU ran a command list, after the manager paged for it
+        UINT64 PeakUsage;
+        UINT64 PeakOverBudget;
+    };
+
+    class MockResidencyBackend : public D3DX12Residency::ResidencyBackend
+    {
+    public:
+        MockResidencyBackend(UINT32 GpuLatencyFrames, UINT64 TicksPerFrame);
+        virtual ~MockResidencyBackend();
+
+        // New heaps are not resident, as if created with D3D12_HEAP_FLAG_CREATE_NOT_RESIDENT.
+        // Mark their ManagedObject evicted before tracking it so the first use pages them in.
+        ID3D12Pageable* CreatePageable(UINT64 Size);
+        // The heap's memory is released at once but the object lives until the GPU is idle
+        void DestroyPageable(ID3D12Pageable* pPageable);
+        bool IsResident(ID3D12Pageable* pPageable);
+
+        ID3D12CommandQueue* CreateQueue();
+
+        // The list remembers the heaps it references, it may be deleted once it was executed
+        static ID3D12CommandList* CreateCommandList(const std::vector<ID3D12Pageable*>& References);
+        static void DestroyCommandList(ID3D12CommandList* pCommandList);
+
+        void SetBudget(UINT64 LocalBudget, UINT64 NonLocalBudget);
+
+        // Advances the clock by a frame and lets the GPU finish the frames that are old enough
+        void BeginFrame();
+
+        // Blocks until every GPU wait queued on pQueue so far has been released by the
+        // residency manager's worker thread, so paging never overlaps the next submission
+        void WaitForPagingWork(ID3D12CommandQueue* pQueue);
+
+        // Lets the GPU run everything that has been submitted
+        void Flush();
+
+        MockCounters GetCounters();
+        UINT64 GetUsage();
+
+        virtual HRESULT CreateFence(UINT64 InitialValue, ID3D12Fence** ppFence) override;
+        virtual void DestroyFence(ID3D12Fence* pFence) override;
+        virtual UINT64 GetCompletedFenceValue(ID3D12Fence* pFence) override;
+        virtual HRESULT SignalFence(ID3D12Fence* pFence, UINT64 Value) override;
+        virtual HRESULT WaitForFence(ID3D12Fence* pFence, UINT64 Value) override;
+
+        virtual HRESULT QueueSignal(ID3D12CommandQueue* pQueue, ID3D12Fence* pFence, UINT64 Value) override;
+        virtual HRESULT QueueWait(ID3D12CommandQueue* pQueue, ID3D12Fence* pFence, UINT64 Value) override;
+        virtual void ExecuteCommandLists(ID3D12CommandQueue* pQueue, UINT32 Count, ID3D12CommandList** ppCommandLists) override;
+        virtual HRESULT GetQueuePrivateData(ID3D12CommandQueue* pQueue, const GUID& Guid, UINT32* pSize, void* pData) override;
+        virtual HRESULT SetQueuePrivateData(ID3D12CommandQueue* pQueue, const GUID& Guid, UINT32 Size, const void* pData) override;
+
+        virtual HRESULT MakeResident(UINT32 NumObjects, ID3D12Pageable* const* ppObjects) override;
+        virtual HRESULT Evict(UINT32 NumObjects, ID3D12Pageable* const* ppObjects) override;
+        virtual HRESULT QueryVideoMemoryInfo(DXGI_MEMORY_SEGMENT_GROUP Segment, DXGI_QUERY_VIDEO_MEMORY_INFO* pInfo) override;
+
+        virtual UINT64 GetTimestamp() override;
+        virtual UINT64 GetTimestampFrequency() override;
+
+    private:
+        // Runs queued work submitted no later than LastFrame, returns true if anything ran
+        bool RunQueues(UINT64 LastFrame);
+        void UpdatePeakUsage();
+
+        std::mutex Mutex;
+        std::condition_variable FenceSignaled;
+
+        const UINT32 GpuLatencyFrames;
+        const UINT64 TicksPerFrame;
+        UINT64 CurrentFrame;
+        UINT64 CurrentTime;
+
+        UINT64 LocalBudget;
+        UINT64 NonLocalBudget;
+        UINT64 Usage;
+
+        MockCounters Counters;
+
+        std::vector<MockPageable*> Pageables;
+        std::vector<MockFence*> Fences;
+        std::vector<MockQueue*> Queues;
+    };
+}
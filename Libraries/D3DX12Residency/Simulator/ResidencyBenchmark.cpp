@@ -0,0 +1,475 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+// Replays residency traces through a ResidencyManager running on the mock backend and
+// reports how much paging the manager did and how long ExecuteCommandLists took.
+
+#include "MockResidencyBackend.h"
+#include "ResidencyTrace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace ResidencySimulator;
+
+namespace
+{
+    struct BenchmarkOptions
+    {
+        UINT32 GpuLatencyFrames;
+        UINT32 MaxLatency;
+        UINT64 TicksPerFrame;
+        D3DX12Residency::EVICTION_POLICY Policy;
+    };
+
+    struct TimingSummary
+    {
+        double Mean;
+        double P50;
+        double P99;
+        double Max;
+    };
+
+    struct BenchmarkResult
+    {
+        MockCounters Counters;
+        D3DX12Residency::ResidencyStatistics Statistics;
+        UINT64 Budget;
+        UINT32 Frames;
+        UINT32 Executes;
+        TimingSummary Submit;
+        TimingSummary SubmitAndPaging;
+    };
+
+    TimingSummary Summarize(std::vector<double>& Samples)
+    {
+        TimingSummary Summary = {};
+        if (Samples.empty())
+        {
+            return Summary;
+        }
+
+        std::sort(Samples.begin(), Samples.end());
+
+        double Total = 0.0;
+        for (double Sample : Samples)
+        {
+            Total += Sample;
+        }
+
+        Summary.Mean = Total / Samples.size();
+        Summary.P50 = Samples[Samples.size() / 2];
+        Summary.P99 = Samples[std::min(Samples.size() - 1, Samples.size() * 99 / 100)];
+        Summary.Max = Samples.back();
+        return Summary;
+    }
+
+    double MicrosecondsSince(std::chrono::steady_clock::time_point Start)
+    {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - Start).count();
+    }
+
+    bool Replay(const Trace& Input, const BenchmarkOptions& Options, BenchmarkResult& Result, std::string& Error)
+    {
+        MockResidencyBackend Backend(Options.GpuLatencyFrames, Options.TicksPerFrame);
+
+        D3DX12Residency::ResidencyManager Manager;
+        if (FAILED(Manager.Initialize(&Backend, Options.MaxLatency, Options.Policy)))
+        {
+            Error = "the residency manager failed to initialize";
+            return false;
+        }
+
+        ID3D12CommandQueue* pQueue = Backend.CreateQueue();
+
+        std::vector<std::unique_ptr<D3DX12Residency::ManagedObject>> Objects;
+        std::vector<D3DX12Residency::ResidencySet*> Sets;
+        std::vector<ID3D12CommandList*> CommandLists;
+        std::vector<ID3D12Pageable*> References;
+
+        std::vector<double> SubmitTimes;
+        std::vector<double> SubmitAndPagingTimes;
+
+        Result.Budget = 0;
+        Result.Frames = 0;
+        Result.Executes = 0;
+
+        bool Succeeded = true;
+        for (const TraceEvent& Event : Input.Events)
+        {
+            if (Event.EventType == TraceEvent::SetBudget)
+            {
+                Backend.SetBudget(Event.Size, Event.NonLocalBudget);
+                Result.Budget = Event.Size + Event.NonLocalBudget;
+            }
+            else if (Event.EventType == TraceEvent::CreateHeap)
+            {
+                if (Event.Id >= Objects.size())
+                {
+                    Objects.resize(Event.Id + 1);
+                }
+                if (Objects[Event.Id] != nullptr)
+                {
+                    Error = "heap " + std::to_string(Event.Id) + " was created twice";
+                    Succeeded = false;
+                    break;
+                }
+
+                Objects[Event.Id].reset(new D3DX12Residency::ManagedObject());
+                Objects[Event.Id]->Initialize(Backend.CreatePageable(Event.Size), Event.Size);
+                Objects[Event.Id]->ResidencyStatus = D3DX12Residency::ManagedObject::RESIDENCY_STATUS::EVICTED;
+                Manager.BeginTrackingObject(Objects[Event.Id].get());
+            }
+            else if (Event.EventType == TraceEvent::DestroyHeap)
+            {
+                if (Event.Id >= Objects.size() || Objects[Event.Id] == nullptr)
+                {
+                    Error = "heap " + std::to_string(Event.Id) + " was freed but never created";
+                    Succeeded = false;
+                    break;
+                }
+
+                Manager.EndTrackingObject(Objects[Event.Id].get());
+                Backend.DestroyPageable(Objects[Event.Id]->pUnderlying);
+                Objects[Event.Id].reset();
+            }
+            else if (Event.EventType == TraceEvent::BeginFrame)
+            {
+                Backend.BeginFrame();
+                Result.Frames++;
+            }
+            else
+            {
+                const UINT32 Count = UINT32(Event.CommandLists.size());
+                while (Sets.size() < Count)
+                {
+                    Sets.push_back(Manager.CreateResidencySet());
+                }
+
+                CommandLists.clear();
+                for (UINT32 i = 0; i < Count && Succeeded; i++)
+                {
+                    References.clear();
+                    Sets[i]->Open();
+                    for (uint32_t Id : Event.CommandLists[i])
+                    {
+                        if (Id >= Objects.size() || Objects[Id] == nullptr)
+                        {
+                            Error = "heap " + std::to_string(Id) + " was used but does not exist";
+                            Succeeded = false;
+                            break;
+                        }
+                        Sets[i]->Insert(Objects[Id].get());
+                        References.push_back(Objects[Id]->pUnderlying);
+                    }
+                    Sets[i]->Close();
+                    CommandLists.push_back(MockResidencyBackend::CreateCommandList(References));
+                }
+
+                if (Succeeded)
+                {
+                    const auto Start = std::chrono::steady_clock::now();
+                    const HRESULT hr = Manager.ExecuteCommandLists(pQueue, CommandLists.data(), Sets.data(), Count);
+                    SubmitTimes.push_back(MicrosecondsSince(Start));
+
+                    Backend.WaitForPagingWork(pQueue);
+                    SubmitAndPagingTimes.push_back(MicrosecondsSince(Start));
+
+                    if (FAILED(hr))
+                    {
+                        Error = "ExecuteCommandLists failed";
+                        Succeeded = false;
+                    }
+                    Result.Executes++;
+                }
+
+                for (ID3D12CommandList* pCommandList : CommandLists)
+                {
+                    MockResidencyBackend::DestroyCommandList(pCommandList);
+                }
+            }
+        }
+
+        Backend.Flush();
+        Manager.GetStatistics(&Result.Statistics);
+
+        for (D3DX12Residency::ResidencySet* pSet : Sets)
+        {
+            Manager.DestroyResidencySet(pSet);
+        }
+        for (std::unique_ptr<D3DX12Residency::ManagedObject>& pObject : Objects)
+        {
+            if (pObject != nullptr)
+            {
+                Manager.EndTrackingObject(pObject.get());
+            }
+        }
+        Manager.Destroy();
+
+        Result.Counters = Backend.GetCounters();
+        Result.Submit = Summarize(SubmitTimes);
+        Result.SubmitAndPaging = Summarize(SubmitAndPagingTimes);
+        return Succeeded;
+    }
+
+    const char* PolicyName(D3DX12Residency::EVICTION_POLICY Policy)
+    {
+        switch (Policy)
+        {
+        case D3DX12Residency::EVICTION_POLICY::CLOCK:
+            return "clock";
+        case D3DX12Residency::EVICTION_POLICY::GDSF:
+            return "gdsf";
+        default:
+            return "lru";
+        }
+    }
+
+    void PrintResult(const char* pName, const BenchmarkResult& Result)
+    {
+        const double MB = 1024.0 * 1024.0;
+        const MockCounters& Counters = Result.Counters;
+        const D3DX12Residency::ResidencyStatistics& Statistics = Result.Statistics;
+
+        printf("%s (%s)\n", pName, PolicyName(Statistics.Policy));
+        printf("  hits / misses           %llu / %llu\n", (unsigned long long)Statistics.Hits, (unsigned long long)Statistics.Misses);
+        printf("  frames                  %u (%u ExecuteCommandLists calls)\n", Result.Frames, Result.Executes);
+        printf("  budget                  %.1f MB\n", Result.Budget / MB);
+        printf("  peak usage              %.1f MB (%.1f MB over budget)\n", Counters.PeakUsage / MB, Counters.PeakOverBudget / MB);
+        printf("  made resident           %.1f MB in %llu objects, %llu calls\n", Counters.BytesMadeResident / MB,
+            (unsigned long long)Counters.ObjectsMadeResident, (unsigned long long)Counters.MakeResidentCalls);
+        printf("  evicted                 %.1f MB in %llu objects, %llu calls\n", Counters.BytesEvicted / MB,
+            (unsigned long long)Counters.ObjectsEvicted, (unsigned long long)Counters.EvictCalls);
+        printf("  stalls                  %llu\n", (unsigned long long)Counters.Stalls);
+        printf("  residency violations    %llu of %llu command lists\n",
+            (unsigned long long)Counters.ResidencyViolations, (unsigned long long)Counters.CommandListsExecuted);
+        printf("  submit (us)             mean %.1f  p50 %.1f  p99 %.1f  max %.1f\n",
+            Result.Submit.Mean, Result.Submit.P50, Result.Submit.P99, Result.Submit.Max);
+        printf("  submit + paging (us)    mean %.1f  p50 %.1f  p99 %.1f  max %.1f\n",
+            Result.SubmitAndPaging.Mean, Result.SubmitAndPaging.P50, Result.SubmitAndPaging.P99, Result.SubmitAndPaging.Max);
+    }
+
+    // The mock's peak only means something if the manager keeps usage near the budget, so
+    // replay the synthetic trace under a small and a large budget and expect the peaks to differ
+    bool CheckPeakFollowsBudget(SyntheticTraceDesc Desc, const BenchmarkOptions& Options)
+    {
+        const UINT32 BudgetPercents[] = { 25, 75 };
+        UINT64 PeakUsage[2] = {};
+        for (UINT32 i = 0; i < 2; i++)
+        {
+            Desc.BudgetPercent = BudgetPercents[i];
+
+            BenchmarkResult Result;
+            std::string Error;
+            if (!Replay(GenerateTrace(Desc), Options, Result, Error))
+            {
+                fprintf(stderr, "budget check (%s): %s\n", PolicyName(Options.Policy), Error.c_str());
+                return false;
+            }
+            PeakUsage[i] = Result.Counters.PeakUsage;
+        }
+
+        if (PeakUsage[0] >= PeakUsage[1])
+        {
+            fprintf(stderr, "budget check (%s): peak usage is %llu bytes with a %u%% budget and %llu bytes with a %u%% budget\n",
+                PolicyName(Options.Policy), (unsigned long long)PeakUsage[0], BudgetPercents[0], (unsigned long long)PeakUsage[1], BudgetPercents[1]);
+            return false;
+        }
+        return true;
+    }
+
+    void PrintUsage()
+    {
+        printf(
+            "Usage: ResidencyBenchmark [options] [trace files]\n"
+            "\n"
+            "Replays each trace, or the built-in sweep and random traces when none is given.\n"
+            "\n"
+            "  --pattern <sweep|random>  generate only this synthetic trace\n"
+            "  --seed <n>                synthetic trace seed (1)\n"
+            "  --heaps <n>               synthetic heap count (512)\n"
+            "  --frames <n>              synthetic frame count (600)\n"
+            "  --lists <n>               command lists per frame (4)\n"
+            "  --heaps-per-list <n>      heaps referenced by each command list (32)\n"
+            "  --budget <percent>        budget as a share of all heap bytes (50)\n"
+            "  --write-trace <file>      save the synthetic trace instead of replaying it\n"
+            "  --gpu-latency <n>         frames the mock GPU runs behind the CPU (2)\n"
+            "  --max-latency <n>         MaxLatency passed to the residency manager (6)\n"
+            "  --policy <lru|clock|gdsf> replay with only this eviction policy\n");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    BenchmarkOptions Options;
+    Options.GpuLatencyFrames = 2;
+    Options.MaxLatency = 6;
+    Options.TicksPerFrame = 16667;
+
+    std::vector<D3DX12Residency::EVICTION_POLICY> Policies;
+
+    std::vector<SyntheticPattern> Patterns;
+    SyntheticTraceDesc Desc = DefaultSyntheticTraceDesc(SyntheticPattern::Sweep);
+    const char* pWriteTrace = nullptr;
+    std::vector<const char*> TraceFiles;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char* pArg = argv[i];
+        const char* pValue = i + 1 < argc ? argv[i + 1] : nullptr;
+
+        if (pArg[0] != '-')
+        {
+            TraceFiles.push_back(pArg);
+            continue;
+        }
+        if (strcmp(pArg, "--help") == 0 || pValue == nullptr)
+        {
+            PrintUsage();
+            return strcmp(pArg, "--help") == 0 ? 0 : 1;
+        }
+
+        i++;
+        const UINT32 Number = UINT32(strtoul(pValue, nullptr, 10));
+        if (strcmp(pArg, "--pattern") == 0)
+        {
+            if (strcmp(pValue, "sweep") == 0)
+            {
+                Patterns.push_back(SyntheticPattern::Sweep);
+            }
+            else if (strcmp(pValue, "random") == 0)
+            {
+                Patterns.push_back(SyntheticPattern::Random);
+            }
+            else
+            {
+                PrintUsage();
+                return 1;
+            }
+        }
+        else if (strcmp(pArg, "--policy") == 0)
+        {
+            if (strcmp(pValue, "lru") == 0)
+            {
+                Policies.push_back(D3DX12Residency::EVICTION_POLICY::LRU);
+            }
+            else if (strcmp(pValue, "clock") == 0)
+            {
+                Policies.push_back(D3DX12Residency::EVICTION_POLICY::CLOCK);
+            }
+            else if (strcmp(pValue, "gdsf") == 0)
+            {
+                Policies.push_back(D3DX12Residency::EVICTION_POLICY::GDSF);
+            }
+            else
+            {
+                PrintUsage();
+                return 1;
+            }
+        }
+        else if (strcmp(pArg, "--seed") == 0) Desc.Seed = Number;
+        else if (strcmp(pArg, "--heaps") == 0) Desc.NumHeaps = Number;
+        else if (strcmp(pArg, "--frames") == 0) Desc.NumFrames = Number;
+        else if (strcmp(pArg, "--lists") == 0) Desc.CommandListsPerFrame = std::max(Number, 1u);
+        else if (strcmp(pArg, "--heaps-per-list") == 0) Desc.HeapsPerCommandList = Number;
+        else if (strcmp(pArg, "--budget") == 0) Desc.BudgetPercent = Number;
+        else if (strcmp(pArg, "--write-trace") == 0) pWriteTrace = pValue;
+        else if (strcmp(pArg, "--gpu-latency") == 0) Options.GpuLatencyFrames = Number;
+        else if (strcmp(pArg, "--max-latency") == 0) Options.MaxLatency = std::max(Number, 1u);
+        else
+        {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    std::vector<std::pair<std::string, Trace>> Traces;
+    for (const char* pFileName : TraceFiles)
+    {
+        std::string Error;
+        Trace Input;
+        if (!Input.Load(pFileName, Error))
+        {
+            fprintf(stderr, "%s\n", Error.c_str());
+            return 1;
+        }
+        Traces.emplace_back(pFileName, std::move(Input));
+    }
+
+    if (Traces.empty())
+    {
+        if (Patterns.empty())
+        {
+            Patterns.push_back(SyntheticPattern::Sweep);
+            Patterns.push_back(SyntheticPattern::Random);
+        }
+
+        for (SyntheticPattern Pattern : Patterns)
+        {
+            Desc.Pattern = Pattern;
+            Traces.emplace_back(Pattern == SyntheticPattern::Sweep ? "sweep" : "random", GenerateTrace(Desc));
+        }
+
+        if (pWriteTrace != nullptr)
+        {
+            if (Traces.size() != 1 || !Traces[0].second.Save(pWriteTrace))
+            {
+                fprintf(stderr, "cannot write %s, pass exactly one --pattern\n", pWriteTrace);
+                return 1;
+            }
+            return 0;
+        }
+    }
+
+    if (Policies.empty())
+    {
+        Policies.push_back(D3DX12Residency::EVICTION_POLICY::LRU);
+        Policies.push_back(D3DX12Residency::EVICTION_POLICY::CLOCK);
+        Policies.push_back(D3DX12Residency::EVICTION_POLICY::GDSF);
+    }
+
+    int ExitCode = 0;
+    for (const auto& Entry : Traces)
+    {
+        for (D3DX12Residency::EVICTION_POLICY Policy : Policies)
+        {
+            Options.Policy = Policy;
+
+            BenchmarkResult Result;
+            std::string Error;
+            if (!Replay(Entry.second, Options, Result, Error))
+            {
+                fprintf(stderr, "%s (%s): %s\n", Entry.first.c_str(), PolicyName(Policy), Error.c_str());
+                ExitCode = 1;
+                continue;
+            }
+            PrintResult(Entry.first.c_str(), Result);
+        }
+    }
+
+    if (TraceFiles.empty())
+    {
+        for (D3DX12Residency::EVICTION_POLICY Policy : Policies)
+        {
+            Options.Policy = Policy;
+            if (!CheckPeakFollowsBudget(Desc, Options))
+            {
+                ExitCode = 1;
+            }
+        }
+    }
+
+    return ExitCode;
+}
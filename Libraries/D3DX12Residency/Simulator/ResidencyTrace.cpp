@@ -0,0 +1,247 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+#include "ResidencyTrace.h"
+
+#include <fstream>
+#include <random>
+#include <stdlib.h>
+#include <sstream>
+
+namespace ResidencySimulator
+{
+    bool Trace::Load(const char* pFileName, std::string& Error)
+    {
+        std::ifstream File(pFileName);
+        if (!File)
+        {
+            Error = std::string("cannot open ") + pFileName;
+            return false;
+        }
+
+        Events.clear();
+
+        std::string Line;
+        uint32_t LineNumber = 0;
+        while (std::getline(File, Line))
+        {
+            LineNumber++;
+
+            std::istringstream Stream(Line);
+            std::string Keyword;
+            if (!(Stream >> Keyword) || Keyword[0] == '#')
+            {
+                continue;
+            }
+
+            TraceEvent Event;
+            Event.Id = 0;
+            Event.Size = 0;
+            Event.NonLocalBudget = 0;
+
+            bool Valid = true;
+            if (Keyword == "budget")
+            {
+                Event.EventType = TraceEvent::SetBudget;
+                Valid = bool(Stream >> Event.Size);
+                Stream >> Event.NonLocalBudget;
+            }
+            else if (Keyword == "heap")
+            {
+                Event.EventType = TraceEvent::CreateHeap;
+                Valid = bool(Stream >> Event.Id >> Event.Size);
+            }
+            else if (Keyword == "free")
+            {
+                Event.EventType = TraceEvent::DestroyHeap;
+                Valid = bool(Stream >> Event.Id);
+            }
+            else if (Keyword == "frame")
+            {
+                Event.EventType = TraceEvent::BeginFrame;
+            }
+            else if (Keyword == "exec")
+            {
+                Event.EventType = TraceEvent::Execute;
+                Event.CommandLists.emplace_back();
+
+                std::string Token;
+                while (Valid && Stream >> Token)
+                {
+                    if (Token == "|")
+                    {
+                        Event.CommandLists.emplace_back();
+                        continue;
+                    }
+
+                    char* pEnd = nullptr;
+                    const unsigned long Id = strtoul(Token.c_str(), &pEnd, 10);
+                    Valid = *pEnd == '\0';
+                    Event.CommandLists.back().push_back(uint32_t(Id));
+                }
+            }
+            else
+            {
+                Valid = false;
+            }
+
+            if (!Valid)
+            {
+                Error = std::string(pFileName) + "(" + std::to_string(LineNumber) + "): cannot parse '" + Line + "'";
+                return false;
+            }
+
+            Events.push_back(std::move(Event));
+        }
+
+        return true;
+    }
+
+    bool Trace::Save(const char* pFileName) const
+    {
+        std::ofstream File(pFileName);
+        if (!File)
+        {
+            return false;
+        }
+
+        for (const TraceEvent& Event : Events)
+        {
+            switch (Event.EventType)
+            {
+            case TraceEvent::SetBudget:
+                File << "budget " << Event.Size << " " << Event.NonLocalBudget << "\n";
+                break;
+            case TraceEvent::CreateHeap:
+                File << "heap " << Event.Id << " " << Event.Size << "\n";
+                break;
+            case TraceEvent::DestroyHeap:
+                File << "free " << Event.Id << "\n";
+                break;
+            case TraceEvent::BeginFrame:
+                File << "frame\n";
+                break;
+            case TraceEvent::Execute:
+                File << "exec";
+                for (size_t i = 0; i < Event.CommandLists.size(); i++)
+                {
+                    if (i > 0)
+                    {
+                        File << " |";
+                    }
+                    for (uint32_t Id : Event.CommandLists[i])
+                    {
+                        File << " " << Id;
+                    }
+                }
+                File << "\n";
+                break;
+            }
+        }
+
+        return bool(File);
+    }
+
+    SyntheticTraceDesc DefaultSyntheticTraceDesc(SyntheticPattern Pattern)
+    {
+        SyntheticTraceDesc Desc;
+        Desc.Pattern = Pattern;
+        Desc.Seed = 1;
+        Desc.NumHeaps = 512;
+        Desc.MinHeapSize = 1 << 20;
+        Desc.MaxHeapSize = 16 << 20;
+        Desc.NumFrames = 600;
+        Desc.CommandListsPerFrame = 4;
+        Desc.HeapsPerCommandList = 32;
+        Desc.BudgetPercent = 50;
+        return Desc;
+    }
+
+    Trace GenerateTrace(const SyntheticTraceDesc& Desc)
+    {
+        // Only the engine's raw output is used, the standard distributions differ between libraries
+        std::mt19937 Random(Desc.Seed);
+        auto Next = [&Random](uint64_t Range) -> uint64_t
+        {
+            return Range > 0 ? uint64_t(Random()) % Range : 0;
+        };
+
+        Trace Result;
+
+        const uint64_t HeapAlignment = 64 * 1024;
+        const uint64_t SizeRange = Desc.MaxHeapSize > Desc.MinHeapSize ? Desc.MaxHeapSize - Desc.MinHeapSize : 0;
+
+        std::vector<TraceEvent> Heaps;
+        uint64_t TotalSize = 0;
+        for (uint32_t i = 0; i < Desc.NumHeaps; i++)
+        {
+            TraceEvent Event;
+            Event.EventType = TraceEvent::CreateHeap;
+            Event.Id = i;
+            Event.Size = (Desc.MinHeapSize + Next(SizeRange + 1) + HeapAlignment - 1) & ~(HeapAlignment - 1);
+            Event.NonLocalBudget = 0;
+            TotalSize += Event.Size;
+            Heaps.push_back(Event);
+        }
+
+        TraceEvent Budget;
+        Budget.EventType = TraceEvent::SetBudget;
+        Budget.Id = 0;
+        Budget.Size = TotalSize / 100 * Desc.BudgetPercent;
+        Budget.NonLocalBudget = 0;
+        Result.Events.push_back(Budget);
+        Result.Events.insert(Result.Events.end(), Heaps.begin(), Heaps.end());
+
+        const uint32_t HeapsPerFrame = Desc.CommandListsPerFrame * Desc.HeapsPerCommandList;
+
+        for (uint32_t Frame = 0; Frame < Desc.NumFrames; Frame++)
+        {
+            TraceEvent FrameEvent;
+            FrameEvent.EventType = TraceEvent::BeginFrame;
+            FrameEvent.Id = 0;
+            FrameEvent.Size = 0;
+            FrameEvent.NonLocalBudget = 0;
+            Result.Events.push_back(FrameEvent);
+
+            TraceEvent Execute;
+            Execute.EventType = TraceEvent::Execute;
+            Execute.Id = 0;
+            Execute.Size = 0;
+            Execute.NonLocalBudget = 0;
+            Execute.CommandLists.resize(Desc.CommandListsPerFrame);
+
+            for (uint32_t i = 0; i < HeapsPerFrame && Desc.NumHeaps > 0; i++)
+            {
+                uint32_t Id;
+                if (Desc.Pattern == SyntheticPattern::Sweep)
+                {
+                    // The window moves one heap every other frame and a few heaps stray outside it
+                    const uint32_t WindowStart = Frame / 2;
+                    const uint32_t Offset = Next(8) == 0 ? uint32_t(Next(Desc.NumHeaps)) : i;
+                    Id = (WindowStart + Offset) % Desc.NumHeaps;
+                }
+                else
+                {
+                    // The product of two uniform ids leans heavily towards the low ones
+                    const uint64_t A = Next(Desc.NumHeaps);
+                    const uint64_t B = Next(Desc.NumHeaps);
+                    Id = uint32_t(A * B / Desc.NumHeaps);
+                }
+
+                Execute.CommandLists[i % Desc.CommandListsPerFrame].push_back(Id);
+            }
+
+            Result.Events.push_back(std::move(Execute));
+        }
+
+        return Result;
+    }
+}
@@ -0,0 +1,89 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+// A recording of what an app asks of the residency manager: heaps coming and going, the
+// budget changing, frames beginning and command lists executing with the heaps they use.
+//
+// Traces are stored as text, one event per line:
+//
+//     # comment
+//     budget <local bytes> [<non-local bytes>]
+//     heap <id> <size in bytes>
+//     free <id>
+//     frame
+//     exec <id> <id> ... [| <id> <id> ...]
+//
+// An exec line is one call to ExecuteCommandLists, each '|' starts the next command list.
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace ResidencySimulator
+{
+    struct TraceEvent
+    {
+        enum Type
+        {
+            SetBudget,
+            CreateHeap,
+            DestroyHeap,
+            BeginFrame,
+            Execute
+        };
+
+        Type EventType;
+        // Heap id for CreateHeap and DestroyHeap
+        uint32_t Id;
+        // Heap size for CreateHeap, local budget for SetBudget
+        uint64_t Size;
+        uint64_t NonLocalBudget;
+        // Heaps referenced by each command list of an Execute
+        std::vector<std::vector<uint32_t>> CommandLists;
+    };
+
+    struct Trace
+    {
+        std::vector<TraceEvent> Events;
+
+        bool Load(const char* pFileName, std::string& Error);
+        bool Save(const char* pFileName) const;
+    };
+
+    enum class SyntheticPattern
+    {
+        // The camera moves along a path of heaps and the working set is a window sliding along it
+        Sweep,
+        // Each frame draws from every heap, with low ids far more likely than high ones
+        Random
+    };
+
+    struct SyntheticTraceDesc
+    {
+        SyntheticPattern Pattern;
+        uint32_t Seed;
+        uint32_t NumHeaps;
+        uint64_t MinHeapSize;
+        uint64_t MaxHeapSize;
+        uint32_t NumFrames;
+        uint32_t CommandListsPerFrame;
+        uint32_t HeapsPerCommandList;
+        // The budget as a share of all heap bytes, in percent
+        uint32_t BudgetPercent;
+    };
+
+    SyntheticTraceDesc DefaultSyntheticTraceDesc(SyntheticPattern Pattern);
+
+    // The same description always yields the same trace, on any platform
+    Trace GenerateTrace(const SyntheticTraceDesc& Desc);
+}
@@ -0,0 +1,89 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+// Everything d3dx12Residency.h expects to be included before it. On Windows that is the
+// real SDK. Elsewhere only the mock backend is available, so the D3D12 and DXGI objects are
+// opaque types and the handful of Win32 types the library uses are provided here. Threads,
+// locks and the clock come from the library's standard C++ platform layer.
+
+#pragma once
+
+#ifdef _WIN32
+
+#define NOMINMAX
+#include <windows.h>
+#include <d3d12.h>
+#include <dxgi1_4.h>
+
+#else
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <new>
+
+typedef int32_t HRESULT;
+typedef uint8_t BYTE;
+typedef uint32_t UINT;
+typedef int32_t INT32;
+typedef uint32_t UINT32;
+typedef int64_t INT64;
+typedef uint64_t UINT64;
+typedef size_t SIZE_T;
+
+#define S_OK                        HRESULT(0)
+#define E_FAIL                      HRESULT(0x80004005)
+#define E_INVALIDARG                HRESULT(0x80070057)
+#define E_OUTOFMEMORY               HRESULT(0x8007000E)
+#define SUCCEEDED(hr)               (HRESULT(hr) >= 0)
+#define FAILED(hr)                  (HRESULT(hr) < 0)
+
+#define MAXUINT64                   UINT64_MAX
+#define FORCEINLINE                 inline __attribute__((always_inline))
+#define ARRAYSIZE(a)                (sizeof(a) / sizeof((a)[0]))
+#define ZeroMemory(p, size)         memset((p), 0, (size))
+#define CONTAINING_RECORD(address, type, field) ((type*)((char*)(address) - offsetof(type, field)))
+
+struct GUID
+{
+    uint32_t Data1;
+    uint16_t Data2;
+    uint16_t Data3;
+    uint8_t Data4[8];
+};
+
+struct LIST_ENTRY
+{
+    LIST_ENTRY* Flink;
+    LIST_ENTRY* Blink;
+};
+
+// Only ever handled through pointers the mock backend hands out
+struct ID3D12Pageable;
+struct ID3D12Fence;
+struct ID3D12CommandQueue;
+struct ID3D12CommandList;
+
+enum DXGI_MEMORY_SEGMENT_GROUP
+{
+    DXGI_MEMORY_SEGMENT_GROUP_LOCAL = 0,
+    DXGI_MEMORY_SEGMENT_GROUP_NON_LOCAL = 1
+};
+
+struct DXGI_QUERY_VIDEO_MEMORY_INFO
+{
+    UINT64 Budget;
+    UINT64 CurrentUsage;
+    UINT64 AvailableForReservation;
+    UINT64 CurrentReservation;
+};
+
+#endif
@@ -10,10 +10,29 @@
 //*********************************************************
 
 #pragma once
+
+// Threads, locks, events and the clock come from Win32 on Windows and from the C++ standard
+// library everywhere else. Define RESIDENCY_PORTABLE_THREADING to 1 to use the standard library
+// on Windows too.
+#ifndef RESIDENCY_PORTABLE_THREADING
+#ifdef _WIN32
+#define RESIDENCY_PORTABLE_THREADING 0
+#else
+#define RESIDENCY_PORTABLE_THREADING 1
+#endif
+#endif
+
+#include <atomic>
+#include <new>
+#if RESIDENCY_PORTABLE_THREADING
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#endif
+
 namespace D3DX12Residency
 {
-    __declspec(selectany) INT64 g_ResidencyManagerUniqueID = 0;
-
 #if 0
 #define RESIDENCY_CHECK(x) \
     if((x) == false) { DebugBreak(); }
@@ -25,19 +44,157 @@ namespace D3DX12Residency
 #define RESIDENCY_CHECK_RESULT(x) x
 #endif
 
+    // Pages on the thread calling ExecuteCommandLists instead of a worker, which makes the
+    // paging decisions independent of thread timing
+#ifndef RESIDENCY_SINGLE_THREADED
 #define RESIDENCY_SINGLE_THREADED 0
+#endif
 
 #define RESIDENCY_MIN(x,y) ((x) < (y) ? (x) : (y))
 #define RESIDENCY_MAX(x,y) ((x) > (y) ? (x) : (y))
 
-    // This size can be tuned to your app in order to save space
+    // This size can be tuned to your app in order to save space. Open command list slots are
+    // tracked with one bit each in a 32 bit mask, so it can't exceed 32.
 #define MAX_NUM_CONCURRENT_CMD_LISTS 32
+    static_assert(MAX_NUM_CONCURRENT_CMD_LISTS <= 32, "Command list slots are tracked in a 32 bit mask");
+
+    // The D3D12 backend needs d3d12.h and dxgi1_4.h. Without it the residency manager can only
+    // be initialized with a backend of the app's own, such as a simulator's mock device.
+#ifndef RESIDENCY_D3D12_BACKEND
+#ifdef _WIN32
+#define RESIDENCY_D3D12_BACKEND 1
+#else
+#define RESIDENCY_D3D12_BACKEND 0
+#endif
+#endif
 
     namespace Internal
     {
+#if RESIDENCY_PORTABLE_THREADING
+        class CriticalSection
+        {
+        public:
+            void Enter()
+            {
+                Mutex.lock();
+            }
+
+            void Leave()
+            {
+                Mutex.unlock();
+            }
+
+        private:
+            // Recursive, like a Win32 critical section
+            std::recursive_mutex Mutex;
+        };
+
+        // A manual reset event stays signaled until it is reset, an auto reset event releases a single wait
+        class Event
+        {
+        public:
+            Event() :
+                Created(false),
+                ManualReset(false),
+                Signaled(false)
+            {
+            }
+
+            HRESULT Create(bool ManualResetIn)
+            {
+                ManualReset = ManualResetIn;
+                Signaled = false;
+                Created = true;
+                return S_OK;
+            }
+
+            void Destroy()
+            {
+                Created = false;
+            }
+
+            bool IsCreated() const
+            {
+                return Created;
+            }
+
+            HRESULT Set()
+            {
+                {
+                    std::lock_guard<std::mutex> Lock(Mutex);
+                    Signaled = true;
+                }
+                Condition.notify_all();
+                return S_OK;
+            }
+
+            HRESULT Reset()
+            {
+                std::lock_guard<std::mutex> Lock(Mutex);
+                Signaled = false;
+                return S_OK;
+            }
+
+            void Wait()
+            {
+                std::unique_lock<std::mutex> Lock(Mutex);
+                Condition.wait(Lock, [this] { return Signaled; });
+                if (ManualReset == false)
+                {
+                    Signaled = false;
+                }
+            }
+
+        private:
+            std::mutex Mutex;
+            std::condition_variable Condition;
+            bool Created;
+            bool ManualReset;
+            bool Signaled;
+        };
+
+        class Thread
+        {
+        public:
+            typedef void(*ThreadFunction)(void* pData);
+
+            HRESULT Start(ThreadFunction pFunction, void* pData)
+            {
+                try
+                {
+                    Worker = std::thread(pFunction, pData);
+                }
+                catch (...)
+                {
+                    return E_FAIL;
+                }
+                return S_OK;
+            }
+
+            void Join()
+            {
+                if (Worker.joinable())
+                {
+                    Worker.join();
+                }
+            }
+
+        private:
+            std::thread Worker;
+        };
+
+        inline UINT64 GetTimestamp()
+        {
+            return UINT64(std::chrono::steady_clock::now().time_since_epoch().count());
+        }
+
+        inline UINT64 GetTimestampFrequency()
+        {
+            return UINT64(std::chrono::steady_clock::period::den / std::chrono::steady_clock::period::num);
+        }
+#else
         class CriticalSection
         {
-            friend class ScopedLock;
         public:
             CriticalSection()
             {
@@ -49,10 +206,131 @@ namespace D3DX12Residency
                 DeleteCriticalSection(&CS);
             }
 
+            void Enter()
+            {
+                EnterCriticalSection(&CS);
+            }
+
+            void Leave()
+            {
+                LeaveCriticalSection(&CS);
+            }
+
         private:
             CRITICAL_SECTION CS;
         };
 
+        class Event
+        {
+        public:
+            Event() :
+                Handle(nullptr)
+            {
+            }
+
+            ~Event()
+            {
+                Destroy();
+            }
+
+            HRESULT Create(bool ManualReset)
+            {
+                Handle = CreateEvent(nullptr, ManualReset, false, nullptr);
+                return Handle ? S_OK : HRESULT_FROM_WIN32(GetLastError());
+            }
+
+            void Destroy()
+            {
+                if (Handle)
+                {
+                    CloseHandle(Handle);
+                    Handle = nullptr;
+                }
+            }
+
+            bool IsCreated() const
+            {
+                return Handle != nullptr;
+            }
+
+            HRESULT Set()
+            {
+                return SetEvent(Handle) ? S_OK : HRESULT_FROM_WIN32(GetLastError());
+            }
+
+            HRESULT Reset()
+            {
+                return ResetEvent(Handle) ? S_OK : HRESULT_FROM_WIN32(GetLastError());
+            }
+
+            void Wait()
+            {
+                WaitForSingleObject(Handle, INFINITE);
+            }
+
+        private:
+            HANDLE Handle;
+        };
+
+        class Thread
+        {
+        public:
+            typedef void(*ThreadFunction)(void* pData);
+
+            Thread() :
+                Handle(nullptr),
+                pFunction(nullptr),
+                pData(nullptr)
+            {
+            }
+
+            HRESULT Start(ThreadFunction pFunctionIn, void* pDataIn)
+            {
+                pFunction = pFunctionIn;
+                pData = pDataIn;
+
+                Handle = CreateThread(nullptr, 0, ThreadStart, this, 0, nullptr);
+                return Handle ? S_OK : HRESULT_FROM_WIN32(GetLastError());
+            }
+
+            void Join()
+            {
+                if (Handle)
+                {
+                    WaitForSingleObject(Handle, INFINITE);
+                    CloseHandle(Handle);
+                    Handle = nullptr;
+                }
+            }
+
+        private:
+            static DWORD WINAPI ThreadStart(void* pThis)
+            {
+                Thread* pThread = (Thread*)pThis;
+                pThread->pFunction(pThread->pData);
+                return 0;
+            }
+
+            HANDLE Handle;
+            ThreadFunction pFunction;
+            void* pData;
+        };
+
+        inline UINT64 GetTimestamp()
+        {
+            LARGE_INTEGER Time;
+            QueryPerformanceCounter(&Time);
+            return UINT64(Time.QuadPart);
+        }
+
+        inline UINT64 GetTimestampFrequency()
+        {
+            LARGE_INTEGER Frequency;
+            QueryPerformanceFrequency(&Frequency);
+            return UINT64(Frequency.QuadPart);
+        }
+#endif
+
         class ScopedLock
         {
         public:
@@ -62,7 +340,7 @@ namespace D3DX12Residency
             {
                 if (pCS)
                 {
-                    EnterCriticalSection(&pCS->CS);
+                    pCS->Enter();
                 }
             };
 
@@ -70,7 +348,7 @@ namespace D3DX12Residency
             {
                 if (pCS)
                 {
-                    LeaveCriticalSection(&pCS->CS);
+                    pCS->Leave();
                 }
             }
 
@@ -79,23 +357,223 @@ namespace D3DX12Residency
             CriticalSection* pCS;
         };
 
+        // Index of the lowest set bit, Mask must not be 0
+        inline UINT32 LowestSetBit(UINT32 Mask)
+        {
+#ifdef _MSC_VER
+            unsigned long Index;
+            _BitScanForward(&Index, Mask);
+            return UINT32(Index);
+#else
+            return UINT32(__builtin_ctz(Mask));
+#endif
+        }
+
+        // Queues remember which residency manager created their fence by this ID
+        inline INT64 GenerateResidencyManagerUniqueID()
+        {
+            static std::atomic<INT64> LastID(0);
+            return ++LastID;
+        }
+    }
+
+    // Every call the residency manager makes on the device, its queues and fences and the DXGI
+    // adapter. Fences, queues, command lists and pageables are only ever handed back to the
+    // backend they came from, so a mock may put objects of its own behind those pointers.
+    class ResidencyBackend
+    {
+    public:
+        virtual ~ResidencyBackend() {}
+
+        virtual HRESULT CreateFence(UINT64 InitialValue, ID3D12Fence** ppFence) = 0;
+        virtual void DestroyFence(ID3D12Fence* pFence) = 0;
+        virtual UINT64 GetCompletedFenceValue(ID3D12Fence* pFence) = 0;
+        // Signals the fence from the CPU
+        virtual HRESULT SignalFence(ID3D12Fence* pFence, UINT64 Value) = 0;
+        // Blocks the calling thread until the fence has reached Value
+        virtual HRESULT WaitForFence(ID3D12Fence* pFence, UINT64 Value) = 0;
+
+        virtual HRESULT QueueSignal(ID3D12CommandQueue* pQueue, ID3D12Fence* pFence, UINT64 Value) = 0;
+        virtual HRESULT QueueWait(ID3D12CommandQueue* pQueue, ID3D12Fence* pFence, UINT64 Value) = 0;
+        virtual void ExecuteCommandLists(ID3D12CommandQueue* pQueue, UINT32 Count, ID3D12CommandList** ppCommandLists) = 0;
+        virtual HRESULT GetQueuePrivateData(ID3D12CommandQueue* pQueue, const GUID& Guid, UINT32* pSize, void* pData) = 0;
+        virtual HRESULT SetQueuePrivateData(ID3D12CommandQueue* pQueue, const GUID& Guid, UINT32 Size, const void* pData) = 0;
+
+        virtual HRESULT MakeResident(UINT32 NumObjects, ID3D12Pageable* const* ppObjects) = 0;
+        virtual HRESULT Evict(UINT32 NumObjects, ID3D12Pageable* const* ppObjects) = 0;
+        virtual HRESULT QueryVideoMemoryInfo(DXGI_MEMORY_SEGMENT_GROUP Segment, DXGI_QUERY_VIDEO_MEMORY_INFO* pInfo) = 0;
+
+        // A monotonic clock, the eviction grace period is measured in its ticks. Defaults to the
+        // platform's clock, a mock device may override it to control time.
+        virtual UINT64 GetTimestamp()
+        {
+            return Internal::GetTimestamp();
+        }
+
+        virtual UINT64 GetTimestampFrequency()
+        {
+            return Internal::GetTimestampFrequency();
+        }
+    };
+
+    // Which resident objects the manager evicts first when it needs room to make others resident
+    enum class EVICTION_POLICY
+    {
+        // The least recently used
+        LRU,
+        // The least recently used that was not used again since the clock hand last passed it
+        CLOCK,
+        // Greedy-Dual-Size-Frequency: the lowest count of uses per byte, aged by what was evicted before.
+        // Objects that keep coming back stay resident however large they are.
+        GDSF
+    };
+
+    struct ResidencyStatistics
+    {
+        EVICTION_POLICY Policy;
+        // Objects an ExecuteCommandLists call used that were resident, and that had to be made resident
+        UINT64 Hits;
+        UINT64 Misses;
+        UINT64 BytesMadeResident;
+        UINT64 BytesEvicted;
+        UINT64 ObjectsEvicted;
+    };
+
+#if RESIDENCY_D3D12_BACKEND
+    class D3D12ResidencyBackend : public ResidencyBackend
+    {
+    public:
+        D3D12ResidencyBackend() :
+            Device(nullptr),
+            NodeIndex(0),
+            Adapter(nullptr)
+        {
+        }
+
+        // NOTE: DeviceNodeIndex is an index not a mask. The majority of D3D12 uses bit masks to identify a GPU node whereas DXGI uses 0 based indices.
+        void Initialize(ID3D12Device* ParentDevice, UINT DeviceNodeIndex, IDXGIAdapter3* ParentAdapter)
+        {
+            Device = ParentDevice;
+            NodeIndex = DeviceNodeIndex;
+            Adapter = ParentAdapter;
+        }
+
+        virtual HRESULT CreateFence(UINT64 InitialValue, ID3D12Fence** ppFence) override
+        {
+            return Device->CreateFence(InitialValue, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(ppFence));
+        }
+
+        virtual void DestroyFence(ID3D12Fence* pFence) override
+        {
+            pFence->Release();
+        }
+
+        virtual UINT64 GetCompletedFenceValue(ID3D12Fence* pFence) override
+        {
+            return pFence->GetCompletedValue();
+        }
+
+        virtual HRESULT SignalFence(ID3D12Fence* pFence, UINT64 Value) override
+        {
+            return pFence->Signal(Value);
+        }
+
+        virtual HRESULT WaitForFence(ID3D12Fence* pFence, UINT64 Value) override
+        {
+            // Without an event to set, this doesn't return until the fence has reached the value
+            return pFence->SetEventOnCompletion(Value, nullptr);
+        }
+
+        virtual HRESULT QueueSignal(ID3D12CommandQueue* pQueue, ID3D12Fence* pFence, UINT64 Value) override
+        {
+            return pQueue->Signal(pFence, Value);
+        }
+
+        virtual HRESULT QueueWait(ID3D12CommandQueue* pQueue, ID3D12Fence* pFence, UINT64 Value) override
+        {
+            return pQueue->Wait(pFence, Value);
+        }
+
+        virtual void ExecuteCommandLists(ID3D12CommandQueue* pQueue, UINT32 Count, ID3D12CommandList** ppCommandLists) override
+        {
+            pQueue->ExecuteCommandLists(Count, ppCommandLists);
+        }
+
+        virtual HRESULT GetQueuePrivateData(ID3D12CommandQueue* pQueue, const GUID& Guid, UINT32* pSize, void* pData) override
+        {
+            return pQueue->GetPrivateData(Guid, pSize, pData);
+        }
+
+        virtual HRESULT SetQueuePrivateData(ID3D12CommandQueue* pQueue, const GUID& Guid, UINT32 Size, const void* pData) override
+        {
+            return pQueue->SetPrivateData(Guid, Size, pData);
+        }
+
+        virtual HRESULT MakeResident(UINT32 NumObjects, ID3D12Pageable* const* ppObjects) override
+        {
+            return Device->MakeResident(NumObjects, ppObjects);
+        }
+
+        virtual HRESULT Evict(UINT32 NumObjects, ID3D12Pageable* const* ppObjects) override
+        {
+            return Device->Evict(NumObjects, ppObjects);
+        }
+
+        virtual HRESULT QueryVideoMemoryInfo(DXGI_MEMORY_SEGMENT_GROUP Segment, DXGI_QUERY_VIDEO_MEMORY_INFO* pInfo) override
+        {
+            return Adapter->QueryVideoMemoryInfo(NodeIndex, Segment, pInfo);
+        }
+
+    private:
+        ID3D12Device* Device;
+        // NOTE: This is an index not a mask. The majority of D3D12 uses bit masks to identify a GPU node whereas DXGI uses 0 based indices.
+        UINT NodeIndex;
+        IDXGIAdapter3* Adapter;
+    };
+#endif
+
+    namespace Internal
+    {
         // One per Residency Manager
         class SyncManager
         {
         public:
-            SyncManager()
+            SyncManager() :
+                UsedCommandListSlots(0)
             {
-                for (UINT32 i = 0; i < ARRAYSIZE(AvailableCommandLists); i++)
+            }
+
+            // Reserves the lowest free command list slot. Sets are opened on many recording threads
+            // at once, so this is a compare-exchange loop rather than a lock.
+            bool AcquireCommandListSlot(UINT32& Slot)
+            {
+                UINT32 Used = UsedCommandListSlots.load();
+                while (true)
                 {
-                    AvailableCommandLists[i] = false;
+                    const UINT32 Available = ~Used & cAllCommandListSlots;
+                    if (Available == 0)
+                    {
+                        return false;
+                    }
+
+                    const UINT32 Index = LowestSetBit(Available);
+                    if (UsedCommandListSlots.compare_exchange_weak(Used, Used | (1u << Index)))
+                    {
+                        Slot = Index;
+                        return true;
+                    }
                 }
             }
 
-            Internal::CriticalSection MaskCriticalSection;
+            void ReleaseCommandListSlot(UINT32 Slot)
+            {
+                UsedCommandListSlots.fetch_and(~(1u << Slot));
+            }
+
+            static const UINT32 cAllCommandListSlots = UINT32((UINT64(1) << MAX_NUM_CONCURRENT_CMD_LISTS) - 1);
 
-            static const UINT32 sUnsetValue = UINT32(-1);
-            // Represents which command lists are currently open for recording
-            bool AvailableCommandLists[MAX_NUM_CONCURRENT_CMD_LISTS];
+            // One bit for each command list slot that is currently open for recording
+            std::atomic<UINT32> UsedCommandListSlots;
         };
 
         //Forward Declaration
@@ -118,9 +596,12 @@ namespace D3DX12Residency
             Size(0),
             ResidencyStatus(RESIDENCY_STATUS::RESIDENT),
             LastGPUSyncPoint(0),
-            LastUsedTimestamp(0)
+            LastUsedTimestamp(0),
+            CommandListsUsedOn(0),
+            UseCount(0),
+            EvictionPriority(0.0),
+            RecentlyUsed(false)
         {
-            memset(CommandListsUsedOn, 0, sizeof(CommandListsUsedOn));
         }
 
         void Initialize(ID3D12Pageable* pUnderlyingIn, UINT64 ObjectSize, UINT64 InitialGPUSyncPoint = 0)
@@ -144,11 +625,19 @@ namespace D3DX12Residency
         UINT64 LastGPUSyncPoint;
         UINT64 LastUsedTimestamp;
 
-        // This is used to track which open command lists this resource is currently used on.
-        bool CommandListsUsedOn[MAX_NUM_CONCURRENT_CMD_LISTS];
+        // One bit for each open command list slot this resource is currently used on. Sets on other
+        // threads may change their own bits at the same time, so bits are only changed atomically.
+        std::atomic<UINT32> CommandListsUsedOn;
 
         // Linked list entry
         LIST_ENTRY ListEntry;
+
+        // Eviction policy state. The number of ExecuteCommandLists calls the object was used in,
+        // including ones before it was last evicted.
+        UINT32 UseCount;
+        double EvictionPriority;
+        bool RecentlyUsed;
+        LIST_ENTRY PolicyListEntry;
     };
 
     // This represents a set of objects which are referenced by a command list i.e. every time a resource
@@ -184,10 +673,12 @@ namespace D3DX12Residency
             RESIDENCY_CHECK(IsOpen);
             RESIDENCY_CHECK(CommandListIndex != InvalidIndex);
 
-            // If we haven't seen this object on this command list mark it
-            if (pObject->CommandListsUsedOn[CommandListIndex] == false)
+            // If we haven't seen this object on this command list mark it. Only this set changes its
+            // own bit, so testing it first keeps the atomic operation off the common path.
+            const UINT32 CommandListBit = 1u << CommandListIndex;
+            if ((pObject->CommandListsUsedOn.load(std::memory_order_relaxed) & CommandListBit) == 0)
             {
-                pObject->CommandListsUsedOn[CommandListIndex] = true;
+                pObject->CommandListsUsedOn.fetch_or(CommandListBit);
                 if (ppSet == nullptr || CurrentSetSize >= MaxResidencySetSize)
                 {
                     Realloc();
@@ -210,8 +701,6 @@ namespace D3DX12Residency
 
         HRESULT Open()
         {
-            Internal::ScopedLock Lock(&pSyncManager->MaskCriticalSection);
-
             // It's invalid to open a set that is already open
             if (IsOpen)
             {
@@ -220,20 +709,7 @@ namespace D3DX12Residency
 
             RESIDENCY_CHECK(CommandListIndex == InvalidIndex);
 
-            bool CommandlistAvailable = false;
-            // Find the first available command list by bitscanning
-            for (UINT32 i = 0; i < ARRAYSIZE(pSyncManager->AvailableCommandLists); i++)
-            {
-                if (pSyncManager->AvailableCommandLists[i] == false)
-                {
-                    CommandListIndex = i;
-                    pSyncManager->AvailableCommandLists[i] = true;
-                    CommandlistAvailable = true;
-                    break;
-                }
-            }
-
-            if (CommandlistAvailable == false)
+            if (pSyncManager->AcquireCommandListSlot(CommandListIndex) == false)
             {
                 // There are too many open residency sets, consider using less or increasing the value of MAX_NUM_CONCURRENT_CMD_LISTS
                 RESIDENCY_CHECK(false);
@@ -275,14 +751,12 @@ namespace D3DX12Residency
 
         inline void Remove(ManagedObject* pObject)
         {
-            pObject->CommandListsUsedOn[CommandListIndex] = false;
+            pObject->CommandListsUsedOn.fetch_and(~(1u << CommandListIndex));
         }
 
         inline void ReturnCommandListReservation()
         {
-            Internal::ScopedLock Lock(&pSyncManager->MaskCriticalSection);
-
-            pSyncManager->AvailableCommandLists[CommandListIndex] = false;
+            pSyncManager->ReleaseCommandListSlot(CommandListIndex);
 
             CommandListIndex = ResidencySet::InvalidIndex;
 
@@ -294,16 +768,6 @@ namespace D3DX12Residency
             pSyncManager = pSyncManagerIn;
         }
 
-        bool Initialize(Internal::SyncManager* pSyncManagerIn, UINT32 MaxSize)
-        {
-            pSyncManager = pSyncManagerIn;
-            MaxResidencySetSize = MaxSize;
-
-            ppSet = new ManagedObject*[MaxResidencySetSize];
-
-            return ppSet != nullptr;
-        }
-
         inline void Realloc()
         {
             MaxResidencySetSize = (MaxResidencySetSize == 0) ? 4096 : INT32(MaxResidencySetSize + (MaxResidencySetSize / 2.0f));
@@ -369,28 +833,72 @@ namespace D3DX12Residency
             return pEntry;
         }
 
-        inline LIST_ENTRY* RemoveTailList(LIST_ENTRY* pHead)
-        {
-            LIST_ENTRY* pEntry = pHead->Blink;
-            Internal::RemoveEntryList(pEntry);
-            return pEntry;
-        }
+        inline LIST_ENTRY* RemoveTailList(LIST_ENTRY* pHead)
+        {
+            LIST_ENTRY* pEntry = pHead->Blink;
+            Internal::RemoveEntryList(pEntry);
+            return pEntry;
+        }
+
+        inline bool IsListEmpty(LIST_ENTRY* pEntry)
+        {
+            return pEntry->Flink == pEntry;
+        }
+
+        // Storage that only ever grows, so the paging path stops allocating once it has seen its
+        // largest workload
+        template <typename T>
+        class ScratchBuffer
+        {
+        public:
+            ScratchBuffer() :
+                pData(nullptr),
+                Capacity(0)
+            {
+            }
+
+            ~ScratchBuffer()
+            {
+                delete[](pData);
+            }
+
+            ScratchBuffer(const ScratchBuffer&) = delete;
+            ScratchBuffer& operator=(const ScratchBuffer&) = delete;
+
+            // The contents are not kept when the buffer grows
+            bool Reserve(UINT32 Count)
+            {
+                if (Count > Capacity)
+                {
+                    const UINT32 NewCapacity = RESIDENCY_MAX(Count, Capacity + Capacity / 2);
+                    T* pNewData = new (std::nothrow) T[NewCapacity];
+                    if (pNewData == nullptr)
+                    {
+                        return false;
+                    }
 
-        inline bool IsListEmpty(LIST_ENTRY* pEntry)
-        {
-            return pEntry->Flink == pEntry;
-        }
+                    delete[](pData);
+                    pData = pNewData;
+                    Capacity = NewCapacity;
+                }
+                return true;
+            }
+
+            T* pData;
+            UINT32 Capacity;
+        };
 
         struct Fence
         {
-            Fence(UINT64 StartingValue) : pFence(nullptr), FenceValue(StartingValue)
+            Fence(UINT64 StartingValue) : pFence(nullptr), pBackend(nullptr), FenceValue(StartingValue)
             {
                 Internal::InitializeListHead(&ListEntry);
             };
 
-            HRESULT Initialize(ID3D12Device* pDevice)
+            HRESULT Initialize(ResidencyBackend* pBackendIn)
             {
-                HRESULT hr = pDevice->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&pFence));
+                pBackend = pBackendIn;
+                HRESULT hr = pBackend->CreateFence(0, &pFence);
                 RESIDENCY_CHECK_RESULT(hr);
 
                 return hr;
@@ -400,31 +908,47 @@ namespace D3DX12Residency
             {
                 if (pFence)
                 {
-                    pFence->Release();
+                    pBackend->DestroyFence(pFence);
                     pFence = nullptr;
                 }
             }
 
             HRESULT GPUWait(ID3D12CommandQueue* pQueue)
             {
-                HRESULT hr = pQueue->Wait(pFence, FenceValue);
+                HRESULT hr = pBackend->QueueWait(pQueue, pFence, FenceValue);
                 RESIDENCY_CHECK_RESULT(hr);
                 return hr;
             }
 
             HRESULT GPUSignal(ID3D12CommandQueue* pQueue)
             {
-                HRESULT hr = pQueue->Signal(pFence, FenceValue);
+                HRESULT hr = pBackend->QueueSignal(pQueue, pFence, FenceValue);
                 RESIDENCY_CHECK_RESULT(hr);
                 return hr;
             }
 
+            HRESULT CPUSignal(UINT64 Value)
+            {
+                return pBackend->SignalFence(pFence, Value);
+            }
+
+            inline UINT64 GetCompletedValue()
+            {
+                return pBackend->GetCompletedFenceValue(pFence);
+            }
+
+            HRESULT CPUWait(UINT64 Value)
+            {
+                return pBackend->WaitForFence(pFence, Value);
+            }
+
             inline void Increment()
             {
                 FenceValue++;
             }
 
             ID3D12Fence* pFence;
+            ResidencyBackend* pBackend;
             UINT64 FenceValue;
             LIST_ENTRY ListEntry;
         };
@@ -434,12 +958,11 @@ namespace D3DX12Residency
         {
             QueueSyncPoint() : pFence(nullptr), LastUsedValue(0) {};
 
-            inline bool IsCompleted() { return LastUsedValue <= pFence->pFence->GetCompletedValue(); }
+            inline bool IsCompleted() { return LastUsedValue <= pFence->GetCompletedValue(); }
 
-            inline void WaitForCompletion(HANDLE Event)
+            inline void WaitForCompletion()
             {
-                RESIDENCY_CHECK_RESULT(pFence->pFence->SetEventOnCompletion(LastUsedValue, Event));
-                RESIDENCY_CHECK_RESULT(WaitForSingleObject(Event, INFINITE));
+                RESIDENCY_CHECK_RESULT(pFence->CPUWait(LastUsedValue));
             }
 
             Fence* pFence;
@@ -449,13 +972,13 @@ namespace D3DX12Residency
         struct DeviceWideSyncPoint
         {
             DeviceWideSyncPoint(UINT32 NumQueues, UINT64 Generation) :
-                GenerationID(Generation), NumQueueSyncPoints(NumQueues) {};
+                GenerationID(Generation), NumQueueSyncPoints(NumQueues), MaxQueueSyncPoints(NumQueues) {};
 
             // Create the whole structure in one allocation for locality
             static DeviceWideSyncPoint* CreateSyncPoint(UINT32 NumQueues, UINT64 Generation)
             {
                 DeviceWideSyncPoint* pSyncPoint = nullptr;
-                const SIZE_T Size = sizeof(DeviceWideSyncPoint) + (sizeof(QueueSyncPoint) * (NumQueues - 1));
+                const SIZE_T Size = sizeof(DeviceWideSyncPoint) + (sizeof(QueueSyncPoint) * (RESIDENCY_MAX(NumQueues, 1u) - 1));
 
                 BYTE* pAlloc = new BYTE[Size];
                 if (pAlloc && Size >= sizeof(DeviceWideSyncPoint))
@@ -466,6 +989,24 @@ namespace D3DX12Residency
                 return pSyncPoint;
             }
 
+            static void DestroySyncPoint(DeviceWideSyncPoint* pSyncPoint)
+            {
+                pSyncPoint->~DeviceWideSyncPoint();
+                delete[](reinterpret_cast<BYTE*>(pSyncPoint));
+            }
+
+            // Completed sync points are reused for later ones while they have room for every queue
+            bool Reuse(UINT32 NumQueues, UINT64 Generation)
+            {
+                if (NumQueues > MaxQueueSyncPoints)
+                {
+                    return false;
+                }
+                GenerationID = Generation;
+                NumQueueSyncPoints = NumQueues;
+                return true;
+            }
+
             // A device wide fence is completed if all of the queues that were active at that point are completed
             inline bool IsCompleted()
             {
@@ -479,38 +1020,283 @@ namespace D3DX12Residency
                 return true;
             }
 
-            inline void WaitForCompletion(HANDLE Event)
+            inline void WaitForCompletion()
             {
                 for (UINT32 i = 0; i < NumQueueSyncPoints; i++)
                 {
                     if (pQueueSyncPoints[i].IsCompleted() == false)
                     {
-                        pQueueSyncPoints[i].WaitForCompletion(Event);
+                        pQueueSyncPoints[i].WaitForCompletion();
                     }
                 }
             }
 
-            const UINT64 GenerationID;
-            const UINT32 NumQueueSyncPoints;
+            UINT64 GenerationID;
+            UINT32 NumQueueSyncPoints;
+            UINT32 MaxQueueSyncPoints;
             LIST_ENTRY ListEntry;
             // NumQueueSyncPoints QueueSyncPoints will be placed below here
             QueueSyncPoint pQueueSyncPoints[1];
         };
 
+        // Picks the objects to evict when the budget is exceeded. The cache tells the policy which
+        // objects are resident and when they are used; the policy only ever offers objects whose
+        // last use is no later than the sync point the trim may evict up to.
+        class EvictionPolicy
+        {
+        public:
+            virtual ~EvictionPolicy() {}
+
+            // The object became resident, or was tracked while resident
+            virtual void Inserted(ManagedObject* pObject) = 0;
+            // The object was evicted, or stopped being tracked while resident
+            virtual void Removed(ManagedObject* pObject) = 0;
+            virtual void Referenced(ManagedObject* pObject) = 0;
+
+            // pResidentList is in order of last use, oldest first. A trim calls BeginTrim once and
+            // evicts what NextVictim returns until it is under budget or NextVictim returns nullptr.
+            virtual void BeginTrim(LIST_ENTRY* pResidentList, UINT64 SyncPoint) {}
+            virtual ManagedObject* NextVictim(LIST_ENTRY* pResidentList, UINT64 SyncPoint) = 0;
+        };
+
+        class LRUPolicy : public EvictionPolicy
+        {
+        public:
+            virtual void Inserted(ManagedObject* pObject) override {}
+            virtual void Removed(ManagedObject* pObject) override {}
+            virtual void Referenced(ManagedObject* pObject) override {}
+
+            virtual ManagedObject* NextVictim(LIST_ENTRY* pResidentList, UINT64 SyncPoint) override
+            {
+                if (IsListEmpty(pResidentList))
+                {
+                    return nullptr;
+                }
+
+                ManagedObject* pObject = CONTAINING_RECORD(pResidentList->Flink, ManagedObject, ListEntry);
+                return pObject->LastGPUSyncPoint <= SyncPoint ? pObject : nullptr;
+            }
+        };
+
+        // Second chance: resident objects sit in a ring in the order they became resident. The hand
+        // passes over objects used since it last came by, clearing their flag, and evicts the first
+        // one that wasn't. Unlike LRU an object used once in a burst is evicted ahead of one used
+        // steadily.
+        class ClockPolicy : public EvictionPolicy
+        {
+        public:
+            ClockPolicy() :
+                NumObjects(0)
+            {
+                InitializeListHead(&Ring);
+            }
+
+            virtual void Inserted(ManagedObject* pObject) override
+            {
+                // Behind the hand, so a newly resident object gets a full turn
+                pObject->RecentlyUsed = true;
+                InsertTailList(&Ring, &pObject->PolicyListEntry);
+                NumObjects++;
+            }
+
+            virtual void Removed(ManagedObject* pObject) override
+            {
+                RemoveEntryList(&pObject->PolicyListEntry);
+                NumObjects--;
+            }
+
+            virtual void Referenced(ManagedObject* pObject) override
+            {
+                pObject->RecentlyUsed = true;
+            }
+
+            virtual ManagedObject* NextVictim(LIST_ENTRY* pResidentList, UINT64 SyncPoint) override
+            {
+                // Two turns clear every flag, after that only objects the GPU still uses are left
+                for (UINT32 Step = 0; Step < NumObjects * 2; Step++)
+                {
+                    LIST_ENTRY* pEntry = RemoveHeadList(&Ring);
+                    InsertTailList(&Ring, pEntry);
+
+                    ManagedObject* pObject = CONTAINING_RECORD(pEntry, ManagedObject, PolicyListEntry);
+                    if (pObject->RecentlyUsed)
+                    {
+                        pObject->RecentlyUsed = false;
+                    }
+                    else if (pObject->LastGPUSyncPoint <= SyncPoint)
+                    {
+                        return pObject;
+                    }
+                }
+                return nullptr;
+            }
+
+        private:
+            LIST_ENTRY Ring;
+            UINT32 NumObjects;
+        };
+
+        // Greedy-Dual-Size-Frequency. An object's priority is the inflation value at its last use plus
+        // its use count weighted by the cost of paging it back in per byte. The cheapest object is
+        // evicted first and the inflation value rises to its priority, which ages everything that
+        // wasn't used since.
+        class GDSFPolicy : public EvictionPolicy
+        {
+        public:
+            GDSFPolicy() :
+                Inflation(0.0),
+                NumCandidates(0)
+            {
+            }
+
+            virtual void Inserted(ManagedObject* pObject) override
+            {
+                UpdatePriority(pObject);
+            }
+
+            virtual void Removed(ManagedObject* pObject) override {}
+
+            virtual void Referenced(ManagedObject* pObject) override
+            {
+                UpdatePriority(pObject);
+            }
+
+            virtual void BeginTrim(LIST_ENTRY* pResidentList, UINT64 SyncPoint) override
+            {
+                // Objects are moved to the back of the resident list when used, so the ones the trim
+                // may evict are at its front
+                NumCandidates = 0;
+                UINT32 NumEvictable = 0;
+                for (LIST_ENTRY* pEntry = pResidentList->Flink; pEntry != pResidentList; pEntry = pEntry->Flink)
+                {
+                    if (CONTAINING_RECORD(pEntry, ManagedObject, ListEntry)->LastGPUSyncPoint > SyncPoint)
+                    {
+                        break;
+                    }
+                    NumEvictable++;
+                }
+
+                // Without room for the heap nothing is offered, the trim ends as if every object were in use
+                if (Candidates.Reserve(NumEvictable) == false)
+                {
+                    return;
+                }
+
+                LIST_ENTRY* pEntry = pResidentList->Flink;
+                while (NumCandidates < NumEvictable)
+                {
+                    Candidates.pData[NumCandidates++] = CONTAINING_RECORD(pEntry, ManagedObject, ListEntry);
+                    pEntry = pEntry->Flink;
+                }
+
+                // Build a min-heap on priority
+                for (UINT32 i = NumCandidates / 2; i > 0; i--)
+                {
+                    SiftDown(i - 1);
+                }
+            }
+
+            virtual ManagedObject* NextVictim(LIST_ENTRY* pResidentList, UINT64 SyncPoint) override
+            {
+                if (NumCandidates == 0)
+                {
+                    return nullptr;
+                }
+
+                ManagedObject** pCandidates = Candidates.pData;
+                ManagedObject* pObject = pCandidates[0];
+                pCandidates[0] = pCandidates[--NumCandidates];
+                SiftDown(0);
+
+                Inflation = RESIDENCY_MAX(Inflation, pObject->EvictionPriority);
+                return pObject;
+            }
+
+        private:
+            // Making an object resident costs about as much as paging this many bytes, however small it is
+            static const UINT64 cPagingCallCost = 1024 * 1024;
+
+            void UpdatePriority(ManagedObject* pObject)
+            {
+                const double CostPerByte = double(cPagingCallCost + pObject->Size) / double(RESIDENCY_MAX(pObject->Size, 1ull));
+                pObject->EvictionPriority = Inflation + pObject->UseCount * CostPerByte;
+            }
+
+            void SiftDown(UINT32 Index)
+            {
+                ManagedObject** pCandidates = Candidates.pData;
+                while (true)
+                {
+                    const UINT32 Left = Index * 2 + 1;
+                    const UINT32 Right = Left + 1;
+
+                    UINT32 Smallest = Index;
+                    if (Left < NumCandidates && pCandidates[Left]->EvictionPriority < pCandidates[Smallest]->EvictionPriority)
+                    {
+                        Smallest = Left;
+                    }
+                    if (Right < NumCandidates && pCandidates[Right]->EvictionPriority < pCandidates[Smallest]->EvictionPriority)
+                    {
+                        Smallest = Right;
+                    }
+                    if (Smallest == Index)
+                    {
+                        return;
+                    }
+
+                    ManagedObject* pTemp = pCandidates[Index];
+                    pCandidates[Index] = pCandidates[Smallest];
+                    pCandidates[Smallest] = pTemp;
+                    Index = Smallest;
+                }
+            }
+
+            double Inflation;
+
+            // Heap of the objects the current trim may evict, kept between trims to avoid reallocating
+            Internal::ScratchBuffer<ManagedObject*> Candidates;
+            UINT32 NumCandidates;
+        };
+
         // A Least Recently Used Cache. Tracks all of the objects requested by the app so that objects
-        // that aren't used freqently can get evicted to help the app stay under buget.
+        // that aren't used freqently can get evicted to help the app stay under buget. The resident
+        // objects are kept in order of last use; which of them are evicted under pressure is up to
+        // the eviction policy.
         class LRUCache
         {
         public:
             LRUCache() :
                 NumResidentObjects(0),
                 NumEvictedObjects(0),
-                ResidentSize(0)
+                ResidentSize(0),
+                NumReferences(0),
+                pPolicy(&LRUEviction)
             {
                 Internal::InitializeListHead(&ResidentObjectListHead);
                 Internal::InitializeListHead(&EvictedObjectListHead);
+                ZeroMemory(&Statistics, sizeof(Statistics));
             };
 
+            // Must be called before any object is inserted
+            void SetPolicy(EVICTION_POLICY Policy)
+            {
+                RESIDENCY_CHECK(NumResidentObjects == 0 && NumEvictedObjects == 0);
+
+                Statistics.Policy = Policy;
+                switch (Policy)
+                {
+                case EVICTION_POLICY::CLOCK:
+                    pPolicy = &ClockEviction;
+                    break;
+                case EVICTION_POLICY::GDSF:
+                    pPolicy = &GDSFEviction;
+                    break;
+                default:
+                    pPolicy = &LRUEviction;
+                    break;
+                }
+            }
+
             void Insert(ManagedObject* pObject)
             {
                 if (pObject->ResidencyStatus == ManagedObject::RESIDENCY_STATUS::RESIDENT)
@@ -518,6 +1304,7 @@ namespace D3DX12Residency
                     Internal::InsertHeadList(&ResidentObjectListHead, &pObject->ListEntry);
                     NumResidentObjects++;
                     ResidentSize += pObject->Size;
+                    pPolicy->Inserted(pObject);
                 }
                 else
                 {
@@ -533,6 +1320,7 @@ namespace D3DX12Residency
                 {
                     NumResidentObjects--;
                     ResidentSize -= pObject->Size;
+                    pPolicy->Removed(pObject);
                 }
                 else
                 {
@@ -549,6 +1337,10 @@ namespace D3DX12Residency
 
                 Internal::RemoveEntryList(&pObject->ListEntry);
                 Internal::InsertTailList(&ResidentObjectListHead, &pObject->ListEntry);
+
+                pObject->UseCount++;
+                pPolicy->Referenced(pObject);
+                NumReferences++;
             }
 
             void MakeResident(ManagedObject* pObject)
@@ -562,6 +1354,10 @@ namespace D3DX12Residency
                 NumEvictedObjects--;
                 NumResidentObjects++;
                 ResidentSize += pObject->Size;
+                pPolicy->Inserted(pObject);
+
+                Statistics.Misses++;
+                Statistics.BytesMadeResident += pObject->Size;
             }
 
             void Evict(ManagedObject* pObject)
@@ -575,6 +1371,10 @@ namespace D3DX12Residency
                 NumResidentObjects--;
                 ResidentSize -= pObject->Size;
                 NumEvictedObjects++;
+                pPolicy->Removed(pObject);
+
+                Statistics.BytesEvicted += pObject->Size;
+                Statistics.ObjectsEvicted++;
             }
 
             // Evict all of the resident objects used in sync points up to the specficied one (inclusive)
@@ -582,12 +1382,11 @@ namespace D3DX12Residency
             {
                 NumObjectsToEvict = 0;
 
-                LIST_ENTRY* pResourceEntry = ResidentObjectListHead.Flink;
-                while (pResourceEntry != &ResidentObjectListHead)
+                pPolicy->BeginTrim(&ResidentObjectListHead, SyncPoint);
+                while (CurrentUsage >= CurrentBudget)
                 {
-                    ManagedObject* pObject = CONTAINING_RECORD(pResourceEntry, ManagedObject, ListEntry);
-
-                    if (pObject->LastGPUSyncPoint > SyncPoint || CurrentUsage < CurrentBudget)
+                    ManagedObject* pObject = pPolicy->NextVictim(&ResidentObjectListHead, SyncPoint);
+                    if (pObject == nullptr)
                     {
                         break;
                     }
@@ -598,8 +1397,6 @@ namespace D3DX12Residency
                     Evict(pObject);
 
                     CurrentUsage -= pObject->Size;
-
-                    pResourceEntry = ResidentObjectListHead.Flink;
                 }
             }
 
@@ -641,24 +1438,35 @@ namespace D3DX12Residency
             UINT32 NumEvictedObjects;
 
             UINT64 ResidentSize;
+
+            void GetStatistics(ResidencyStatistics* pStatistics)
+            {
+                *pStatistics = Statistics;
+                // Every object made resident is referenced right after
+                pStatistics->Hits = NumReferences - Statistics.Misses;
+            }
+
+        private:
+            ResidencyStatistics Statistics;
+            UINT64 NumReferences;
+
+            EvictionPolicy* pPolicy;
+            LRUPolicy LRUEviction;
+            ClockPolicy ClockEviction;
+            GDSFPolicy GDSFEviction;
         };
 
         class ResidencyManagerInternal
         {
         public:
             ResidencyManagerInternal(SyncManager* pSyncManagerIn) :
-                Device(nullptr),
+                Backend(nullptr),
                 AsyncThreadFence(1),
-                CompletionEvent(INVALID_HANDLE_VALUE),
-                AsyncThreadWorkCompletionEvent(INVALID_HANDLE_VALUE),
-                Adapter(nullptr),
-                AsyncWorkEvent(INVALID_HANDLE_VALUE),
-                AsyncWorkThread(INVALID_HANDLE_VALUE),
                 FinishAsyncWork(false),
+                AsyncPagingResult(S_OK),
                 cStartEvicted(false),
                 CurrentSyncPointGeneration(0),
                 NumQueuesSeen(0),
-                NodeIndex(0),
                 CurrentAsyncWorkloadHead(0),
                 CurrentAsyncWorkloadTail(0),
                 cMinEvictionGracePeriod(1.0f),
@@ -671,17 +1479,25 @@ namespace D3DX12Residency
             {
                 Internal::InitializeListHead(&QueueFencesListHead);
                 Internal::InitializeListHead(&InFlightSyncPointsHead);
+                Internal::InitializeListHead(&FreeSyncPointsHead);
 
-                ResidencyManagerUniqueID = InterlockedIncrement64(&g_ResidencyManagerUniqueID);
+                ResidencyManagerUniqueID = Internal::GenerateResidencyManagerUniqueID();
             };
 
+#if RESIDENCY_D3D12_BACKEND
             // NOTE: DeviceNodeIndex is an index not a mask. The majority of D3D12 uses bit masks to identify a GPU node whereas DXGI uses 0 based indices.
-            HRESULT Initialize(ID3D12Device* ParentDevice, UINT DeviceNodeIndex, IDXGIAdapter3* ParentAdapter, UINT32 MaxLatency)
+            HRESULT Initialize(ID3D12Device* ParentDevice, UINT DeviceNodeIndex, IDXGIAdapter3* ParentAdapter, UINT32 MaxLatency, EVICTION_POLICY Policy)
+            {
+                D3D12Backend.Initialize(ParentDevice, DeviceNodeIndex, ParentAdapter);
+                return Initialize(&D3D12Backend, MaxLatency, Policy);
+            }
+#endif
+
+            HRESULT Initialize(ResidencyBackend* pBackend, UINT32 MaxLatency, EVICTION_POLICY Policy)
             {
-                Device = ParentDevice;
-                NodeIndex = DeviceNodeIndex;
-                Adapter = ParentAdapter;
+                Backend = pBackend;
                 MaxSoftwareQueueLatency = MaxLatency;
+                LRU.SetPolicy(Policy);
 
                 AsyncWorkQueueSize = MaxLatency + 1;
                 AsyncWorkQueue = new AsyncWorkload[AsyncWorkQueueSize];
@@ -691,52 +1507,29 @@ namespace D3DX12Residency
                     return E_OUTOFMEMORY;
                 }
 
-                LARGE_INTEGER Frequency;
-                QueryPerformanceFrequency(&Frequency);
+                const UINT64 Frequency = Backend->GetTimestampFrequency();
 
-                // Calculate how many QPC ticks are equivalent to the given time in seconds
-                MinEvictionGracePeriodTicks = UINT64(Frequency.QuadPart * cMinEvictionGracePeriod);
-                MaxEvictionGracePeriodTicks = UINT64(Frequency.QuadPart * cMaxEvictionGracePeriod);
+                // Calculate how many timestamp ticks are equivalent to the given time in seconds
+                MinEvictionGracePeriodTicks = UINT64(Frequency * cMinEvictionGracePeriod);
+                MaxEvictionGracePeriodTicks = UINT64(Frequency * cMaxEvictionGracePeriod);
 
                 HRESULT hr = S_OK;
-                hr = AsyncThreadFence.Initialize(Device);
-
-                if (SUCCEEDED(hr))
-                {
-                    CompletionEvent = CreateEvent(nullptr, false, false, nullptr);
-                    if (CompletionEvent == INVALID_HANDLE_VALUE)
-                    {
-                        hr = HRESULT_FROM_WIN32(GetLastError());
-                    }
-                }
+                hr = AsyncThreadFence.Initialize(Backend);
 
                 if (SUCCEEDED(hr))
                 {
-                    AsyncThreadWorkCompletionEvent = CreateEvent(nullptr, false, false, nullptr);
-                    if (AsyncThreadWorkCompletionEvent == INVALID_HANDLE_VALUE)
-                    {
-                        hr = HRESULT_FROM_WIN32(GetLastError());
-                    }
+                    hr = AsyncThreadWorkCompletionEvent.Create(false);
                 }
 
                 if (SUCCEEDED(hr))
                 {
-                    AsyncWorkEvent = CreateEvent(nullptr, true, false, nullptr);
-                    if (AsyncWorkEvent == INVALID_HANDLE_VALUE)
-                    {
-                        hr = HRESULT_FROM_WIN32(GetLastError());
-                    }
+                    hr = AsyncWorkEvent.Create(true);
                 }
 
 #if !RESIDENCY_SINGLE_THREADED
                 if (SUCCEEDED(hr))
                 {
-                    AsyncWorkThread = CreateThread(nullptr, 0, AsyncThreadStart, (void*) this, 0, nullptr);
-
-                    if (AsyncWorkThread == INVALID_HANDLE_VALUE)
-                    {
-                        hr = HRESULT_FROM_WIN32(GetLastError());
-                    }
+                    hr = AsyncWorkThread.Start(AsyncThreadStart, (void*) this);
                 }
 #endif
 
@@ -745,14 +1538,6 @@ namespace D3DX12Residency
 
             void Destroy()
             {
-                AsyncThreadFence.Destroy();
-
-                if (CompletionEvent != INVALID_HANDLE_VALUE)
-                {
-                    CloseHandle(CompletionEvent);
-                    CompletionEvent = INVALID_HANDLE_VALUE;
-                }
-
 #if !RESIDENCY_SINGLE_THREADED
                 AsyncWorkload* pWork = DequeueAsyncWork();
 
@@ -762,33 +1547,37 @@ namespace D3DX12Residency
                 }
 
                 FinishAsyncWork = true;
-                if (SetEvent(AsyncWorkEvent) == false)
+                if (AsyncWorkEvent.IsCreated())
                 {
-                    RESIDENCY_CHECK_RESULT(HRESULT_FROM_WIN32(GetLastError()));
+                    RESIDENCY_CHECK_RESULT(AsyncWorkEvent.Set());
                 }
 
                 // Make sure the async worker thread is finished to prevent dereferencing
                 // dangling pointers to ResidencyManagerInternal
-                WaitForSingleObject(AsyncWorkThread, INFINITE);
-                if (AsyncWorkThread != INVALID_HANDLE_VALUE)
-                {
-                    CloseHandle(AsyncWorkThread);
-                    AsyncWorkThread = INVALID_HANDLE_VALUE;
-                }
+                AsyncWorkThread.Join();
+#endif
+
+                // The worker may signal this fence until it has exited
+                AsyncThreadFence.Destroy();
 
-                if (AsyncWorkEvent != INVALID_HANDLE_VALUE)
+                AsyncWorkEvent.Destroy();
+
+                delete[](AsyncWorkQueue);
+                AsyncWorkQueue = nullptr;
+
+                while (Internal::IsListEmpty(&InFlightSyncPointsHead) == false)
                 {
-                    CloseHandle(AsyncWorkEvent);
-                    AsyncWorkEvent = INVALID_HANDLE_VALUE;
+                    Internal::DeviceWideSyncPoint::DestroySyncPoint(
+                        CONTAINING_RECORD(Internal::RemoveHeadList(&InFlightSyncPointsHead), Internal::DeviceWideSyncPoint, ListEntry));
                 }
-#endif
-
-                if (AsyncThreadWorkCompletionEvent != INVALID_HANDLE_VALUE)
+                while (Internal::IsListEmpty(&FreeSyncPointsHead) == false)
                 {
-                    CloseHandle(AsyncThreadWorkCompletionEvent);
-                    AsyncThreadWorkCompletionEvent = INVALID_HANDLE_VALUE;
+                    Internal::DeviceWideSyncPoint::DestroySyncPoint(
+                        CONTAINING_RECORD(Internal::RemoveHeadList(&FreeSyncPointsHead), Internal::DeviceWideSyncPoint, ListEntry));
                 }
 
+                AsyncThreadWorkCompletionEvent.Destroy();
+
                 while (Internal::IsListEmpty(&QueueFencesListHead) == false)
                 {
                     Internal::Fence* pObject =
@@ -810,7 +1599,7 @@ namespace D3DX12Residency
                     if (cStartEvicted)
                     {
                         pObject->ResidencyStatus = ManagedObject::RESIDENCY_STATUS::EVICTED;
-                        RESIDENCY_CHECK_RESULT(Device->Evict(1, &pObject->pUnderlying));
+                        RESIDENCY_CHECK_RESULT(Backend->Evict(1, &pObject->pUnderlying));
                     }
 
                     LRU.Insert(pObject);
@@ -824,12 +1613,24 @@ namespace D3DX12Residency
                 LRU.Remove(pObject);
             }
 
-            // One residency set per command-list
+            // One residency set per command-list. Paging that failed on the worker thread after an
+            // earlier call returned is reported by the next call, which executes nothing.
             HRESULT ExecuteCommandLists(ID3D12CommandQueue* Queue, ID3D12CommandList** CommandLists, ResidencySet** ResidencySets, UINT32 Count)
             {
+                const HRESULT PagingResult = AsyncPagingResult.exchange(S_OK);
+                if (FAILED(PagingResult))
+                {
+                    return PagingResult;
+                }
                 return ExecuteSubset(Queue, CommandLists, ResidencySets, Count);
             }
 
+            void GetStatistics(ResidencyStatistics* pStatistics)
+            {
+                Internal::ScopedLock Lock(&Mutex);
+                LRU.GetStatistics(pStatistics);
+            }
+
             HRESULT GetCurrentGPUSyncPoint(ID3D12CommandQueue* Queue, UINT64 *pGPUSyncPoint)
             {
                 Internal::Fence* QueueFence = nullptr;
@@ -867,19 +1668,19 @@ namespace D3DX12Residency
                 // Find or create the fence for this queue
                 {
                     UINT32 Size = sizeof(CommandQueuePrivateData);
-                    hr = Queue->GetPrivateData(FenceGuid, &Size, &CommandQueuePrivateData);
+                    hr = Backend->GetQueuePrivateData(Queue, FenceGuid, &Size, &CommandQueuePrivateData);
                     if (FAILED(hr) || ResidencyManagerUniqueID != CommandQueuePrivateData.ResidencyManagerUniqueID)
                     {
                         QueueFence = new Internal::Fence(1);
-                        hr = QueueFence->Initialize(Device);
+                        hr = QueueFence->Initialize(Backend);
                         Internal::InsertTailList(&QueueFencesListHead, &QueueFence->ListEntry);
 
-                        InterlockedIncrement(&NumQueuesSeen);
+                        NumQueuesSeen++;
 
                         if (SUCCEEDED(hr))
                         {
                             CommandQueuePrivateData = { QueueFence, ResidencyManagerUniqueID };
-                            hr = Queue->SetPrivateData(FenceGuid, UINT32(sizeof(CommandQueuePrivateData)), &CommandQueuePrivateData);
+                            hr = Backend->SetQueuePrivateData(Queue, FenceGuid, UINT32(sizeof(CommandQueuePrivateData)), &CommandQueuePrivateData);
                             RESIDENCY_CHECK_RESULT(hr);
                         }
                     }
@@ -934,19 +1735,26 @@ namespace D3DX12Residency
                     }
                 }
 
-                // Create a set to gather up all unique resources required by this call
-                ResidencySet* pMasterSet = new ResidencySet();
-                if (pMasterSet == nullptr || pMasterSet->Initialize(pSyncManager, MaxObjectsReferenced) == false)
+                // Gather up all unique resources required by this call into this thread's scratch buffer.
+                // Duplicates are found with a command list slot of our own, so threads submitting at the
+                // same time never wait on each other here.
+                Internal::ScratchBuffer<ManagedObject*>& MergedObjects = GetMergeScratch();
+                if (MergedObjects.Reserve(MaxObjectsReferenced) == false)
                 {
                     return E_OUTOFMEMORY;
                 }
 
-                hr = pMasterSet->Open();
-                if (FAILED(hr))
+                UINT32 MergeSlot;
+                if (pSyncManager->AcquireCommandListSlot(MergeSlot) == false)
                 {
-                    return hr;
+                    // There are too many open residency sets, consider using less or increasing the value of MAX_NUM_CONCURRENT_CMD_LISTS
+                    RESIDENCY_CHECK(false);
+                    return E_OUTOFMEMORY;
                 }
 
+                const UINT32 MergeBit = 1u << MergeSlot;
+                UINT32 NumObjects = 0;
+
                 // For each residency set
                 for (UINT32 i = 0; i < Count; i++)
                 {
@@ -955,32 +1763,34 @@ namespace D3DX12Residency
                         // For each object in this set
                         for (INT32 x = 0; x < ResidencySets[i]->CurrentSetSize; x++)
                         {
-                            if (pMasterSet->Insert(ResidencySets[i]->ppSet[x]))
+                            ManagedObject* pObject = ResidencySets[i]->ppSet[x];
+                            if ((pObject->CommandListsUsedOn.load(std::memory_order_relaxed) & MergeBit) == 0)
                             {
-                                TotalSizeNeeded += ResidencySets[i]->ppSet[x]->Size;
+                                pObject->CommandListsUsedOn.fetch_or(MergeBit);
+                                MergedObjects.pData[NumObjects++] = pObject;
+                                TotalSizeNeeded += pObject->Size;
                             }
                         }
                     }
                 }
-                // Close this set to free it's slot up for the app
-                hr = pMasterSet->Close();
-                if (FAILED(hr))
+
+                // Free the slot up for the app
+                for (UINT32 i = 0; i < NumObjects; i++)
                 {
-                    return hr;
+                    MergedObjects.pData[i]->CommandListsUsedOn.fetch_and(~MergeBit);
                 }
+                pSyncManager->ReleaseCommandListSlot(MergeSlot);
 
                 // This set of commandlists can't possibly fit within the budget, they need to be split up. If the number of command lists is 1 there is
                 // nothing we can do
                 if (Count > 1 && TotalSizeNeeded > LocalMemory.Budget + NonLocalMemory.Budget)
                 {
-                    delete(pMasterSet);
-
                     // Recursively try to find a small enough set to fit in memory
                     const UINT32 Half = Count / 2;
                     const HRESULT LowerHR = ExecuteSubset(Queue, CommandLists, ResidencySets, Half);
                     const HRESULT UpperHR = ExecuteSubset(Queue, &CommandLists[Half], &ResidencySets[Half], Count - Half);
 
-                    return (LowerHR == S_OK && UpperHR == S_OK) ? S_OK : E_FAIL;
+                    return FAILED(LowerHR) ? LowerHR : UpperHR;
                 }
 
 
@@ -994,10 +1804,12 @@ namespace D3DX12Residency
                     Internal::ScopedLock Lock(&ExecutionCS);
                     // Evict or make resident all of the objects we identified above.
                     // This will run on an async thread, allowing the current to continue while still blocking the GPU if required
-                    hr = EnqueueAsyncWork(pMasterSet, AsyncThreadFence.FenceValue, CurrentSyncPointGeneration);
+                    hr = EnqueueAsyncWork(MergedObjects.pData, NumObjects, AsyncThreadFence.FenceValue, CurrentSyncPointGeneration);
 #if RESIDENCY_SINGLE_THREADED
-                    AsyncWorkload* pWorkload = DequeueAsyncWork();
-                    ProcessPagingWork(pWorkload);
+                    if (SUCCEEDED(hr))
+                    {
+                        hr = ProcessPagingWork(DequeueAsyncWork());
+                    }
 #endif
 
                     // If there are some things that need to be made resident we need to make sure that the GPU
@@ -1008,28 +1820,37 @@ namespace D3DX12Residency
                         AsyncThreadFence.Increment();
                     }
 
-                    Queue->ExecuteCommandLists(Count, CommandLists);
-
+                    // The lists may use heaps that were never paged in, so they must not run
                     if (SUCCEEDED(hr))
                     {
+                        Backend->ExecuteCommandLists(Queue, Count, CommandLists);
                         hr = SignalFence(Queue, QueueFence);
                     }
                 }
                 return hr;
             }
 
+            // Each thread that submits merges its residency sets here, and keeps the buffer for next time
+            static Internal::ScratchBuffer<ManagedObject*>& GetMergeScratch()
+            {
+                static thread_local Internal::ScratchBuffer<ManagedObject*> MergedObjects;
+                return MergedObjects;
+            }
+
             struct AsyncWorkload
             {
                 AsyncWorkload() :
-                    pMasterSet(nullptr),
+                    NumObjects(0),
                     FenceValueToSignal(0),
                     SyncPointGeneration(0)
                 {}
 
                 UINT64 SyncPointGeneration;
 
-                // List of objects to make resident
-                ResidencySet* pMasterSet;
+                // The unique objects used by the command lists. The storage stays with the queue entry
+                // and is reused by later workloads.
+                Internal::ScratchBuffer<ManagedObject*> Objects;
+                UINT32 NumObjects;
 
                 // The GPU will wait on this value so that it doesn't execute until the objects are made resident
                 UINT64 FenceValueToSignal;
@@ -1038,14 +1859,17 @@ namespace D3DX12Residency
             SIZE_T AsyncWorkQueueSize;
             AsyncWorkload* AsyncWorkQueue;
 
-            HANDLE AsyncWorkEvent;
-            HANDLE AsyncWorkThread;
+            Internal::Event AsyncWorkEvent;
+            Internal::Thread AsyncWorkThread;
             Internal::CriticalSection AsyncWorkMutex;
-            volatile bool FinishAsyncWork;
-            volatile SIZE_T CurrentAsyncWorkloadHead;
-            volatile SIZE_T CurrentAsyncWorkloadTail;
-
-            static unsigned long WINAPI AsyncThreadStart(void* pData)
+            std::atomic<bool> FinishAsyncWork;
+            // The first paging failure on the worker thread, until ExecuteCommandLists reports it
+            std::atomic<HRESULT> AsyncPagingResult;
+            // Written by one thread and read by the other, the workload must be visible before the tail moves
+            std::atomic<SIZE_T> CurrentAsyncWorkloadHead;
+            std::atomic<SIZE_T> CurrentAsyncWorkloadTail;
+
+            static void AsyncThreadStart(void* pData)
             {
                 ResidencyManagerInternal* pManager = (ResidencyManagerInternal*)pData;
 
@@ -1056,45 +1880,35 @@ namespace D3DX12Residency
                     while (pWork)
                     {
                         // Submit the work
-                        pManager->ProcessPagingWork(pWork);
-                        if (SetEvent(pManager->AsyncThreadWorkCompletionEvent) == false)
+                        const HRESULT hr = pManager->ProcessPagingWork(pWork);
+                        if (FAILED(hr))
                         {
-                            RESIDENCY_CHECK_RESULT(HRESULT_FROM_WIN32(GetLastError()));
+                            HRESULT Expected = S_OK;
+                            pManager->AsyncPagingResult.compare_exchange_strong(Expected, hr);
                         }
+                        RESIDENCY_CHECK_RESULT(pManager->AsyncThreadWorkCompletionEvent.Set());
 
                         // Get more work
                         pWork = pManager->DequeueAsyncWork();
                     }
 
                     //Wait until there is more work do be done
-                    WaitForSingleObject(pManager->AsyncWorkEvent, INFINITE);
-                    if (ResetEvent(pManager->AsyncWorkEvent) == false)
-                    {
-                        RESIDENCY_CHECK_RESULT(HRESULT_FROM_WIN32(GetLastError()));
-                    }
+                    pManager->AsyncWorkEvent.Wait();
+                    RESIDENCY_CHECK_RESULT(pManager->AsyncWorkEvent.Reset());
 
                     if (pManager->FinishAsyncWork)
                     {
-                        return 0;
+                        return;
                     }
                 }
-
-                return 0;
             }
 
             // This will be run from a worker thread and will emulate a software queue for making gpu resources resident or evicted.
             // The GPU will be synchronized by this queue to ensure that it never executes using an evicted resource.
-            void ProcessPagingWork(AsyncWorkload* pWork)
+            HRESULT ProcessPagingWork(AsyncWorkload* pWork)
             {
                 Internal::DeviceWideSyncPoint* FirstUncompletedSyncPoint = DequeueCompletedSyncPoints();
 
-                // Use a union so that we only need 1 allocation
-                union ResidentScratchSpace
-                {
-                    ManagedObject* pManagedObject;
-                    ID3D12Pageable* pUnderlying;
-                };
-
                 ResidentScratchSpace* pMakeResidentList = nullptr;
                 UINT32 NumObjectsToMakeResident = 0;
 
@@ -1104,20 +1918,28 @@ namespace D3DX12Residency
                 // the size of all the objects which will need to be made resident in order to execute this set.
                 UINT64 SizeToMakeResident = 0;
 
-                LARGE_INTEGER CurrentTime;
-                QueryPerformanceCounter(&CurrentTime);
+                const UINT64 CurrentTime = Backend->GetTimestamp();
 
                 {
                     // A lock must be taken here as the state of the objects will be altered
                     Internal::ScopedLock Lock(&Mutex);
 
-                    pMakeResidentList = new ResidentScratchSpace[pWork->pMasterSet->CurrentSetSize];
-                    pEvictionList = new ID3D12Pageable*[LRU.NumResidentObjects];
+                    // Every object of this workload may end up resident, and any resident object may be evicted
+                    if (MakeResidentScratch.Reserve(pWork->NumObjects) == false ||
+                        EvictionScratch.Reserve(LRU.NumResidentObjects + pWork->NumObjects) == false)
+                    {
+                        // Nothing was paged, but the GPU waits on this workload's fence all the same
+                        pWork->NumObjects = 0;
+                        RESIDENCY_CHECK_RESULT(AsyncThreadFence.CPUSignal(pWork->FenceValueToSignal));
+                        return E_OUTOFMEMORY;
+                    }
+                    pMakeResidentList = MakeResidentScratch.pData;
+                    pEvictionList = EvictionScratch.pData;
 
                     // Mark the objects used by this command list to be made resident
-                    for (INT32 i = 0; i < pWork->pMasterSet->CurrentSetSize; i++)
+                    for (UINT32 i = 0; i < pWork->NumObjects; i++)
                     {
-                        ManagedObject*& pObject = pWork->pMasterSet->ppSet[i];
+                        ManagedObject*& pObject = pWork->Objects.pData[i];
                         // If it's evicted we need to make it resident again
                         if (pObject->ResidencyStatus == ManagedObject::RESIDENCY_STATUS::EVICTED)
                         {
@@ -1130,7 +1952,7 @@ namespace D3DX12Residency
                         // Update the last sync point that this was used on
                         pObject->LastGPUSyncPoint = pWork->SyncPointGeneration;
 
-                        pObject->LastUsedTimestamp = CurrentTime.QuadPart;
+                        pObject->LastUsedTimestamp = CurrentTime;
                         LRU.ObjectReferenced(pObject);
                     }
 
@@ -1139,11 +1961,11 @@ namespace D3DX12Residency
                     GetCurrentBudget(&LocalMemory, DXGI_MEMORY_SEGMENT_GROUP_LOCAL);
 
                     UINT64 EvictionGracePeriod = GetCurrentEvictionGracePeriod(&LocalMemory);
-                    LRU.TrimAgedAllocations(FirstUncompletedSyncPoint, pEvictionList, NumObjectsToEvict, CurrentTime.QuadPart, EvictionGracePeriod);
+                    LRU.TrimAgedAllocations(FirstUncompletedSyncPoint, pEvictionList, NumObjectsToEvict, CurrentTime, EvictionGracePeriod);
 
                     if (NumObjectsToEvict)
                     {
-                        RESIDENCY_CHECK_RESULT(Device->Evict(NumObjectsToEvict, pEvictionList));
+                        RESIDENCY_CHECK_RESULT(Backend->Evict(NumObjectsToEvict, pEvictionList));
                         NumObjectsToEvict = 0;
                     }
 
@@ -1191,7 +2013,7 @@ namespace D3DX12Residency
                                     }
                                 }
 
-                                hr = Device->MakeResident(NumObjectsInBatch, &pMakeResidentList[BatchStart].pUnderlying);
+                                hr = Backend->MakeResident(NumObjectsInBatch, &pMakeResidentList[BatchStart].pUnderlying);
                                 if (SUCCEEDED(hr))
                                 {
                                     SizeToMakeResident -= BatchSize;
@@ -1219,7 +2041,7 @@ namespace D3DX12Residency
                                         pMakeResidentList[i].pUnderlying = pMakeResidentList[i].pManagedObject->pUnderlying;
                                     }
 
-                                    hr = Device->MakeResident(NumObjects, &pMakeResidentList[MakeResidentIndex].pUnderlying);
+                                    hr = Backend->MakeResident(NumObjects, &pMakeResidentList[MakeResidentIndex].pUnderlying);
                                     if (FAILED(hr))
                                     {
                                         // TODO: What should we do if this fails? This is a catastrophic failure in which the app is trying to use more memory
@@ -1242,7 +2064,7 @@ namespace D3DX12Residency
 
                                 LRU.TrimToSyncPointInclusive(TotalUsage + INT64(SizeToMakeResident), TotalBudget, pEvictionList, NumObjectsToEvict, GenerationToWaitFor);
 
-                                RESIDENCY_CHECK_RESULT(Device->Evict(NumObjectsToEvict, pEvictionList));
+                                RESIDENCY_CHECK_RESULT(Backend->Evict(NumObjectsToEvict, pEvictionList));
                             }
                             else
                             {
@@ -1252,40 +2074,54 @@ namespace D3DX12Residency
                         }
                     }
 
-                    delete[](pMakeResidentList);
-                    delete[](pEvictionList);
                 }
 
                 // Tell the GPU that it's safe to execute since we made things resident
-                RESIDENCY_CHECK_RESULT(AsyncThreadFence.pFence->Signal(pWork->FenceValueToSignal));
+                RESIDENCY_CHECK_RESULT(AsyncThreadFence.CPUSignal(pWork->FenceValueToSignal));
 
-                delete(pWork->pMasterSet);
-                pWork->pMasterSet = nullptr;
+                pWork->NumObjects = 0;
+                return S_OK;
             }
+
+            // Use a union so that we only need 1 allocation
+            union ResidentScratchSpace
+            {
+                ManagedObject* pManagedObject;
+                ID3D12Pageable* pUnderlying;
+            };
+
+            // Only the thread doing the paging work uses these
+            Internal::ScratchBuffer<ResidentScratchSpace> MakeResidentScratch;
+            Internal::ScratchBuffer<ID3D12Pageable*> EvictionScratch;
+
             // The Enqueue and Dequeue Async Work functions are threadsafe as there is only 1 producer and 1 consumer, if that changes
             // Synchronisation will be required
-            HRESULT EnqueueAsyncWork(ResidencySet* pMasterSet, UINT64 FenceValueToSignal, UINT64 SyncPointGeneration)
+            HRESULT EnqueueAsyncWork(ManagedObject** ppObjects, UINT32 NumObjects, UINT64 FenceValueToSignal, UINT64 SyncPointGeneration)
             {
                 // We can't get too far ahead of the worker thread otherwise huge hitches occur
                 while ((CurrentAsyncWorkloadTail - CurrentAsyncWorkloadHead) >= MaxSoftwareQueueLatency)
                 {
-                    WaitForSingleObject(AsyncThreadWorkCompletionEvent, INFINITE);
+                    AsyncThreadWorkCompletionEvent.Wait();
                 }
 
                 RESIDENCY_CHECK(CurrentAsyncWorkloadTail >= CurrentAsyncWorkloadHead);
 
                 const SIZE_T currentIndex = CurrentAsyncWorkloadTail % AsyncWorkQueueSize;
-                AsyncWorkQueue[currentIndex].pMasterSet = pMasterSet;
+                AsyncWorkload& Work = AsyncWorkQueue[currentIndex];
+                if (Work.Objects.Reserve(NumObjects) == false)
+                {
+                    return E_OUTOFMEMORY;
+                }
+                if (NumObjects)
+                {
+                    memcpy(Work.Objects.pData, ppObjects, NumObjects * sizeof(ManagedObject*));
+                }
+                Work.NumObjects = NumObjects;
                 AsyncWorkQueue[currentIndex].FenceValueToSignal = FenceValueToSignal;
                 AsyncWorkQueue[currentIndex].SyncPointGeneration = SyncPointGeneration;
 
                 CurrentAsyncWorkloadTail++;
-                if (SetEvent(AsyncWorkEvent) == false)
-                {
-                    return HRESULT_FROM_WIN32(GetLastError());
-                }
-
-                return S_OK;
+                return AsyncWorkEvent.Set();
             }
 
             AsyncWorkload* DequeueAsyncWork()
@@ -1304,17 +2140,32 @@ namespace D3DX12Residency
 
             void GetCurrentBudget(DXGI_QUERY_VIDEO_MEMORY_INFO* InfoOut, DXGI_MEMORY_SEGMENT_GROUP Segment)
             {
-                RESIDENCY_CHECK_RESULT(Adapter->QueryVideoMemoryInfo(NodeIndex, Segment, InfoOut));
+                RESIDENCY_CHECK_RESULT(Backend->QueryVideoMemoryInfo(Segment, InfoOut));
             }
 
             HRESULT EnqueueSyncPoint()
             {
                 Internal::ScopedLock Lock(&AsyncWorkMutex);
 
-                Internal::DeviceWideSyncPoint* pPoint = Internal::DeviceWideSyncPoint::CreateSyncPoint(NumQueuesSeen, CurrentSyncPointGeneration);
+                Internal::DeviceWideSyncPoint* pPoint = nullptr;
+                if (Internal::IsListEmpty(&FreeSyncPointsHead) == false)
+                {
+                    pPoint = CONTAINING_RECORD(Internal::RemoveHeadList(&FreeSyncPointsHead), Internal::DeviceWideSyncPoint, ListEntry);
+                    if (pPoint->Reuse(NumQueuesSeen, CurrentSyncPointGeneration) == false)
+                    {
+                        // A queue was added since it was created
+                        Internal::DeviceWideSyncPoint::DestroySyncPoint(pPoint);
+                        pPoint = nullptr;
+                    }
+                }
+
                 if (pPoint == nullptr)
                 {
-                    return E_OUTOFMEMORY;
+                    pPoint = Internal::DeviceWideSyncPoint::CreateSyncPoint(NumQueuesSeen, CurrentSyncPointGeneration);
+                    if (pPoint == nullptr)
+                    {
+                        return E_OUTOFMEMORY;
+                    }
                 }
 
                 UINT32 i = 0;
@@ -1349,7 +2200,7 @@ namespace D3DX12Residency
                     if (pPoint->IsCompleted())
                     {
                         Internal::RemoveHeadList(&InFlightSyncPointsHead);
-                        delete pPoint;
+                        Internal::InsertTailList(&FreeSyncPointsHead, &pPoint->ListEntry);
                     }
                     else
                     {
@@ -1379,13 +2230,13 @@ namespace D3DX12Residency
                     {
                         // Keep popping off until we find the one to wait on
                         Internal::RemoveHeadList(&InFlightSyncPointsHead);
-                        delete(pPoint);
+                        Internal::InsertTailList(&FreeSyncPointsHead, &pPoint->ListEntry);
                     }
                     else
                     {
-                        pPoint->WaitForCompletion(CompletionEvent);
+                        pPoint->WaitForCompletion();
                         Internal::RemoveHeadList(&InFlightSyncPointsHead);
-                        delete(pPoint);
+                        Internal::InsertTailList(&FreeSyncPointsHead, &pPoint->ListEntry);
                         return;
                     }
                 }
@@ -1416,19 +2267,19 @@ namespace D3DX12Residency
             }
 
             LIST_ENTRY QueueFencesListHead;
-            UINT32 NumQueuesSeen;
+            std::atomic<UINT32> NumQueuesSeen;
             Internal::Fence AsyncThreadFence;
 
             LIST_ENTRY InFlightSyncPointsHead;
+            LIST_ENTRY FreeSyncPointsHead;
             UINT64 CurrentSyncPointGeneration;
 
-            HANDLE CompletionEvent;
-            HANDLE AsyncThreadWorkCompletionEvent;
+            Internal::Event AsyncThreadWorkCompletionEvent;
 
-            ID3D12Device* Device;
-            // NOTE: This is an index not a mask. The majority of D3D12 uses bit masks to identify a GPU node whereas DXGI uses 0 based indices.
-            UINT NodeIndex;
-            IDXGIAdapter3* Adapter;
+            ResidencyBackend* Backend;
+#if RESIDENCY_D3D12_BACKEND
+            D3D12ResidencyBackend D3D12Backend;
+#endif
             Internal::LRUCache LRU;
 
             Internal::CriticalSection Mutex;
@@ -1460,10 +2311,19 @@ namespace D3DX12Residency
         {
         }
 
+#if RESIDENCY_D3D12_BACKEND
         // NOTE: DeviceNodeIndex is an index not a mask. The majority of D3D12 uses bit masks to identify a GPU node whereas DXGI uses 0 based indices.
-        FORCEINLINE HRESULT Initialize(ID3D12Device* ParentDevice, UINT DeviceNodeIndex, IDXGIAdapter3* ParentAdapter, UINT32 MaxLatency)
+        FORCEINLINE HRESULT Initialize(ID3D12Device* ParentDevice, UINT DeviceNodeIndex, IDXGIAdapter3* ParentAdapter, UINT32 MaxLatency,
+            EVICTION_POLICY Policy = EVICTION_POLICY::LRU)
+        {
+            return Manager.Initialize(ParentDevice, DeviceNodeIndex, ParentAdapter, MaxLatency, Policy);
+        }
+#endif
+
+        // Makes every device, queue, fence and budget call through pBackend, which must outlive the manager
+        FORCEINLINE HRESULT Initialize(ResidencyBackend* pBackend, UINT32 MaxLatency, EVICTION_POLICY Policy = EVICTION_POLICY::LRU)
         {
-            return Manager.Initialize(ParentDevice, DeviceNodeIndex, ParentAdapter, MaxLatency);
+            return Manager.Initialize(pBackend, MaxLatency, Policy);
         }
 
         FORCEINLINE void Destroy()
@@ -1481,6 +2341,12 @@ namespace D3DX12Residency
             Manager.EndTrackingObject(pObject);
         }
 
+        // Counts since Initialize for the policy the manager was initialized with
+        FORCEINLINE void GetStatistics(ResidencyStatistics* pStatistics)
+        {
+            Manager.GetStatistics(pStatistics);
+        }
+
         HRESULT GetCurrentGPUSyncPoint(ID3D12CommandQueue* Queue, UINT64 *pCurrentGPUSyncPoint)
         {
             return Manager.GetCurrentGPUSyncPoint(Queue, pCurrentGPUSyncPoint);
@@ -19,8 +19,10 @@
 #include "GameInput.h"
 #include "GpuTimeManager.h"
 #include "CommandContext.h"
+#include "TaskScheduler.h"
 #include <vector>
 #include <unordered_map>
+#include <map>
 #include <array>
 
 using namespace Graphics;
@@ -195,7 +197,7 @@ class NestedTimingTree
 {
 public:
     NestedTimingTree( const wstring& name, NestedTimingTree* parent = nullptr )
-        : m_Name(name), m_Parent(parent), m_IsExpanded(false), m_IsGraphed(false), m_GraphHandle(PERF_GRAPH_ERROR) {}
+        : m_Name(name), m_Parent(parent), m_IsExpanded(false), m_IsGraphed(false), m_GraphHandle(PERF_GRAPH_ERROR), m_IsJobTime(false) {}
 
     NestedTimingTree* GetChild( const wstring& name )
     {
@@ -331,11 +333,54 @@ public:
         gpuTime = 0.0f;
         for (auto iter = m_Children.begin(); iter != m_Children.end(); ++iter)
         {
+            if ((*iter)->m_IsJobTime)
+                continue;
             cpuTime += (*iter)->m_CpuTime.GetLast();
             gpuTime += (*iter)->m_GpuTime.GetLast();
         }
     }
 
+    // Time the task scheduler's threads spent running jobs since the last frame, one node
+    // per thread under "Jobs".  It overlaps the frame's own timings, so it is left out of
+    // the CPU total.
+    static void UpdateJobTimes( void )
+    {
+        static vector<TaskScheduler::ThreadStats> s_LastStats;
+
+        const uint32_t ThreadCount = TaskScheduler::GetThreadCount();
+        if (ThreadCount == 1)
+            return;
+
+        s_LastStats.resize(ThreadCount, TaskScheduler::ThreadStats());
+
+        NestedTimingTree* JobsNode = sm_RootScope.GetChild(L"Jobs");
+        JobsNode->m_IsJobTime = true;
+
+        const double SecondsPerTick = SystemTime::TicksToSeconds(1);
+        int64_t TotalTicks = 0;
+        uint64_t TotalJobs = 0;
+        for (uint32_t i = 0; i < ThreadCount; ++i)
+        {
+            const TaskScheduler::ThreadStats Stats = TaskScheduler::GetThreadStats(i);
+            const int64_t BusyTicks = (int64_t)((Stats.BusySeconds - s_LastStats[i].BusySeconds) / SecondsPerTick);
+            TotalJobs += Stats.JobCount - s_LastStats[i].JobCount;
+            s_LastStats[i] = Stats;
+
+            NestedTimingTree* ThreadNode = JobsNode->GetChild(i == 0 ? wstring(L"Other Threads") : L"Worker " + to_wstring(i));
+            ThreadNode->SetCpuTicks(BusyTicks);
+            TotalTicks += BusyTicks;
+        }
+        JobsNode->SetCpuTicks(TotalTicks);
+
+        EngineProfiling::SetCounter(L"Jobs Run", (uint32_t)TotalJobs);
+    }
+
+    void SetCpuTicks( int64_t Ticks )
+    {
+        m_StartTick = 0;
+        m_EndTick = Ticks;
+    }
+
     static void PushProfilingMarker( const wstring& name, CommandContext* Context );
     static void PopProfilingMarker( CommandContext* Context );
     static void Update( void );
@@ -343,6 +388,8 @@ public:
     {
         uint32_t FrameIndex = (uint32_t)Graphics::GetFrameCount();
 
+        UpdateJobTimes();
+
         GpuTimeManager::BeginReadBack();
         sm_RootScope.GatherTimes(FrameIndex);
         s_FrameDelta.RecordStat(FrameIndex, GpuTimeManager::GetTime(0));
@@ -401,6 +448,7 @@ private:
     GpuTimer m_GpuTimer;
     bool m_IsGraphed;
     GraphHandle m_GraphHandle;
+    bool m_IsJobTime;
     static StatHistory s_TotalCpuTime;
     static StatHistory s_TotalGpuTime;
     static StatHistory s_FrameDelta;
@@ -421,6 +469,8 @@ NestedTimingTree* NestedTimingTree::sm_SelectedScope = &NestedTimingTree::sm_Roo
 bool NestedTimingTree::sm_CursorOnGraph = false;
 namespace EngineProfiling
 {
+    map<wstring, uint32_t> Counters;
+
     BoolVar DrawFrameRate("Display Frame Rate", true);
     BoolVar DrawProfiler("Display Profiler", false);
     //BoolVar DrawPerfGraph("Display Performance Graph", false);
@@ -446,6 +496,11 @@ namespace EngineProfiling
         NestedTimingTree::PopProfilingMarker(Context);
     }
 
+    void SetCounter(const wstring& name, uint32_t value)
+    {
+        Counters[name] = value;
+    }
+
     bool IsPaused()
     {
         return Paused;
@@ -491,6 +546,23 @@ namespace EngineProfiling
             Text.SetColor( Color(1.0f, 1.0f, 1.0f) );
 
             NestedTimingTree::Display( Text, x );
+
+            if (!Counters.empty())
+            {
+                Text.SetLeftMargin(x);
+                Text.SetCursorX(x);
+                Text.NewLine();
+                Text.SetColor( Color(0.5f, 1.0f, 1.0f) );
+                Text.DrawString("Counters\n");
+                Text.SetColor( Color(1.0f, 1.0f, 1.0f) );
+                for (auto& counter : Counters)
+                {
+                    Text.SetCursorX(x);
+                    Text.DrawString(counter.first);
+                    Text.SetCursorX(x + 300.0f);
+                    Text.DrawFormattedString("%u\n", counter.second);
+                }
+            }
         }
 
         Text.GetCommandContext().SetScissor(0, 0, g_DisplayWidth, g_DisplayHeight);
@@ -25,6 +25,10 @@ namespace EngineProfiling
     void BeginBlock(const std::wstring& name, CommandContext* Context = nullptr);
     void EndBlock(CommandContext* Context = nullptr);
 
+    // Named per-frame values such as object counts, listed under the timings
+    // when the profiler is displayed. Call from the main thread.
+    void SetCounter(const std::wstring& name, uint32_t value);
+
     void DisplayFrameRate(TextContext& Text);
     void DisplayPerfGraph(GraphicsContext& Text);
     void Display(TextContext& Text, float x, float y, float w, float h);
@@ -13,6 +13,7 @@
 
 #include "pch.h"
 #include "FileUtility.h"
+#include "TaskScheduler.h"
 #include <fstream>
 #include <mutex>
 #include <zlib.h> // From NuGet package 
@@ -131,8 +132,13 @@ ByteArray Utility::ReadFileSync( const wstring& fileName)
     return ReadFileHelperEx(make_shared<wstring>(fileName));
 }
 
-task<ByteArray> Utility::ReadFileAsync(const wstring& fileName)
+future<ByteArray> Utility::ReadFileAsync(const wstring& fileName)
 {
     shared_ptr<wstring> SharedPtr = make_shared<wstring>(fileName);
-    return create_task( [=] { return ReadFileHelperEx(SharedPtr); } );
+
+    // Tasks must be copyable, packaged_task isn't
+    auto ReadTask = make_shared<packaged_task<ByteArray()> >( [=] { return ReadFileHelperEx(SharedPtr); } );
+    future<ByteArray> Result = ReadTask->get_future();
+    TaskScheduler::Run( [=] { (*ReadTask)(); } );
+    return Result;
 }
@@ -13,17 +13,17 @@
 
 #pragma once
 
-#include "pch.h"
-#include <vector>
+#include <cstdint>
+#include <future>
+#include <memory>
 #include <string>
-#include <ppl.h>
+#include <vector>
 
 namespace Utility
 {
     using namespace std;
-    using namespace concurrency;
 
-    typedef shared_ptr<vector<byte> > ByteArray;
+    typedef shared_ptr<vector<uint8_t> > ByteArray;
     extern ByteArray NullFile;
 
     // Reads the entire contents of a binary file.  If the file with the same name except with an additional
@@ -31,7 +31,8 @@ namespace Utility
     // This operation blocks until the entire file is read.
     ByteArray ReadFileSync(const wstring& fileName);
 
-    // Same as previous except that it does not block but instead returns a task.
-    task<ByteArray> ReadFileAsync(const wstring& fileName);
+    // Same as previous except that it does not block but instead returns a future.  The file is read
+    // by one of the task scheduler's threads.
+    future<ByteArray> ReadFileAsync(const wstring& fileName);
 
 } // namespace Utility
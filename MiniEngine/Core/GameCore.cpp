@@ -19,6 +19,8 @@
 #include "BufferManager.h"
 #include "CommandContext.h"
 #include "PostEffects.h"
+#include "TaskScheduler.h"
+#include "TextureManager.h"
 
 #if WINAPI_FAMILY_PARTITION(WINAPI_PARTITION_DESKTOP)
     #pragma comment(lib, "runtimeobject.lib")
@@ -49,6 +51,7 @@ namespace GameCore
         SystemTime::Initialize();
         GameInput::Initialize();
         EngineTuning::Initialize();
+        TaskScheduler::Initialize();
 
         game.Startup();
     }
@@ -58,11 +61,13 @@ namespace GameCore
         game.Cleanup();
 
         GameInput::Shutdown();
+        TaskScheduler::Shutdown();
     }
 
     bool UpdateApplication( IGameApp& game )
     {
         EngineProfiling::Update();
+        TextureManager::Update();
 
         float DeltaTime = Graphics::GetFrameTime();
     
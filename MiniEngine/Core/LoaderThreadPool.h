@@ -0,0 +1,92 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Threads for jobs that block, such as file reads and uploads, kept apart from the
+// TaskScheduler so a frame waiting on its jobs never picks one up.  A thread is created
+// the first time a job finds every thread busy, up to MaxThreads.  It needs nothing but
+// the standard library, so Tools/TaskSchedulerTest covers it without a device.
+//
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace TaskScheduler
+{
+    class LoaderThreadPool
+    {
+    public:
+        ~LoaderThreadPool() { Stop(); }
+
+        // Queues Job for the next free thread, first in first out
+        void Start( std::function<void()>&& Job, uint32_t MaxThreads )
+        {
+            {
+                std::lock_guard<std::mutex> Guard(m_Mutex);
+                m_Jobs.push_back(std::move(Job));
+                if (m_Threads.size() < MaxThreads && m_IdleThreads < m_Jobs.size())
+                    m_Threads.emplace_back(&LoaderThreadPool::ThreadMain, this);
+            }
+            m_Wake.notify_one();
+        }
+
+        // Waits for the jobs that are running and drops the ones that haven't begun, so
+        // nothing runs once it returns.  The pool can be started again afterwards.
+        void Stop( void )
+        {
+            {
+                std::lock_guard<std::mutex> Guard(m_Mutex);
+                m_Stopping = true;
+                m_Jobs.clear();
+            }
+            m_Wake.notify_all();
+
+            for (std::thread& Thread : m_Threads)
+                Thread.join();
+            m_Threads.clear();
+            m_IdleThreads = 0;
+            m_Stopping = false;
+        }
+
+        uint32_t GetThreadCount( void ) const { return (uint32_t)m_Threads.size(); }
+
+    private:
+        void ThreadMain( void )
+        {
+            std::unique_lock<std::mutex> Lock(m_Mutex);
+            for (;;)
+            {
+                ++m_IdleThreads;
+                m_Wake.wait(Lock, [this] { return !m_Jobs.empty() || m_Stopping; });
+                --m_IdleThreads;
+                if (m_Stopping)
+                    return;
+
+                std::function<void()> Job = std::move(m_Jobs.front());
+                m_Jobs.pop_front();
+
+                Lock.unlock();
+                Job();
+                Lock.lock();
+            }
+        }
+
+        std::mutex m_Mutex;
+        std::condition_variable m_Wake;
+        std::deque<std::function<void()>> m_Jobs;
+        std::vector<std::thread> m_Threads;
+        size_t m_IdleThreads = 0;
+        bool m_Stopping = false;
+    };
+}
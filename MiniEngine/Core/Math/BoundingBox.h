@@ -0,0 +1,100 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+#pragma once
+
+#include "VectorMath.h"
+#include <float.h>
+
+namespace Math
+{
+    class AxisAlignedBox
+    {
+    public:
+        // An empty box, adding any point to it makes it valid
+        AxisAlignedBox() : m_min(FLT_MAX, FLT_MAX, FLT_MAX), m_max(-FLT_MAX, -FLT_MAX, -FLT_MAX) {}
+        AxisAlignedBox( Vector3 minBound, Vector3 maxBound ) : m_min(minBound), m_max(maxBound) {}
+
+        void AddPoint( Vector3 point )
+        {
+            m_min = Min(point, m_min);
+            m_max = Max(point, m_max);
+        }
+
+        void AddBoundingBox( const AxisAlignedBox& box )
+        {
+            AddPoint(box.m_min);
+            AddPoint(box.m_max);
+        }
+
+        Vector3 GetMin( void ) const { return m_min; }
+        Vector3 GetMax( void ) const { return m_max; }
+        Vector3 GetCenter( void ) const { return (m_min + m_max) * 0.5f; }
+        Vector3 GetDimensions( void ) const { return Max(m_max - m_min, Vector3(kZero)); }
+
+        // Half the box's size along each axis
+        Vector3 GetExtents( void ) const { return GetDimensions() * 0.5f; }
+
+        // The box around the transformed box, which is larger than it unless the
+        // transform only scales and translates
+        friend AxisAlignedBox operator* ( const AffineTransform& xform, const AxisAlignedBox& box );
+
+    private:
+
+        Vector3 m_min;
+        Vector3 m_max;
+    };
+
+    // A box in any orientation, stored as its center and the transform from the
+    // unit cube [-1, 1] to the box. The basis columns are the box's half axes.
+    class OrientedBox
+    {
+    public:
+        OrientedBox() {}
+        OrientedBox( const AxisAlignedBox& box )
+            : m_repr(Matrix3::MakeScale(box.GetExtents()), box.GetCenter()) {}
+        explicit OrientedBox( const AffineTransform& unitCubeToBox ) : m_repr(unitCubeToBox) {}
+
+        Vector3 GetCenter( void ) const { return m_repr.GetTranslation(); }
+        Vector3 GetHalfAxisX( void ) const { return m_repr.GetX(); }
+        Vector3 GetHalfAxisY( void ) const { return m_repr.GetY(); }
+        Vector3 GetHalfAxisZ( void ) const { return m_repr.GetZ(); }
+
+        // Half the box's size along each world axis
+        Vector3 GetAxisAlignedExtents( void ) const
+        {
+            return Abs(m_repr.GetX()) + Abs(m_repr.GetY()) + Abs(m_repr.GetZ());
+        }
+
+        AxisAlignedBox GetAxisAlignedBox( void ) const
+        {
+            Vector3 extents = GetAxisAlignedExtents();
+            return AxisAlignedBox(GetCenter() - extents, GetCenter() + extents);
+        }
+
+        friend OrientedBox operator* ( const AffineTransform& xform, const OrientedBox& box )
+        {
+            return OrientedBox(xform * box.m_repr);
+        }
+
+    private:
+
+        AffineTransform m_repr;
+    };
+
+    //=======================================================================================================
+    // Inline implementations
+    //
+
+    inline AxisAlignedBox operator* ( const AffineTransform& xform, const AxisAlignedBox& box )
+    {
+        return (xform * OrientedBox(box)).GetAxisAlignedBox();
+    }
+
+} // namespace Math
@@ -14,6 +14,8 @@
 #include "pch.h"
 #include "Frustum.h"
 #include "Camera.h"
+#include <immintrin.h>
+#include <intrin.h>
 
 using namespace Math;
 
@@ -114,3 +116,268 @@ Frustum::Frustum( const Matrix4& ProjMat )
         ConstructPerspectiveFrustum( RcpXX, RcpYY, NearClip, FarClip );
     }
 }
+
+Frustum Frustum::FromViewProjection( const Matrix4& ViewProjMat )
+{
+    Frustum result;
+
+    // With p' = M * p, the clip space bounds -w <= x <= w, -w <= y <= w and 0 <= z <= w are planes made
+    // of the rows of M.
+    const Matrix4 Rows = Transpose(ViewProjMat);
+    const Vector4 RowX = Rows.GetX();
+    const Vector4 RowY = Rows.GetY();
+    const Vector4 RowZ = Rows.GetZ();
+    const Vector4 RowW = Rows.GetW();
+
+    // Unproject the corners of the clip space box, z = 0 and z = 1 are the near and far planes in
+    // either order
+    const Matrix4 ClipToWorld = Invert(ViewProjMat);
+    Vector3 Corners[2][4];
+    for (int z = 0; z < 2; ++z)
+    {
+        for (int corner = 0; corner < 4; ++corner)
+        {
+            Vector4 p = ClipToWorld * Vector4(corner & 2 ? 1.0f : -1.0f, corner & 1 ? 1.0f : -1.0f, (float)z, 1.0f);
+            Corners[z][corner] = Vector3(p) / p.GetW();
+        }
+    }
+
+    // Reversed Z puts the near plane at z = 1.  The near face is the smaller one, or either for an
+    // orthographic projection.
+    const int NearZ = LengthSquare(Corners[1][3] - Corners[1][0]) < LengthSquare(Corners[0][3] - Corners[0][0]) ? 1 : 0;
+    const int FarZ = 1 - NearZ;
+
+    // Corners are numbered lower left, upper left, lower right, upper right, the same as CornerID
+    for (int corner = 0; corner < 4; ++corner)
+    {
+        result.m_FrustumCorners[kNearLowerLeft + corner] = Corners[NearZ][corner];
+        result.m_FrustumCorners[kFarLowerLeft + corner] = Corners[FarZ][corner];
+    }
+
+    const Vector4 ZeroPlane = RowZ;
+    const Vector4 OnePlane = RowW - RowZ;
+    const Vector4 Planes[6] =
+    {
+        NearZ == 0 ? ZeroPlane : OnePlane,
+        NearZ == 0 ? OnePlane : ZeroPlane,
+        RowW + RowX, RowW - RowX,
+        RowW - RowY, RowW + RowY
+    };
+
+    // Normalize them so distances are in world units, which the sphere tests need
+    for (int i = 0; i < 6; ++i)
+        result.m_FrustumPlanes[i] = BoundingPlane(Planes[i] * RecipSqrt(LengthSquare(Vector3(Planes[i]))));
+
+    return result;
+}
+
+//=======================================================================================================
+// Batched intersection tests
+//
+// Every level evaluates the plane distances with the same operations in the same order, so they agree
+// on everything but objects within rounding error of a plane.  The SIMD kernels write four or eight bits
+// at a time and leave the last few objects to the scalar kernel.
+//
+
+namespace
+{
+    struct FrustumPlanesSoA
+    {
+        float nx[6], ny[6], nz[6], d[6];
+        float absNx[6], absNy[6], absNz[6];
+    };
+
+    FrustumPlanesSoA GetPlanesSoA( const BoundingPlane* planes )
+    {
+        FrustumPlanesSoA soa;
+        for (int i = 0; i < 6; ++i)
+        {
+            XMFLOAT4 plane;
+            XMStoreFloat4(&plane, Vector4(planes[i]));
+            soa.nx[i] = plane.x;
+            soa.ny[i] = plane.y;
+            soa.nz[i] = plane.z;
+            soa.d[i] = plane.w;
+            soa.absNx[i] = fabsf(plane.x);
+            soa.absNy[i] = fabsf(plane.y);
+            soa.absNz[i] = fabsf(plane.z);
+        }
+        return soa;
+    }
+
+    // A sphere is a box with zero extents and the radius added to the distance
+    template <bool kBoxes>
+    void IntersectScalar( const FrustumPlanesSoA& p, const float* cx, const float* cy, const float* cz,
+        const float* ex, const float* ey, const float* ez, uint32_t begin, uint32_t end, uint32_t* visibleMask )
+    {
+        for (uint32_t i = begin; i < end; ++i)
+        {
+            bool outside = false;
+            for (int j = 0; j < 6; ++j)
+            {
+                float dist = p.nx[j] * cx[i];
+                dist += p.ny[j] * cy[i];
+                dist += p.nz[j] * cz[i];
+                dist += p.d[j];
+                float radius = 0.0f;
+                if (kBoxes)
+                {
+                    radius = p.absNx[j] * ex[i];
+                    radius += p.absNy[j] * ey[i];
+                    radius += p.absNz[j] * ez[i];
+                }
+                else
+                {
+                    radius = ex[i];
+                }
+                outside |= dist + radius < 0.0f;
+            }
+            if (!outside)
+                visibleMask[i / 32] |= 1u << (i % 32);
+        }
+    }
+
+    template <bool kBoxes>
+    uint32_t IntersectSSE( const FrustumPlanesSoA& p, const float* cx, const float* cy, const float* cz,
+        const float* ex, const float* ey, const float* ez, uint32_t count, uint32_t* visibleMask )
+    {
+        const uint32_t simdCount = count & ~3u;
+        for (uint32_t i = 0; i < simdCount; i += 4)
+        {
+            const __m128 centerX = _mm_loadu_ps(cx + i);
+            const __m128 centerY = _mm_loadu_ps(cy + i);
+            const __m128 centerZ = _mm_loadu_ps(cz + i);
+            const __m128 extentX = _mm_loadu_ps(ex + i);
+            __m128 extentY = _mm_setzero_ps(), extentZ = _mm_setzero_ps();
+            if (kBoxes)
+            {
+                extentY = _mm_loadu_ps(ey + i);
+                extentZ = _mm_loadu_ps(ez + i);
+            }
+
+            __m128 outside = _mm_setzero_ps();
+            for (int j = 0; j < 6; ++j)
+            {
+                __m128 dist = _mm_mul_ps(_mm_set1_ps(p.nx[j]), centerX);
+                dist = _mm_add_ps(dist, _mm_mul_ps(_mm_set1_ps(p.ny[j]), centerY));
+                dist = _mm_add_ps(dist, _mm_mul_ps(_mm_set1_ps(p.nz[j]), centerZ));
+                dist = _mm_add_ps(dist, _mm_set1_ps(p.d[j]));
+                __m128 radius;
+                if (kBoxes)
+                {
+                    radius = _mm_mul_ps(_mm_set1_ps(p.absNx[j]), extentX);
+                    radius = _mm_add_ps(radius, _mm_mul_ps(_mm_set1_ps(p.absNy[j]), extentY));
+                    radius = _mm_add_ps(radius, _mm_mul_ps(_mm_set1_ps(p.absNz[j]), extentZ));
+                }
+                else
+                {
+                    radius = extentX;
+                }
+                outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(dist, radius), _mm_setzero_ps()));
+            }
+            visibleMask[i / 32] |= (uint32_t)(~_mm_movemask_ps(outside) & 0xF) << (i % 32);
+        }
+        return simdCount;
+    }
+
+    template <bool kBoxes>
+    uint32_t IntersectAVX2( const FrustumPlanesSoA& p, const float* cx, const float* cy, const float* cz,
+        const float* ex, const float* ey, const float* ez, uint32_t count, uint32_t* visibleMask )
+    {
+        const uint32_t simdCount = count & ~7u;
+        for (uint32_t i = 0; i < simdCount; i += 8)
+        {
+            const __m256 centerX = _mm256_loadu_ps(cx + i);
+            const __m256 centerY = _mm256_loadu_ps(cy + i);
+            const __m256 centerZ = _mm256_loadu_ps(cz + i);
+            const __m256 extentX = _mm256_loadu_ps(ex + i);
+            __m256 extentY = _mm256_setzero_ps(), extentZ = _mm256_setzero_ps();
+            if (kBoxes)
+            {
+                extentY = _mm256_loadu_ps(ey + i);
+                extentZ = _mm256_loadu_ps(ez + i);
+            }
+
+            __m256 outside = _mm256_setzero_ps();
+            for (int j = 0; j < 6; ++j)
+            {
+                __m256 dist = _mm256_mul_ps(_mm256_set1_ps(p.nx[j]), centerX);
+                dist = _mm256_add_ps(dist, _mm256_mul_ps(_mm256_set1_ps(p.ny[j]), centerY));
+                dist = _mm256_add_ps(dist, _mm256_mul_ps(_mm256_set1_ps(p.nz[j]), centerZ));
+                dist = _mm256_add_ps(dist, _mm256_set1_ps(p.d[j]));
+                __m256 radius;
+                if (kBoxes)
+                {
+                    radius = _mm256_mul_ps(_mm256_set1_ps(p.absNx[j]), extentX);
+                    radius = _mm256_add_ps(radius, _mm256_mul_ps(_mm256_set1_ps(p.absNy[j]), extentY));
+                    radius = _mm256_add_ps(radius, _mm256_mul_ps(_mm256_set1_ps(p.absNz[j]), extentZ));
+                }
+                else
+                {
+                    radius = extentX;
+                }
+                outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(dist, radius), _mm256_setzero_ps(), _CMP_LT_OQ));
+            }
+            visibleMask[i / 32] |= (uint32_t)(~_mm256_movemask_ps(outside) & 0xFF) << (i % 32);
+        }
+        _mm256_zeroupper();
+        return simdCount;
+    }
+
+    template <bool kBoxes>
+    void Intersect( Frustum::SimdLevel simd, const BoundingPlane* planes, const float* cx, const float* cy, const float* cz,
+        const float* ex, const float* ey, const float* ez, uint32_t count, uint32_t* visibleMask )
+    {
+        memset(visibleMask, 0, (count + 31) / 32 * sizeof(uint32_t));
+
+        const FrustumPlanesSoA p = GetPlanesSoA(planes);
+
+        if (simd == Frustum::kSimdAuto || simd > Frustum::GetSupportedSimdLevel())
+            simd = Frustum::GetSupportedSimdLevel();
+
+        uint32_t done = 0;
+        if (simd == Frustum::kSimdAVX2)
+            done = IntersectAVX2<kBoxes>(p, cx, cy, cz, ex, ey, ez, count, visibleMask);
+        else if (simd == Frustum::kSimdSSE)
+            done = IntersectSSE<kBoxes>(p, cx, cy, cz, ex, ey, ez, count, visibleMask);
+
+        IntersectScalar<kBoxes>(p, cx, cy, cz, ex, ey, ez, done, count, visibleMask);
+    }
+}
+
+Frustum::SimdLevel Frustum::GetSupportedSimdLevel( void )
+{
+    static const SimdLevel s_SupportedLevel = [](void)
+    {
+        // SSE2 is part of x64.  AVX needs the OS to save the upper halves of the registers.
+        int cpuInfo[4];
+        __cpuid(cpuInfo, 0);
+        const int maxFunctionId = cpuInfo[0];
+
+        __cpuid(cpuInfo, 1);
+        const bool osXSave = (cpuInfo[2] & (1 << 27)) != 0;
+        const bool avx = (cpuInfo[2] & (1 << 28)) != 0;
+        if (maxFunctionId >= 7 && osXSave && avx && (_xgetbv(0) & 0x6) == 0x6)
+        {
+            __cpuidex(cpuInfo, 7, 0);
+            if (cpuInfo[1] & (1 << 5))
+                return kSimdAVX2;
+        }
+        return kSimdSSE;
+    }();
+
+    return s_SupportedLevel;
+}
+
+void Frustum::IntersectSpheres( const float* centerX, const float* centerY, const float* centerZ, const float* radius,
+    uint32_t count, uint32_t* visibleMask, SimdLevel simd ) const
+{
+    Intersect<false>(simd, m_FrustumPlanes, centerX, centerY, centerZ, radius, nullptr, nullptr, count, visibleMask);
+}
+
+void Frustum::IntersectBoundingBoxes( const float* centerX, const float* centerY, const float* centerZ,
+    const float* extentX, const float* extentY, const float* extentZ,
+    uint32_t count, uint32_t* visibleMask, SimdLevel simd ) const
+{
+    Intersect<true>(simd, m_FrustumPlanes, centerX, centerY, centerZ, extentX, extentY, extentZ, count, visibleMask);
+}
@@ -15,6 +15,7 @@
 
 #include "BoundingPlane.h"
 #include "BoundingSphere.h"
+#include "BoundingBox.h"
 
 namespace Math
 {
@@ -25,6 +26,11 @@ namespace Math
 
         Frustum( const Matrix4& ProjectionMatrix );
 
+        // The frustum a view-projection matrix maps to clip space, in the space the matrix transforms from.
+        // Works for any perspective or orthographic matrix, including ones with reversed Z, and is handy
+        // when there's a matrix but no camera, as with light shadow maps.
+        static Frustum FromViewProjection( const Matrix4& ViewProjMat );
+
         enum CornerID
         {
             kNearLowerLeft, kNearUpperLeft, kNearLowerRight, kNearUpperRight,
@@ -43,9 +49,26 @@ namespace Math
         // fully contained in the frustum, or by intersecting one or more of the planes.
         bool IntersectSphere( BoundingSphere sphere ) const;
 
-        // We don't officially have a BoundingBox class yet, but let's assume it's forthcoming.  (There is a
-        // simple struct in the Model project.)
+        // Test whether the box intersects the frustum.  Like the sphere test, a box that is behind none of the
+        // planes counts as intersecting, so a few boxes just outside of a corner are reported as visible.
         bool IntersectBoundingBox(const Vector3 minBound, const Vector3 maxBound) const;
+        bool IntersectBoundingBox( const AxisAlignedBox& box ) const;
+        bool IntersectOrientedBox( const OrientedBox& box ) const;
+
+        // Batched tests for culling many objects at once.  The objects are passed as structure-of-arrays,
+        // one float array per component, and need no alignment or padding.  Bit i of visibleMask is set
+        // when object i intersects the frustum; visibleMask holds (count + 31) / 32 words and the bits past
+        // count are cleared.  Boxes are given as centers and half extents.
+        enum SimdLevel { kSimdScalar, kSimdSSE, kSimdAVX2, kSimdAuto };
+
+        // The widest level the CPU and OS support
+        static SimdLevel GetSupportedSimdLevel( void );
+
+        void IntersectSpheres( const float* centerX, const float* centerY, const float* centerZ, const float* radius,
+            uint32_t count, uint32_t* visibleMask, SimdLevel simd = kSimdAuto ) const;
+        void IntersectBoundingBoxes( const float* centerX, const float* centerY, const float* centerZ,
+            const float* extentX, const float* extentY, const float* extentZ,
+            uint32_t count, uint32_t* visibleMask, SimdLevel simd = kSimdAuto ) const;
 
         friend Frustum  operator* ( const OrthogonalTransform& xform, const Frustum& frustum );    // Fast
         friend Frustum  operator* ( const AffineTransform& xform, const Frustum& frustum );        // Slow
@@ -91,6 +114,25 @@ namespace Math
         return true;
     }
 
+    inline bool Frustum::IntersectBoundingBox( const AxisAlignedBox& box ) const
+    {
+        return IntersectBoundingBox(box.GetMin(), box.GetMax());
+    }
+
+    inline bool Frustum::IntersectOrientedBox( const OrientedBox& box ) const
+    {
+        for (int i = 0; i < 6; ++i)
+        {
+            BoundingPlane p = m_FrustumPlanes[i];
+            Vector3 n = p.GetNormal();
+            Scalar radius = Abs(Dot(n, box.GetHalfAxisX())) + Abs(Dot(n, box.GetHalfAxisY())) + Abs(Dot(n, box.GetHalfAxisZ()));
+            if (p.DistanceFromPoint(box.GetCenter()) + radius < 0.0f)
+                return false;
+        }
+
+        return true;
+    }
+
     inline Frustum operator* ( const OrthogonalTransform& xform, const Frustum& frustum )
     {
         Frustum result;
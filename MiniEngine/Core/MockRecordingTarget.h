@@ -0,0 +1,103 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// A recording target that needs no device.  Commands are plain values and submitting a
+// list appends them to one stream, standing in for the GPU's view of the queue.  It
+// hands out lists the way GraphicsRecordingTarget hands out contexts: a pass that fits
+// in one chunk is recorded into the parent list, otherwise the parent is flushed ahead
+// of chunk 0.  Tools/TaskSchedulerTest uses it to check ParallelRecord's ordering.
+//
+
+#pragma once
+
+#include "ParallelRecording.h"
+#include <thread>
+#include <vector>
+
+namespace TaskScheduler
+{
+    struct MockCommandList
+    {
+        void Record( uint32_t Command )
+        {
+            Commands.push_back(Command);
+            RecordingThread = std::this_thread::get_id();
+        }
+
+        std::vector<uint32_t> Commands;
+        std::thread::id RecordingThread;
+    };
+
+    class MockRecordingTarget : public RecordingTarget<MockCommandList>
+    {
+    public:
+        virtual MockCommandList& BeginChunk( uint32_t ChunkIndex, uint32_t ChunkCount ) override
+        {
+            if (ChunkIndex != m_BegunChunks++)
+                m_InOrder = false;
+
+            if (ChunkCount == 1)
+                return m_Parent;
+
+            // Sized once per pass, the lists handed out earlier must stay put
+            if (ChunkIndex == 0)
+            {
+                FlushParent();
+                m_Chunks.assign(ChunkCount, MockCommandList());
+            }
+            return m_Chunks[ChunkIndex];
+        }
+
+        virtual void SubmitChunk( uint32_t ChunkIndex, uint32_t ChunkCount, MockCommandList& List ) override
+        {
+            if (ChunkIndex != m_SubmittedChunks++ || m_BegunChunks != ChunkCount)
+                m_InOrder = false;
+
+            if (ChunkCount > 1)
+                Submit(List);
+        }
+
+        // Commands recorded outside of ParallelRecord, before or after a pass
+        MockCommandList& GetParent( void ) { return m_Parent; }
+
+        void FlushParent( void )
+        {
+            Submit(m_Parent);
+            m_Parent.Commands.clear();
+        }
+
+        // Starts counting chunks again for the next pass
+        void BeginPass( void )
+        {
+            m_BegunChunks = 0;
+            m_SubmittedChunks = 0;
+        }
+
+        // False once a chunk was begun or submitted out of order, or submitted before
+        // every chunk was begun
+        bool WasInOrder( void ) const { return m_InOrder; }
+
+        // Every submitted command, in the order the GPU would see them
+        const std::vector<uint32_t>& GetSubmitted( void ) const { return m_Submitted; }
+
+        const std::vector<MockCommandList>& GetChunks( void ) const { return m_Chunks; }
+
+    private:
+        void Submit( const MockCommandList& List )
+        {
+            m_Submitted.insert(m_Submitted.end(), List.Commands.begin(), List.Commands.end());
+        }
+
+        MockCommandList m_Parent;
+        std::vector<MockCommandList> m_Chunks;
+        std::vector<uint32_t> m_Submitted;
+        uint32_t m_BegunChunks = 0;
+        uint32_t m_SubmittedChunks = 0;
+        bool m_InOrder = true;
+    };
+}
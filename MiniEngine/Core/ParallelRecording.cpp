@@ -0,0 +1,41 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+#include "pch.h"
+#include "ParallelRecording.h"
+#include "CommandContext.h"
+
+using namespace TaskScheduler;
+
+GraphicsContext& GraphicsRecordingTarget::BeginChunk( uint32_t ChunkIndex, uint32_t ChunkCount )
+{
+    if (ChunkCount == 1)
+        return m_Parent;
+
+    if (ChunkIndex == 0)
+        m_Parent.Flush();
+
+    // Begun and set up here, on the submitting thread, so a recording thread only ever
+    // touches the one context it was handed
+    GraphicsContext& Context = GraphicsContext::Begin();
+    m_SetupState(Context);
+    return Context;
+}
+
+void GraphicsRecordingTarget::SubmitChunk( uint32_t ChunkIndex, uint32_t ChunkCount, GraphicsContext& Context )
+{
+    if (ChunkCount == 1)
+        return;
+
+    Context.Finish();
+
+    // Flushing reset Parent's command list, which only restored its root signature and PSO
+    if (ChunkIndex == ChunkCount - 1)
+        m_SetupState(m_Parent);
+}
@@ -0,0 +1,100 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Records one pass's draws on several threads.  The draw list is split into contiguous
+// chunks, each chunk is recorded into its own context on a TaskScheduler thread, and the
+// contexts are submitted in chunk order, so the GPU sees the draws in list order no
+// matter which thread finished first.
+//
+
+#pragma once
+
+#include "TaskScheduler.h"
+#include <functional>
+#include <vector>
+
+class GraphicsContext;
+
+namespace TaskScheduler
+{
+    // Hands out the context each chunk records into and submits it.  Both are called on
+    // the thread that called ParallelRecord, so an implementation needs no locking.
+    template <typename ContextType>
+    class RecordingTarget
+    {
+    public:
+        virtual ~RecordingTarget() {}
+
+        // Called for every chunk, in order, before any chunk is recorded
+        virtual ContextType& BeginChunk( uint32_t ChunkIndex, uint32_t ChunkCount ) = 0;
+
+        // Called for every chunk, in order, after all of them are recorded
+        virtual void SubmitChunk( uint32_t ChunkIndex, uint32_t ChunkCount, ContextType& Context ) = 0;
+    };
+
+    // Splits Count items into at most one chunk per thread, with at least MinItemsPerChunk
+    // items in each, and calls Record(Context, ChunkIndex, First, End) for each chunk.  The
+    // calling thread records the first chunk itself.  Returns the number of chunks.
+    template <typename ContextType, typename RecordFunc>
+    uint32_t ParallelRecord( RecordingTarget<ContextType>& Target, uint32_t Count, uint32_t MinItemsPerChunk, RecordFunc Record )
+    {
+        if (Count == 0)
+            return 0;
+
+        if (MinItemsPerChunk == 0)
+            MinItemsPerChunk = 1;
+
+        uint32_t ChunkCount = (Count + MinItemsPerChunk - 1) / MinItemsPerChunk;
+        if (ChunkCount > GetThreadCount())
+            ChunkCount = GetThreadCount();
+
+        std::vector<ContextType*> Contexts(ChunkCount);
+        for (uint32_t i = 0; i < ChunkCount; ++i)
+            Contexts[i] = &Target.BeginChunk(i, ChunkCount);
+
+        auto RecordChunk = [&]( uint32_t i )
+        {
+            const uint32_t First = (uint32_t)((uint64_t)Count * i / ChunkCount);
+            const uint32_t End = (uint32_t)((uint64_t)Count * (i + 1) / ChunkCount);
+            Record(*Contexts[i], i, First, End);
+        };
+
+        {
+            TaskGroup Group;
+            for (uint32_t i = 1; i < ChunkCount; ++i)
+                Group.Run([&RecordChunk, i] { RecordChunk(i); });
+            RecordChunk(0);
+            Group.Wait();
+        }
+
+        for (uint32_t i = 0; i < ChunkCount; ++i)
+            Target.SubmitChunk(i, ChunkCount, *Contexts[i]);
+
+        return ChunkCount;
+    }
+
+    // Records the chunks of a pass into contexts of their own, between the commands
+    // already recorded on Parent and the ones recorded after.  Parent is flushed ahead of
+    // the first chunk, so its barriers and clears reach the GPU first.  SetupState puts
+    // each chunk's context, and afterwards Parent, in the state the pass draws with:
+    // root signature, buffers, targets and viewport.  A pass that fits in one chunk is
+    // recorded straight into Parent.
+    class GraphicsRecordingTarget : public RecordingTarget<GraphicsContext>
+    {
+    public:
+        GraphicsRecordingTarget( GraphicsContext& Parent, const std::function<void(GraphicsContext&)>& SetupState )
+            : m_Parent(Parent), m_SetupState(SetupState) {}
+
+        virtual GraphicsContext& BeginChunk( uint32_t ChunkIndex, uint32_t ChunkCount ) override;
+        virtual void SubmitChunk( uint32_t ChunkIndex, uint32_t ChunkCount, GraphicsContext& Context ) override;
+
+    private:
+        GraphicsContext& m_Parent;
+        std::function<void(GraphicsContext&)> m_SetupState;
+    };
+}
@@ -56,6 +56,11 @@ void ShadowBuffer::BeginRendering( GraphicsContext& Context )
 {
     Context.TransitionResource(*this, D3D12_RESOURCE_STATE_DEPTH_WRITE, true);
     Context.ClearDepth(*this);
+    SetAsTarget(Context);
+}
+
+void ShadowBuffer::SetAsTarget( GraphicsContext& Context ) const
+{
     Context.SetDepthStencilTarget(GetDSV());
     Context.SetViewportAndScissor(m_Viewport, m_Scissor);
 }
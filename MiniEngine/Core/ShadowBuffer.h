@@ -33,6 +33,10 @@ public:
     void BeginRendering( GraphicsContext& context );
     void EndRendering( GraphicsContext& context );
 
+    // Binds the buffer and its viewport without the transition and clear, for contexts that
+    // record part of a pass BeginRendering started on another context
+    void SetAsTarget( GraphicsContext& context ) const;
+
 private:
     D3D12_VIEWPORT m_Viewport;
     D3D12_RECT m_Scissor;
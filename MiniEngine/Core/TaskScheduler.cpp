@@ -0,0 +1,422 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+// Built without the precompiled header, so that nothing but the standard library is
+// needed to use the scheduler outside of the engine
+
+#include "TaskScheduler.h"
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <thread>
+
+using namespace std;
+
+namespace TaskScheduler
+{
+    struct Job
+    {
+        Job( Task&& Func, TaskGroup* Group ) : Func(std::move(Func)), Group(Group) {}
+
+        void Execute( void )
+        {
+            Func();
+            if (Group != nullptr)
+                Group->FinishTask();
+        }
+
+        Task Func;
+        TaskGroup* Group;
+    };
+
+    // Chase and Lev's work-stealing deque, "Dynamic Circular Work-Stealing Deque" (SPAA 2005).
+    // Only the owning worker pushes and pops, at the bottom, and any thread steals from the
+    // top.  The owner and thieves only contend over the last job, which they race for with
+    // a compare and swap on the top.  The indices are accessed sequentially consistently,
+    // which the algorithm as published assumes.
+    class WorkStealingDeque
+    {
+    public:
+        WorkStealingDeque() : m_Top(0), m_Bottom(0), m_Buffer(new RingBuffer(kInitialCapacity)) {}
+
+        ~WorkStealingDeque()
+        {
+            delete m_Buffer.load();
+            for (RingBuffer* Retired : m_RetiredBuffers)
+                delete Retired;
+        }
+
+        void Push( Job* NewJob )
+        {
+            const int64_t Bottom = m_Bottom.load(memory_order_relaxed);
+            const int64_t Top = m_Top.load(memory_order_acquire);
+            RingBuffer* Buffer = m_Buffer.load(memory_order_relaxed);
+
+            if (Bottom - Top >= Buffer->Capacity)
+                Buffer = Grow(Buffer, Top, Bottom);
+
+            Buffer->Put(Bottom, NewJob);
+            m_Bottom.store(Bottom + 1);
+        }
+
+        Job* Pop( void )
+        {
+            const int64_t Bottom = m_Bottom.load(memory_order_relaxed) - 1;
+            RingBuffer* Buffer = m_Buffer.load(memory_order_relaxed);
+
+            // Claim the bottom job before looking at the top, so a thief either sees the
+            // claim or the owner sees the thief's
+            m_Bottom.store(Bottom);
+            int64_t Top = m_Top.load();
+
+            if (Top > Bottom)
+            {
+                m_Bottom.store(Bottom + 1, memory_order_relaxed);
+                return nullptr;
+            }
+
+            Job* Result = Buffer->Get(Bottom);
+            if (Top == Bottom)
+            {
+                // The last job, which a thief may be taking at the same time
+                if (!m_Top.compare_exchange_strong(Top, Top + 1))
+                    Result = nullptr;
+                m_Bottom.store(Bottom + 1, memory_order_relaxed);
+            }
+            return Result;
+        }
+
+        // Returns null when the deque is empty or another thread won the race for the job
+        Job* Steal( void )
+        {
+            int64_t Top = m_Top.load();
+            const int64_t Bottom = m_Bottom.load();
+            if (Top >= Bottom)
+                return nullptr;
+
+            Job* Result = m_Buffer.load(memory_order_acquire)->Get(Top);
+            if (!m_Top.compare_exchange_strong(Top, Top + 1))
+                return nullptr;
+            return Result;
+        }
+
+    private:
+        static const int64_t kInitialCapacity = 256;
+
+        struct RingBuffer
+        {
+            RingBuffer( int64_t Capacity ) : Capacity(Capacity), Slots(new atomic<Job*>[(size_t)Capacity]) {}
+            ~RingBuffer() { delete [] Slots; }
+
+            Job* Get( int64_t Index ) const { return Slots[Index & (Capacity - 1)].load(memory_order_relaxed); }
+            void Put( int64_t Index, Job* NewJob ) { Slots[Index & (Capacity - 1)].store(NewJob, memory_order_relaxed); }
+
+            const int64_t Capacity;
+            atomic<Job*>* Slots;
+        };
+
+        // A thief may still be reading the old buffer, so it is kept until the deque goes away
+        RingBuffer* Grow( RingBuffer* Buffer, int64_t Top, int64_t Bottom )
+        {
+            RingBuffer* Grown = new RingBuffer(Buffer->Capacity * 2);
+            for (int64_t i = Top; i < Bottom; ++i)
+                Grown->Put(i, Buffer->Get(i));
+            m_RetiredBuffers.push_back(Buffer);
+            m_Buffer.store(Grown, memory_order_release);
+            return Grown;
+        }
+
+        atomic<int64_t> m_Top;
+        atomic<int64_t> m_Bottom;
+        atomic<RingBuffer*> m_Buffer;
+        vector<RingBuffer*> m_RetiredBuffers;
+    };
+
+    // Jobs queued by threads that aren't workers, first in first out
+    class SharedQueue
+    {
+    public:
+        void Push( Job* NewJob )
+        {
+            lock_guard<mutex> LockGuard(m_Mutex);
+            m_Jobs.push_back(NewJob);
+        }
+
+        Job* Pop( void )
+        {
+            lock_guard<mutex> LockGuard(m_Mutex);
+            if (m_Jobs.empty())
+                return nullptr;
+            Job* Front = m_Jobs.front();
+            m_Jobs.pop_front();
+            return Front;
+        }
+
+    private:
+        mutex m_Mutex;
+        deque<Job*> m_Jobs;
+    };
+
+    // Padded to a cache line, every thread updates its own after each job
+    struct ThreadCounters
+    {
+        atomic<uint64_t> JobCount;
+        atomic<uint64_t> BusyNanoseconds;
+        char Padding[64 - 2 * sizeof(atomic<uint64_t>)];
+    };
+
+    bool s_Initialized = false;
+    vector<unique_ptr<WorkStealingDeque>> s_WorkerDeques;
+    SharedQueue s_SharedQueue;
+    vector<thread> s_Workers;
+    unique_ptr<ThreadCounters[]> s_ThreadCounters;
+
+    // 0 on threads that aren't workers, otherwise one more than the worker's index
+    thread_local uint32_t s_ThreadIndex = 0;
+    thread_local uint32_t s_JobDepth = 0;
+
+    // Counted after the job is pushed, so a thread may take a job before it is counted and
+    // briefly drive the count below zero
+    atomic<int32_t> s_QueuedJobCount(0);
+    mutex s_WakeMutex;
+    condition_variable s_WakeCondition;
+    bool s_ShuttingDown = false;
+
+    void QueueJob( Job* NewJob )
+    {
+        // Without workers nothing might ever pick up a job no one waits on
+        if (s_WorkerDeques.empty())
+        {
+            NewJob->Execute();
+            delete NewJob;
+            return;
+        }
+
+        if (s_ThreadIndex > 0)
+            s_WorkerDeques[s_ThreadIndex - 1]->Push(NewJob);
+        else
+            s_SharedQueue.Push(NewJob);
+
+        // Counted once the job can be found, so a worker woken by the count never spins on a
+        // job that isn't there yet.  Counted under the lock so a worker can't check the count
+        // and then miss the wake up.
+        {
+            lock_guard<mutex> LockGuard(s_WakeMutex);
+            ++s_QueuedJobCount;
+        }
+
+        s_WakeCondition.notify_one();
+    }
+
+    Job* FindJob( void )
+    {
+        const uint32_t ThreadIndex = s_ThreadIndex;
+        const uint32_t WorkerCount = (uint32_t)s_WorkerDeques.size();
+
+        Job* Found = nullptr;
+        if (ThreadIndex > 0)
+            Found = s_WorkerDeques[ThreadIndex - 1]->Pop();
+        if (Found == nullptr)
+            Found = s_SharedQueue.Pop();
+
+        // Start with the next worker along, so thieves spread out over the deques
+        for (uint32_t i = 0; Found == nullptr && i < WorkerCount; ++i)
+            Found = s_WorkerDeques[(ThreadIndex + i) % WorkerCount]->Steal();
+
+        return Found;
+    }
+
+    bool RunQueuedJob( void )
+    {
+        if (s_QueuedJobCount <= 0)
+            return false;
+
+        Job* NextJob = FindJob();
+        if (NextJob == nullptr)
+            return false;
+
+        --s_QueuedJobCount;
+
+        // Only the outermost job is timed, the jobs a job runs while it waits are part of its time
+        const auto StartTime = chrono::steady_clock::now();
+        ++s_JobDepth;
+        NextJob->Execute();
+        --s_JobDepth;
+        delete NextJob;
+
+        ThreadCounters& Counters = s_ThreadCounters[s_ThreadIndex];
+        ++Counters.JobCount;
+        if (s_JobDepth == 0)
+            Counters.BusyNanoseconds += (uint64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - StartTime).count();
+
+        return true;
+    }
+
+    void WorkerMain( uint32_t ThreadIndex )
+    {
+        s_ThreadIndex = ThreadIndex;
+
+        for (;;)
+        {
+            if (RunQueuedJob())
+                continue;
+
+            unique_lock<mutex> Lock(s_WakeMutex);
+            s_WakeCondition.wait(Lock, [] { return s_QueuedJobCount > 0 || s_ShuttingDown; });
+            if (s_ShuttingDown && s_QueuedJobCount <= 0)
+                return;
+        }
+    }
+}
+
+void TaskScheduler::Initialize( uint32_t NumWorkers )
+{
+    assert(!s_Initialized && "Task scheduler already initialized");
+
+    if (NumWorkers == 0)
+    {
+        const uint32_t HardwareThreads = thread::hardware_concurrency();
+        NumWorkers = HardwareThreads > 1 ? HardwareThreads - 1 : 0;
+    }
+
+    s_ShuttingDown = false;
+    s_ThreadCounters.reset(new ThreadCounters[NumWorkers + 1]);
+    for (uint32_t i = 0; i <= NumWorkers; ++i)
+    {
+        s_ThreadCounters[i].JobCount = 0;
+        s_ThreadCounters[i].BusyNanoseconds = 0;
+    }
+
+    // Every deque exists before any worker starts stealing
+    s_WorkerDeques.resize(NumWorkers);
+    for (auto& Deque : s_WorkerDeques)
+        Deque.reset(new WorkStealingDeque);
+
+    s_Initialized = true;
+
+    for (uint32_t i = 1; i <= NumWorkers; ++i)
+        s_Workers.emplace_back(WorkerMain, i);
+}
+
+void TaskScheduler::Shutdown( void )
+{
+    if (!s_Initialized)
+        return;
+
+    {
+        lock_guard<mutex> LockGuard(s_WakeMutex);
+        s_ShuttingDown = true;
+    }
+    s_WakeCondition.notify_all();
+
+    for (auto& Worker : s_Workers)
+        Worker.join();
+
+    s_Initialized = false;
+    s_Workers.clear();
+    s_WorkerDeques.clear();
+}
+
+uint32_t TaskScheduler::GetThreadCount( void )
+{
+    return (uint32_t)s_Workers.size() + 1;
+}
+
+void TaskScheduler::TaskGroup::Run( Task&& NewTask )
+{
+    ++m_PendingTasks;
+    QueueJob(new Job(std::move(NewTask), this));
+}
+
+void TaskScheduler::TaskGroup::RunAfter( TaskGroup& Dependency, Task&& NewTask )
+{
+    ++m_PendingTasks;
+    Job* NewJob = new Job(std::move(NewTask), this);
+
+    {
+        // Dependency's last job takes the same lock before it queues its dependents
+        lock_guard<mutex> LockGuard(Dependency.m_DependentMutex);
+        if (Dependency.m_PendingTasks > 0)
+        {
+            Dependency.m_DependentJobs.push_back(NewJob);
+            return;
+        }
+    }
+
+    QueueJob(NewJob);
+}
+
+void TaskScheduler::TaskGroup::FinishTask( void )
+{
+    vector<Job*> ReadyJobs;
+    {
+        lock_guard<mutex> LockGuard(m_DependentMutex);
+        if (--m_PendingTasks == 0)
+            ReadyJobs.swap(m_DependentJobs);
+    }
+
+    for (Job* ReadyJob : ReadyJobs)
+        QueueJob(ReadyJob);
+}
+
+void TaskScheduler::TaskGroup::Wait( void )
+{
+    while (m_PendingTasks > 0)
+    {
+        if (!RunQueuedJob())
+            this_thread::yield();
+    }
+
+    // The last job drops the count while holding the lock, so once the lock is free nothing
+    // touches the group and the caller is free to destroy it
+    lock_guard<mutex> LockGuard(m_DependentMutex);
+}
+
+void TaskScheduler::Run( Task&& NewTask )
+{
+    QueueJob(new Job(std::move(NewTask), nullptr));
+}
+
+void TaskScheduler::ParallelFor( uint32_t Begin, uint32_t End, uint32_t GrainSize,
+    const function<void(uint32_t, uint32_t)>& Body )
+{
+    if (Begin >= End)
+        return;
+
+    if (GrainSize == 0)
+        GrainSize = 1;
+
+    TaskGroup Group;
+    function<void(uint32_t, uint32_t)> Split = [&]( uint32_t First, uint32_t Last )
+    {
+        while (Last - First > GrainSize)
+        {
+            const uint32_t Middle = First + (Last - First) / 2;
+            Group.Run([&Split, Middle, Last] { Split(Middle, Last); });
+            Last = Middle;
+        }
+        Body(First, Last);
+    };
+
+    Split(Begin, End);
+    Group.Wait();
+}
+
+TaskScheduler::ThreadStats TaskScheduler::GetThreadStats( uint32_t ThreadIndex )
+{
+    ThreadStats Stats = {};
+    if (s_ThreadCounters != nullptr && ThreadIndex < GetThreadCount())
+    {
+        Stats.JobCount = s_ThreadCounters[ThreadIndex].JobCount;
+        Stats.BusySeconds = s_ThreadCounters[ThreadIndex].BusyNanoseconds * 1e-9;
+    }
+    return Stats;
+}
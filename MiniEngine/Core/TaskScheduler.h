@@ -0,0 +1,104 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// A pool of worker threads, each with its own Chase-Lev deque of jobs.  A worker pushes
+// and pops jobs at the bottom of its deque without taking a lock and, when that runs dry,
+// steals from the top of another worker's deque.  Threads that aren't workers share one
+// locked queue.  A thread waiting on a TaskGroup runs queued jobs until the group is done
+// rather than blocking, so jobs may wait on other jobs.  There are no fibers, and nothing
+// but the standard library is used, so the scheduler builds on any platform.
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace TaskScheduler
+{
+    typedef std::function<void(void)> Task;
+
+    // Starts NumWorkers worker threads, or one per hardware thread less the calling
+    // thread when NumWorkers is 0.  Without workers, jobs run as soon as they are handed over.
+    void Initialize( uint32_t NumWorkers = 0 );
+
+    // Runs every job still queued before the workers exit
+    void Shutdown( void );
+
+    // The workers plus the thread that waits on their jobs
+    uint32_t GetThreadCount( void );
+
+    struct Job;
+
+    // Counts the group's unfinished jobs.  Jobs can also be made to wait for another group
+    // to finish, which is how dependencies between jobs are expressed.
+    class TaskGroup
+    {
+    public:
+        TaskGroup() : m_PendingTasks(0) {}
+        ~TaskGroup() { Wait(); }
+
+        TaskGroup(const TaskGroup&) = delete;
+        TaskGroup& operator=(const TaskGroup&) = delete;
+
+        void Run( Task&& NewTask );
+
+        // Queues NewTask once every job added to Dependency so far has finished.  NewTask
+        // counts as one of this group's jobs from now on.
+        void RunAfter( TaskGroup& Dependency, Task&& NewTask );
+
+        bool IsDone( void ) const { return m_PendingTasks == 0; }
+
+        // Runs queued jobs, this group's or any other's, until every job in this group has finished
+        void Wait( void );
+
+    private:
+        friend struct Job;
+        void FinishTask( void );
+
+        std::atomic<uint32_t> m_PendingTasks;
+
+        // Jobs of other groups waiting for this one
+        std::mutex m_DependentMutex;
+        std::vector<Job*> m_DependentJobs;
+    };
+
+    // Queues a job no one waits on, such as an asynchronous file read
+    void Run( Task&& NewTask );
+
+    // Calls Body(First, End) on ranges covering [Begin, End) of at most GrainSize items and
+    // returns once all of them are done.  The range is split in halves, leaving the other
+    // half to be stolen, so an idle thread always takes the largest piece left.
+    void ParallelFor( uint32_t Begin, uint32_t End, uint32_t GrainSize,
+        const std::function<void(uint32_t, uint32_t)>& Body );
+
+    // Calls Body(Index) for every index, with about four ranges per thread
+    template <typename IndexFunc>
+    void ParallelFor( uint32_t Begin, uint32_t End, IndexFunc Body )
+    {
+        const uint32_t Count = End > Begin ? End - Begin : 0;
+        const uint32_t GrainSize = Count / (GetThreadCount() * 4);
+        ParallelFor(Begin, End, GrainSize > 0 ? GrainSize : 1, [&Body]( uint32_t First, uint32_t Last )
+        {
+            for (uint32_t Index = First; Index < Last; ++Index)
+                Body(Index);
+        });
+    }
+
+    // Totals since Initialize for one thread, or for every thread that isn't a worker when
+    // ThreadIndex is 0.  A job that waits on others counts the time it spends running them.
+    struct ThreadStats
+    {
+        uint64_t JobCount;
+        double BusySeconds;
+    };
+    ThreadStats GetThreadStats( uint32_t ThreadIndex );
+}
@@ -18,8 +18,14 @@
 #include "DDSTextureLoader.h"
 #include "GraphicsCore.h"
 #include "CommandContext.h"
+#include "EngineProfiling.h"
+#include "EngineTuning.h"
+#include "SystemTime.h"
+#include "LoaderThreadPool.h"
+#include <algorithm>
+#include <atomic>
 #include <map>
-#include <thread>
+#include <mutex>
 
 using namespace std;
 using namespace Graphics;
@@ -161,6 +167,7 @@ namespace TextureManager
 
     void Shutdown( void )
     {
+        ShutdownStreaming();
         s_TextureCache.clear();
     }
 
@@ -238,6 +245,20 @@ namespace TextureManager
 
 } // namespace TextureManager
 
+void ManagedTexture::operator= ( const Texture& Tex )
+{
+    D3D12_CPU_DESCRIPTOR_HANDLE Handle = m_hCpuDescriptorHandle;
+    if (Handle.ptr == D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN)
+        Handle = AllocateDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+
+    g_Device->CopyDescriptorsSimple(1, Handle, Tex.GetSRV(), D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+    m_pResource = const_cast<ID3D12Resource*>(Tex.GetResource());
+    m_UsageState = D3D12_RESOURCE_STATE_GENERIC_READ;
+
+    // Set last, because WaitForLoad() returns as soon as the handle is valid
+    m_hCpuDescriptorHandle = Handle;
+}
+
 void ManagedTexture::WaitForLoad( void ) const
 {
     volatile D3D12_CPU_DESCRIPTOR_HANDLE& VolHandle = (volatile D3D12_CPU_DESCRIPTOR_HANDLE&)m_hCpuDescriptorHandle;
@@ -335,3 +356,300 @@ const ManagedTexture* TextureManager::LoadPIXImageFromFile( const std::wstring&
 
     return ManTex;
 }
+
+namespace TextureManager
+{
+    BoolVar AsyncLoading("Graphics/Textures/Async Loading", true);
+    IntVar StreamingBudgetMB("Graphics/Textures/Streaming Budget (MB)", 2048, 64, 16384, 64);
+    IntVar MaxLoadsInFlight("Graphics/Textures/Max Loads In Flight", 4, 1, 16, 1);
+
+    struct LoadRequest
+    {
+        ManagedTexture* Target;
+        vector<wstring> FileNames;
+        bool sRGB;
+        float Priority;
+        uint64_t Order;
+
+        // Written by the load job.  Loaded is created through a staging descriptor that
+        // is returned to the pool once its view has been copied to Target.
+        Texture Loaded;
+        uint64_t BytesRead;
+        bool Succeeded;
+    };
+
+    // Highest priority first, and in request order among equals
+    struct LoadRequestOrder
+    {
+        bool operator()( const LoadRequest* A, const LoadRequest* B ) const
+        {
+            return A->Priority < B->Priority || (A->Priority == B->Priority && A->Order > B->Order);
+        }
+    };
+
+    // Guards everything but the completed loads, which load jobs append to
+    mutex s_StreamMutex;
+    map< const ManagedTexture*, unique_ptr<LoadRequest> > s_LoadRequests;
+    vector<LoadRequest*> s_LoadQueue;
+    bool s_LoadQueueIsHeap = true;
+    uint64_t s_NextLoadOrder = 0;
+    uint32_t s_LoadsInFlight = 0;
+    vector<D3D12_CPU_DESCRIPTOR_HANDLE> s_StagingDescriptors;
+
+    // Loads block on file reads and on the upload of their mips, so they run on threads of
+    // their own rather than the TaskScheduler's.  A frame waiting on culling or recording
+    // jobs would otherwise pick up a load and stall until it was done.  There is at most one
+    // loader per load in flight.
+    TaskScheduler::LoaderThreadPool s_Loaders;
+
+    mutex s_CompletedMutex;
+    vector<LoadRequest*> s_CompletedLoads;
+
+    // File bytes read by loads that haven't been swapped in yet
+    atomic<uint64_t> s_BytesInFlight(0);
+
+    uint32_t s_CompletedLoadCount = 0;
+    uint64_t s_ResidentBytes = 0;
+    uint64_t s_BytesLoaded = 0;
+    int64_t s_FirstRequestTick = 0;
+    int64_t s_FirstFrameTick = 0;
+    int64_t s_LastLoadTick = 0;
+
+    D3D12_CPU_DESCRIPTOR_HANDLE AllocateStagingDescriptor( void )
+    {
+        if (s_StagingDescriptors.empty())
+            return AllocateDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+
+        D3D12_CPU_DESCRIPTOR_HANDLE Handle = s_StagingDescriptors.back();
+        s_StagingDescriptors.pop_back();
+        return Handle;
+    }
+
+    // Runs on a loader thread.  Creating the texture uploads its mips and waits for the copy.
+    void LoadRequestedTexture( LoadRequest& Request )
+    {
+        for (const wstring& FileName : Request.FileNames)
+        {
+            if (FileName.empty())
+                continue;
+
+            Utility::ByteArray ba = Utility::ReadFileSync( s_RootPath + FileName + L".dds" );
+            Request.BytesRead += ba->size();
+            s_BytesInFlight += ba->size();
+            if (ba->size() > 0 && Request.Loaded.CreateDDSFromMemory( ba->data(), ba->size(), Request.sRGB ))
+            {
+                Request.Loaded.GetResource()->SetName((FileName + L".dds").c_str());
+                Request.Succeeded = true;
+                return;
+            }
+
+            ba = Utility::ReadFileSync( s_RootPath + FileName + L".tga" );
+            Request.BytesRead += ba->size();
+            s_BytesInFlight += ba->size();
+            if (ba->size() > 0)
+            {
+                Request.Loaded.CreateTGAFromMemory( ba->data(), ba->size(), Request.sRGB );
+                Request.Loaded.GetResource()->SetName((FileName + L".tga").c_str());
+                Request.Succeeded = true;
+                return;
+            }
+        }
+    }
+
+    // Swaps a finished load in and forgets the request.  Called with s_StreamMutex held.
+    void FinishLoad( LoadRequest& Request )
+    {
+        if (Request.Succeeded)
+        {
+            D3D12_RESOURCE_DESC Desc = Request.Loaded->GetDesc();
+            s_ResidentBytes += g_Device->GetResourceAllocationInfo(1, 1, &Desc).SizeInBytes;
+            *Request.Target = Request.Loaded;
+        }
+        else
+        {
+            Request.Target->KeepPlaceholder();
+        }
+
+        s_BytesInFlight -= Request.BytesRead;
+        s_BytesLoaded += Request.BytesRead;
+        ++s_CompletedLoadCount;
+        s_LastLoadTick = SystemTime::GetCurrentTick();
+
+        s_StagingDescriptors.push_back(Request.Loaded.GetSRV());
+        s_LoadRequests.erase(Request.Target);
+    }
+
+    // Called with s_StreamMutex held
+    void StartLoad( LoadRequest* Request )
+    {
+        Request->Loaded = Texture(AllocateStagingDescriptor());
+        ++s_LoadsInFlight;
+
+        s_Loaders.Start([Request]
+        {
+            LoadRequestedTexture(*Request);
+
+            lock_guard<mutex> Guard(s_CompletedMutex);
+            s_CompletedLoads.push_back(Request);
+        }, s_LoadsInFlight);
+    }
+
+    void ShutdownStreaming( void )
+    {
+        {
+            lock_guard<mutex> Guard(s_StreamMutex);
+            s_LoadQueue.clear();
+        }
+
+        // Loads that haven't begun are dropped, their textures keep the placeholder
+        s_Loaders.Stop();
+        s_LoadsInFlight = 0;
+
+        s_CompletedLoads.clear();
+        s_LoadRequests.clear();
+        s_StagingDescriptors.clear();
+    }
+}
+
+const ManagedTexture* TextureManager::LoadFromFileAsync( const std::vector<std::wstring>& fileNames, bool sRGB,
+    const Texture& Placeholder, float Priority )
+{
+    wstring Key = L"Async:";
+    for (const wstring& FileName : fileNames)
+        Key += FileName + L"|";
+
+    auto ManagedTex = FindOrLoadTexture(Key);
+
+    ManagedTexture* ManTex = ManagedTex.first;
+    const bool RequestsLoad = ManagedTex.second;
+
+    if (!RequestsLoad)
+    {
+        ManTex->WaitForLoad();
+        return ManTex;
+    }
+
+    *ManTex = Placeholder;
+
+    LoadRequest* Request = new LoadRequest;
+    Request->Target = ManTex;
+    Request->FileNames = fileNames;
+    Request->sRGB = sRGB;
+    Request->Priority = Priority;
+    Request->BytesRead = 0;
+    Request->Succeeded = false;
+
+    lock_guard<mutex> Guard(s_StreamMutex);
+
+    if (s_FirstRequestTick == 0)
+        s_FirstRequestTick = SystemTime::GetCurrentTick();
+
+    Request->Order = s_NextLoadOrder++;
+    s_LoadRequests[ManTex].reset(Request);
+
+    if (AsyncLoading)
+    {
+        s_LoadQueue.push_back(Request);
+        s_LoadQueueIsHeap = false;
+    }
+    else
+    {
+        Request->Loaded = Texture(AllocateStagingDescriptor());
+        LoadRequestedTexture(*Request);
+        FinishLoad(*Request);
+    }
+
+    return ManTex;
+}
+
+void TextureManager::SetLoadPriority( const ManagedTexture* Texture, float Priority )
+{
+    lock_guard<mutex> Guard(s_StreamMutex);
+
+    auto iter = s_LoadRequests.find(Texture);
+    if (iter == s_LoadRequests.end() || iter->second->Priority == Priority)
+        return;
+
+    // Loads already started are no longer in the queue, so their priority doesn't matter
+    iter->second->Priority = Priority;
+    s_LoadQueueIsHeap = false;
+}
+
+void TextureManager::Update( void )
+{
+    vector<LoadRequest*> Completed;
+    {
+        lock_guard<mutex> Guard(s_CompletedMutex);
+        Completed.swap(s_CompletedLoads);
+    }
+
+    lock_guard<mutex> Guard(s_StreamMutex);
+
+    if (s_FirstRequestTick != 0 && s_FirstFrameTick == 0)
+        s_FirstFrameTick = SystemTime::GetCurrentTick();
+
+    // Nothing is rendering yet this frame, so the descriptors can be overwritten
+    for (LoadRequest* Request : Completed)
+    {
+        --s_LoadsInFlight;
+        FinishLoad(*Request);
+    }
+
+    if (!s_LoadQueueIsHeap)
+    {
+        make_heap(s_LoadQueue.begin(), s_LoadQueue.end(), LoadRequestOrder());
+        s_LoadQueueIsHeap = true;
+    }
+
+    // File sizes are only known once read, so the budget can be overrun by the loads in flight
+    const uint64_t BudgetBytes = (uint64_t)StreamingBudgetMB * 1024 * 1024;
+    while (!s_LoadQueue.empty() && s_LoadsInFlight < (uint32_t)MaxLoadsInFlight &&
+        s_ResidentBytes + s_BytesInFlight < BudgetBytes)
+    {
+        pop_heap(s_LoadQueue.begin(), s_LoadQueue.end(), LoadRequestOrder());
+        LoadRequest* Request = s_LoadQueue.back();
+        s_LoadQueue.pop_back();
+        StartLoad(Request);
+    }
+
+    EngineProfiling::SetCounter(L"Texture Loads Queued", (uint32_t)s_LoadQueue.size());
+    EngineProfiling::SetCounter(L"Texture Loads In Flight", s_LoadsInFlight);
+    EngineProfiling::SetCounter(L"Texture MB Streamed", (uint32_t)(s_ResidentBytes >> 20));
+}
+
+bool TextureManager::IsStreaming( void )
+{
+    lock_guard<mutex> Guard(s_StreamMutex);
+    return !s_LoadQueue.empty() || s_LoadsInFlight > 0;
+}
+
+TextureManager::StreamingStats TextureManager::GetStreamingStats( void )
+{
+    lock_guard<mutex> Guard(s_StreamMutex);
+
+    StreamingStats Stats;
+    Stats.QueuedLoads = (uint32_t)s_LoadQueue.size();
+    Stats.LoadsInFlight = s_LoadsInFlight;
+    Stats.CompletedLoads = s_CompletedLoadCount;
+    Stats.ResidentBytes = s_ResidentBytes;
+    Stats.BudgetBytes = (uint64_t)StreamingBudgetMB * 1024 * 1024;
+    Stats.BytesPerSecond = 0.0;
+    Stats.TimeToFirstFrame = 0.0;
+    Stats.TimeToLastLoad = 0.0;
+
+    if (s_FirstRequestTick != 0)
+    {
+        const bool Streaming = !s_LoadQueue.empty() || s_LoadsInFlight > 0;
+        const int64_t EndTick = Streaming || s_LastLoadTick == 0 ? SystemTime::GetCurrentTick() : s_LastLoadTick;
+        const double StreamingSeconds = SystemTime::TimeBetweenTicks(s_FirstRequestTick, EndTick);
+
+        if (StreamingSeconds > 0.0)
+            Stats.BytesPerSecond = s_BytesLoaded / StreamingSeconds;
+        if (s_FirstFrameTick != 0)
+            Stats.TimeToFirstFrame = SystemTime::TimeBetweenTicks(s_FirstRequestTick, s_FirstFrameTick);
+        if (!Streaming)
+            Stats.TimeToLastLoad = StreamingSeconds;
+    }
+
+    return Stats;
+}
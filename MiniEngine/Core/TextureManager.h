@@ -59,6 +59,8 @@ class ManagedTexture : public Texture
 public:
     ManagedTexture( const std::wstring& FileName ) : m_MapKey(FileName), m_IsValid(true) {}
 
+    // Shows Texture through this texture's descriptor.  The descriptor itself stays where it
+    // is, so handles copied from GetSRV() earlier see the new texture too.
     void operator= ( const Texture& Texture );
 
     void WaitForLoad(void) const;
@@ -67,6 +69,9 @@ public:
     void SetToInvalidTexture(void);
     bool IsValid(void) const { return m_IsValid; }
 
+    // For an asynchronous load that found none of its files, the placeholder stays
+    void KeepPlaceholder(void) { m_IsValid = false; }
+
 private:
     std::wstring m_MapKey;        // For deleting from the map later
     bool m_IsValid;
@@ -77,6 +82,11 @@ namespace TextureManager
     void Initialize( const std::wstring& TextureLibRoot );
     void Shutdown(void);
 
+    // Stops the loader threads, waiting for the loads they are running and dropping the rest.
+    // Graphics::Terminate calls it before idling the GPU, while the command queues and
+    // descriptor heaps the loads use still exist.  Shutdown calls it again.
+    void ShutdownStreaming( void );
+
     const ManagedTexture* LoadFromFile( const std::wstring& fileName, bool sRGB = false );
     const ManagedTexture* LoadDDSFromFile( const std::wstring& fileName, bool sRGB = false );
     const ManagedTexture* LoadTGAFromFile( const std::wstring& fileName, bool sRGB = false );
@@ -102,6 +112,43 @@ namespace TextureManager
         return LoadPIXImageFromFile(MakeWStr(fileName));
     }
 
+    // When false, LoadFromFileAsync loads the texture before returning, for callers that
+    // copy texture descriptors once rather than each frame
+    extern BoolVar AsyncLoading;
+
+    // Queues a load of the first of fileNames (without extension) found as a DDS or TGA
+    // file and returns at once.  The texture shows Placeholder until a loader thread has
+    // read and created it and Update() swaps it in, or for good if no file was found.
+    // Its descriptor never moves, so a GetSRV() copied when a draw is recorded always
+    // shows the current texture.  A copy made once, into a descriptor table of your own,
+    // keeps the placeholder.  Loads with a higher priority, such as screen size over
+    // distance, start first.
+    const ManagedTexture* LoadFromFileAsync( const std::vector<std::wstring>& fileNames, bool sRGB,
+        const Texture& Placeholder, float Priority = 0.0f );
+
+    // Reorders a load that hasn't started yet
+    void SetLoadPriority( const ManagedTexture* Texture, float Priority );
+
+    // Called once per frame, before rendering.  Swaps in textures that finished loading and
+    // starts the most important queued loads while they fit in the streaming budget.
+    void Update( void );
+
+    // True while any asynchronous load is queued or in flight
+    bool IsStreaming( void );
+
+    struct StreamingStats
+    {
+        uint32_t QueuedLoads;
+        uint32_t LoadsInFlight;
+        uint32_t CompletedLoads;
+        uint64_t ResidentBytes;     // GPU memory of the textures streamed in
+        uint64_t BudgetBytes;
+        double BytesPerSecond;      // File bytes read over the time spent streaming
+        double TimeToFirstFrame;    // Seconds from the first request to the first Update()
+        double TimeToLastLoad;      // Seconds from the first request until the queue last drained
+    };
+    StreamingStats GetStreamingStats( void );
+
     const Texture& GetBlackTex2D(void);
     const Texture& GetWhiteTex2D(void);
 }
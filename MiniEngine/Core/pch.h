@@ -43,9 +43,9 @@
 #include <memory>
 #include <string>
 #include <exception>
+#include <functional>
 
 #include <wrl.h>
-#include <ppltasks.h>
 
 #include "Utility.h"
 #include "VectorMath.h"
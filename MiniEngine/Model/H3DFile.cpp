@@ -0,0 +1,579 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+#include "H3DFile.h"
+#include <compressapi.h>
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+#pragma comment(lib, "Cabinet.lib")
+
+const char* H3DFile::s_CompressionString[] =
+{
+    "none",
+    "xpress",
+    "xpress_huff",
+    "mszip",
+};
+static_assert(_countof(H3DFile::s_CompressionString) == H3DFile::compressions, "s_CompressionString doesn't match compression enum");
+
+static DWORD CompressionAlgorithm(uint32_t compression)
+{
+    switch (compression)
+    {
+    case H3DFile::compression_xpress: return COMPRESS_ALGORITHM_XPRESS;
+    case H3DFile::compression_xpress_huff: return COMPRESS_ALGORITHM_XPRESS_HUFF;
+    case H3DFile::compression_mszip: return COMPRESS_ALGORITHM_MSZIP;
+    default: return 0;
+    }
+}
+
+static uint32_t AttribFormatSize(uint16_t format)
+{
+    switch (format)
+    {
+    case Model::attrib_format_ubyte:
+    case Model::attrib_format_byte:
+        return 1;
+    case Model::attrib_format_ushort:
+    case Model::attrib_format_short:
+        return 2;
+    case Model::attrib_format_float:
+        return 4;
+    default:
+        return 0;
+    }
+}
+
+// True if [offset, offset + size) lies within [0, limit). Written so that nothing
+// read from the file can wrap around.
+static bool RangeFits(uint64_t offset, uint64_t size, uint64_t limit)
+{
+    return offset <= limit && size <= limit - offset;
+}
+
+H3DFile::H3DFile()
+    : m_File(INVALID_HANDLE_VALUE)
+    , m_Mapping(nullptr)
+    , m_pBase(nullptr)
+{
+    Close();
+}
+
+H3DFile::~H3DFile()
+{
+    Close();
+}
+
+void H3DFile::Close()
+{
+    if (m_pBase != nullptr)
+        UnmapViewOfFile(m_pBase);
+    if (m_Mapping != nullptr)
+        CloseHandle(m_Mapping);
+    if (m_File != INVALID_HANDLE_VALUE)
+        CloseHandle(m_File);
+
+    m_File = INVALID_HANDLE_VALUE;
+    m_Mapping = nullptr;
+    m_pBase = nullptr;
+    m_FileSize = 0;
+
+    m_Version = 0;
+    m_IndexSize = 0;
+    m_Compression = compression_none;
+    m_pHeader = nullptr;
+    m_pMeshes = nullptr;
+    m_pMaterials = nullptr;
+    m_VertexData = {};
+    m_IndexData = {};
+    m_VertexDataDepth = {};
+    m_IndexDataDepth = {};
+
+    m_pMeshChunks = nullptr;
+    m_DecodedMaterials.clear();
+}
+
+bool H3DFile::Open(const char *filename)
+{
+    Close();
+
+    m_File = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (m_File == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(m_File, &fileSize) || fileSize.QuadPart < (LONGLONG)sizeof(Model::Header))
+    {
+        Close();
+        return false;
+    }
+    m_FileSize = (uint64_t)fileSize.QuadPart;
+
+    m_Mapping = CreateFileMappingA(m_File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (m_Mapping != nullptr)
+        m_pBase = (const unsigned char*)MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0);
+
+    if (m_pBase == nullptr || !Validate())
+    {
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+bool H3DFile::Validate()
+{
+    const uint32_t *magicAndVersion = (const uint32_t*)m_pBase;
+    if (magicAndVersion[0] == kMagic && magicAndVersion[1] == kVersionChunked)
+        return ValidateChunked();
+
+    // The mapping is page aligned, and so are the headers and mesh and material
+    // arrays in either revision, so they're all used in place
+    uint64_t headerOffset = 0;
+    const FileHeader *fileHeader = nullptr;
+    if (magicAndVersion[0] == kMagic)
+    {
+        fileHeader = (const FileHeader*)m_pBase;
+        headerOffset = sizeof(FileHeader);
+        if (m_FileSize < sizeof(FileHeader) + sizeof(Model::Header) || fileHeader->version != kVersionAligned)
+            return false;
+        if (fileHeader->sectionAlignment == 0 || (fileHeader->sectionAlignment & (fileHeader->sectionAlignment - 1)) != 0)
+            return false;
+        if (fileHeader->indexSize != sizeof(uint16_t) && fileHeader->indexSize != sizeof(uint32_t))
+            return false;
+    }
+
+    m_pHeader = (const Model::Header*)(m_pBase + headerOffset);
+    const Model::Header &header = *m_pHeader;
+
+    uint64_t meshesOffset = headerOffset + sizeof(Model::Header);
+    uint64_t materialsOffset = meshesOffset + (uint64_t)sizeof(Model::Mesh) * header.meshCount;
+    uint64_t materialsEnd = materialsOffset + (uint64_t)sizeof(Model::Material) * header.materialCount;
+    if (materialsEnd > m_FileSize)
+        return false;
+    m_pMeshes = (const Model::Mesh*)(m_pBase + meshesOffset);
+    m_pMaterials = (const Model::Material*)(m_pBase + materialsOffset);
+
+    uint64_t vertexDataOffset, indexDataOffset, vertexDataDepthOffset, indexDataDepthOffset;
+    if (fileHeader != nullptr)
+    {
+        m_Version = fileHeader->version;
+        m_IndexSize = fileHeader->indexSize;
+        vertexDataOffset = fileHeader->vertexDataOffset;
+        indexDataOffset = fileHeader->indexDataOffset;
+        vertexDataDepthOffset = fileHeader->vertexDataDepthOffset;
+        indexDataDepthOffset = fileHeader->indexDataDepthOffset;
+
+        const uint64_t alignmentMask = fileHeader->sectionAlignment - 1;
+        if ((vertexDataOffset | indexDataOffset | vertexDataDepthOffset | indexDataDepthOffset) & alignmentMask)
+            return false;
+    }
+    else
+    {
+        m_Version = 0;
+        m_IndexSize = Model::ComputeIndexSize(header, m_pMeshes);
+        vertexDataOffset = materialsEnd;
+        indexDataOffset = vertexDataOffset + header.vertexDataByteSize;
+        vertexDataDepthOffset = indexDataOffset + header.indexDataByteSize;
+        indexDataDepthOffset = vertexDataDepthOffset + header.vertexDataByteSizeDepth;
+    }
+
+    auto makeSection = [this, materialsEnd](uint64_t offset, uint32_t size, Span &section) -> bool
+    {
+        if (offset < materialsEnd || !RangeFits(offset, size, m_FileSize))
+            return false;
+        section.data = m_pBase + offset;
+        section.size = size;
+        return true;
+    };
+    if (!makeSection(vertexDataOffset, header.vertexDataByteSize, m_VertexData) ||
+        !makeSection(indexDataOffset, header.indexDataByteSize, m_IndexData) ||
+        !makeSection(vertexDataDepthOffset, header.vertexDataByteSizeDepth, m_VertexDataDepth) ||
+        !makeSection(indexDataDepthOffset, header.indexDataByteSize, m_IndexDataDepth))
+        return false;
+
+    return ValidateMeshRanges();
+}
+
+bool H3DFile::ValidateMeshRanges() const
+{
+    const Model::Header &header = *m_pHeader;
+    for (uint32_t meshIndex = 0; meshIndex < header.meshCount; ++meshIndex)
+    {
+        const Model::Mesh &mesh = m_pMeshes[meshIndex];
+
+        // Materials are looked up by index when the model is drawn, so every mesh needs one
+        if (mesh.materialIndex >= header.materialCount)
+            return false;
+        if (!RangeFits(mesh.vertexDataByteOffset, (uint64_t)mesh.vertexCount * mesh.vertexStride, header.vertexDataByteSize))
+            return false;
+        if (!RangeFits(mesh.vertexDataByteOffsetDepth, (uint64_t)mesh.vertexCountDepth * mesh.vertexStrideDepth, header.vertexDataByteSizeDepth))
+            return false;
+        if (!RangeFits(mesh.indexDataByteOffset, (uint64_t)mesh.indexCount * m_IndexSize, header.indexDataByteSize))
+            return false;
+    }
+    return true;
+}
+
+// Every enabled stored attribute must fit in the stored vertex and either match
+// the decoded attribute exactly or expand to a float one with as many components
+static bool ValidateStoredAttribs(const Model::Attrib *attribs, const Model::Attrib *storedAttribs,
+    unsigned int attribsEnabled, unsigned int vertexStride, unsigned int storedStride)
+{
+    for (int n = 0; n < Model::maxAttribs; n++)
+    {
+        if ((attribsEnabled & (1 << n)) == 0)
+            continue;
+
+        const Model::Attrib &attrib = attribs[n];
+        const Model::Attrib &stored = storedAttribs[n];
+        uint32_t size = AttribFormatSize(attrib.format) * attrib.components;
+        uint32_t storedSize = AttribFormatSize(stored.format) * stored.components;
+        if (size == 0 || storedSize == 0 || attrib.offset + size > vertexStride || stored.offset + storedSize > storedStride)
+            return false;
+        if (stored.components != attrib.components)
+            return false;
+        if (stored.format != attrib.format && attrib.format != Model::attrib_format_float)
+            return false;
+    }
+    return true;
+}
+
+bool H3DFile::ValidateChunked()
+{
+    const ChunkedFileHeader *fileHeader = (const ChunkedFileHeader*)m_pBase;
+    if (m_FileSize < sizeof(ChunkedFileHeader) + sizeof(Model::Header))
+        return false;
+    if (fileHeader->indexSize != sizeof(uint16_t) && fileHeader->indexSize != sizeof(uint32_t))
+        return false;
+    if (fileHeader->compression >= compressions)
+        return false;
+
+    m_Version = fileHeader->version;
+    m_IndexSize = fileHeader->indexSize;
+    m_Compression = fileHeader->compression;
+
+    m_pHeader = (const Model::Header*)(m_pBase + sizeof(ChunkedFileHeader));
+    const Model::Header &header = *m_pHeader;
+
+    // Meshes are stored as they are, so the remaining bytes bound their count
+    uint64_t meshesOffset = sizeof(ChunkedFileHeader) + sizeof(Model::Header);
+    if (header.meshCount > (m_FileSize - meshesOffset) / sizeof(Model::Mesh))
+        return false;
+    uint64_t meshesEnd = meshesOffset + (uint64_t)sizeof(Model::Mesh) * header.meshCount;
+    uint64_t tocSize = (uint64_t)sizeof(MeshChunk) * header.meshCount;
+    if (fileHeader->tocOffset < meshesEnd || !RangeFits(fileHeader->tocOffset, tocSize, m_FileSize) ||
+        fileHeader->tocOffset % alignof(MeshChunk) != 0)
+        return false;
+    uint64_t tocEnd = fileHeader->tocOffset + tocSize;
+    m_pMeshes = (const Model::Mesh*)(m_pBase + meshesOffset);
+    m_pMeshChunks = (const MeshChunk*)(m_pBase + fileHeader->tocOffset);
+
+    // Materials are mostly zero padded paths, compressed they're a small fraction
+    // of their in-memory size. None of the codecs gets a whole material into less
+    // than a byte, which bounds the count before anything is allocated for them.
+    if (fileHeader->materialsOffset < tocEnd || !RangeFits(fileHeader->materialsOffset, fileHeader->materialsCompressedSize, m_FileSize))
+        return false;
+    if (header.materialCount > m_FileSize - fileHeader->materialsOffset)
+        return false;
+    uint64_t materialsSize = (uint64_t)sizeof(Model::Material) * header.materialCount;
+    if (materialsSize > UINT32_MAX)
+        return false;
+    m_DecodedMaterials.resize(header.materialCount);
+    if (!Decompress(m_pBase + fileHeader->materialsOffset, fileHeader->materialsCompressedSize, m_DecodedMaterials.data(), (uint32_t)materialsSize))
+        return false;
+    m_pMaterials = m_DecodedMaterials.data();
+
+    if (!ValidateMeshRanges())
+        return false;
+
+    for (uint32_t meshIndex = 0; meshIndex < header.meshCount; ++meshIndex)
+    {
+        const Model::Mesh &mesh = m_pMeshes[meshIndex];
+        const MeshChunk &chunk = m_pMeshChunks[meshIndex];
+
+        if (chunk.offset < tocEnd || !RangeFits(chunk.offset, chunk.compressedSize, m_FileSize) || chunk.compressedSize > chunk.uncompressedSize)
+            return false;
+
+        uint64_t expectedSize =
+            (uint64_t)mesh.vertexCount * chunk.storedStride +
+            (uint64_t)mesh.vertexCountDepth * chunk.storedStrideDepth +
+            2 * (uint64_t)mesh.indexCount * m_IndexSize;
+        if (chunk.uncompressedSize != expectedSize)
+            return false;
+
+        if (!ValidateStoredAttribs(mesh.attrib, chunk.storedAttrib, mesh.attribsEnabled, mesh.vertexStride, chunk.storedStride) ||
+            !ValidateStoredAttribs(mesh.attribDepth, chunk.storedAttribDepth, mesh.attribsEnabledDepth, mesh.vertexStrideDepth, chunk.storedStrideDepth))
+            return false;
+    }
+
+    return true;
+}
+
+bool H3DFile::Decompress(const unsigned char *compressed, uint32_t compressedSize, void *data, uint32_t size) const
+{
+    // Chunks that didn't get any smaller are stored raw
+    if (compressedSize == size)
+    {
+        memcpy(data, compressed, size);
+        return true;
+    }
+
+    DECOMPRESSOR_HANDLE decompressor = nullptr;
+    if (m_Compression == compression_none || !CreateDecompressor(CompressionAlgorithm(m_Compression), nullptr, &decompressor))
+        return false;
+
+    SIZE_T decompressedSize = 0;
+    BOOL ok = ::Decompress(decompressor, compressed, compressedSize, data, size, &decompressedSize);
+    CloseDecompressor(decompressor);
+
+    return ok && decompressedSize == size;
+}
+
+bool H3DFile::Compress(uint32_t compression, const void *data, size_t size, std::vector<unsigned char> &compressed)
+{
+    COMPRESSOR_HANDLE compressor = nullptr;
+    if (compression == compression_none || size == 0 || !CreateCompressor(CompressionAlgorithm(compression), nullptr, &compressor))
+        return false;
+
+    // The first call only reports how big the output buffer needs to be
+    SIZE_T compressedSize = 0;
+    ::Compress(compressor, data, size, nullptr, 0, &compressedSize);
+    compressed.resize(compressedSize);
+    BOOL ok = compressedSize > 0 && ::Compress(compressor, data, size, compressed.data(), compressed.size(), &compressedSize);
+    CloseCompressor(compressor);
+
+    if (!ok || compressedSize >= size)
+        return false;
+
+    compressed.resize(compressedSize);
+    return true;
+}
+
+static float LoadAttribComponent(const unsigned char *src, const Model::Attrib &attrib)
+{
+    switch (attrib.format)
+    {
+    case Model::attrib_format_ubyte: { uint8_t v; memcpy(&v, src, 1); return attrib.normalized ? v / 255.0f : (float)v; }
+    case Model::attrib_format_byte: { int8_t v; memcpy(&v, src, 1); return attrib.normalized ? std::max(v / 127.0f, -1.0f) : (float)v; }
+    case Model::attrib_format_ushort: { uint16_t v; memcpy(&v, src, 2); return attrib.normalized ? v / 65535.0f : (float)v; }
+    case Model::attrib_format_short: { int16_t v; memcpy(&v, src, 2); return attrib.normalized ? std::max(v / 32767.0f, -1.0f) : (float)v; }
+    default: { float v; memcpy(&v, src, 4); return v; }
+    }
+}
+
+// Copies or expands each enabled attribute from the stored layout to the mesh's
+static void DecodeVertices(
+    const unsigned char *storedData, const Model::Attrib *storedAttribs, uint32_t storedStride,
+    unsigned char *vertexData, const Model::Attrib *attribs, uint32_t vertexStride,
+    unsigned int attribsEnabled, uint32_t vertexCount, const H3DFile::MeshChunk &chunk)
+{
+    if (storedStride == vertexStride && memcmp(storedAttribs, attribs, sizeof(Model::Attrib) * Model::maxAttribs) == 0)
+    {
+        memcpy(vertexData, storedData, (size_t)vertexCount * vertexStride);
+        return;
+    }
+
+    memset(vertexData, 0, (size_t)vertexCount * vertexStride);
+    for (int n = 0; n < Model::maxAttribs; n++)
+    {
+        if ((attribsEnabled & (1 << n)) == 0)
+            continue;
+
+        const Model::Attrib &attrib = attribs[n];
+        const Model::Attrib &stored = storedAttribs[n];
+        const uint32_t storedComponentSize = AttribFormatSize(stored.format);
+        const bool isQuantizedPosition = (n == Model::attrib_position && stored.format == Model::attrib_format_ushort && stored.normalized);
+
+        for (uint32_t v = 0; v < vertexCount; v++)
+        {
+            const unsigned char *src = storedData + v * storedStride + stored.offset;
+            unsigned char *dst = vertexData + v * vertexStride + attrib.offset;
+            if (stored.format == attrib.format)
+            {
+                memcpy(dst, src, storedComponentSize * stored.components);
+                continue;
+            }
+
+            for (uint32_t c = 0; c < stored.components; c++)
+            {
+                float value = LoadAttribComponent(src + c * storedComponentSize, stored);
+                if (isQuantizedPosition && c < 3)
+                    value = value * chunk.positionScale[c] + chunk.positionBias[c];
+                memcpy(dst + c * sizeof(float), &value, sizeof(float));
+            }
+        }
+    }
+}
+
+bool H3DFile::DecodeMesh(uint32_t meshIndex, unsigned char *vertexData, unsigned char *indexData,
+    unsigned char *vertexDataDepth, unsigned char *indexDataDepth) const
+{
+    const Model::Mesh &mesh = m_pMeshes[meshIndex];
+    const MeshChunk &chunk = m_pMeshChunks[meshIndex];
+
+    std::vector<unsigned char> decompressed;
+    const unsigned char *payload = m_pBase + chunk.offset;
+    if (chunk.compressedSize != chunk.uncompressedSize)
+    {
+        decompressed.resize(chunk.uncompressedSize);
+        if (!Decompress(payload, chunk.compressedSize, decompressed.data(), chunk.uncompressedSize))
+            return false;
+        payload = decompressed.data();
+    }
+
+    const size_t indexDataSize = (size_t)mesh.indexCount * m_IndexSize;
+
+    DecodeVertices(payload, chunk.storedAttrib, chunk.storedStride,
+        vertexData + mesh.vertexDataByteOffset, mesh.attrib, mesh.vertexStride,
+        mesh.attribsEnabled, mesh.vertexCount, chunk);
+    payload += (size_t)mesh.vertexCount * chunk.storedStride;
+
+    memcpy(indexData + mesh.indexDataByteOffset, payload, indexDataSize);
+    payload += indexDataSize;
+
+    DecodeVertices(payload, chunk.storedAttribDepth, chunk.storedStrideDepth,
+        vertexDataDepth + mesh.vertexDataByteOffsetDepth, mesh.attribDepth, mesh.vertexStrideDepth,
+        mesh.attribsEnabledDepth, mesh.vertexCountDepth, chunk);
+    payload += (size_t)mesh.vertexCountDepth * chunk.storedStrideDepth;
+
+    memcpy(indexDataDepth + mesh.indexDataByteOffset, payload, indexDataSize);
+
+    return true;
+}
+
+static void StoreQuantizedComponent(unsigned char *dst, float value, const Model::Attrib &stored)
+{
+    if (stored.format == Model::attrib_format_ushort)
+    {
+        uint16_t v = (uint16_t)(std::min(std::max(value, 0.0f), 1.0f) * 65535.0f + 0.5f);
+        memcpy(dst, &v, 2);
+    }
+    else
+    {
+        int16_t v = (int16_t)floorf(std::min(std::max(value, -1.0f), 1.0f) * 32767.0f + 0.5f);
+        memcpy(dst, &v, 2);
+    }
+}
+
+// Lays out the stored attributes back to back. When quantizing, float positions
+// become unorm16 and float normals, tangents and bitangents become snorm16.
+static uint32_t BuildStoredLayout(const Model::Attrib *attribs, unsigned int attribsEnabled, bool quantize, Model::Attrib *storedAttribs)
+{
+    memset(storedAttribs, 0, sizeof(Model::Attrib) * Model::maxAttribs);
+
+    uint32_t storedStride = 0;
+    for (int n = 0; n < Model::maxAttribs; n++)
+    {
+        if ((attribsEnabled & (1 << n)) == 0)
+            continue;
+
+        Model::Attrib &stored = storedAttribs[n];
+        stored = attribs[n];
+        if (quantize && attribs[n].format == Model::attrib_format_float)
+        {
+            if (n == Model::attrib_position && attribs[n].components == 3)
+            {
+                stored.format = Model::attrib_format_ushort;
+                stored.normalized = 1;
+            }
+            else if (n == Model::attrib_normal || n == Model::attrib_tangent || n == Model::attrib_bitangent)
+            {
+                stored.format = Model::attrib_format_short;
+                stored.normalized = 1;
+            }
+        }
+        stored.offset = (uint16_t)storedStride;
+        storedStride += AttribFormatSize(stored.format) * stored.components;
+    }
+    return storedStride;
+}
+
+static void EncodeVertices(
+    const unsigned char *vertexData, const Model::Attrib *attribs, uint32_t vertexStride,
+    const Model::Attrib *storedAttribs, uint32_t storedStride,
+    unsigned int attribsEnabled, uint32_t vertexCount, const H3DFile::MeshChunk &chunk,
+    unsigned char *storedData)
+{
+    for (int n = 0; n < Model::maxAttribs; n++)
+    {
+        if ((attribsEnabled & (1 << n)) == 0)
+            continue;
+
+        const Model::Attrib &attrib = attribs[n];
+        const Model::Attrib &stored = storedAttribs[n];
+        const uint32_t storedComponentSize = AttribFormatSize(stored.format);
+        const bool isQuantizedPosition = (n == Model::attrib_position && stored.format == Model::attrib_format_ushort && stored.normalized);
+
+        for (uint32_t v = 0; v < vertexCount; v++)
+        {
+            const unsigned char *src = vertexData + v * vertexStride + attrib.offset;
+            unsigned char *dst = storedData + v * storedStride + stored.offset;
+            if (stored.format == attrib.format)
+            {
+                memcpy(dst, src, storedComponentSize * stored.components);
+                continue;
+            }
+
+            for (uint32_t c = 0; c < stored.components; c++)
+            {
+                float value;
+                memcpy(&value, src + c * sizeof(float), sizeof(float));
+                if (isQuantizedPosition)
+                    value = chunk.positionScale[c] > 0.0f ? (value - chunk.positionBias[c]) / chunk.positionScale[c] : 0.0f;
+                StoreQuantizedComponent(dst + c * storedComponentSize, value, stored);
+            }
+        }
+    }
+}
+
+void H3DFile::EncodeMesh(const Model &model, uint32_t meshIndex, bool quantize,
+    MeshChunk &chunk, std::vector<unsigned char> &payload)
+{
+    const Model::Mesh &mesh = model.m_pMesh[meshIndex];
+    const uint32_t indexSize = model.m_IndexSize;
+
+    memset(&chunk, 0, sizeof(chunk));
+    const Vector3 boundsMin = mesh.boundingBox.min;
+    const Vector3 boundsMax = mesh.boundingBox.max;
+    chunk.boundsMin[0] = boundsMin.GetX(); chunk.boundsMin[1] = boundsMin.GetY(); chunk.boundsMin[2] = boundsMin.GetZ();
+    chunk.boundsMax[0] = boundsMax.GetX(); chunk.boundsMax[1] = boundsMax.GetY(); chunk.boundsMax[2] = boundsMax.GetZ();
+    for (int axis = 0; axis < 3; axis++)
+    {
+        chunk.positionBias[axis] = chunk.boundsMin[axis];
+        chunk.positionScale[axis] = chunk.boundsMax[axis] - chunk.boundsMin[axis];
+    }
+
+    chunk.storedStride = BuildStoredLayout(mesh.attrib, mesh.attribsEnabled, quantize, chunk.storedAttrib);
+    chunk.storedStrideDepth = BuildStoredLayout(mesh.attribDepth, mesh.attribsEnabledDepth, quantize, chunk.storedAttribDepth);
+
+    const size_t indexDataSize = (size_t)mesh.indexCount * indexSize;
+    const size_t vertexDataSize = (size_t)mesh.vertexCount * chunk.storedStride;
+    const size_t vertexDataSizeDepth = (size_t)mesh.vertexCountDepth * chunk.storedStrideDepth;
+    payload.assign(vertexDataSize + vertexDataSizeDepth + 2 * indexDataSize, 0);
+    unsigned char *dst = payload.data();
+
+    EncodeVertices(model.m_pVertexData + mesh.vertexDataByteOffset, mesh.attrib, mesh.vertexStride,
+        chunk.storedAttrib, chunk.storedStride, mesh.attribsEnabled, mesh.vertexCount, chunk, dst);
+    dst += vertexDataSize;
+
+    memcpy(dst, model.m_pIndexData + mesh.indexDataByteOffset, indexDataSize);
+    dst += indexDataSize;
+
+    EncodeVertices(model.m_pVertexDataDepth + mesh.vertexDataByteOffsetDepth, mesh.attribDepth, mesh.vertexStrideDepth,
+        chunk.storedAttribDepth, chunk.storedStrideDepth, mesh.attribsEnabledDepth, mesh.vertexCountDepth, chunk, dst);
+    dst += vertexDataSizeDepth;
+
+    memcpy(dst, model.m_pIndexDataDepth + mesh.indexDataByteOffset, indexDataSize);
+
+    chunk.uncompressedSize = (uint32_t)payload.size();
+}
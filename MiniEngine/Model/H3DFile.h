@@ -0,0 +1,176 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+#pragma once
+
+#include "Model.h"
+
+// Read-only view of an .h3d file mapped into memory. Open() validates the headers
+// and every mesh's vertex and index ranges, after which the headers and data
+// sections are used in place, straight out of the mapping.
+//
+// Revision 0 files are Header, meshes, materials, then the four data sections
+// packed back to back. Revision 1 files start with a FileHeader that records the
+// index size and where each section is. Every section is aligned to
+// sectionAlignment so it can be handed to an upload or an unbuffered read as is.
+//
+// Revision 2 files are chunked: a ChunkedFileHeader, the Header and meshes, a
+// table of contents with one MeshChunk per mesh, the compressed materials, then
+// one compressed chunk per mesh holding its vertices and indices for both
+// streams. Chunks decode independently, so they can be decoded in parallel or
+// streamed in any order, and the table of contents carries each mesh's bounds so
+// that order can be nearest-first. The Header and meshes describe the decoded
+// model, exactly as a revision 1 file would.
+class H3DFile
+{
+public:
+
+    // A revision 0 file starts with its mesh count, which is never this large
+    static const uint32_t kMagic = 0x20443348; // "H3D "
+    static const uint32_t kVersionAligned = 1;
+    static const uint32_t kVersionChunked = 2;
+    static const uint32_t kSectionAlignment = 4096;
+    static const uint32_t kChunkAlignment = 64;
+
+    struct FileHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t sectionAlignment;
+        uint32_t indexSize; // 2 or 4 bytes
+        uint64_t vertexDataOffset;
+        uint64_t indexDataOffset;
+        uint64_t vertexDataDepthOffset;
+        uint64_t indexDataDepthOffset;
+    };
+    static_assert(sizeof(FileHeader) % 16 == 0, "the Model::Header following the FileHeader must stay 16 byte aligned");
+
+    // Chunk compression, backed by the Windows compression API. XPRESS is an LZ77
+    // codec in the same class as LZ4, MSZIP is deflate.
+    enum
+    {
+        compression_none = 0,
+        compression_xpress,
+        compression_xpress_huff,
+        compression_mszip,
+
+        compressions
+    };
+    static const char *s_CompressionString[];
+
+    enum
+    {
+        // Positions are stored as unorm16 across the mesh's bounds and normals,
+        // tangents and bitangents as snorm16
+        flag_quantized = (1 << 0),
+    };
+
+    struct ChunkedFileHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t chunkAlignment;
+        uint32_t indexSize; // 2 or 4 bytes
+        uint32_t compression;
+        uint32_t flags;
+        uint64_t tocOffset; // MeshChunk[meshCount]
+        uint64_t materialsOffset;
+        uint32_t materialsCompressedSize; // decodes to Material[materialCount]
+        uint32_t reserved;
+    };
+    static_assert(sizeof(ChunkedFileHeader) % 16 == 0, "the Model::Header following the ChunkedFileHeader must stay 16 byte aligned");
+
+    // A chunk decodes to the mesh's vertices in the stored layout, its indices,
+    // its depth-only vertices in the stored layout, then its depth-only indices.
+    // Stored attributes are expanded back to the formats in the Mesh on decode.
+    struct MeshChunk
+    {
+        float boundsMin[3]; // the mesh's bounds, so chunks can be culled or ordered without decoding them
+        float boundsMax[3];
+        float positionScale[3]; // unorm16 positions decode to value * scale + bias
+        float positionBias[3];
+        uint64_t offset;
+        uint32_t compressedSize; // same as uncompressedSize when stored raw
+        uint32_t uncompressedSize;
+        uint32_t storedStride;
+        uint32_t storedStrideDepth;
+        Model::Attrib storedAttrib[Model::maxAttribs];
+        Model::Attrib storedAttribDepth[Model::maxAttribs];
+    };
+
+    struct Span
+    {
+        const unsigned char *data;
+        uint32_t size;
+    };
+
+    H3DFile();
+    ~H3DFile();
+
+    H3DFile(const H3DFile&) = delete;
+    H3DFile& operator=(const H3DFile&) = delete;
+
+    // Returns false if the file can't be mapped or any header, section, chunk or
+    // mesh range is inconsistent with the file size
+    bool Open(const char *filename);
+    void Close();
+
+    uint32_t GetVersion() const { return m_Version; }
+    uint32_t GetIndexSize() const { return m_IndexSize; }
+    bool IsChunked() const { return m_Version == kVersionChunked; }
+
+    const Model::Header& GetHeader() const { return *m_pHeader; }
+    const Model::Mesh* GetMeshes() const { return m_pMeshes; }
+    const Model::Material* GetMaterials() const { return m_pMaterials; }
+
+    // Revisions 0 and 1 only, chunked files have no data sections to map
+    Span GetVertexData() const { return m_VertexData; }
+    Span GetIndexData() const { return m_IndexData; }
+    Span GetVertexDataDepth() const { return m_VertexDataDepth; }
+    Span GetIndexDataDepth() const { return m_IndexDataDepth; }
+
+    // Revision 2 only. Decodes one mesh into buffers laid out as the Header's
+    // data sections, writing only that mesh's ranges, so different meshes can be
+    // decoded into the same buffers from different threads.
+    const MeshChunk& GetMeshChunk(uint32_t meshIndex) const { return m_pMeshChunks[meshIndex]; }
+    bool DecodeMesh(uint32_t meshIndex, unsigned char *vertexData, unsigned char *indexData,
+        unsigned char *vertexDataDepth, unsigned char *indexDataDepth) const;
+
+    // Used by Model::SaveH3DChunked to build and compress one mesh chunk. Fills
+    // in everything in the MeshChunk but its offset and compressed size.
+    static void EncodeMesh(const Model &model, uint32_t meshIndex, bool quantize,
+        MeshChunk &chunk, std::vector<unsigned char> &payload);
+    static bool Compress(uint32_t compression, const void *data, size_t size, std::vector<unsigned char> &compressed);
+
+private:
+
+    bool Validate();
+    bool ValidateChunked();
+    bool ValidateMeshRanges() const;
+    bool Decompress(const unsigned char *compressed, uint32_t compressedSize, void *data, uint32_t size) const;
+
+    HANDLE m_File;
+    HANDLE m_Mapping;
+    const unsigned char *m_pBase;
+    uint64_t m_FileSize;
+
+    uint32_t m_Version;
+    uint32_t m_IndexSize;
+    uint32_t m_Compression;
+    const Model::Header *m_pHeader;
+    const Model::Mesh *m_pMeshes;
+    const Model::Material *m_pMaterials;
+    Span m_VertexData;
+    Span m_IndexData;
+    Span m_VertexDataDepth;
+    Span m_IndexDataDepth;
+
+    const MeshChunk *m_pMeshChunks;
+    std::vector<Model::Material> m_DecodedMaterials;
+};
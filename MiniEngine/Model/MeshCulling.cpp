@@ -0,0 +1,59 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+#include "MeshCulling.h"
+#include <intrin.h>
+
+void MeshCuller::Init(const Model& model)
+{
+    m_MeshCount = model.m_Header.meshCount;
+
+    m_CenterX.resize(m_MeshCount);
+    m_CenterY.resize(m_MeshCount);
+    m_CenterZ.resize(m_MeshCount);
+    m_ExtentX.resize(m_MeshCount);
+    m_ExtentY.resize(m_MeshCount);
+    m_ExtentZ.resize(m_MeshCount);
+
+    for (uint32_t meshIndex = 0; meshIndex < m_MeshCount; ++meshIndex)
+    {
+        const Model::BoundingBox& bbox = model.m_pMesh[meshIndex].boundingBox;
+        const AxisAlignedBox box(bbox.min, bbox.max);
+        const Vector3 center = box.GetCenter();
+        const Vector3 extent = box.GetExtents();
+
+        m_CenterX[meshIndex] = center.GetX();
+        m_CenterY[meshIndex] = center.GetY();
+        m_CenterZ[meshIndex] = center.GetZ();
+        m_ExtentX[meshIndex] = extent.GetX();
+        m_ExtentY[meshIndex] = extent.GetY();
+        m_ExtentZ[meshIndex] = extent.GetZ();
+    }
+}
+
+void MeshCuller::Cull(const Math::Frustum& frustum, std::vector<uint32_t>& visibleMeshes) const
+{
+    visibleMeshes.clear();
+
+    std::vector<uint32_t> visibleMask((m_MeshCount + 31) / 32);
+    frustum.IntersectBoundingBoxes(m_CenterX.data(), m_CenterY.data(), m_CenterZ.data(),
+        m_ExtentX.data(), m_ExtentY.data(), m_ExtentZ.data(), m_MeshCount, visibleMask.data());
+
+    for (uint32_t word = 0; word < (uint32_t)visibleMask.size(); ++word)
+    {
+        uint32_t bits = visibleMask[word];
+        while (bits != 0)
+        {
+            unsigned long bit;
+            _BitScanForward(&bit, bits);
+            visibleMeshes.push_back(word * 32 + bit);
+            bits &= bits - 1;
+        }
+    }
+}
@@ -0,0 +1,47 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+#pragma once
+
+#include "Model.h"
+#include "Math/Frustum.h"
+#include <vector>
+
+// Culls a model's meshes against view frusta. The mesh bounding boxes are kept
+// as a structure of arrays of centers and half extents for the batched
+// Frustum::IntersectBoundingBoxes test.
+//
+// Cull() only reads the bounds, so any number of views can be culled at the
+// same time from different threads.
+class MeshCuller
+{
+public:
+
+    MeshCuller() : m_MeshCount(0) {}
+
+    // Copies the mesh bounding boxes, call again if they change
+    void Init(const Model& model);
+
+    // Replaces visibleMeshes with the meshes whose bounds intersect the frustum,
+    // in mesh order. The frustum must be in the model's space.
+    void Cull(const Math::Frustum& frustum, std::vector<uint32_t>& visibleMeshes) const;
+
+    uint32_t GetMeshCount() const { return m_MeshCount; }
+
+private:
+
+    uint32_t m_MeshCount;
+
+    std::vector<float> m_CenterX;
+    std::vector<float> m_CenterY;
+    std::vector<float> m_CenterZ;
+    std::vector<float> m_ExtentX;
+    std::vector<float> m_ExtentY;
+    std::vector<float> m_ExtentZ;
+};
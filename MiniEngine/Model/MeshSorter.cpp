@@ -0,0 +1,110 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+#include "MeshSorter.h"
+#include <assert.h>
+#include <string.h>
+
+namespace
+{
+    const uint32_t kMeshShift = 0;
+    const uint32_t kLowShift = 20;      // depth when sorting by state, material when sorting front to back
+    const uint32_t kHighShift = 36;     // material when sorting by state, depth when sorting front to back
+    const uint32_t kPSOShift = 52;
+    const uint32_t kPassShift = 60;
+
+    // Non-negative floats order the same as their bit patterns, so the top 16
+    // bits are a depth bucket: the exponent and 7 bits of mantissa.
+    uint32_t DepthBucket(float distance)
+    {
+        uint32_t bits;
+        memcpy(&bits, &distance, sizeof(bits));
+        return bits >> 16;
+    }
+}
+
+void MeshSorter::Reset(SortOrder order)
+{
+    m_Order = order;
+    m_Keys.clear();
+}
+
+void MeshSorter::AddMesh(uint32_t pass, uint32_t pso, uint32_t material, float distance, uint32_t meshIndex)
+{
+    assert(pass < kMaxPasses && pso < kMaxPSOs && material < kMaxMaterials && meshIndex < kMaxMeshes);
+
+    const uint64_t depth = DepthBucket(distance > 0.0f ? distance : 0.0f);
+    uint64_t key = (uint64_t)pass << kPassShift | (uint64_t)pso << kPSOShift | (uint64_t)meshIndex << kMeshShift;
+    if (m_Order == kSortFrontToBack)
+        key |= depth << kHighShift | (uint64_t)material << kLowShift;
+    else
+        key |= (uint64_t)material << kHighShift | depth << kLowShift;
+
+    m_Keys.push_back(key);
+}
+
+void MeshSorter::Sort()
+{
+    const size_t count = m_Keys.size();
+    if (count < 2)
+        return;
+
+    // One histogram per byte, all built in a single pass over the keys
+    uint32_t histograms[8][256] = {};
+    for (uint64_t key : m_Keys)
+    {
+        for (uint32_t byte = 0; byte < 8; ++byte)
+            ++histograms[byte][(key >> (byte * 8)) & 0xFF];
+    }
+
+    m_SortScratch.resize(count);
+    uint64_t* src = m_Keys.data();
+    uint64_t* dst = m_SortScratch.data();
+
+    // Least significant byte first. A byte that's the same in every key puts
+    // all of them in one bucket and is skipped.
+    for (uint32_t byte = 0; byte < 8; ++byte)
+    {
+        uint32_t* histogram = histograms[byte];
+        if (histogram[(src[0] >> (byte * 8)) & 0xFF] == count)
+            continue;
+
+        uint32_t offset = 0;
+        for (uint32_t bucket = 0; bucket < 256; ++bucket)
+        {
+            uint32_t bucketCount = histogram[bucket];
+            histogram[bucket] = offset;
+            offset += bucketCount;
+        }
+
+        for (size_t i = 0; i < count; ++i)
+            dst[histogram[(src[i] >> (byte * 8)) & 0xFF]++] = src[i];
+
+        uint64_t* swap = src;
+        src = dst;
+        dst = swap;
+    }
+
+    if (src != m_Keys.data())
+        m_Keys.swap(m_SortScratch);
+}
+
+MeshSorter::DrawPacket MeshSorter::GetPacket(uint32_t index) const
+{
+    const uint64_t key = m_Keys[index];
+    const uint32_t low = (uint32_t)(key >> kLowShift) & 0xFFFF;
+    const uint32_t high = (uint32_t)(key >> kHighShift) & 0xFFFF;
+
+    DrawPacket packet;
+    packet.pass = (uint32_t)(key >> kPassShift) & (kMaxPasses - 1);
+    packet.pso = (uint32_t)(key >> kPSOShift) & (kMaxPSOs - 1);
+    packet.material = m_Order == kSortFrontToBack ? low : high;
+    packet.meshIndex = (uint32_t)(key >> kMeshShift) & (kMaxMeshes - 1);
+    return packet;
+}
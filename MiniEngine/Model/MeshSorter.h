@@ -0,0 +1,62 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+// Orders mesh draws to minimize state changes. Each draw gets a 64-bit sort key
+// made of, from the most significant bits down:
+//
+//   pass (4 bits)       draws of a lower pass are submitted first
+//   pso (8 bits)        pipeline state within the pass
+//   material (16 bits)  descriptor table and constants
+//   depth (16 bits)     a coarse, logarithmic bucket of the distance to the viewer
+//   mesh (20 bits)      the mesh index, which also makes the order stable
+//
+// Sorting front to back swaps the material and depth fields, which suits depth
+// only passes where there are no material changes to save. The keys are radix
+// sorted, skipping the bytes every key has in common.
+class MeshSorter
+{
+public:
+
+    enum SortOrder { kSortByState, kSortFrontToBack };
+
+    static const uint32_t kMaxPasses = 1 << 4;
+    static const uint32_t kMaxPSOs = 1 << 8;
+    static const uint32_t kMaxMaterials = 1 << 16;
+    static const uint32_t kMaxMeshes = 1 << 20;
+
+    struct DrawPacket
+    {
+        uint32_t pass;
+        uint32_t pso;
+        uint32_t material;
+        uint32_t meshIndex;
+    };
+
+    // Clears the draw list, keeping its memory
+    void Reset(SortOrder order);
+
+    // distance is from the viewer to the mesh and must not be negative
+    void AddMesh(uint32_t pass, uint32_t pso, uint32_t material, float distance, uint32_t meshIndex);
+
+    void Sort();
+
+    uint32_t GetCount() const { return (uint32_t)m_Keys.size(); }
+    DrawPacket GetPacket(uint32_t index) const;
+
+private:
+
+    SortOrder m_Order;
+    std::vector<uint64_t> m_Keys;
+    std::vector<uint64_t> m_SortScratch;
+};
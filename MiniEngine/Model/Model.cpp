@@ -23,6 +23,7 @@ Model::Model()
     , m_pVertexDataDepth(nullptr)
     , m_pIndexDataDepth(nullptr)
     , m_SRVs(nullptr)
+    , m_Textures(nullptr)
 {
     Clear();
 }
@@ -59,6 +60,7 @@ void Model::Clear()
     m_pVertexDataDepth = nullptr;
     m_Header.vertexDataByteSizeDepth = 0;
     m_pIndexDataDepth = nullptr;
+    m_IndexSize = sizeof(uint16_t);
 
     ReleaseTextures();
 
@@ -66,6 +68,18 @@ void Model::Clear()
     m_Header.boundingBox.max = Vector3(0.0f);
 }
 
+uint32_t Model::ComputeIndexSize(const Header &header, const Mesh *meshes)
+{
+    uint64_t totalIndexCount = 0;
+    for (unsigned int meshIndex = 0; meshIndex < header.meshCount; meshIndex++)
+        totalIndexCount += meshes[meshIndex].indexCount;
+
+    if (totalIndexCount > 0 && header.indexDataByteSize == totalIndexCount * sizeof(uint32_t))
+        return sizeof(uint32_t);
+
+    return sizeof(uint16_t);
+}
+
 // assuming at least 3 floats for position
 void Model::ComputeMeshBoundingBox(unsigned int meshIndex, BoundingBox &bbox) const
 {
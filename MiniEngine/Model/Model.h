@@ -174,6 +174,7 @@ public:
     StructuredBuffer m_VertexBuffer;
     ByteAddressBuffer m_IndexBuffer;
     uint32_t m_VertexStride;
+    uint32_t m_IndexSize; // 2 or 4 bytes, shared by every mesh and both index buffers
 
     // optimized for depth-only rendering
     unsigned char *m_pVertexDataDepth;
@@ -197,10 +198,20 @@ public:
         return m_SRVs + materialIdx * 6;
     }
 
+    // Textures stream in after Load() returns.  Reorders the loads still queued so the
+    // textures of meshes that look largest from ViewerPosition arrive first.
+    void UpdateTexturePriorities( const Vector3& ViewerPosition ) const;
+
+    // Revision 0 .h3d files don't store the index size. Models with 32-bit indices
+    // are told apart by their index data being four bytes per index instead of two.
+    static uint32_t ComputeIndexSize(const Header &header, const Mesh *meshes);
+
 protected:
 
     bool LoadH3D(const char *filename);
     bool SaveH3D(const char *filename) const;
+    // Chunked revision, compression is one of H3DFile's compression_* values
+    bool SaveH3DChunked(const char *filename, uint32_t compression, bool quantize) const;
 
     void ComputeMeshBoundingBox(unsigned int meshIndex, BoundingBox &bbox) const;
     void ComputeGlobalBoundingBox(BoundingBox &bbox) const;
@@ -209,4 +220,5 @@ protected:
     void ReleaseTextures();
     void LoadTextures();
     D3D12_CPU_DESCRIPTOR_HANDLE* m_SRVs;
+    const ManagedTexture** m_Textures; // Material::texCount per material, null for texture slots not loaded
 };
@@ -12,33 +12,40 @@
 //
 
 #include "Model.h"
+#include "H3DFile.h"
 #include "Utility.h"
 #include "TextureManager.h"
 #include "GraphicsCore.h"
 #include "DescriptorHeap.h"
 #include "CommandContext.h"
+#include "TaskScheduler.h"
 #include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <map>
+#include <vector>
 
 bool Model::LoadH3D(const char *filename)
 {
-    FILE *file = nullptr;
-    if (0 != fopen_s(&file, filename, "rb"))
+    // The file is mapped and its sections are uploaded straight out of the
+    // mapping, so the data makes one pass through the page cache and isn't
+    // copied to the heap on the way
+    H3DFile file;
+    if (!file.Open(filename))
         return false;
 
-    bool ok = false;
-
-    if (1 != fread(&m_Header, sizeof(Header), 1, file)) goto h3d_load_fail;
+    m_Header = file.GetHeader();
+    if (m_Header.meshCount == 0)
+        return false;
 
     m_pMesh = new Mesh [m_Header.meshCount];
     m_pMaterial = new Material [m_Header.materialCount];
-
-    if (m_Header.meshCount > 0)
-        if (1 != fread(m_pMesh, sizeof(Mesh) * m_Header.meshCount, 1, file)) goto h3d_load_fail;
-    if (m_Header.materialCount > 0)
-        if (1 != fread(m_pMaterial, sizeof(Material) * m_Header.materialCount, 1, file)) goto h3d_load_fail;
+    memcpy(m_pMesh, file.GetMeshes(), sizeof(Mesh) * m_Header.meshCount);
+    memcpy(m_pMaterial, file.GetMaterials(), sizeof(Material) * m_Header.materialCount);
 
     m_VertexStride = m_pMesh[0].vertexStride;
     m_VertexStrideDepth = m_pMesh[0].vertexStrideDepth;
+    m_IndexSize = file.GetIndexSize();
 #if _DEBUG
     for (uint32_t meshIndex = 1; meshIndex < m_Header.meshCount; ++meshIndex)
     {
@@ -64,45 +71,71 @@ bool Model::LoadH3D(const char *filename)
     }
 #endif
 
-    m_pVertexData = new unsigned char[ m_Header.vertexDataByteSize ];
-    m_pIndexData = new unsigned char[ m_Header.indexDataByteSize ];
-    m_pVertexDataDepth = new unsigned char[ m_Header.vertexDataByteSizeDepth ];
-    m_pIndexDataDepth = new unsigned char[ m_Header.indexDataByteSize ];
-
-    if (m_Header.vertexDataByteSize > 0)
-        if (1 != fread(m_pVertexData, m_Header.vertexDataByteSize, 1, file)) goto h3d_load_fail;
-    if (m_Header.indexDataByteSize > 0)
-        if (1 != fread(m_pIndexData, m_Header.indexDataByteSize, 1, file)) goto h3d_load_fail;
+    if (m_VertexStride == 0 || m_VertexStrideDepth == 0)
+        return false;
 
-    if (m_Header.vertexDataByteSizeDepth > 0)
-        if (1 != fread(m_pVertexDataDepth, m_Header.vertexDataByteSizeDepth, 1, file)) goto h3d_load_fail;
-    if (m_Header.indexDataByteSize > 0)
-        if (1 != fread(m_pIndexDataDepth, m_Header.indexDataByteSize, 1, file)) goto h3d_load_fail;
-
-    m_VertexBuffer.Create(L"VertexBuffer", m_Header.vertexDataByteSize / m_VertexStride, m_VertexStride, m_pVertexData);
-    m_IndexBuffer.Create(L"IndexBuffer", m_Header.indexDataByteSize / sizeof(uint16_t), sizeof(uint16_t), m_pIndexData);
-    delete [] m_pVertexData;
-    m_pVertexData = nullptr;
-    delete [] m_pIndexData;
-    m_pIndexData = nullptr;
-
-    m_VertexBufferDepth.Create(L"VertexBufferDepth", m_Header.vertexDataByteSizeDepth / m_VertexStrideDepth, m_VertexStrideDepth, m_pVertexDataDepth);
-    m_IndexBufferDepth.Create(L"IndexBufferDepth", m_Header.indexDataByteSize / sizeof(uint16_t), sizeof(uint16_t), m_pIndexDataDepth);
-    delete [] m_pVertexDataDepth;
-    m_pVertexDataDepth = nullptr;
-    delete [] m_pIndexDataDepth;
-    m_pIndexDataDepth = nullptr;
+    if (file.IsChunked())
+    {
+        // Chunks are independent, decode them all in parallel and upload the result
+        m_pVertexData = new unsigned char[ m_Header.vertexDataByteSize ];
+        m_pIndexData = new unsigned char[ m_Header.indexDataByteSize ];
+        m_pVertexDataDepth = new unsigned char[ m_Header.vertexDataByteSizeDepth ];
+        m_pIndexDataDepth = new unsigned char[ m_Header.indexDataByteSize ];
+
+        std::atomic<bool> decodeFailed(false);
+        TaskScheduler::ParallelFor(0u, m_Header.meshCount, [&](uint32_t meshIndex)
+        {
+            if (!file.DecodeMesh(meshIndex, m_pVertexData, m_pIndexData, m_pVertexDataDepth, m_pIndexDataDepth))
+                decodeFailed = true;
+        });
+        file.Close();
+        if (decodeFailed)
+            return false;
+
+        m_VertexBuffer.Create(L"VertexBuffer", m_Header.vertexDataByteSize / m_VertexStride, m_VertexStride, m_pVertexData);
+        m_IndexBuffer.Create(L"IndexBuffer", m_Header.indexDataByteSize / m_IndexSize, m_IndexSize, m_pIndexData);
+        delete [] m_pVertexData;
+        m_pVertexData = nullptr;
+        delete [] m_pIndexData;
+        m_pIndexData = nullptr;
+
+        m_VertexBufferDepth.Create(L"VertexBufferDepth", m_Header.vertexDataByteSizeDepth / m_VertexStrideDepth, m_VertexStrideDepth, m_pVertexDataDepth);
+        m_IndexBufferDepth.Create(L"IndexBufferDepth", m_Header.indexDataByteSize / m_IndexSize, m_IndexSize, m_pIndexDataDepth);
+        delete [] m_pVertexDataDepth;
+        m_pVertexDataDepth = nullptr;
+        delete [] m_pIndexDataDepth;
+        m_pIndexDataDepth = nullptr;
+    }
+    else
+    {
+        m_VertexBuffer.Create(L"VertexBuffer", m_Header.vertexDataByteSize / m_VertexStride, m_VertexStride, file.GetVertexData().data);
+        m_IndexBuffer.Create(L"IndexBuffer", m_Header.indexDataByteSize / m_IndexSize, m_IndexSize, file.GetIndexData().data);
 
-    LoadTextures();
+        m_VertexBufferDepth.Create(L"VertexBufferDepth", m_Header.vertexDataByteSizeDepth / m_VertexStrideDepth, m_VertexStrideDepth, file.GetVertexDataDepth().data);
+        m_IndexBufferDepth.Create(L"IndexBufferDepth", m_Header.indexDataByteSize / m_IndexSize, m_IndexSize, file.GetIndexDataDepth().data);
 
-    ok = true;
+        file.Close();
+    }
 
-h3d_load_fail:
+    LoadTextures();
 
-    if (EOF == fclose(file))
-        ok = false;
+    return true;
+}
 
-    return ok;
+// Writes zeros up to the next multiple of alignment
+static bool WriteSectionPadding(FILE *file, uint64_t &position, uint32_t alignment)
+{
+    static const unsigned char zeros[256] = {};
+    uint64_t padding = Math::AlignUp(position, alignment) - position;
+    while (padding > 0)
+    {
+        size_t count = (size_t)(padding < sizeof(zeros) ? padding : sizeof(zeros));
+        if (1 != fwrite(zeros, count, 1, file))
+            return false;
+        padding -= count;
+        position += count;
+    }
+    return true;
 }
 
 bool Model::SaveH3D(const char *filename) const
@@ -113,6 +146,30 @@ bool Model::SaveH3D(const char *filename) const
 
     bool ok = false;
 
+    // Sections are placed one after the other, each at the next aligned offset
+    H3DFile::FileHeader fileHeader = {};
+    fileHeader.magic = H3DFile::kMagic;
+    fileHeader.version = H3DFile::kVersionAligned;
+    fileHeader.sectionAlignment = H3DFile::kSectionAlignment;
+    fileHeader.indexSize = m_IndexSize;
+
+    const uint64_t headersSize = sizeof(fileHeader) + sizeof(Header) + (uint64_t)sizeof(Mesh) * m_Header.meshCount + (uint64_t)sizeof(Material) * m_Header.materialCount;
+    uint64_t position = headersSize;
+    auto placeSection = [&position](uint32_t size) -> uint64_t
+    {
+        position = Math::AlignUp(position, H3DFile::kSectionAlignment);
+        uint64_t offset = position;
+        position += size;
+        return offset;
+    };
+    fileHeader.vertexDataOffset = placeSection(m_Header.vertexDataByteSize);
+    fileHeader.indexDataOffset = placeSection(m_Header.indexDataByteSize);
+    fileHeader.vertexDataDepthOffset = placeSection(m_Header.vertexDataByteSizeDepth);
+    fileHeader.indexDataDepthOffset = placeSection(m_Header.indexDataByteSize);
+
+    position = headersSize;
+
+    if (1 != fwrite(&fileHeader, sizeof(fileHeader), 1, file)) goto h3d_save_fail;
     if (1 != fwrite(&m_Header, sizeof(Header), 1, file)) goto h3d_save_fail;
 
     if (m_Header.meshCount > 0)
@@ -120,13 +177,22 @@ bool Model::SaveH3D(const char *filename) const
     if (m_Header.materialCount > 0)
         if (1 != fwrite(m_pMaterial, sizeof(Material) * m_Header.materialCount, 1, file)) goto h3d_save_fail;
 
+    if (!WriteSectionPadding(file, position, H3DFile::kSectionAlignment)) goto h3d_save_fail;
     if (m_Header.vertexDataByteSize > 0)
         if (1 != fwrite(m_pVertexData, m_Header.vertexDataByteSize, 1, file)) goto h3d_save_fail;
+    position += m_Header.vertexDataByteSize;
+
+    if (!WriteSectionPadding(file, position, H3DFile::kSectionAlignment)) goto h3d_save_fail;
     if (m_Header.indexDataByteSize > 0)
         if (1 != fwrite(m_pIndexData, m_Header.indexDataByteSize, 1, file)) goto h3d_save_fail;
+    position += m_Header.indexDataByteSize;
 
+    if (!WriteSectionPadding(file, position, H3DFile::kSectionAlignment)) goto h3d_save_fail;
     if (m_Header.vertexDataByteSizeDepth > 0)
         if (1 != fwrite(m_pVertexDataDepth, m_Header.vertexDataByteSizeDepth, 1, file)) goto h3d_save_fail;
+    position += m_Header.vertexDataByteSizeDepth;
+
+    if (!WriteSectionPadding(file, position, H3DFile::kSectionAlignment)) goto h3d_save_fail;
     if (m_Header.indexDataByteSize > 0)
         if (1 != fwrite(m_pIndexDataDepth, m_Header.indexDataByteSize, 1, file)) goto h3d_save_fail;
 
@@ -140,23 +206,93 @@ h3d_save_fail:
     return ok;
 }
 
-void Model::ReleaseTextures()
+bool Model::SaveH3DChunked(const char *filename, uint32_t compression, bool quantize) const
 {
-    /*
-    if (m_Textures != nullptr)
+    // Meshes are encoded and compressed in parallel, then written in order
+    std::vector<H3DFile::MeshChunk> chunks(m_Header.meshCount);
+    std::vector<std::vector<unsigned char>> chunkData(m_Header.meshCount);
+    TaskScheduler::ParallelFor(0u, m_Header.meshCount, [&](uint32_t meshIndex)
     {
-        for (uint32_t materialIdx = 0; materialIdx < m_Header.materialCount; ++materialIdx)
-        {
-            for (int n = 0; n < Material::texCount; n++)
-            {
-                if (m_Textures[materialIdx * Material::texCount + n])
-                    m_Textures[materialIdx * Material::texCount + n]->Release();
-                m_Textures[materialIdx * Material::texCount + n] = nullptr;
-            }
-        }
-        delete [] m_Textures;
+        std::vector<unsigned char> payload;
+        H3DFile::EncodeMesh(*this, meshIndex, quantize, chunks[meshIndex], payload);
+        if (!H3DFile::Compress(compression, payload.data(), payload.size(), chunkData[meshIndex]))
+            chunkData[meshIndex].swap(payload);
+        chunks[meshIndex].compressedSize = (uint32_t)chunkData[meshIndex].size();
+    });
+
+    std::vector<unsigned char> materialData;
+    const size_t materialsSize = sizeof(Material) * m_Header.materialCount;
+    if (!H3DFile::Compress(compression, m_pMaterial, materialsSize, materialData))
+        materialData.assign((const unsigned char*)m_pMaterial, (const unsigned char*)m_pMaterial + materialsSize);
+
+    H3DFile::ChunkedFileHeader fileHeader = {};
+    fileHeader.magic = H3DFile::kMagic;
+    fileHeader.version = H3DFile::kVersionChunked;
+    fileHeader.chunkAlignment = H3DFile::kChunkAlignment;
+    fileHeader.indexSize = m_IndexSize;
+    fileHeader.compression = compression;
+    fileHeader.flags = quantize ? H3DFile::flag_quantized : 0;
+
+    uint64_t position = sizeof(fileHeader) + sizeof(Header) + (uint64_t)sizeof(Mesh) * m_Header.meshCount;
+    fileHeader.tocOffset = Math::AlignUp(position, H3DFile::kChunkAlignment);
+    position = fileHeader.tocOffset + (uint64_t)sizeof(H3DFile::MeshChunk) * m_Header.meshCount;
+    fileHeader.materialsOffset = position;
+    fileHeader.materialsCompressedSize = (uint32_t)materialData.size();
+    position += materialData.size();
+    for (uint32_t meshIndex = 0; meshIndex < m_Header.meshCount; ++meshIndex)
+    {
+        position = Math::AlignUp(position, H3DFile::kChunkAlignment);
+        chunks[meshIndex].offset = position;
+        position += chunks[meshIndex].compressedSize;
+    }
+
+    FILE *file = nullptr;
+    if (0 != fopen_s(&file, filename, "wb"))
+        return false;
+
+    bool ok = false;
+    position = sizeof(fileHeader) + sizeof(Header) + (uint64_t)sizeof(Mesh) * m_Header.meshCount;
+
+    if (1 != fwrite(&fileHeader, sizeof(fileHeader), 1, file)) goto h3d_save_fail;
+    if (1 != fwrite(&m_Header, sizeof(Header), 1, file)) goto h3d_save_fail;
+    if (m_Header.meshCount > 0)
+        if (1 != fwrite(m_pMesh, sizeof(Mesh) * m_Header.meshCount, 1, file)) goto h3d_save_fail;
+
+    if (!WriteSectionPadding(file, position, H3DFile::kChunkAlignment)) goto h3d_save_fail;
+    if (m_Header.meshCount > 0)
+        if (1 != fwrite(chunks.data(), sizeof(H3DFile::MeshChunk) * m_Header.meshCount, 1, file)) goto h3d_save_fail;
+    position += sizeof(H3DFile::MeshChunk) * m_Header.meshCount;
+
+    if (materialData.size() > 0)
+        if (1 != fwrite(materialData.data(), materialData.size(), 1, file)) goto h3d_save_fail;
+    position += materialData.size();
+
+    for (uint32_t meshIndex = 0; meshIndex < m_Header.meshCount; ++meshIndex)
+    {
+        if (!WriteSectionPadding(file, position, H3DFile::kChunkAlignment)) goto h3d_save_fail;
+        if (chunkData[meshIndex].size() > 0)
+            if (1 != fwrite(chunkData[meshIndex].data(), chunkData[meshIndex].size(), 1, file)) goto h3d_save_fail;
+        position += chunkData[meshIndex].size();
     }
-    */
+
+    ok = true;
+
+h3d_save_fail:
+
+    if (EOF == fclose(file))
+        ok = false;
+
+    return ok;
+}
+
+void Model::ReleaseTextures()
+{
+    // The texture manager owns the textures, they're only forgotten here
+    delete [] m_Textures;
+    m_Textures = nullptr;
+
+    delete [] m_SRVs;
+    m_SRVs = nullptr;
 }
 
 void Model::LoadTextures(void)
@@ -164,38 +300,33 @@ void Model::LoadTextures(void)
     ReleaseTextures();
 
     m_SRVs = new D3D12_CPU_DESCRIPTOR_HANDLE[m_Header.materialCount * 6];
+    m_Textures = new const ManagedTexture*[m_Header.materialCount * Material::texCount]();
 
-    const ManagedTexture* MatTextures[6] = {};
+    // The defaults are loaded up front.  They show until a material's own textures have
+    // streamed in, and for good if they are missing.
+    const ManagedTexture* DefaultDiffuse = TextureManager::LoadFromFile("default", true);
+    const ManagedTexture* DefaultSpecular = TextureManager::LoadFromFile("default_specular", true);
+    const ManagedTexture* DefaultNormal = TextureManager::LoadFromFile("default_normal", false);
 
     for (uint32_t materialIdx = 0; materialIdx < m_Header.materialCount; ++materialIdx)
     {
         const Material& pMaterial = m_pMaterial[materialIdx];
+        const ManagedTexture** MatTextures = m_Textures + materialIdx * Material::texCount;
+        const std::wstring DiffusePath = MakeWStr(pMaterial.texDiffusePath);
 
         // Load diffuse
-        MatTextures[0] = TextureManager::LoadFromFile(pMaterial.texDiffusePath, true);
-        if (!MatTextures[0]->IsValid())
-            MatTextures[0] = TextureManager::LoadFromFile("default", true);
+        MatTextures[0] = TextureManager::LoadFromFileAsync({ DiffusePath }, true, *DefaultDiffuse);
 
         // Load specular
-        MatTextures[1] = TextureManager::LoadFromFile(pMaterial.texSpecularPath, true);
-        if (!MatTextures[1]->IsValid())
-        {
-            MatTextures[1] = TextureManager::LoadFromFile(std::string(pMaterial.texDiffusePath) + "_specular", true);
-            if (!MatTextures[1]->IsValid())
-                MatTextures[1] = TextureManager::LoadFromFile("default_specular", true);
-        }
+        MatTextures[1] = TextureManager::LoadFromFileAsync(
+            { MakeWStr(pMaterial.texSpecularPath), DiffusePath + L"_specular" }, true, *DefaultSpecular);
 
         // Load emissive
         //MatTextures[2] = TextureManager::LoadFromFile(pMaterial.texEmissivePath, true);
 
         // Load normal
-        MatTextures[3] = TextureManager::LoadFromFile(pMaterial.texNormalPath, false);
-        if (!MatTextures[3]->IsValid())
-        {
-            MatTextures[3] = TextureManager::LoadFromFile(std::string(pMaterial.texDiffusePath) + "_normal", false);
-            if (!MatTextures[3]->IsValid())
-                MatTextures[3] = TextureManager::LoadFromFile("default_normal", false);
-        }
+        MatTextures[3] = TextureManager::LoadFromFileAsync(
+            { MakeWStr(pMaterial.texNormalPath), DiffusePath + L"_normal" }, false, *DefaultNormal);
 
         // Load lightmap
         //MatTextures[4] = TextureManager::LoadFromFile(pMaterial.texLightmapPath, true);
@@ -211,3 +342,40 @@ void Model::LoadTextures(void)
         m_SRVs[materialIdx * 6 + 5] = MatTextures[0]->GetSRV();
     }
 }
+
+void Model::UpdateTexturePriorities( const Vector3& ViewerPosition ) const
+{
+    if (m_Textures == nullptr)
+        return;
+
+    // A mesh's size on screen goes with its bounding sphere's radius over its distance
+    std::vector<float> MaterialPriorities(m_Header.materialCount, 0.0f);
+    for (uint32_t meshIndex = 0; meshIndex < m_Header.meshCount; ++meshIndex)
+    {
+        const Mesh& mesh = m_pMesh[meshIndex];
+        const Vector3 Center = (mesh.boundingBox.min + mesh.boundingBox.max) * 0.5f;
+        const float Radius = Length(mesh.boundingBox.max - mesh.boundingBox.min) * 0.5f;
+        const float Distance = Max((float)Length(Center - ViewerPosition) - Radius, 1.0f);
+
+        float& Priority = MaterialPriorities[mesh.materialIndex];
+        Priority = Max(Priority, Radius / Distance);
+    }
+
+    // Materials share textures, which take the priority of the largest material using them
+    std::map<const ManagedTexture*, float> TexturePriorities;
+    for (uint32_t materialIdx = 0; materialIdx < m_Header.materialCount; ++materialIdx)
+    {
+        for (uint32_t n = 0; n < Material::texCount; ++n)
+        {
+            const ManagedTexture* Texture = m_Textures[materialIdx * Material::texCount + n];
+            if (Texture != nullptr)
+            {
+                float& Priority = TexturePriorities[Texture];
+                Priority = Max(Priority, MaterialPriorities[materialIdx]);
+            }
+        }
+    }
+
+    for (const auto& TexturePriority : TexturePriorities)
+        TextureManager::SetLoadPriority(TexturePriority.first, TexturePriority.second);
+}
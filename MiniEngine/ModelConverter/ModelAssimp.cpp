@@ -39,9 +39,23 @@ int AssimpModel::FormatFromFilename(const char *filename)
     return format_none;
 }
 
+bool AssimpModel::CanLoad(const char *filename)
+{
+    if (FormatFromFilename(filename) != format_none)
+        return true;
+
+    const char *p = strrchr(filename, '.');
+    if (!p || *p == 0)
+        return false;
+
+    Assimp::Importer importer;
+    return importer.IsExtensionSupported(p);
+}
+
 bool AssimpModel::Load(const char *filename)
 {
     Clear();
+    m_OptimizeStats = {};
 
     int format = FormatFromFilename(filename);
 
@@ -79,7 +93,7 @@ bool AssimpModel::Save(const char *filename) const
         break;
 
     case format_h3d:
-        rval = SaveH3D(filename);
+        rval = m_ChunkedOutput ? SaveH3DChunked(filename, m_Compression, m_Quantize) : SaveH3D(filename);
         break;
     }
 
@@ -87,6 +101,25 @@ bool AssimpModel::Save(const char *filename) const
 }
 
 
+template <typename IndexType>
+static void CopyFaceIndices(const aiMesh *srcMesh, unsigned char *indexData, unsigned char *indexDataDepth)
+{
+    IndexType *dstIndex = (IndexType*)indexData;
+    IndexType *dstIndexDepth = (IndexType*)indexDataDepth;
+    for (unsigned int f = 0; f < srcMesh->mNumFaces; f++)
+    {
+        assert(srcMesh->mFaces[f].mNumIndices == 3);
+
+        *dstIndex++ = (IndexType)srcMesh->mFaces[f].mIndices[0];
+        *dstIndex++ = (IndexType)srcMesh->mFaces[f].mIndices[1];
+        *dstIndex++ = (IndexType)srcMesh->mFaces[f].mIndices[2];
+
+        *dstIndexDepth++ = (IndexType)srcMesh->mFaces[f].mIndices[0];
+        *dstIndexDepth++ = (IndexType)srcMesh->mFaces[f].mIndices[1];
+        *dstIndexDepth++ = (IndexType)srcMesh->mFaces[f].mIndices[2];
+    }
+}
+
 bool AssimpModel::LoadAssimp(const char *filename)
 {
     Assimp::Importer importer;
@@ -97,7 +130,7 @@ bool AssimpModel::LoadAssimp(const char *filename)
 
     // max triangles and vertices per mesh, splits above this threshold
     importer.SetPropertyInteger(AI_CONFIG_PP_SLM_TRIANGLE_LIMIT, INT_MAX);
-    importer.SetPropertyInteger(AI_CONFIG_PP_SLM_VERTEX_LIMIT, 0xfffe); // avoid the primitive restart index
+    importer.SetPropertyInteger(AI_CONFIG_PP_SLM_VERTEX_LIMIT, m_AllowIndex32 ? INT_MAX : 0xfffe); // avoid the primitive restart index
 
     // remove points and lines
     importer.SetPropertyInteger(AI_CONFIG_PP_SBP_REMOVE, aiPrimitiveType_POINT | aiPrimitiveType_LINE);
@@ -215,6 +248,15 @@ bool AssimpModel::LoadAssimp(const char *filename)
         strncpy_s(dstMat->name, matName.C_Str(), Material::maxMaterialName - 1);
     }
 
+    // every mesh shares one index buffer, so one mesh too big for 16-bit indices
+    // makes them all 32-bit
+    m_IndexSize = sizeof(uint16_t);
+    for (unsigned int meshIndex = 0; meshIndex < scene->mNumMeshes; meshIndex++)
+    {
+        if (scene->mMeshes[meshIndex]->mNumVertices > 0xfffe)
+            m_IndexSize = sizeof(uint32_t);
+    }
+
     m_Header.meshCount = scene->mNumMeshes;
     m_pMesh = new Mesh [m_Header.meshCount];
     memset(m_pMesh, 0, sizeof(Mesh) * m_Header.meshCount);
@@ -280,7 +322,7 @@ bool AssimpModel::LoadAssimp(const char *filename)
         dstMesh->indexCount = srcMesh->mNumFaces * 3;
 
         m_Header.vertexDataByteSize += dstMesh->vertexStride * dstMesh->vertexCount;
-        m_Header.indexDataByteSize += sizeof(uint16_t) * dstMesh->indexCount;
+        m_Header.indexDataByteSize += m_IndexSize * dstMesh->indexCount;
 
         // depth-only rendering
         dstMesh->vertexDataByteOffsetDepth = m_Header.vertexDataByteSizeDepth;
@@ -384,20 +426,10 @@ bool AssimpModel::LoadAssimp(const char *filename)
             dstBitangent = (float*)((unsigned char*)dstBitangent + dstMesh->vertexStride);
         }
 
-        uint16_t *dstIndex = (uint16_t*)(m_pIndexData + dstMesh->indexDataByteOffset);
-        uint16_t *dstIndexDepth = (uint16_t*)(m_pIndexDataDepth + dstMesh->indexDataByteOffset);
-        for (unsigned int f = 0; f < srcMesh->mNumFaces; f++)
-        {
-            assert(srcMesh->mFaces[f].mNumIndices == 3);
-
-            *dstIndex++ = srcMesh->mFaces[f].mIndices[0];
-            *dstIndex++ = srcMesh->mFaces[f].mIndices[1];
-            *dstIndex++ = srcMesh->mFaces[f].mIndices[2];
-
-            *dstIndexDepth++ = srcMesh->mFaces[f].mIndices[0];
-            *dstIndexDepth++ = srcMesh->mFaces[f].mIndices[1];
-            *dstIndexDepth++ = srcMesh->mFaces[f].mIndices[2];
-        }
+        if (m_IndexSize == sizeof(uint32_t))
+            CopyFaceIndices<uint32_t>(srcMesh, m_pIndexData + dstMesh->indexDataByteOffset, m_pIndexDataDepth + dstMesh->indexDataByteOffset);
+        else
+            CopyFaceIndices<uint16_t>(srcMesh, m_pIndexData + dstMesh->indexDataByteOffset, m_pIndexDataDepth + dstMesh->indexDataByteOffset);
     }
 
     ComputeAllBoundingBoxes();
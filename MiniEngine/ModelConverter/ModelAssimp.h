@@ -26,17 +26,52 @@ public:
     };
     static const char *s_FormatString[];
     static int FormatFromFilename(const char *filename);
+    static bool CanLoad(const char *filename);
 
     virtual bool Load(const char* filename) override;
     bool Save(const char* filename) const;
 
+    // Meshes are split at 64K vertices by default so that every model keeps 16-bit
+    // indices. When allowed, meshes are left whole and the model switches to 32-bit
+    // indices if any of them needs it.
+    void AllowIndex32(bool allow) { m_AllowIndex32 = allow; }
+
+    // Save chunked (revision 2) .h3d files, compression is one of H3DFile's
+    // compression_* values
+    void SetChunkedOutput(uint32_t compression, bool quantize)
+    {
+        m_ChunkedOutput = true;
+        m_Compression = compression;
+        m_Quantize = quantize;
+    }
+
+    // vertex counts before and after duplicate vertex removal and the time the
+    // optimization took, all zero when the input was already optimized (.h3d)
+    struct OptimizeStats
+    {
+        uint32_t vertexCountIn;
+        uint32_t vertexCountOut;
+        uint32_t vertexCountInDepth;
+        uint32_t vertexCountOutDepth;
+        double optimizeMs;
+    };
+    const OptimizeStats &GetOptimizeStats() const { return m_OptimizeStats; }
+
 private:
 
     bool LoadAssimp(const char *filename);
 
+    // Meshes are optimized in parallel on the TaskScheduler's workers. Without
+    // TaskScheduler::Initialize they all run on the loading thread.
     void Optimize();
     void OptimizeRemoveDuplicateVertices(bool depth);
     void OptimizePostTransform(bool depth);
     void OptimizePreTransform(bool depth);
+
+    OptimizeStats m_OptimizeStats = {};
+    bool m_AllowIndex32 = false;
+    bool m_ChunkedOutput = false;
+    uint32_t m_Compression = 0;
+    bool m_Quantize = false;
 };
 
@@ -12,15 +12,28 @@
 //
 
 #include "ModelAssimp.h"
+#include "H3DFile.h"
+#include "TaskScheduler.h"
 
+#include <Windows.h>
 #include <stdio.h>
+#include <chrono>
+#include <string>
+#include <vector>
 
 void PrintHelp()
 {
     printf("model_convert\n");
 
     printf("usage:\n");
-    printf("model_convert input_file output_file\n");
+    printf("model_convert [options] input_file output_file\n");
+    printf("model_convert [options] -batch input_dir output_dir\n");
+    printf("\n");
+    printf("-index32         keep meshes with more than 64K vertices whole and use 32-bit indices\n");
+    printf("-batch           convert every model in input_dir to an .h3d file in output_dir\n");
+    printf("-compress codec  write a chunked .h3d with per-mesh chunks compressed with codec:\n");
+    printf("                 none, xpress (fastest to decode), xpress_huff or mszip (smallest)\n");
+    printf("-quantize        write a chunked .h3d with 16-bit positions, normals and tangents\n");
 }
 
 void PrintModelStats(const Model *model)
@@ -34,6 +47,7 @@ void PrintModelStats(const Model *model)
 
     printf("vertex data size: %u\n", model->m_Header.vertexDataByteSize);
     printf("index data size: %u\n", model->m_Header.indexDataByteSize);
+    printf("index size: %u\n", model->m_IndexSize);
     printf("vertex data size depth-only: %u\n", model->m_Header.vertexDataByteSizeDepth);
     printf("\n");
 
@@ -110,21 +124,109 @@ void PrintModelStats(const Model *model)
     printf("\n");
 }
 
-int main(int argc, char **argv)
+static double MillisecondsSince(std::chrono::high_resolution_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+struct ConvertOptions
+{
+    bool allowIndex32 = false;
+    bool chunked = false;
+    uint32_t compression = H3DFile::compression_none;
+    bool quantize = false;
+};
+
+static void ApplyOptions(AssimpModel &model, const ConvertOptions &options)
+{
+    model.AllowIndex32(options.allowIndex32);
+    if (options.chunked)
+        model.SetChunkedOutput(options.compression, options.quantize);
+}
+
+// Converts every file Assimp can load in inputDir to outputDir/<name>.h3d. .h3d
+// files are already converted and are skipped. Each model is optimized on all
+// cores, so files are converted one at a time.
+int ConvertDirectory(const char *inputDir, const char *outputDir, const ConvertOptions &options)
 {
-    if (argc != 3)
+    std::vector<std::string> inputFiles;
+
+    WIN32_FIND_DATAA findData;
+    HANDLE findHandle = FindFirstFileA((std::string(inputDir) + "\\*").c_str(), &findData);
+    if (findHandle == INVALID_HANDLE_VALUE)
     {
-        PrintHelp();
+        printf("failed to open input directory: %s\n", inputDir);
         return -1;
     }
+    do
+    {
+        if ((findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0 &&
+            AssimpModel::FormatFromFilename(findData.cFileName) == AssimpModel::format_none &&
+            AssimpModel::CanLoad(findData.cFileName))
+            inputFiles.push_back(findData.cFileName);
+    } while (FindNextFileA(findHandle, &findData));
+    FindClose(findHandle);
 
-    const char *input_file = argv[1];
-    const char *output_file = argv[2];
+    if (!CreateDirectoryA(outputDir, nullptr) && GetLastError() != ERROR_ALREADY_EXISTS)
+    {
+        printf("failed to create output directory: %s\n", outputDir);
+        return -1;
+    }
 
+    printf("converting %u files from %s to %s\n", (unsigned int)inputFiles.size(), inputDir, outputDir);
+
+    auto batchStart = std::chrono::high_resolution_clock::now();
+    unsigned int convertedCount = 0;
+    for (const std::string &inputName : inputFiles)
+    {
+        std::string inputFile = std::string(inputDir) + "\\" + inputName;
+        std::string outputFile = std::string(outputDir) + "\\" + inputName.substr(0, inputName.find_last_of('.')) + ".h3d";
+
+        AssimpModel model;
+        ApplyOptions(model, options);
+
+        auto loadStart = std::chrono::high_resolution_clock::now();
+        if (!model.Load(inputFile.c_str()))
+        {
+            printf("%s: failed to load\n", inputName.c_str());
+            continue;
+        }
+        double loadMs = MillisecondsSince(loadStart);
+
+        auto saveStart = std::chrono::high_resolution_clock::now();
+        if (!model.Save(outputFile.c_str()))
+        {
+            printf("%s: failed to save %s\n", inputName.c_str(), outputFile.c_str());
+            continue;
+        }
+        double saveMs = MillisecondsSince(saveStart);
+
+        uint64_t outputSize = 0;
+        WIN32_FILE_ATTRIBUTE_DATA outputAttributes;
+        if (GetFileAttributesExA(outputFile.c_str(), GetFileExInfoStandard, &outputAttributes))
+            outputSize = ((uint64_t)outputAttributes.nFileSizeHigh << 32) | outputAttributes.nFileSizeLow;
+
+        const AssimpModel::OptimizeStats &optimizeStats = model.GetOptimizeStats();
+        printf("%s: %u meshes, %u -> %u vertices, %u-bit indices, %llu bytes, load %.2f ms (optimize %.2f ms), save %.2f ms\n"
+            , inputName.c_str(), model.m_Header.meshCount
+            , optimizeStats.vertexCountIn, optimizeStats.vertexCountOut, model.m_IndexSize * 8
+            , outputSize, loadMs, optimizeStats.optimizeMs, saveMs);
+        convertedCount++;
+    }
+
+    printf("converted %u of %u files in %.2f ms\n", convertedCount, (unsigned int)inputFiles.size(), MillisecondsSince(batchStart));
+
+    return convertedCount == inputFiles.size() ? 0 : -1;
+}
+
+// Converts a single file, printing what was done and the converted model's layout
+int ConvertFile(const char *input_file, const char *output_file, const ConvertOptions &options)
+{
     printf("input file %s\n", input_file);
     printf("output file %s\n", output_file);
 
     AssimpModel model;
+    ApplyOptions(model, options);
 
     printf("loading...\n");
     if (!model.Load(input_file))
@@ -133,6 +235,15 @@ int main(int argc, char **argv)
         return -1;
     }
 
+    const AssimpModel::OptimizeStats &optimizeStats = model.GetOptimizeStats();
+    if (optimizeStats.vertexCountIn)
+    {
+        printf("removed duplicate vertices: %u -> %u, depth-only %u -> %u, optimized in %.2f ms\n"
+            , optimizeStats.vertexCountIn, optimizeStats.vertexCountOut
+            , optimizeStats.vertexCountInDepth, optimizeStats.vertexCountOutDepth
+            , optimizeStats.optimizeMs);
+    }
+
     printf("saving...\n");
     if (!model.Save(output_file))
     {
@@ -146,3 +257,62 @@ int main(int argc, char **argv)
 
     return 0;
 }
+
+int main(int argc, char **argv)
+{
+    ConvertOptions options;
+    bool batch = false;
+
+    int argIndex = 1;
+    for (; argIndex < argc && argv[argIndex][0] == '-'; argIndex++)
+    {
+        if (_stricmp(argv[argIndex], "-index32") == 0)
+            options.allowIndex32 = true;
+        else if (_stricmp(argv[argIndex], "-batch") == 0)
+            batch = true;
+        else if (_stricmp(argv[argIndex], "-quantize") == 0)
+            options.chunked = options.quantize = true;
+        else if (_stricmp(argv[argIndex], "-compress") == 0)
+        {
+            if (argIndex + 1 >= argc)
+            {
+                printf("-compress needs a codec\n");
+                PrintHelp();
+                return -1;
+            }
+
+            const char *codec = argv[++argIndex];
+            options.chunked = true;
+            options.compression = H3DFile::compressions;
+            for (uint32_t n = 0; n < H3DFile::compressions; n++)
+            {
+                if (_stricmp(codec, H3DFile::s_CompressionString[n]) == 0)
+                    options.compression = n;
+            }
+            if (options.compression == H3DFile::compressions)
+            {
+                printf("unknown compression: %s\n", codec);
+                return -1;
+            }
+        }
+        else
+            break;
+    }
+
+    if (argc - argIndex != 2)
+    {
+        PrintHelp();
+        return -1;
+    }
+
+    // Meshes are optimized and encoded on the task scheduler's worker threads
+    TaskScheduler::Initialize();
+
+    int result = batch ?
+        ConvertDirectory(argv[argIndex], argv[argIndex + 1], options) :
+        ConvertFile(argv[argIndex], argv[argIndex + 1], options);
+
+    TaskScheduler::Shutdown();
+
+    return result;
+}
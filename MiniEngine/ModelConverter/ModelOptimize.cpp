@@ -13,76 +13,203 @@
 
 #include "ModelAssimp.h"
 #include "IndexOptimizePostTransform.h"
+#include "TaskScheduler.h"
 
 #include <string.h>
+#include <chrono>
+#include <vector>
+
+// FNV-1a over the whole vertex. Every attribute is at least four byte aligned, so
+// it's hashed four bytes at a time with any odd bytes at the end folded in last.
+static uint32_t HashVertex(const unsigned char *vertexData, unsigned int vertexStride)
+{
+    uint32_t hash = 2166136261u;
+    unsigned int n = 0;
+    for (; n + 4 <= vertexStride; n += 4)
+    {
+        uint32_t word;
+        memcpy(&word, vertexData + n, 4);
+        hash = (hash ^ word) * 16777619u;
+    }
+    for (; n < vertexStride; n++)
+    {
+        hash = (hash ^ vertexData[n]) * 16777619u;
+    }
+
+    // FNV's low bits are weak and the table index is taken from them
+    hash ^= hash >> 15;
+    hash *= 0x2c1b3c6du;
+    hash ^= hash >> 12;
+    return hash;
+}
+
+// Fills vertexRemap with the new index of every vertex and uniqueVertices with the
+// first occurrence of each unique vertex, in order. Open addressing with linear
+// probing into a table at most half full, so it's linear in the vertex count.
+static void FindUniqueVertices(
+    const unsigned char *vertexData,
+    unsigned int vertexCount,
+    unsigned int vertexStride,
+    std::vector<uint32_t> &vertexRemap,
+    std::vector<uint32_t> &uniqueVertices)
+{
+    struct HashSlot
+    {
+        uint32_t hash;
+        uint32_t uniqueIndex;
+    };
+    const uint32_t emptySlot = (uint32_t)-1;
+
+    uint32_t tableSize = 16;
+    while (tableSize < 2 * vertexCount)
+        tableSize *= 2;
+    std::vector<HashSlot> table(tableSize, HashSlot{ 0, emptySlot });
+
+    vertexRemap.resize(vertexCount);
+    uniqueVertices.clear();
+    for (unsigned int v = 0; v < vertexCount; v++)
+    {
+        const unsigned char *vData = vertexData + v * vertexStride;
+        const uint32_t hash = HashVertex(vData, vertexStride);
+
+        uint32_t slot = hash & (tableSize - 1);
+        while (table[slot].uniqueIndex != emptySlot)
+        {
+            if (table[slot].hash == hash &&
+                0 == memcmp(vData, vertexData + uniqueVertices[table[slot].uniqueIndex] * vertexStride, vertexStride))
+                break;
+            slot = (slot + 1) & (tableSize - 1);
+        }
+
+        if (table[slot].uniqueIndex == emptySlot)
+        {
+            // this is a new unique vertex
+            table[slot].hash = hash;
+            table[slot].uniqueIndex = (uint32_t)uniqueVertices.size();
+            uniqueVertices.push_back(v);
+        }
+        vertexRemap[v] = table[slot].uniqueIndex;
+    }
+}
+
+template <typename IndexType>
+static void RemapIndices(unsigned char *indexData, unsigned int indexCount, const uint32_t *vertexRemap)
+{
+    IndexType *indexArray = (IndexType*)indexData;
+    for (unsigned int n = 0; n < indexCount; n++)
+    {
+        indexArray[n] = (IndexType)vertexRemap[indexArray[n]];
+    }
+}
+
+template <typename IndexType>
+static void OptimizeMeshFaces(unsigned char *indexData, unsigned int indexCount)
+{
+    enum {lruCacheSize = 64};
+
+    IndexType *srcIndices = new IndexType [indexCount];
+    IndexType *dstIndices = (IndexType*)indexData;
+    memcpy(srcIndices, dstIndices, sizeof(IndexType) * indexCount);
+
+    OptimizeFaces<IndexType>(srcIndices, indexCount, dstIndices, lruCacheSize);
+
+    delete [] srcIndices;
+}
+
+// Copies vertices to reorderedVertexData in the order the indices first use them
+// and remaps the indices to match
+template <typename IndexType>
+static void ReorderMeshVertices(
+    unsigned char *indexData,
+    unsigned int indexCount,
+    const unsigned char *vertexData,
+    unsigned int vertexCount,
+    unsigned int vertexStride,
+    unsigned char *reorderedVertexData)
+{
+    unsigned int reorderedCount = 0;
+
+    uint32_t *vertexRemap = new uint32_t [vertexCount];
+    memset(vertexRemap, (uint32_t)-1, sizeof(uint32_t) * vertexCount);
+
+    IndexType *indexArray = (IndexType*)indexData;
+    for (unsigned int n = 0; n < indexCount; n++)
+    {
+        IndexType index = indexArray[n];
+        if (vertexRemap[index] == (uint32_t)-1)
+        {
+            // not relocated yet
+            const unsigned char *vSrc = vertexData + index * vertexStride;
+            unsigned char *vDst = reorderedVertexData + reorderedCount * vertexStride;
+            memcpy(vDst, vSrc, vertexStride);
+
+            vertexRemap[index] = reorderedCount;
+            reorderedCount++;
+        }
+        indexArray[n] = (IndexType)vertexRemap[index];
+    }
+
+    delete [] vertexRemap;
+}
 
 void AssimpModel::OptimizeRemoveDuplicateVertices(bool depth)
 {
     unsigned char *deduplicatedVertexData = new unsigned char [depth ? m_Header.vertexDataByteSizeDepth : m_Header.vertexDataByteSize];
-    uint32_t deduplicatedVertexDataSize = 0;
 
-    for (unsigned int meshIndex = 0; meshIndex < m_Header.meshCount; meshIndex++)
+    // meshes are independent, find their unique vertices in parallel
+    std::vector<std::vector<uint32_t>> vertexRemaps(m_Header.meshCount);
+    std::vector<std::vector<uint32_t>> uniqueVertices(m_Header.meshCount);
+    TaskScheduler::ParallelFor(0u, m_Header.meshCount, [&](unsigned int meshIndex)
     {
-        Mesh *mesh = m_pMesh + meshIndex;
+        const Mesh *mesh = m_pMesh + meshIndex;
         unsigned int vertexStride = depth ? mesh->vertexStrideDepth : mesh->vertexStride;
-        unsigned char *meshVertexData = depth ? (m_pVertexDataDepth + mesh->vertexDataByteOffsetDepth) : (m_pVertexData + mesh->vertexDataByteOffset);
-
-        unsigned char *meshDeduplicatedVertexData = deduplicatedVertexData + deduplicatedVertexDataSize;
-        unsigned int deduplicatedCount = 0;
-
+        const unsigned char *meshVertexData = depth ? (m_pVertexDataDepth + mesh->vertexDataByteOffsetDepth) : (m_pVertexData + mesh->vertexDataByteOffset);
         unsigned int vertexCount = depth ? mesh->vertexCountDepth : mesh->vertexCount;
-        uint32_t *vertexRemap = new uint32_t [vertexCount];
-        memset(vertexRemap, (uint32_t)-1, sizeof(uint32_t) * vertexCount);
-        assert(vertexCount <= (uint32_t)-1);
 
-        for (unsigned int v1 = 0; v1 < vertexCount; v1++)
-        {
-            if (vertexRemap[v1] != (uint32_t)-1)
-                continue; // this was already found to be a duplicate
+        FindUniqueVertices(meshVertexData, vertexCount, vertexStride, vertexRemaps[meshIndex], uniqueVertices[meshIndex]);
+    });
 
-            const unsigned char *v1Data = meshVertexData + v1 * vertexStride;
+    // unique vertices of each mesh are packed after the previous mesh's
+    std::vector<uint32_t> deduplicatedVertexDataOffsets(m_Header.meshCount);
+    uint32_t deduplicatedVertexDataSize = 0;
+    for (unsigned int meshIndex = 0; meshIndex < m_Header.meshCount; meshIndex++)
+    {
+        const Mesh *mesh = m_pMesh + meshIndex;
+        unsigned int vertexStride = depth ? mesh->vertexStrideDepth : mesh->vertexStride;
+        deduplicatedVertexDataOffsets[meshIndex] = deduplicatedVertexDataSize;
+        deduplicatedVertexDataSize += (uint32_t)uniqueVertices[meshIndex].size() * vertexStride;
+    }
 
-            // this is a new unique vertex
-            uint32_t remappedSlot = deduplicatedCount++;
-            vertexRemap[v1] = remappedSlot;
-            memcpy(meshDeduplicatedVertexData + remappedSlot * vertexStride, v1Data, vertexStride);
-
-            // scan for duplicates
-            for (unsigned int v2 = v1 + 1; v2 < vertexCount; v2++)
-            {
-                if (vertexRemap[v2] != (uint32_t)-1)
-                    continue; // this was already found to be a duplicate of another vertex
-
-                const unsigned char *v2Data = meshVertexData + v2 * vertexStride;
-
-                if (0 == memcmp(v1Data, v2Data, vertexStride))
-                {
-                    vertexRemap[v2] = remappedSlot;
-                }
-            }
-        }
+    TaskScheduler::ParallelFor(0u, m_Header.meshCount, [&](unsigned int meshIndex)
+    {
+        Mesh *mesh = m_pMesh + meshIndex;
+        unsigned int vertexStride = depth ? mesh->vertexStrideDepth : mesh->vertexStride;
+        const unsigned char *meshVertexData = depth ? (m_pVertexDataDepth + mesh->vertexDataByteOffsetDepth) : (m_pVertexData + mesh->vertexDataByteOffset);
+        unsigned char *meshDeduplicatedVertexData = deduplicatedVertexData + deduplicatedVertexDataOffsets[meshIndex];
 
-        unsigned int indexCount = mesh->indexCount;
-        uint16_t *indexArray = (uint16_t*)((depth ? m_pIndexDataDepth : m_pIndexData) + mesh->indexDataByteOffset);
-        for (unsigned int n = 0; n < indexCount; n++)
+        const std::vector<uint32_t> &meshUniqueVertices = uniqueVertices[meshIndex];
+        for (size_t n = 0; n < meshUniqueVertices.size(); n++)
         {
-            indexArray[n] = vertexRemap[indexArray[n]];
+            memcpy(meshDeduplicatedVertexData + n * vertexStride, meshVertexData + meshUniqueVertices[n] * vertexStride, vertexStride);
         }
 
-        delete [] vertexRemap;
+        unsigned char *meshIndexData = (depth ? m_pIndexDataDepth : m_pIndexData) + mesh->indexDataByteOffset;
+        if (m_IndexSize == sizeof(uint32_t))
+            RemapIndices<uint32_t>(meshIndexData, mesh->indexCount, vertexRemaps[meshIndex].data());
+        else
+            RemapIndices<uint16_t>(meshIndexData, mesh->indexCount, vertexRemaps[meshIndex].data());
 
         if (depth)
         {
-            mesh->vertexCountDepth = deduplicatedCount;
-            mesh->vertexDataByteOffsetDepth = deduplicatedVertexDataSize;
+            mesh->vertexCountDepth = (uint32_t)meshUniqueVertices.size();
+            mesh->vertexDataByteOffsetDepth = deduplicatedVertexDataOffsets[meshIndex];
         }
         else
         {
-            mesh->vertexCount = deduplicatedCount;
-            mesh->vertexDataByteOffset = deduplicatedVertexDataSize;
+            mesh->vertexCount = (uint32_t)meshUniqueVertices.size();
+            mesh->vertexDataByteOffset = deduplicatedVertexDataOffsets[meshIndex];
         }
-        deduplicatedVertexDataSize += deduplicatedCount * vertexStride;
-    }
+    });
 
     if (depth)
     {
@@ -100,60 +227,37 @@ void AssimpModel::OptimizeRemoveDuplicateVertices(bool depth)
 
 void AssimpModel::OptimizePostTransform(bool depth)
 {
-    enum {lruCacheSize = 64};
-
-    for (unsigned int meshIndex = 0; meshIndex < m_Header.meshCount; meshIndex++)
+    TaskScheduler::ParallelFor(0u, m_Header.meshCount, [&](unsigned int meshIndex)
     {
-        Mesh *mesh = m_pMesh + meshIndex;
+        const Mesh *mesh = m_pMesh + meshIndex;
+        unsigned char *meshIndexData = (depth ? m_pIndexDataDepth : m_pIndexData) + mesh->indexDataByteOffset;
 
-        uint16_t *srcIndices = new uint16_t [mesh->indexCount];
-        uint16_t *dstIndices = (uint16_t*)((depth ? m_pIndexDataDepth : m_pIndexData) + mesh->indexDataByteOffset);
-        memcpy(srcIndices, dstIndices, sizeof(uint16_t) * mesh->indexCount);
-
-        OptimizeFaces<uint16_t>(srcIndices, mesh->indexCount, dstIndices, lruCacheSize);
-
-        delete [] srcIndices;
-    }
+        if (m_IndexSize == sizeof(uint32_t))
+            OptimizeMeshFaces<uint32_t>(meshIndexData, mesh->indexCount);
+        else
+            OptimizeMeshFaces<uint16_t>(meshIndexData, mesh->indexCount);
+    });
 }
 
 void AssimpModel::OptimizePreTransform(bool depth)
 {
     unsigned char *reorderedVertexData = new unsigned char [depth ? m_Header.vertexDataByteSizeDepth : m_Header.vertexDataByteSize];
 
-    for (unsigned int meshIndex = 0; meshIndex < m_Header.meshCount; meshIndex++)
+    // every mesh keeps its vertex data offset, so they can be reordered in parallel
+    TaskScheduler::ParallelFor(0u, m_Header.meshCount, [&](unsigned int meshIndex)
     {
-        Mesh *mesh = m_pMesh + meshIndex;
-        unsigned int indexCount = mesh->indexCount;
+        const Mesh *mesh = m_pMesh + meshIndex;
         unsigned int vertexStride = depth ? mesh->vertexStrideDepth : mesh->vertexStride;
-        unsigned char *meshVertexData = depth ? (m_pVertexDataDepth + mesh->vertexDataByteOffsetDepth) : (m_pVertexData + mesh->vertexDataByteOffset);
-
-        unsigned char *meshReorderedVertexData = reorderedVertexData + (depth ? mesh->vertexDataByteOffsetDepth : mesh->vertexDataByteOffset);
-        unsigned int reorderedCount = 0;
-
         unsigned int vertexCount = depth ? mesh->vertexCountDepth : mesh->vertexCount;
-        uint32_t *vertexRemap = new uint32_t [vertexCount];
-        memset(vertexRemap, (uint32_t)-1, sizeof(uint32_t) * vertexCount);
-        assert(vertexCount <= (uint32_t)-1);
-
-        uint16_t *indexArray = (uint16_t*)((depth ? m_pIndexDataDepth : m_pIndexData) + mesh->indexDataByteOffset);
-        for (unsigned int n = 0; n < indexCount; n++)
-        {
-            uint16_t index = indexArray[n];
-            if (vertexRemap[index] == (uint32_t)-1)
-            {
-                // not relocated yet
-                const unsigned char *vSrc = meshVertexData + index * vertexStride;
-                unsigned char *vDst = meshReorderedVertexData + reorderedCount * vertexStride;
-                memcpy(vDst, vSrc, vertexStride);
-
-                vertexRemap[index] = reorderedCount;
-                reorderedCount++;
-            }
-            indexArray[n] = vertexRemap[index];
-        }
+        unsigned int vertexDataByteOffset = depth ? mesh->vertexDataByteOffsetDepth : mesh->vertexDataByteOffset;
+        const unsigned char *meshVertexData = (depth ? m_pVertexDataDepth : m_pVertexData) + vertexDataByteOffset;
+        unsigned char *meshIndexData = (depth ? m_pIndexDataDepth : m_pIndexData) + mesh->indexDataByteOffset;
 
-        delete [] vertexRemap;
-    }
+        if (m_IndexSize == sizeof(uint32_t))
+            ReorderMeshVertices<uint32_t>(meshIndexData, mesh->indexCount, meshVertexData, vertexCount, vertexStride, reorderedVertexData + vertexDataByteOffset);
+        else
+            ReorderMeshVertices<uint16_t>(meshIndexData, mesh->indexCount, meshVertexData, vertexCount, vertexStride, reorderedVertexData + vertexDataByteOffset);
+    });
 
     if (depth)
     {
@@ -171,14 +275,38 @@ void AssimpModel::Optimize()
 {
     // TODO: quantize/compress vertex data
 
-    OptimizeRemoveDuplicateVertices(false);
-    OptimizeRemoveDuplicateVertices(true);
+    auto countVertices = [this](uint32_t &vertexCount, uint32_t &vertexCountDepth)
+    {
+        vertexCount = vertexCountDepth = 0;
+        for (unsigned int meshIndex = 0; meshIndex < m_Header.meshCount; meshIndex++)
+        {
+            vertexCount += m_pMesh[meshIndex].vertexCount;
+            vertexCountDepth += m_pMesh[meshIndex].vertexCountDepth;
+        }
+    };
+
+    countVertices(m_OptimizeStats.vertexCountIn, m_OptimizeStats.vertexCountInDepth);
+    auto optimizeStart = std::chrono::high_resolution_clock::now();
 
-    // re-order indices for post transform cache
-    OptimizePostTransform(false);
-    OptimizePostTransform(true);
+    // The color and depth-only streams share nothing but the index counts and
+    // offsets, which aren't modified, so they're optimized concurrently
+    auto optimizeStream = [this](bool depth)
+    {
+        OptimizeRemoveDuplicateVertices(depth);
+
+        // re-order indices for post transform cache
+        OptimizePostTransform(depth);
+
+        // re-order vertices for linear memory access
+        OptimizePreTransform(depth);
+    };
+    {
+        TaskScheduler::TaskGroup depthStream;
+        depthStream.Run([&] { optimizeStream(true); });
+        optimizeStream(false);
+        depthStream.Wait();
+    }
 
-    // re-order vertices for linear memory access
-    OptimizePreTransform(false);
-    OptimizePreTransform(true);
+    m_OptimizeStats.optimizeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - optimizeStart).count();
+    countVertices(m_OptimizeStats.vertexCountOut, m_OptimizeStats.vertexCountOutDepth);
 }
@@ -0,0 +1,103 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+#include "CullingBenchmark.h"
+#include "EngineProfiling.h"
+#include "SystemTime.h"
+#include "Utility.h"
+#include "Math/Random.h"
+#include <vector>
+#include <algorithm>
+#include <intrin.h>
+
+using namespace Math;
+
+namespace
+{
+    const uint32_t kPasses = 16;
+
+    // Runs cull kPasses times and returns the fastest pass in microseconds
+    template <typename CullFunc>
+    double TimePasses(CullFunc cull)
+    {
+        double best = DBL_MAX;
+        for (uint32_t pass = 0; pass < kPasses; ++pass)
+        {
+            int64_t start = SystemTime::GetCurrentTick();
+            cull();
+            best = std::min(best, SystemTime::TimeBetweenTicks(start, SystemTime::GetCurrentTick()) * 1000000.0);
+        }
+        return best;
+    }
+}
+
+void CullingBenchmark::Run(const Frustum& frustum, Vector3 minBound, Vector3 maxBound, uint32_t objectCount)
+{
+    RandomNumberGenerator rng;
+    rng.SetSeed(1);
+
+    // Objects are up to 1% of the scene in size
+    const Vector3 sceneSize = maxBound - minBound;
+    std::vector<AxisAlignedBox> boxes(objectCount);
+    std::vector<float> centerX(objectCount), centerY(objectCount), centerZ(objectCount);
+    std::vector<float> extentX(objectCount), extentY(objectCount), extentZ(objectCount);
+    for (uint32_t i = 0; i < objectCount; ++i)
+    {
+        Vector3 center = minBound + sceneSize * Vector3(rng.NextFloat(), rng.NextFloat(), rng.NextFloat());
+        Vector3 extent = sceneSize * Vector3(rng.NextFloat(), rng.NextFloat(), rng.NextFloat()) * 0.005f;
+        boxes[i] = AxisAlignedBox(center - extent, center + extent);
+        centerX[i] = center.GetX();
+        centerY[i] = center.GetY();
+        centerZ[i] = center.GetZ();
+        extentX[i] = extent.GetX();
+        extentY[i] = extent.GetY();
+        extentZ[i] = extent.GetZ();
+    }
+
+    std::vector<uint32_t> referenceMask((objectCount + 31) / 32);
+    const double loopTime = TimePasses([&]()
+    {
+        std::fill(referenceMask.begin(), referenceMask.end(), 0);
+        for (uint32_t i = 0; i < objectCount; ++i)
+        {
+            if (frustum.IntersectBoundingBox(boxes[i]))
+                referenceMask[i / 32] |= 1u << (i % 32);
+        }
+    });
+
+    uint32_t visibleCount = 0;
+    for (uint32_t word : referenceMask)
+        visibleCount += __popcnt(word);
+
+    Utility::Printf("Culling %u boxes, %u visible\n", objectCount, visibleCount);
+    Utility::Printf("  one at a time %10.1f us\n", loopTime);
+    EngineProfiling::SetCounter(L"Cull Benchmark Loop (us)", (uint32_t)loopTime);
+
+    static const char* s_LevelNames[] = { "scalar", "SSE", "AVX2" };
+    static const wchar_t* s_CounterNames[] = { L"Cull Benchmark Scalar (us)", L"Cull Benchmark SSE (us)", L"Cull Benchmark AVX2 (us)" };
+
+    std::vector<uint32_t> visibleMask(referenceMask.size());
+    for (int level = Frustum::kSimdScalar; level <= Frustum::GetSupportedSimdLevel(); ++level)
+    {
+        const double batchTime = TimePasses([&]()
+        {
+            frustum.IntersectBoundingBoxes(centerX.data(), centerY.data(), centerZ.data(),
+                extentX.data(), extentY.data(), extentZ.data(), objectCount, visibleMask.data(), (Frustum::SimdLevel)level);
+        });
+
+        // Boxes touching a plane can go either way with different rounding
+        uint32_t mismatches = 0;
+        for (size_t word = 0; word < visibleMask.size(); ++word)
+            mismatches += __popcnt(visibleMask[word] ^ referenceMask[word]);
+
+        Utility::Printf("  batched %-6s %10.1f us (%.1fx), %u mismatches\n",
+            s_LevelNames[level], batchTime, loopTime / batchTime, mismatches);
+        EngineProfiling::SetCounter(s_CounterNames[level], (uint32_t)batchTime);
+    }
+}
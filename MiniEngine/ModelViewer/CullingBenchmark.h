@@ -0,0 +1,22 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+#pragma once
+
+#include "Math/Frustum.h"
+
+namespace CullingBenchmark
+{
+    // Culls objectCount random boxes scattered through the given bounds against
+    // the frustum, one box at a time with Frustum::IntersectBoundingBox and in a
+    // batch at every SIMD level. The time per pass is printed and reported as
+    // EngineProfiling counters, and the batched results are checked against the
+    // one-at-a-time ones.
+    void Run(const Math::Frustum& frustum, Math::Vector3 minBound, Math::Vector3 maxBound, uint32_t objectCount);
+}
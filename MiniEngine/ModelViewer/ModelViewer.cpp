@@ -18,6 +18,10 @@
 #include "BufferManager.h"
 #include "Camera.h"
 #include "Model.h"
+#include "MeshCulling.h"
+#include "MeshSorter.h"
+#include "ParallelRecording.h"
+#include "CullingBenchmark.h"
 #include "GpuBuffer.h"
 #include "CommandContext.h"
 #include "SamplerManager.h"
@@ -57,7 +61,7 @@ class ModelViewer : public GameCore::IGameApp
 {
 public:
 
-    ModelViewer( void ) {}
+    ModelViewer( void ) : m_LightShadowIndex(0), m_DrawCount(0), m_PSOChanges(0), m_MaterialChanges(0), m_TexturesStreamed(false) {}
 
     virtual void Startup( void ) override;
     virtual void Cleanup( void ) override;
@@ -67,10 +71,21 @@ public:
 
 private:
 
-    void RenderLightShadows(GraphicsContext& gfxContext);
-
-    enum eObjectFilter { kOpaque = 0x1, kCutout = 0x2, kTransparent = 0x4, kAll = 0xF, kNone = 0x0 };
-    void RenderObjects( GraphicsContext& Context, const Matrix4& ViewProjMat, eObjectFilter Filter = kAll );
+    void RenderLightShadows(GraphicsContext& gfxContext, const std::function<void(GraphicsContext&)>& SetupGraphicsState);
+
+    // Every view the model is drawn into, each with its own list of visible meshes
+    enum eView { kMainView, kSunShadowView, kLightShadowView, kNumViews };
+    void CullViews( void );
+
+    // Draws the visible meshes of a view sorted into draw packets, opaque meshes with OpaquePSO first so
+    // they fill the depth buffer, then alpha tested ones with CutoutPSO.  Cutouts are skipped when
+    // CutoutPSO is null.  Large passes are split across the task scheduler's threads, each recording
+    // into a context that SetupState puts in the state Context has for the pass.  With TimePasses the
+    // opaque and cutout draws are recorded as separate batches under "Opaque" and "Cutout" timers.
+    enum eDrawPass { kOpaquePass, kCutoutPass, kNumDrawPasses };
+    void RenderObjects( GraphicsContext& Context, const Matrix4& ViewProjMat, eView View,
+        const GraphicsPSO& OpaquePSO, const GraphicsPSO* CutoutPSO, MeshSorter::SortOrder Order,
+        const std::function<void(GraphicsContext&)>& SetupState, bool TimePasses = false );
     void CreateParticleEffects();
     Camera m_Camera;
     std::auto_ptr<CameraController> m_CameraController;
@@ -99,6 +114,17 @@ private:
     Model m_Model;
     std::vector<bool> m_pMaterialIsCutout;
 
+    MeshCuller m_MeshCuller;
+    std::vector<uint32_t> m_VisibleMeshes[kNumViews];
+    uint32_t m_LightShadowIndex;
+
+    MeshSorter m_MeshSorter;
+    uint32_t m_DrawCount;
+    uint32_t m_PSOChanges;
+    uint32_t m_MaterialChanges;
+
+    bool m_TexturesStreamed;
+
     Vector3 m_SunDirection;
     ShadowCamera m_SunShadow;
 };
@@ -113,6 +139,12 @@ NumVar ShadowDimX("Application/Lighting/Shadow Dim X", 5000, 1000, 10000, 100 );
 NumVar ShadowDimY("Application/Lighting/Shadow Dim Y", 3000, 1000, 10000, 100 );
 NumVar ShadowDimZ("Application/Lighting/Shadow Dim Z", 3000, 1000, 10000, 100 );
 
+BoolVar EnableCulling("Application/Culling/Enable", true);
+BoolVar RunCullingBenchmark("Application/Culling/Run Benchmark", false);
+
+BoolVar ParallelRecording("Application/Threading/Parallel Recording", true);
+IntVar MinDrawsPerList("Application/Threading/Min Draws Per List", 128, 16, 4096, 16);
+
 BoolVar ShowWaveTileCounts("Application/Forward+/Show Wave Tile Counts", false);
 #ifdef _WAVE_OP
 BoolVar EnableWaveOps("Application/Forward+/Enable Wave Ops", true);
@@ -212,6 +244,8 @@ void ModelViewer::Startup( void )
     ASSERT(m_Model.Load("Models/sponza.h3d"), "Failed to load model");
     ASSERT(m_Model.m_Header.meshCount > 0, "Model contains no meshes");
 
+    m_MeshCuller.Init(m_Model);
+
     // The caller of this function can override which materials are considered cutouts
     m_pMaterialIsCutout.resize(m_Model.m_Header.materialCount);
     for (uint32_t i = 0; i < m_Model.m_Header.materialCount; ++i)
@@ -237,6 +271,9 @@ void ModelViewer::Startup( void )
     m_Camera.SetZRange( 1.0f, 10000.0f );
     m_CameraController.reset(new CameraController(m_Camera, Vector3(kYUnitVector)));
 
+    // The model's textures stream in from here on, nearest and largest first
+    m_Model.UpdateTexturePriorities(m_Camera.GetPosition());
+
     MotionBlur::Enable = true;
     TemporalEffects::EnableTAA = true;
     FXAA::Enable = false;
@@ -275,6 +312,25 @@ void ModelViewer::Update( float deltaT )
     m_CameraController->Update(deltaT);
     m_ViewProjMatrix = m_Camera.GetViewProjMatrix();
 
+    if (TextureManager::IsStreaming())
+    {
+        m_Model.UpdateTexturePriorities(m_Camera.GetPosition());
+    }
+    else if (!m_TexturesStreamed)
+    {
+        m_TexturesStreamed = true;
+        TextureManager::StreamingStats Stats = TextureManager::GetStreamingStats();
+        Utility::Printf("Streamed %u textures, %.1f MB, in %.2f s (%.1f MB/s), first frame after %.2f s\n",
+            Stats.CompletedLoads, Stats.ResidentBytes / (1024.0 * 1024.0), Stats.TimeToLastLoad,
+            Stats.BytesPerSecond / (1024.0 * 1024.0), Stats.TimeToFirstFrame);
+    }
+
+    if (RunCullingBenchmark)
+    {
+        RunCullingBenchmark = false;
+        CullingBenchmark::Run(m_Camera.GetWorldSpaceFrustum(), m_Model.GetBoundingBox().min, m_Model.GetBoundingBox().max, 64 * 1024);
+    }
+
     float costheta = cosf(m_SunOrientation);
     float sintheta = sinf(m_SunOrientation);
     float cosphi = cosf(m_SunInclination * 3.14159f * 0.5f);
@@ -302,7 +358,44 @@ void ModelViewer::Update( float deltaT )
     m_MainScissor.bottom = (LONG)g_SceneColorBuffer.GetHeight();
 }
 
-void ModelViewer::RenderObjects( GraphicsContext& gfxContext, const Matrix4& ViewProjMat, eObjectFilter Filter )
+void ModelViewer::CullViews( void )
+{
+    ScopedTimer _prof(L"Culling");
+
+    Matrix4 ViewProjMats[kNumViews];
+    ViewProjMats[kMainView] = m_ViewProjMatrix;
+    ViewProjMats[kSunShadowView] = m_SunShadow.GetViewProjMatrix();
+    ViewProjMats[kLightShadowView] = Lighting::m_LightShadowMatrix[m_LightShadowIndex < Lighting::MaxLights ? m_LightShadowIndex : 0];
+
+    if (!EnableCulling)
+    {
+        for (uint32_t view = 0; view < kNumViews; ++view)
+        {
+            m_VisibleMeshes[view].resize(m_Model.m_Header.meshCount);
+            for (uint32_t meshIndex = 0; meshIndex < m_Model.m_Header.meshCount; ++meshIndex)
+                m_VisibleMeshes[view][meshIndex] = meshIndex;
+        }
+    }
+    else
+    {
+        TaskScheduler::ParallelFor(0u, (uint32_t)kNumViews, [&](uint32_t view)
+        {
+            m_MeshCuller.Cull(Frustum::FromViewProjection(ViewProjMats[view]), m_VisibleMeshes[view]);
+        });
+    }
+
+    static const wchar_t* s_ViewNames[kNumViews] = { L"Main View", L"Sun Shadow", L"Light Shadow" };
+    for (uint32_t view = 0; view < kNumViews; ++view)
+    {
+        const uint32_t visibleCount = (uint32_t)m_VisibleMeshes[view].size();
+        EngineProfiling::SetCounter(std::wstring(s_ViewNames[view]) + L" Visible", visibleCount);
+        EngineProfiling::SetCounter(std::wstring(s_ViewNames[view]) + L" Culled", m_Model.m_Header.meshCount - visibleCount);
+    }
+}
+
+void ModelViewer::RenderObjects( GraphicsContext& gfxContext, const Matrix4& ViewProjMat, eView View,
+    const GraphicsPSO& OpaquePSO, const GraphicsPSO* CutoutPSO, MeshSorter::SortOrder Order,
+    const std::function<void(GraphicsContext&)>& SetupState, bool TimePasses )
 {
     struct VSConstants
     {
@@ -314,63 +407,140 @@ void ModelViewer::RenderObjects( GraphicsContext& gfxContext, const Matrix4& Vie
     vsConstants.modelToShadow = m_SunShadow.GetShadowMatrix();
     XMStoreFloat3(&vsConstants.viewerPos, m_Camera.GetPosition());
 
-    gfxContext.SetDynamicConstantBufferView(0, sizeof(vsConstants), &vsConstants);
+    // Each pass has a single PSO, so the PSO field of the key is the pass
+    const GraphicsPSO* PSOs[kNumDrawPasses] = { &OpaquePSO, CutoutPSO };
 
-    uint32_t materialIdx = 0xFFFFFFFFul;
+    const Vector3 viewerPos = m_Camera.GetPosition();
+    m_MeshSorter.Reset(Order);
+    for (uint32_t meshIndex : m_VisibleMeshes[View])
+    {
+        const Model::Mesh& mesh = m_Model.m_pMesh[meshIndex];
+        const uint32_t pass = m_pMaterialIsCutout[mesh.materialIndex] ? kCutoutPass : kOpaquePass;
+        if (PSOs[pass] == nullptr)
+            continue;
 
-    uint32_t VertexStride = m_Model.m_VertexStride;
+        const float distance = Length((mesh.boundingBox.min + mesh.boundingBox.max) * 0.5f - viewerPos);
+        m_MeshSorter.AddMesh(pass, pass, mesh.materialIndex, distance, meshIndex);
+    }
+    m_MeshSorter.Sort();
 
-    for (uint32_t meshIndex = 0; meshIndex < m_Model.m_Header.meshCount; meshIndex++)
+    // Counted per list, the lists are recorded at the same time
+    struct ListStats
     {
-        const Model::Mesh& mesh = m_Model.m_pMesh[meshIndex];
+        uint32_t DrawCount;
+        uint32_t PSOChanges;
+        uint32_t MaterialChanges;
+    };
+    std::vector<ListStats> Stats(TaskScheduler::GetThreadCount(), ListStats());
 
-        uint32_t indexCount = mesh.indexCount;
-        uint32_t startIndex = mesh.indexDataByteOffset / sizeof(uint16_t);
-        uint32_t baseVertex = mesh.vertexDataByteOffset / VertexStride;
+    const uint32_t VertexStride = m_Model.m_VertexStride;
 
-        if (mesh.materialIndex != materialIdx)
+    // Records packets [BatchStart, BatchEnd), split across threads when the batch is large enough
+    TaskScheduler::GraphicsRecordingTarget Target(gfxContext, SetupState);
+    auto RecordBatch = [&](uint32_t BatchStart, uint32_t BatchEnd)
+    {
+        const uint32_t MinDraws = ParallelRecording ? (uint32_t)MinDrawsPerList : BatchEnd - BatchStart;
+        TaskScheduler::ParallelRecord(Target, BatchEnd - BatchStart, MinDraws,
+            [&](GraphicsContext& Context, uint32_t ListIndex, uint32_t FirstPacket, uint32_t EndPacket)
         {
-            if ( m_pMaterialIsCutout[mesh.materialIndex] && !(Filter & kCutout) ||
-                !m_pMaterialIsCutout[mesh.materialIndex] && !(Filter & kOpaque) )
-                continue;
+            ListStats& ListStat = Stats[ListIndex];
+
+            Context.SetDynamicConstantBufferView(0, sizeof(vsConstants), &vsConstants);
+
+            // Each list starts out without a PSO or material of its own
+            uint32_t psoIdx = 0xFFFFFFFFul;
+            uint32_t materialIdx = 0xFFFFFFFFul;
 
-            materialIdx = mesh.materialIndex;
-            gfxContext.SetDynamicDescriptors(2, 0, 6, m_Model.GetSRVs(materialIdx) );
+            for (uint32_t packetIndex = BatchStart + FirstPacket; packetIndex < BatchStart + EndPacket; ++packetIndex)
+            {
+                const MeshSorter::DrawPacket packet = m_MeshSorter.GetPacket(packetIndex);
+                const Model::Mesh& mesh = m_Model.m_pMesh[packet.meshIndex];
+
+                uint32_t indexCount = mesh.indexCount;
+                uint32_t startIndex = mesh.indexDataByteOffset / m_Model.m_IndexSize;
+                uint32_t baseVertex = mesh.vertexDataByteOffset / VertexStride;
+
+                if (packet.pso != psoIdx)
+                {
+                    psoIdx = packet.pso;
+                    Context.SetPipelineState(*PSOs[psoIdx]);
+                    ++ListStat.PSOChanges;
+                }
+
+                if (packet.material != materialIdx)
+                {
+                    materialIdx = packet.material;
+                    Context.SetDynamicDescriptors(2, 0, 6, m_Model.GetSRVs(materialIdx) );
+                    ++ListStat.MaterialChanges;
+                }
+
+                Context.SetConstants(4, baseVertex, materialIdx);
+
+                Context.DrawIndexed(indexCount, startIndex, baseVertex);
+                ++ListStat.DrawCount;
+            }
+        });
+    };
+
+    const uint32_t PacketCount = m_MeshSorter.GetCount();
+    if (TimePasses)
+    {
+        // The pass is the top of the sort key, so the opaque packets all come first
+        uint32_t FirstCutout = 0;
+        while (FirstCutout < PacketCount && m_MeshSorter.GetPacket(FirstCutout).pass == kOpaquePass)
+            ++FirstCutout;
+
+        {
+            ScopedTimer _prof1(L"Opaque", gfxContext);
+            RecordBatch(0, FirstCutout);
         }
 
-        gfxContext.SetConstants(4, baseVertex, materialIdx);
+        {
+            ScopedTimer _prof2(L"Cutout", gfxContext);
+            RecordBatch(FirstCutout, PacketCount);
+        }
+    }
+    else
+    {
+        RecordBatch(0, PacketCount);
+    }
 
-        gfxContext.DrawIndexed(indexCount, startIndex, baseVertex);
+    for (const ListStats& ListStat : Stats)
+    {
+        m_DrawCount += ListStat.DrawCount;
+        m_PSOChanges += ListStat.PSOChanges;
+        m_MaterialChanges += ListStat.MaterialChanges;
     }
 }
 
-void ModelViewer::RenderLightShadows(GraphicsContext& gfxContext)
+void ModelViewer::RenderLightShadows(GraphicsContext& gfxContext, const std::function<void(GraphicsContext&)>& SetupGraphicsState)
 {
     using namespace Lighting;
 
     ScopedTimer _prof(L"RenderLightShadows", gfxContext);
 
-    static uint32_t LightIndex = 0;
-    if (LightIndex >= MaxLights)
+    if (m_LightShadowIndex >= MaxLights)
         return;
 
     m_LightShadowTempBuffer.BeginRendering(gfxContext);
     {
-        gfxContext.SetPipelineState(m_ShadowPSO);
-        RenderObjects(gfxContext, m_LightShadowMatrix[LightIndex], kOpaque);
-        gfxContext.SetPipelineState(m_CutoutShadowPSO);
-        RenderObjects(gfxContext, m_LightShadowMatrix[LightIndex], kCutout);
+        RenderObjects(gfxContext, m_LightShadowMatrix[m_LightShadowIndex], kLightShadowView,
+            m_ShadowPSO, &m_CutoutShadowPSO, MeshSorter::kSortByState, [&](GraphicsContext& Context)
+        {
+            SetupGraphicsState(Context);
+            m_LightShadowTempBuffer.SetAsTarget(Context);
+        });
     }
     m_LightShadowTempBuffer.EndRendering(gfxContext);
 
     gfxContext.TransitionResource(m_LightShadowTempBuffer, D3D12_RESOURCE_STATE_GENERIC_READ);
     gfxContext.TransitionResource(m_LightShadowArray, D3D12_RESOURCE_STATE_COPY_DEST);
 
-    gfxContext.CopySubresource(m_LightShadowArray, LightIndex, m_LightShadowTempBuffer, 0);
+    gfxContext.CopySubresource(m_LightShadowArray, m_LightShadowIndex, m_LightShadowTempBuffer, 0);
 
     gfxContext.TransitionResource(m_LightShadowArray, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
 
-    ++LightIndex;
+    ++m_LightShadowIndex;
 }
 
 void ModelViewer::RenderScene( void )
@@ -391,6 +561,16 @@ void ModelViewer::RenderScene( void )
         s_ShowLightCounts = ShowWaveTileCounts;
     }
 
+    // The sun shadow is needed up front to cull every view at once
+    m_SunShadow.UpdateMatrix(-m_SunDirection, Vector3(0, -500.0f, 0), Vector3(ShadowDimX, ShadowDimY, ShadowDimZ),
+        (uint32_t)g_ShadowBuffer.GetWidth(), (uint32_t)g_ShadowBuffer.GetHeight(), 16);
+
+    CullViews();
+
+    m_DrawCount = 0;
+    m_PSOChanges = 0;
+    m_MaterialChanges = 0;
+
     GraphicsContext& gfxContext = GraphicsContext::Begin(L"Scene Render");
 
     ParticleEffects::Update(gfxContext.GetComputeContext(), Graphics::GetFrameTime());
@@ -423,43 +603,40 @@ void ModelViewer::RenderScene( void )
     psConstants.FrameIndexMod2 = FrameIndex;
 
     // Set the default state for command lists
-    auto pfnSetupGraphicsState = [&](void)
+    std::function<void(GraphicsContext&)> pfnSetupGraphicsState = [&](GraphicsContext& Context)
     {
-        gfxContext.SetRootSignature(m_RootSig);
-        gfxContext.SetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-        gfxContext.SetIndexBuffer(m_Model.m_IndexBuffer.IndexBufferView());
-        gfxContext.SetVertexBuffer(0, m_Model.m_VertexBuffer.VertexBufferView());
+        Context.SetRootSignature(m_RootSig);
+        Context.SetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+        Context.SetIndexBuffer(m_Model.m_IndexBuffer.IndexBufferView());
+        Context.SetVertexBuffer(0, m_Model.m_VertexBuffer.VertexBufferView());
     };
 
-    pfnSetupGraphicsState();
+    pfnSetupGraphicsState(gfxContext);
 
-    RenderLightShadows(gfxContext);
+    RenderLightShadows(gfxContext, pfnSetupGraphicsState);
 
     {
         ScopedTimer _prof(L"Z PrePass", gfxContext);
 
-        gfxContext.SetDynamicConstantBufferView(1, sizeof(psConstants), &psConstants);
-
+        auto pfnSetupDepthState = [&](GraphicsContext& Context)
         {
-            ScopedTimer _prof1(L"Opaque", gfxContext);
-            gfxContext.TransitionResource(g_SceneDepthBuffer, D3D12_RESOURCE_STATE_DEPTH_WRITE, true);
-            gfxContext.ClearDepth(g_SceneDepthBuffer);
+            pfnSetupGraphicsState(Context);
+            Context.SetDynamicConstantBufferView(1, sizeof(psConstants), &psConstants);
+            Context.SetDepthStencilTarget(g_SceneDepthBuffer.GetDSV());
+            Context.SetViewportAndScissor(m_MainViewport, m_MainScissor);
+        };
+
+        gfxContext.TransitionResource(g_SceneDepthBuffer, D3D12_RESOURCE_STATE_DEPTH_WRITE, true);
+        gfxContext.ClearDepth(g_SceneDepthBuffer);
+        pfnSetupDepthState(gfxContext);
 
+        // Front to back, so the prepass itself gets the most out of early Z
 #ifdef _WAVE_OP
-            gfxContext.SetPipelineState(EnableWaveOps ? m_DepthWaveOpsPSO : m_DepthPSO );
+        RenderObjects(gfxContext, m_ViewProjMatrix, kMainView,
+            EnableWaveOps ? m_DepthWaveOpsPSO : m_DepthPSO, &m_CutoutDepthPSO, MeshSorter::kSortFrontToBack, pfnSetupDepthState, true);
 #else
-            gfxContext.SetPipelineState(m_DepthPSO);
+        RenderObjects(gfxContext, m_ViewProjMatrix, kMainView, m_DepthPSO, &m_CutoutDepthPSO, MeshSorter::kSortFrontToBack, pfnSetupDepthState, true);
 #endif
-            gfxContext.SetDepthStencilTarget(g_SceneDepthBuffer.GetDSV());
-            gfxContext.SetViewportAndScissor(m_MainViewport, m_MainScissor);
-            RenderObjects(gfxContext, m_ViewProjMatrix, kOpaque );
-        }
-
-        {
-            ScopedTimer _prof2(L"Cutout", gfxContext);
-            gfxContext.SetPipelineState(m_CutoutDepthPSO);
-            RenderObjects(gfxContext, m_ViewProjMatrix, kCutout );
-        }
     }
 
     SSAO::Render(gfxContext, m_Camera);
@@ -473,26 +650,26 @@ void ModelViewer::RenderScene( void )
         gfxContext.TransitionResource(g_SceneColorBuffer, D3D12_RESOURCE_STATE_RENDER_TARGET, true);
         gfxContext.ClearColor(g_SceneColorBuffer);
 
-        pfnSetupGraphicsState();
+        pfnSetupGraphicsState(gfxContext);
 
         {
             ScopedTimer _prof3(L"Render Shadow Map", gfxContext);
 
-            m_SunShadow.UpdateMatrix(-m_SunDirection, Vector3(0, -500.0f, 0), Vector3(ShadowDimX, ShadowDimY, ShadowDimZ),
-                (uint32_t)g_ShadowBuffer.GetWidth(), (uint32_t)g_ShadowBuffer.GetHeight(), 16);
-
             g_ShadowBuffer.BeginRendering(gfxContext);
-            gfxContext.SetPipelineState(m_ShadowPSO);
-            RenderObjects(gfxContext, m_SunShadow.GetViewProjMatrix(), kOpaque);
-            gfxContext.SetPipelineState(m_CutoutShadowPSO);
-            RenderObjects(gfxContext, m_SunShadow.GetViewProjMatrix(), kCutout);
+            RenderObjects(gfxContext, m_SunShadow.GetViewProjMatrix(), kSunShadowView,
+                m_ShadowPSO, &m_CutoutShadowPSO, MeshSorter::kSortByState, [&](GraphicsContext& Context)
+            {
+                pfnSetupGraphicsState(Context);
+                Context.SetDynamicConstantBufferView(1, sizeof(psConstants), &psConstants);
+                g_ShadowBuffer.SetAsTarget(Context);
+            });
             g_ShadowBuffer.EndRendering(gfxContext);
         }
 
         if (SSAO::AsyncCompute)
         {
             gfxContext.Flush();
-            pfnSetupGraphicsState();
+            pfnSetupGraphicsState(gfxContext);
 
             // Make the 3D queue wait for the Compute queue to finish SSAO
             g_CommandManager.GetGraphicsQueue().StallForProducer(g_CommandManager.GetComputeQueue());
@@ -501,26 +678,26 @@ void ModelViewer::RenderScene( void )
         {
             ScopedTimer _prof4(L"Render Color", gfxContext);
 
+            auto pfnSetupColorState = [&](GraphicsContext& Context)
+            {
+                pfnSetupGraphicsState(Context);
+                Context.SetDynamicDescriptors(3, 0, _countof(m_ExtraTextures), m_ExtraTextures);
+                Context.SetDynamicConstantBufferView(1, sizeof(psConstants), &psConstants);
+                Context.SetRenderTarget(g_SceneColorBuffer.GetRTV(), g_SceneDepthBuffer.GetDSV_DepthReadOnly());
+                Context.SetViewportAndScissor(m_MainViewport, m_MainScissor);
+            };
+
             gfxContext.TransitionResource(g_SSAOFullScreen, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+            gfxContext.TransitionResource(g_SceneDepthBuffer, D3D12_RESOURCE_STATE_DEPTH_READ);
+            pfnSetupColorState(gfxContext);
 
-            gfxContext.SetDynamicDescriptors(3, 0, _countof(m_ExtraTextures), m_ExtraTextures);
-            gfxContext.SetDynamicConstantBufferView(1, sizeof(psConstants), &psConstants);
 #ifdef _WAVE_OP
-            gfxContext.SetPipelineState(EnableWaveOps ? m_ModelWaveOpsPSO : m_ModelPSO );
+            const GraphicsPSO& ColorPSO = EnableWaveOps ? m_ModelWaveOpsPSO : m_ModelPSO;
 #else
-            gfxContext.SetPipelineState(ShowWaveTileCounts ? m_WaveTileCountPSO : m_ModelPSO);
+            const GraphicsPSO& ColorPSO = ShowWaveTileCounts ? m_WaveTileCountPSO : m_ModelPSO;
 #endif
-            gfxContext.TransitionResource(g_SceneDepthBuffer, D3D12_RESOURCE_STATE_DEPTH_READ);
-            gfxContext.SetRenderTarget(g_SceneColorBuffer.GetRTV(), g_SceneDepthBuffer.GetDSV_DepthReadOnly());
-            gfxContext.SetViewportAndScissor(m_MainViewport, m_MainScissor);
-
-            RenderObjects( gfxContext, m_ViewProjMatrix, kOpaque );
-
-            if (!ShowWaveTileCounts)
-            {
-                gfxContext.SetPipelineState(m_CutoutModelPSO);
-                RenderObjects( gfxContext, m_ViewProjMatrix, kCutout );
-            }
+            RenderObjects( gfxContext, m_ViewProjMatrix, kMainView,
+                ColorPSO, ShowWaveTileCounts ? nullptr : &m_CutoutModelPSO, MeshSorter::kSortByState, pfnSetupColorState );
         }
 
     }
@@ -541,6 +718,10 @@ void ModelViewer::RenderScene( void )
         MotionBlur::RenderObjectBlur(gfxContext, g_VelocityBuffer);
 
     gfxContext.Finish();
+
+    EngineProfiling::SetCounter(L"Draw Calls", m_DrawCount);
+    EngineProfiling::SetCounter(L"PSO Changes", m_PSOChanges);
+    EngineProfiling::SetCounter(L"Material Changes", m_MaterialChanges);
 }
 
 void ModelViewer::CreateParticleEffects()
@@ -0,0 +1,240 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Runs Core's task scheduler without a device or window, on any platform with a C++14
+// compiler.  Every check is run with a few worker counts and the program returns
+// non-zero if any of them fails.
+//
+
+#include "TaskScheduler.h"
+#include "MockRecordingTarget.h"
+#include "LoaderThreadPool.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+static int s_FailedChecks = 0;
+
+#define CHECK( Condition, Message ) \
+    do { if (!(Condition)) { std::printf("FAILED: %s (%s:%d)\n", Message, __FILE__, __LINE__); ++s_FailedChecks; } } while (0)
+
+// Every index is visited exactly once, whatever the grain size
+static void CheckParallelFor( void )
+{
+    const uint32_t Count = 10000;
+    const uint32_t GrainSizes[] = { 1, 7, 64, Count, 2 * Count };
+    for (uint32_t GrainSize : GrainSizes)
+    {
+        std::vector<std::atomic<uint32_t>> Visits(Count);
+        for (auto& Visit : Visits)
+            Visit = 0;
+
+        TaskScheduler::ParallelFor(0, Count, GrainSize, [&]( uint32_t First, uint32_t Last )
+        {
+            for (uint32_t i = First; i < Last; ++i)
+                ++Visits[i];
+        });
+
+        bool AllOnce = true;
+        for (auto& Visit : Visits)
+            AllOnce &= Visit == 1;
+        CHECK(AllOnce, "ParallelFor didn't visit every index exactly once");
+    }
+
+    uint32_t EmptyCalls = 0;
+    TaskScheduler::ParallelFor(5, 5, [&]( uint32_t ) { ++EmptyCalls; });
+    CHECK(EmptyCalls == 0, "ParallelFor called the body for an empty range");
+}
+
+// A job queued with RunAfter only starts once every job of its dependency has finished
+static void CheckDependencies( void )
+{
+    const uint32_t FirstCount = 64;
+    std::atomic<uint32_t> FirstDone(0);
+    std::atomic<uint32_t> SeenByDependents(0);
+    std::atomic<bool> RanEarly(false);
+
+    TaskScheduler::TaskGroup First;
+    TaskScheduler::TaskGroup Second;
+    for (uint32_t i = 0; i < FirstCount; ++i)
+        First.Run([&] { ++FirstDone; });
+    for (uint32_t i = 0; i < 8; ++i)
+    {
+        Second.RunAfter(First, [&]
+        {
+            if (FirstDone != FirstCount)
+                RanEarly = true;
+            ++SeenByDependents;
+        });
+    }
+    Second.Wait();
+
+    CHECK(First.IsDone() && Second.IsDone(), "TaskGroup::Wait returned with jobs left");
+    CHECK(!RanEarly, "A job started before the group it depends on was done");
+    CHECK(SeenByDependents == 8, "A dependent job didn't run");
+
+    // A group that is already done doesn't hold back its dependents
+    TaskScheduler::TaskGroup Third;
+    bool ThirdRan = false;
+    Third.RunAfter(First, [&] { ThirdRan = true; });
+    Third.Wait();
+    CHECK(ThirdRan, "A job depending on a finished group didn't run");
+}
+
+// Jobs that wait on jobs of their own, so a waiting thread has to keep running jobs
+static uint64_t SumRecursive( uint32_t Begin, uint32_t End )
+{
+    if (End - Begin <= 16)
+    {
+        uint64_t Sum = 0;
+        for (uint32_t i = Begin; i < End; ++i)
+            Sum += i;
+        return Sum;
+    }
+
+    const uint32_t Middle = Begin + (End - Begin) / 2;
+    uint64_t Left = 0;
+    TaskScheduler::TaskGroup Group;
+    Group.Run([&] { Left = SumRecursive(Begin, Middle); });
+    const uint64_t Right = SumRecursive(Middle, End);
+    Group.Wait();
+    return Left + Right;
+}
+
+static void CheckNestedWaits( void )
+{
+    const uint32_t Count = 100000;
+    CHECK(SumRecursive(0, Count) == (uint64_t)Count * (Count - 1) / 2, "Nested jobs produced the wrong sum");
+}
+
+// Jobs no one waits on still run before Shutdown returns
+static void CheckDetachedJobs( uint32_t NumWorkers )
+{
+    std::atomic<uint32_t> Ran(0);
+    TaskScheduler::Initialize(NumWorkers);
+    for (uint32_t i = 0; i < 256; ++i)
+        TaskScheduler::Run([&] { ++Ran; });
+    TaskScheduler::Shutdown();
+    CHECK(Ran == 256, "Shutdown returned before every queued job ran");
+}
+
+// Stopping while loads are streaming waits for the ones that began and drops the rest, so
+// nothing touches the device once teardown starts.  The pool then starts again.
+static void CheckLoaderShutdown( void )
+{
+    const uint32_t JobCount = 8;
+    std::atomic<uint32_t> Began(0), Finished(0), Running(0);
+    auto Load = [&]
+    {
+        ++Began;
+        ++Running;
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        --Running;
+        ++Finished;
+    };
+
+    TaskScheduler::LoaderThreadPool Loaders;
+    for (uint32_t i = 0; i < JobCount; ++i)
+        Loaders.Start(Load, 2);
+    CHECK(Loaders.GetThreadCount() <= 2, "More loader threads were created than allowed");
+
+    while (Began == 0)
+        std::this_thread::yield();
+    Loaders.Stop();
+
+    CHECK(Running == 0, "A load was still running after Stop returned");
+    CHECK(Began == Finished, "A load that began didn't finish before Stop returned");
+    CHECK(Began < JobCount, "Loads that hadn't begun weren't dropped");
+    CHECK(Loaders.GetThreadCount() == 0, "Stop didn't join the loader threads");
+
+    const uint32_t BeganAtStop = Began;
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    CHECK(Began == BeganAtStop, "A load began after Stop returned");
+
+    Loaders.Start(Load, 2);
+    while (Finished == BeganAtStop)
+        std::this_thread::yield();
+    Loaders.Stop();
+    CHECK(Began == BeganAtStop + 1 && Finished == Began, "The pool didn't run a load after it was restarted");
+}
+
+// A pass split across threads reaches the queue in draw order, after what the parent
+// recorded before it and ahead of what the parent records after it
+static void CheckParallelRecord( void )
+{
+    const uint32_t kBeforePass = 1000000;
+    const uint32_t kAfterPass = 2000000;
+    const uint32_t DrawCounts[] = { 1, 100, 5000 };
+    for (uint32_t DrawCount : DrawCounts)
+    {
+        TaskScheduler::MockRecordingTarget Target;
+        Target.GetParent().Record(kBeforePass);
+        Target.BeginPass();
+
+        const uint32_t ChunkCount = TaskScheduler::ParallelRecord(Target, DrawCount, 64,
+            []( TaskScheduler::MockCommandList& List, uint32_t, uint32_t First, uint32_t End )
+            {
+                for (uint32_t Draw = First; Draw < End; ++Draw)
+                    List.Record(Draw);
+            });
+
+        Target.GetParent().Record(kAfterPass);
+        Target.FlushParent();
+
+        const uint32_t ExpectedChunks = (DrawCount + 63) / 64 < TaskScheduler::GetThreadCount() ?
+            (DrawCount + 63) / 64 : TaskScheduler::GetThreadCount();
+        CHECK(ChunkCount == ExpectedChunks, "ParallelRecord split the pass into an unexpected number of chunks");
+        CHECK(Target.WasInOrder(), "ParallelRecord began or submitted chunks out of order");
+
+        std::vector<uint32_t> Expected;
+        Expected.push_back(kBeforePass);
+        for (uint32_t Draw = 0; Draw < DrawCount; ++Draw)
+            Expected.push_back(Draw);
+        Expected.push_back(kAfterPass);
+        CHECK(Target.GetSubmitted() == Expected, "Draws didn't reach the queue in order, between the parent's commands");
+
+        // Chunk 0 is recorded by the calling thread
+        if (ChunkCount > 1)
+        {
+            CHECK(Target.GetChunks()[0].RecordingThread == std::this_thread::get_id(), "The first chunk wasn't recorded on the calling thread");
+        }
+    }
+}
+
+int main( int, char** )
+{
+    const uint32_t WorkerCounts[] = { 0, 1, 3 };
+    for (uint32_t NumWorkers : WorkerCounts)
+    {
+        // 0 asks for one worker per hardware thread less this one, which is none on a single core
+        TaskScheduler::Initialize(NumWorkers);
+        std::printf("%u threads\n", TaskScheduler::GetThreadCount());
+
+        CheckParallelFor();
+        CheckDependencies();
+        CheckNestedWaits();
+        CheckParallelRecord();
+
+        uint64_t JobCount = 0;
+        for (uint32_t i = 0; i < TaskScheduler::GetThreadCount(); ++i)
+            JobCount += TaskScheduler::GetThreadStats(i).JobCount;
+        CHECK(TaskScheduler::GetThreadCount() == 1 || JobCount > 0, "No jobs were counted");
+
+        TaskScheduler::Shutdown();
+
+        CheckDetachedJobs(NumWorkers);
+    }
+
+    CheckLoaderShutdown();
+
+    std::printf(s_FailedChecks == 0 ? "all checks passed\n" : "%d checks failed\n", s_FailedChecks);
+    return s_FailedChecks == 0 ? 0 : 1;
+}
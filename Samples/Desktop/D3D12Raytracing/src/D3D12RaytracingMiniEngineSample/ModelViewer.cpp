@@ -419,6 +419,8 @@ void InitializeSceneInfo(
         sizeof(meshInfoData[0]),
         meshInfoData.data());
 
+    // the hit shaders fetch 16-bit indices
+    ASSERT(model.m_IndexSize == sizeof(uint16_t));
     g_SceneIndices = model.m_IndexBuffer.GetSRV();
     g_SceneMeshInfo = g_hitShaderMeshInfoBuffer.GetSRV();
 }
@@ -841,6 +843,10 @@ void D3D12RaytracingMiniEngineSample::Startup( void )
 
 #define ASSET_DIRECTORY "../../../../../MiniEngine/ModelViewer/"
     TextureManager::Initialize(ASSET_DIRECTORY L"Textures/");
+
+    // InitializeViews copies the material descriptors into the raytracing heap once, so the
+    // textures have to be loaded by then rather than streamed in over the first frames
+    TextureManager::AsyncLoading = false;
     bool bModelLoadSuccess = m_Model.Load(ASSET_DIRECTORY "Models/sponza.h3d");
     ASSERT(bModelLoadSuccess, "Failed to load model");
     ASSERT(m_Model.m_Header.meshCount > 0, "Model contains no meshes");